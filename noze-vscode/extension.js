@@ -0,0 +1,23 @@
+// @ts-check
+
+/// <reference types="node" />
+
+/** @type {any} */
+const vscode = require('vscode')
+/** @type {any} */
+const { LanguageClient } = require('vscode-languageclient')
+
+/** @type {any} */
+let client
+
+/** @param {any} context */
+exports.activate = context => {
+	// 'oohoo lsp' speaks the language server protocol over stdin and stdout.
+	const command = vscode.workspace.getConfiguration('noze').get('serverPath')
+	const server = { command, args: ['lsp'] }
+	client = new LanguageClient('noze', 'noze', server, { documentSelector: [{ scheme: 'file', language: 'noze' }] })
+	context.subscriptions.push(client.start())
+}
+
+exports.deactivate = () =>
+	client === undefined ? undefined : client.stop()
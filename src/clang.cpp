@@ -1,7 +1,20 @@
 #include "./clang.h"
 
-#include <cstdlib> // std::system
+#include <chrono> // std::chrono
+#include <climits> // PATH_MAX
+#include <cstdio> // std::fopen, std::remove
+#include <cstdlib> // mkdtemp, realpath, std::system
+#include <cstring> // strlen
+#include <sys/wait.h> // WEXITSTATUS, WIFEXITED, WTERMSIG
+#include <unistd.h> // rmdir, symlink
+#include "./emit/emit.h" // EMITTED_PROLOGUE
+#include "./util/store/ArenaArrayBuilders.h"
+#include "./util/store/ArenaString.h"
+#include "./util/store/collection_util.h" // every
+#include "./util/store/ListBuilder.h"
 #include "./util/io.h" // delete_file, file_exists
+#include "./util/parallel.h"
+#include "./util/PathCache.h"
 #include "./util/rlimit.h"
 
 namespace {
@@ -34,21 +47,234 @@ namespace {
 	int exec_command(const char* command) {
 		return std::system(command);
 	}
+
+	using Clock = std::chrono::steady_clock;
+
+	double ms_since(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Scratch files are named by index, so programs that are all named 'main.cpp' don't collide.
+	ArenaString scratch_file(const StringSlice& dir, uint index, const StringSlice& extension, Arena& arena) {
+		StringBuilder b { arena, dir.size() + 32 };
+		b << dir << '/' << index << extension << '\0';
+		return b.finish();
+	}
+
+	void write_prologue(const char* path) {
+		std::FILE* file = std::fopen(path, "w");
+		if (file == nullptr) todo();
+		std::fwrite(EMITTED_PROLOGUE.begin(), 1, EMITTED_PROLOGUE.size(), file);
+		std::fclose(file);
+	}
+
+	// Writes EMITTED_PROLOGUE to 'dir/prologue.h' and returns the command to precompile it to 'dir/prologue.h.pch'.
+	StringSlice prepare_prologue(const StringSlice& dir, Arena& arena) {
+		MaxSizeString<PATH_MAX> prologue = MaxSizeString<PATH_MAX>::make([&](MaxSizeStringWriter& w) { w << dir << "/prologue.h" << '\0'; });
+		write_prologue(prologue.slice().begin());
+		StringBuilder precompile { arena, 2 * PATH_MAX };
+		precompile << "cd " << dir << " && " << CLANG << "-x c++-header prologue.h -o prologue.h.pch" << '\0';
+		return precompile.finish();
+	}
+
+	void remove_prologue(const StringSlice& dir) {
+		MaxSizeString<PATH_MAX> prologue = MaxSizeString<PATH_MAX>::make([&](MaxSizeStringWriter& w) { w << dir << "/prologue.h" << '\0'; });
+		std::remove(prologue.slice().begin());
+		MaxSizeString<PATH_MAX> pch = MaxSizeString<PATH_MAX>::make([&](MaxSizeStringWriter& w) { w << dir << "/prologue.h.pch" << '\0'; });
+		std::remove(pch.slice().begin());
+	}
+
+	MaxSizeString<256> absolute_path(const FileLocator& loc) {
+		MaxSizeString<256> path = MaxSizeString<256>::make([&](MaxSizeStringWriter& w) { w << loc << '\0'; });
+		char absolute[PATH_MAX];
+		if (realpath(path.slice().begin(), absolute) == nullptr) todo();
+		return MaxSizeString<256>::make([&](MaxSizeStringWriter& w) { w << StringSlice { absolute, absolute + strlen(absolute) }; });
+	}
 }
 
 int execute_file(const FileLocator& file_path) {
 	MaxSizeString<128> temp = MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << file_path << '\0'; });
-	return exec_command(temp.slice().begin());
+	int status = exec_command(temp.slice().begin());
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+CppBatch compile_cpp_files(const Slice<CppProgram>& programs, ExeCache& cache, Arena& arena) {
+	ListBuilder<uint> to_compile_builder;
+	Slice<CppBuild> builds = fill_array<CppBuild>()(arena, programs.size(), [&](uint i) {
+		TempArena temp;
+		Option<StringSlice> cpp = try_read_file(programs[i].cpp, temp, /*null_terminated*/ false);
+		if (!cpp.has())
+			return CppBuild { false, false, {}, 0 };
+		ExeCacheKey key = exe_cache_key(CLANG, cpp.get());
+		if (cache.try_get_exe(key, programs[i].exe))
+			return CppBuild { true, true, key, 0 };
+		to_compile_builder.add(i, arena);
+		return CppBuild { false, false, key, 0 };
+	});
+	List<uint> to_compile = to_compile_builder.finish();
+	if (to_compile.is_empty())
+		return { 0, 0, 0, builds };
+
+	char dir[] = "/tmp/noze-cpp-XXXXXX";
+	if (mkdtemp(dir) == nullptr) todo();
+	StringSlice dir_slice { dir, dir + strlen(dir) };
+
+	// clang won't put each of several outputs where we want it, so link each input into the scratch directory by its index in 'to_compile'.
+	uint n_compiled = 0;
+	for (uint i : to_compile) {
+		MaxSizeString<256> cpp = MaxSizeString<256>::make([&](MaxSizeStringWriter& w) { w << programs[i].cpp << '\0'; });
+		char absolute[PATH_MAX];
+		if (realpath(cpp.slice().begin(), absolute) == nullptr) todo();
+		if (symlink(absolute, scratch_file(dir_slice, n_compiled, ".cpp", arena).begin()) != 0) todo();
+		delete_file(programs[i].exe);
+		++n_compiled;
+	}
+
+	StringSlice precompile = prepare_prologue(dir_slice, arena);
+
+	// Room for ' <index>.cpp' per program.
+	StringBuilder compile { arena, 2 * PATH_MAX + 16 * n_compiled };
+	compile << "cd " << dir_slice << " && " << CLANG << "-include-pch prologue.h.pch -c";
+	for (uint j = 0; j != n_compiled; ++j)
+		compile << ' ' << j << ".cpp";
+	compile << '\0';
+
+	double precompile_ms;
+	double compile_ms;
+	without_limits([&]() {
+		Clock::time_point start = Clock::now();
+		exec_command(precompile.begin());
+		precompile_ms = ms_since(start);
+
+		// With several inputs, clang goes on to the next after an error, and every input that compiles gets its '.o'.
+		start = Clock::now();
+		exec_command(compile.finish().begin());
+		compile_ms = ms_since(start);
+
+		uint j = 0;
+		for (uint i : to_compile) {
+			std::FILE* object = std::fopen(scratch_file(dir_slice, j, ".o", arena).begin(), "r");
+			if (object != nullptr) {
+				std::fclose(object);
+				MaxSizeString<256> exe = MaxSizeString<256>::make([&](MaxSizeStringWriter& w) { w << programs[i].exe; });
+				StringBuilder link { arena, 2 * PATH_MAX };
+				link << CLANG << dir_slice << '/' << j << ".o -o " << exe.slice() << '\0';
+				Clock::time_point link_start = Clock::now();
+				exec_command(link.finish().begin());
+				builds[i].link_ms = ms_since(link_start);
+				builds[i].built = file_exists(programs[i].exe);
+				if (builds[i].built)
+					cache.set_exe(builds[i].key, programs[i].exe);
+			}
+			++j;
+		}
+	});
+
+	for (uint j = 0; j != n_compiled; ++j) {
+		std::remove(scratch_file(dir_slice, j, ".cpp", arena).begin());
+		std::remove(scratch_file(dir_slice, j, ".o", arena).begin());
+	}
+	remove_prologue(dir_slice);
+	rmdir(dir);
+
+	return { n_compiled, precompile_ms, compile_ms, builds };
 }
 
-void compile_cpp_file(const FileLocator& cpp_file_name, const FileLocator& exe_file_name) {
-	delete_file(exe_file_name);
-	Arena temp;
-	MaxSizeString<256> o = MaxSizeString<256>::make([&](MaxSizeStringWriter& m) {
-		m << CLANG << cpp_file_name << " -o " << exe_file_name << '\0';
+CppShardedBuild compile_cpp_shards(const CppShardedProgram& program, ExeCache& cache, uint n_threads) {
+	TempArena temp;
+	CppShardedBuild failed { false, false, 0, 0, 0, 0 };
+	Option<StringSlice> header = try_read_file(program.header, temp, /*null_terminated*/ false);
+	if (!header.has())
+		return failed;
+	// Index 0 is the header, then one for each shard.
+	Slice<StringSlice> files = uninitialized_array<StringSlice>(temp, program.shards.size() + 1);
+	files[0] = header.get();
+	for (uint i = 0; i != program.shards.size(); ++i) {
+		Option<StringSlice> shard = try_read_file(program.shards[i], temp, /*null_terminated*/ false);
+		if (!shard.has())
+			return failed;
+		files[i + 1] = shard.get();
+	}
+
+	ExeCacheKey exe_key = exe_cache_key(CLANG, files);
+	if (cache.try_get_exe(exe_key, program.exe))
+		return { true, true, 0, 0, 0, 0 };
+	delete_file(program.exe);
+
+	char dir[] = "/tmp/noze-cpp-XXXXXX";
+	if (mkdtemp(dir) == nullptr) todo();
+	StringSlice dir_slice { dir, dir + strlen(dir) };
+	PathCache paths;
+	// The object for shard 'i' goes in 'dir/i.o'.
+	Slice<FileLocator> objects = fill_array<FileLocator>()(temp, program.shards.size(), [&](uint i) {
+		StringBuilder name { temp, 16 };
+		name << i;
+		return FileLocator { dir_slice, paths.from_part_slice(name.finish().slice()), "o" };
+	});
+	Slice<ExeCacheKey> object_keys = fill_array<ExeCacheKey>()(temp, program.shards.size(), [&](uint i) {
+		StringSlice header_and_shard[] = { files[0], files[i + 1] };
+		return exe_cache_key(CLANG, Slice<StringSlice> { header_and_shard, 2 });
+	});
+
+	// Each shard includes the header by a path relative to itself, so compile it where it is instead of linking it into 'dir'.
+	Slice<uint> all_shards = uninitialized_array<uint>(temp, program.shards.size());
+	uint n_to_compile = 0;
+	for (uint i = 0; i != program.shards.size(); ++i)
+		if (!cache.try_get_object(object_keys[i], objects[i])) {
+			all_shards[n_to_compile] = i;
+			++n_to_compile;
+		}
+	Slice<uint> to_compile = all_shards.slice(0, n_to_compile);
+	// Commands are built up front, since 'temp' isn't safe to use from several threads.
+	Slice<StringSlice> compile_commands = map<StringSlice>()(temp, to_compile, [&](uint i) {
+		MaxSizeString<256> shard = absolute_path(program.shards[i]);
+		StringBuilder command { temp, 2 * PATH_MAX };
+		command << CLANG << "-include-pch " << dir_slice << "/prologue.h.pch -c " << shard.slice() << " -o " << dir_slice << '/' << i << ".o" << '\0';
+		return command.finish();
 	});
-	// std::cout << "Running: " << to_exec.slice().begin << std::endl;
-	without_limits([&]() { exec_command(o.slice().begin()); });
-	if (!file_exists(exe_file_name))
-		throw "There was a clang error";
+
+	MaxSizeString<256> exe = MaxSizeString<256>::make([&](MaxSizeStringWriter& w) { w << program.exe; });
+	StringBuilder link { temp, 2 * PATH_MAX + 16 * program.shards.size() };
+	link << CLANG;
+	for (uint i = 0; i != program.shards.size(); ++i)
+		link << dir_slice << '/' << i << ".o ";
+	link << "-o " << exe.slice() << '\0';
+
+	CppShardedBuild res { false, false, to_compile.size(), 0, 0, 0 };
+	without_limits([&]() {
+		Clock::time_point start;
+		if (!to_compile.is_empty()) {
+			StringSlice precompile = prepare_prologue(dir_slice, temp);
+			start = Clock::now();
+			exec_command(precompile.begin());
+			res.precompile_ms = ms_since(start);
+
+			// Each thread takes every n_threads'th shard. A thread just waits on clang, so there's no point in more threads than shards.
+			uint n_compile_threads = n_threads < to_compile.size() ? n_threads : to_compile.size();
+			start = Clock::now();
+			run_on_threads(n_compile_threads, [&](uint thread_index) {
+				for (uint j = thread_index; j < to_compile.size(); j += n_compile_threads)
+					exec_command(compile_commands[j].begin());
+			});
+			res.compile_ms = ms_since(start);
+			remove_prologue(dir_slice);
+		}
+
+		for (uint i : to_compile)
+			if (file_exists(objects[i]))
+				cache.set_object(object_keys[i], objects[i]);
+		if (every(objects, [](const FileLocator& o) { return file_exists(o); })) {
+			start = Clock::now();
+			exec_command(link.finish().begin());
+			res.link_ms = ms_since(start);
+			res.built = file_exists(program.exe);
+			if (res.built)
+				cache.set_exe(exe_key, program.exe);
+		}
+	});
+
+	for (const FileLocator& object : objects)
+		delete_file(object);
+	rmdir(dir);
+	return res;
 }
@@ -1,6 +1,55 @@
 #pragma once
 
+#include "./util/store/Arena.h"
+#include "./util/store/Slice.h"
+#include "./host/ExeCache.h"
 #include "./util/io.h"
 
+// Returns its exit status, or 128 plus the signal that killed it, as a shell would.
 int execute_file(const FileLocator& file_path);
-void compile_cpp_file(const FileLocator& cpp_file_name, const FileLocator& exe_file_name);
+
+// Build 'cpp' into 'exe'.
+struct CppProgram {
+	FileLocator cpp;
+	FileLocator exe;
+};
+
+struct CppBuild {
+	bool built; // False if clang failed on this program
+	bool cached; // If true, clang didn't run for this program
+	ExeCacheKey key;
+	double link_ms;
+};
+
+struct CppBatch {
+	uint n_compiled; // Programs that weren't cached
+	double precompile_ms;
+	double compile_ms; // For all compiled programs together
+	Slice<CppBuild> builds; // In the same order as the programs
+};
+
+// Takes each program's exe from 'cache' if it's there.
+// Compiles the rest in a single clang invocation, then links each and adds it to 'cache'.
+// Every emitted file starts with EMITTED_PROLOGUE, so that's precompiled once and shared instead of parsed for each.
+CppBatch compile_cpp_files(const Slice<CppProgram>& programs, ExeCache& cache, Arena& arena);
+
+// Build the header and shards written by LoweredProgram into 'exe'.
+struct CppShardedProgram {
+	FileLocator header;
+	Slice<FileLocator> shards;
+	FileLocator exe;
+};
+
+struct CppShardedBuild {
+	bool built; // False if clang failed on any shard
+	bool cached; // If true, clang didn't run at all
+	uint n_compiled; // Shards whose object wasn't cached
+	double precompile_ms;
+	double compile_ms; // For all compiled shards together
+	double link_ms;
+};
+
+// Takes the exe from 'cache' if it's there.
+// Otherwise takes the object for each shard from 'cache' if it's there, compiles the rest on up to 'n_threads' threads, and links them.
+// So after changing one module, only its shard is compiled again (unless the header changed too).
+CppShardedBuild compile_cpp_shards(const CppShardedProgram& program, ExeCache& cache, uint n_threads);
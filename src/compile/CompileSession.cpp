@@ -0,0 +1,484 @@
+#include "./CompileSession.h"
+
+#include <new> // placement new
+
+#include "../util/store/ArenaArrayBuilders.h"
+#include "../util/store/collection_util.h"
+#include "../util/store/ListBuilder.h"
+#include "../util/store/Map.h"
+#include "../util/store/Set.h"
+#include "../util/hash_util.h"
+#include "./check/check.h"
+#include "./parse/parser.h"
+#include "./parse/reparse.h"
+#include "./compile.h"
+
+namespace {
+	hash_t hash_slice(const StringSlice& s) {
+		return StringSlice::hash{}(s);
+	}
+
+	hash_t hash_type_ast(const TypeAst& t) {
+		hash_t h = hash_combine(hash_t(t.stored.kind()), hash_slice(t.stored.name()));
+		if (t.stored.kind() == StoredTypeAst::Kind::InstStruct)
+			h = hash_combine(h, hash_arr(t.stored.type_arguments(), hash_type_ast));
+		return hash_combine(h, hash_arr(t.lifetime_constraints, [](const LifetimeConstraintAst& l) {
+			return hash_combine(hash_t(l.kind), hash_slice(l.name));
+		}));
+	}
+
+	hash_t hash_type_parameters(const Slice<TypeParameterAst>& type_parameters) {
+		return hash_arr(type_parameters, [](const TypeParameterAst& t) { return hash_slice(t.name); });
+	}
+
+	hash_t hash_signature(const FunSignatureAst& s) {
+		hash_t h = hash_combine(hash_slice(s.name), s.effect.has() ? hash_t(s.effect.get()) + 1 : 0);
+		h = hash_combine(h, hash_type_ast(s.return_type));
+		h = hash_combine(h, hash_arr(s.parameters, [](const ParameterAst& p) { return hash_combine(hash_slice(p.name), hash_type_ast(p.type)); }));
+		h = hash_combine(h, hash_type_parameters(s.type_parameters));
+		return hash_combine(h, hash_arr(s.spec_uses, [](const SpecUseAst& u) {
+			return hash_combine(hash_slice(u.spec), hash_arr(u.type_arguments, hash_type_ast));
+		}));
+	}
+
+	template <typename T, typename /*const T& => hash_t*/ Hash>
+	hash_t hash_list(const List<T>& list, Hash hash) {
+		hash_t h = 0;
+		for (const T& t : list)
+			h = hash_combine(h, hash(t));
+		return h;
+	}
+
+	// Hashes everything that other modules could depend on, which is everything but the function bodies.
+	// Private declarations are included too, since a public declaration may mention them.
+	hash_t hash_interface(const FileAst& ast) {
+		hash_t h = hash_list(ast.specs, [](const SpecDeclarationAst& s) {
+			hash_t hs = hash_combine(hash_combine(hash_bool(s.is_public), hash_slice(s.name)), hash_type_parameters(s.type_parameters));
+			return hash_combine(hs, hash_arr(s.signatures, hash_signature));
+		});
+		h = hash_combine(h, hash_list(ast.structs, [](const StructDeclarationAst& s) {
+			hash_t hs = hash_combine(hash_combine(hash_bool(s.is_public), hash_slice(s.name)), hash_type_parameters(s.type_parameters));
+			hs = hash_combine(hs, hash_bool(s.copy));
+			return hash_combine(hs, s.body.kind() == StructBodyAst::Kind::CppName
+				? hash_slice(s.body.cpp_name())
+				: hash_arr(s.body.fields(), [](const StructFieldAst& f) { return hash_combine(hash_slice(f.name), hash_type_ast(f.type)); }));
+		}));
+		return hash_combine(h, hash_list(ast.funs, [](const FunDeclarationAst& f) {
+			return hash_combine(hash_bool(f.is_public), hash_signature(f.signature));
+		}));
+	}
+
+	// The smallest edit that turns 'old_source' into 'new_source'. Both end in '\0', which the edit leaves alone.
+	TextEdit find_edit(const StringSlice& old_source, const StringSlice& new_source) {
+		const char* old_begin = old_source.begin();
+		const char* new_begin = new_source.begin();
+		while (old_begin != old_source.end() - 1 && new_begin != new_source.end() - 1 && *old_begin == *new_begin) {
+			++old_begin;
+			++new_begin;
+		}
+		const char* old_end = old_source.end() - 1;
+		const char* new_end = new_source.end() - 1;
+		while (old_end != old_begin && new_end != new_begin && *(old_end - 1) == *(new_end - 1)) {
+			--old_end;
+			--new_end;
+		}
+		return {
+			{ to_ushort(uint(old_begin - old_source.begin())), to_ushort(uint(old_end - old_source.begin())) },
+			new_begin == new_end ? StringSlice {} : StringSlice { new_begin, new_end } };
+	}
+
+	struct CachedImport {
+		Path path;
+		SourceRange range; // Of the import in the importing module
+	};
+
+	struct CachedModule {
+		Path path;
+		// Holds every version of the file, its AST, and its module.
+		// Old versions aren't freed, since the same module is checked in place each time. See 'start_over_grown_modules'.
+		Arena arena;
+		ulong first_version_bytes; // What 'arena' held after the first version was parsed and checked. 0 until first read.
+		StringSlice source; // As last read
+		// Holds 'source' after a reparse, since then no declaration points into it. Emptied for each new version.
+		// After a full parse, declarations point into 'source', so it's in 'arena' instead.
+		Arena source_arena;
+		const Arena::Mark source_arena_empty;
+		Option<LineAndColumnGetter> line_and_column; // Built for 'source' when first asked for.
+		Option<Ref<const FileAst>> ast; // None until first read.
+		bool parsed_cleanly; // 'ast' has no parse diagnostics, so the next version can be reparsed from it.
+		// Parse errors, and imports that can't be resolved. If not empty, this module isn't checked.
+		List<Diagnostic> read_diagnostics;
+		Slice<CachedImport> imports; // The imports that resolved
+		hash_t own_interface_hash; // See hash_interface
+		Ref<Module> module;
+		bool ever_checked; // If not, 'module' is uninitialized.
+		bool checked; // 'module' holds a successful check of 'ast', with no diagnostics.
+		hash_t checked_against; // Interface hashes of the modules this depends on, as of when it was checked.
+		// Includes the interfaces of modules this depends on, so changes propagate to everything downstream.
+		hash_t interface_hash;
+		// Changes when checking allocated new declarations instead of overwriting the old ones.
+		// Then modules depending on this one must be checked again, even if the interface looks the same.
+		uint layout_generation;
+
+		// The rest only applies to the current compile.
+		bool missing; // There was no document for this path.
+		enum class State { Unvisited, InProgress, Done };
+		State state;
+		bool text_changed;
+		bool failed; // This or something it depends on had diagnostics.
+		List<Diagnostic> diagnostics;
+		CachedModule* next; // Links the files left to read
+
+		inline explicit CachedModule(Path _path)
+			: path{_path}, arena{}, first_version_bytes{0}, source{}, source_arena{}, source_arena_empty{source_arena.mark()}, line_and_column{}, ast{}, parsed_cleanly{false}, read_diagnostics{}, imports{}, own_interface_hash{0}, module{arena.allocate_uninitialized<Module>()},
+			ever_checked{false}, checked{false}, checked_against{0}, interface_hash{0}, layout_generation{0},
+			missing{false}, state{State::Unvisited}, text_changed{false}, failed{false}, diagnostics{}, next{nullptr} {}
+		CachedModule(const CachedModule& other) = delete;
+		void operator=(const CachedModule& other) = delete;
+	};
+
+	// A module starts over in a fresh arena once its arena holds this many times what its first version took.
+	// Small arenas aren't worth checking everything downstream again.
+	const ulong MAX_ARENA_GROWTH = 4;
+	const ulong MIN_ARENA_BYTES_TO_START_OVER = 1 << 20;
+
+	// Identifies the declaration slices, which other modules point into.
+	struct Layout {
+		const StructDeclaration* structs;
+		const SpecDeclaration* specs;
+		const FunDeclaration* funs;
+
+		inline explicit Layout(const Module& m) : structs{m.structs_declaration_order.begin()}, specs{m.specs_declaration_order.begin()}, funs{m.funs_declaration_order.begin()} {}
+
+		inline friend bool operator==(const Layout& a, const Layout& b) {
+			return a.structs == b.structs && a.specs == b.specs && a.funs == b.funs;
+		}
+	};
+}
+
+struct CompileSession::Impl {
+	DocumentProvider& document_provider;
+	PathCache paths;
+	IdentifierCache identifiers;
+	Arena arena;
+	Map<Path, Ref<CachedModule>, Path::hash> modules;
+	Option<Path> builtin_module_path;
+	BuiltinTypes builtin_types; // From the module at builtin_module_path
+	Arena result_arena; // Freed at the start of each compile.
+	const Arena::Mark result_arena_empty;
+	Result result;
+	Stats stats;
+
+	explicit Impl(DocumentProvider& _document_provider)
+		: document_provider{_document_provider}, paths{}, identifiers{}, arena{}, modules{arena}, builtin_module_path{}, builtin_types{},
+		result_arena{}, result_arena_empty{result_arena.mark()}, result{}, stats{} {}
+	Impl(const Impl& other) = delete;
+	void operator=(const Impl& other) = delete;
+	~Impl() {
+		modules.each([](const Path& path __attribute__((unused)), const Ref<CachedModule>& m) {
+			m->~CachedModule();
+		});
+	}
+
+	CachedModule& get_cached_module(Path path) {
+		Option<Ref<CachedModule>&> already = modules.get(path);
+		if (already.has())
+			return already.get();
+		Ref<CachedModule> m = new (arena.allocate_uninitialized<CachedModule>().ptr()) CachedModule { path };
+		modules.must_insert(path, m);
+		return m;
+	}
+
+	// After an edit to a file that parsed cleanly, only the declarations the edit touched are parsed again.
+	// The edit is found by comparing the texts, so this works however the document changed.
+	Ref<FileAst> parse(CachedModule& m, Option<Ref<const FileAst>> previous, const StringSlice& document, List<ParseDiagnostic>& diagnostics) {
+		if (previous.has()) {
+			ReparseResult reparsed = reparse_file(previous.get(), document, find_edit(previous.get()->source, document), paths, m.arena);
+			// The previous version's text isn't needed any more.
+			m.source_arena.release(m.source_arena_empty);
+			reparsed.ast->source = copy_string(m.source_arena, document);
+			diagnostics = reparsed.diagnostics;
+			++stats.n_reparsed;
+			return reparsed.ast;
+		}
+		Ref<FileAst> f = m.arena.put(FileAst { m.path, copy_string(m.arena, document) });
+		diagnostics = parse_file_recovering(f, paths, m.arena);
+		return f;
+	}
+
+	void read(CachedModule& m, Arena& temp) {
+		Option<StringSlice> document = document_provider.try_get_document(m.path, NZ_EXTENSION, temp);
+		m.missing = !document.has();
+		if (m.missing)
+			return;
+
+		m.text_changed = !m.ast.has() || m.source != document.get();
+		if (!m.text_changed)
+			return;
+
+		Option<Ref<const FileAst>> previous = m.parsed_cleanly ? m.ast : Option<Ref<const FileAst>> {};
+		m.ast = {};
+		m.parsed_cleanly = false;
+		m.checked = false;
+		m.line_and_column = Option<LineAndColumnGetter> {};
+		List<ParseDiagnostic> parse_diagnostics;
+		Ref<FileAst> f = parse(m, previous, document.get(), parse_diagnostics);
+		m.source = f->source;
+		// Even with errors, follow the imports that parsed, so errors in those files are found in the same compile.
+		ListBuilder<Diagnostic> diagnostics;
+		for (const ParseDiagnostic& diag : parse_diagnostics)
+			diagnostics.add({ m.path, diag }, m.arena);
+		m.imports = map_op<CachedImport>()(m.arena, f->imports, [&](const ImportAst& i) {
+			Option<Path> op_import_path = resolve_import(m.path, i, paths);
+			if (!op_import_path.has())
+				diagnostics.add({ m.path, i.range, Diag::Kind::ImportNotResolved }, m.arena);
+			return op_import_path.has() ? Option { CachedImport { op_import_path.get(), i.range } } : Option<CachedImport> {};
+		});
+		m.read_diagnostics = diagnostics.finish();
+		m.own_interface_hash = hash_interface(*f);
+		m.ast = Option<Ref<const FileAst>> { f };
+		m.parsed_cleanly = parse_diagnostics.is_empty();
+		if (m.first_version_bytes == 0)
+			m.first_version_bytes = m.arena.n_bytes_held();
+		++stats.n_parsed;
+	}
+
+	// Same order as parse_everything. Returns the modules in reverse of that order, which is the order of CompiledProgram::modules.
+	// Modules with parse errors or bad imports are still returned. They're marked as failed, and their diagnostics are added to 'diagnostics'.
+	// Imported modules that don't exist aren't returned. Each import of one gets a diagnostic instead.
+	List<Ref<CachedModule>> read_everything(Path first_path, ListBuilder<Diagnostic>& diagnostics, Arena& temp) {
+		List<Ref<CachedModule>> res;
+		Set<Path, Path::hash> enqued_set { temp };
+		enqued_set.must_insert(first_path);
+		CachedModule* to_visit = &get_cached_module(first_path);
+		to_visit->next = nullptr;
+		do {
+			CachedModule& m = *to_visit;
+			to_visit = m.next;
+			read(m, temp);
+			if (m.missing) {
+				if (m.path == first_path) todo(); // The file to compile doesn't exist
+				m.failed = true;
+				// So 'sort_imports_first' doesn't look at the imports it had when it last existed.
+				m.state = CachedModule::State::Done;
+				continue;
+			}
+			for (const Diagnostic& d : m.read_diagnostics)
+				diagnostics.add(d, result_arena);
+			m.state = CachedModule::State::Unvisited;
+			m.failed = !m.read_diagnostics.is_empty();
+			m.diagnostics = {};
+			res.prepend(&m, temp);
+			for (const CachedImport& i : m.imports) {
+				if (enqued_set.try_insert(i.path).was_added) {
+					CachedModule& import = get_cached_module(i.path);
+					import.next = to_visit;
+					to_visit = &import;
+				}
+			}
+		} while (to_visit != nullptr);
+
+		for (Ref<CachedModule> m : res)
+			for (const CachedImport& i : m->imports)
+				if (get_cached_module(i.path).missing)
+					diagnostics.add({ m->path, i.range, Diag::Kind::ImportedModuleNotFound }, result_arena);
+		return res;
+	}
+
+	// Appends 'm' to 'order' after everything it imports. Returns a diagnostic for the first circular import found.
+	Option<Diagnostic> sort_imports_first(CachedModule& m, ListBuilder<Ref<CachedModule>>& order, Arena& temp) {
+		m.state = CachedModule::State::InProgress;
+		for (const CachedImport& i : m.imports) {
+			CachedModule& import = get_cached_module(i.path);
+			switch (import.state) {
+				case CachedModule::State::InProgress:
+					return Option<Diagnostic> { { m.path, i.range, Diag::Kind::CircularImport } };
+				case CachedModule::State::Unvisited: {
+					Option<Diagnostic> d = sort_imports_first(import, order, temp);
+					if (d.has())
+						return d;
+					break;
+				}
+				case CachedModule::State::Done:
+					break;
+			}
+		}
+		m.state = CachedModule::State::Done;
+		order.add(&m, temp);
+		return {};
+	}
+
+	void check_if_needed(CachedModule& m, Option<Ref<CachedModule>> builtin_module) {
+		if (m.failed) // Diagnostics from reading it
+			return;
+		for (const CachedImport& i : m.imports)
+			if (get_cached_module(i.path).failed) {
+				m.failed = true;
+				return;
+			}
+
+		// Every module uses the builtin types, even if it doesn't import the module that declares them.
+		bool is_builtin_module = !builtin_module.has();
+		hash_t against = is_builtin_module ? 0 : hash_combine(Path::hash{}(builtin_module.get()->path), builtin_module.get()->interface_hash);
+		for (const CachedImport& i : m.imports)
+			against = hash_combine(against, get_cached_module(i.path).interface_hash);
+
+		if (m.checked && !m.text_changed && m.checked_against == against)
+			return;
+
+		const FileAst& ast = *m.ast.get();
+		Ref<Module> module = m.module;
+		module->path = m.path;
+		module->imports = map<Ref<const Module>>()(m.arena, m.imports, [&](const CachedImport& i) {
+			return Ref<const Module> { get_cached_module(i.path).module };
+		});
+		module->comment = ast.comment.has() ? Option { copy_string(m.arena, ast.comment.get()) } : Option<ArenaString> {};
+
+		Option<BuiltinTypes> op_builtin_types = is_builtin_module ? Option<BuiltinTypes> {} : Option<BuiltinTypes> { builtin_types };
+		ListBuilder<Diagnostic> diagnostics;
+		if (m.ever_checked) {
+			Layout old_layout { *module };
+			check_again(module, op_builtin_types, ast, m.arena, identifiers, diagnostics);
+			if (!(Layout { *module } == old_layout))
+				++m.layout_generation;
+		} else {
+			check(module, op_builtin_types, ast, m.arena, identifiers, diagnostics);
+			m.ever_checked = true;
+			m.first_version_bytes = m.arena.n_bytes_held();
+		}
+		++stats.n_checked;
+
+		if (is_builtin_module)
+			builtin_types = op_builtin_types.get();
+		m.checked_against = against;
+		m.interface_hash = hash_combine(hash_combine(m.own_interface_hash, against), m.layout_generation);
+		m.diagnostics = diagnostics.finish();
+		m.checked = m.diagnostics.is_empty();
+		m.failed = !m.checked;
+	}
+
+	static Ref<CachedModule> get_builtin_module(const List<Ref<CachedModule>>& modules_in_order) {
+		for (Ref<CachedModule> m : modules_in_order)
+			if (m->ast.get()->imports.is_empty())
+				return m;
+		// There is always a module without imports, since there is no circular import.
+		unreachable();
+	}
+
+	bool arena_grown(const CachedModule& m) const {
+		ulong held = m.arena.n_bytes_held();
+		return m.first_version_bytes != 0 && held >= MIN_ARENA_BYTES_TO_START_OVER && held > MAX_ARENA_GROWTH * m.first_version_bytes;
+	}
+
+	// Frees the old versions in a module's arena by starting that module over, as if it had never been read.
+	// Modules that depend on it point into its arena, so those start over too. Everything depends on the builtin module.
+	// Only call this between compiles, since 'result' points into these arenas.
+	void start_over_grown_modules() {
+		TempArena temp;
+		Set<Path, Path::hash> start_over { temp };
+		bool any = false;
+		modules.each([&](const Path& path, const Ref<CachedModule>& m) {
+			if (arena_grown(m)) {
+				start_over.must_insert(path);
+				any = true;
+			}
+		});
+		if (!any)
+			return;
+
+		bool everything = builtin_module_path.has() && start_over.has(builtin_module_path.get());
+		for (bool added = true; added; ) {
+			added = false;
+			modules.each([&](const Path& path, const Ref<CachedModule>& m) {
+				if (!start_over.has(path) && (everything || some(m->imports, [&](const CachedImport& i) { return start_over.has(i.path); }))) {
+					start_over.must_insert(path);
+					added = true;
+				}
+			});
+		}
+		if (everything)
+			builtin_module_path = {};
+
+		modules.each([&](const Path& path, const Ref<CachedModule>& m) {
+			if (start_over.has(path)) {
+				Ref<CachedModule> module = m;
+				module->~CachedModule();
+				new (module.ptr()) CachedModule { path };
+				++stats.n_started_over;
+			}
+		});
+	}
+
+	void compile(Path first_path) {
+		result_arena.release(result_arena_empty);
+		result = {};
+		stats = {};
+		start_over_grown_modules();
+		TempArena temp;
+		ListBuilder<Diagnostic> diagnostics;
+
+		// Unlike 'compile', modules are checked even if others had parse errors, as long as they don't depend on those.
+		// So an editor sees every diagnostic it can, not just the syntax errors.
+		List<Ref<CachedModule>> modules_in_order = read_everything(first_path, diagnostics, temp);
+		ListBuilder<Ref<CachedModule>> check_order;
+		Option<Diagnostic> circular = sort_imports_first(get_cached_module(first_path), check_order, temp);
+		if (circular.has())
+			diagnostics.add(circular.get(), result_arena);
+		else {
+			// Same as 'compile': the builtin types come from the first module without imports, so check it before any others.
+			Ref<CachedModule> builtin_module = get_builtin_module(modules_in_order);
+			if (!builtin_module_path.has() || builtin_module_path.get() != builtin_module->path) {
+				// Last time this didn't compute builtin types.
+				builtin_module->checked = false;
+				builtin_module_path = Option { builtin_module->path };
+			}
+			check_if_needed(builtin_module, {});
+			// Every other module needs the builtin types, which only come from checking this.
+			if (builtin_module->read_diagnostics.is_empty())
+				for (Ref<CachedModule> m : check_order.finish())
+					if (m != builtin_module)
+						check_if_needed(m, Option { builtin_module });
+			result.builtin_types = builtin_types;
+
+			for (Ref<CachedModule> m : modules_in_order)
+				for (const Diagnostic& d : m->diagnostics)
+					diagnostics.add(d, result_arena);
+			if (diagnostics.is_empty()) {
+				result.modules = uninitialized_array<Module>(result_arena, modules_in_order.size());
+				uint i = 0;
+				for (Ref<CachedModule> m : modules_in_order) {
+					result.modules[i] = m->module;
+					++i;
+				}
+			}
+		}
+		result.diagnostics = diagnostics.finish();
+	}
+};
+
+CompileSession::CompileSession(DocumentProvider& document_provider) : impl{new CompileSession::Impl { document_provider }} {}
+CompileSession::~CompileSession() {} // impl implicitly deleted
+
+PathCache& CompileSession::paths() {
+	return impl->paths;
+}
+
+const CompileSession::Result& CompileSession::compile(Path first_path) {
+	impl->compile(first_path);
+	return impl->result;
+}
+
+CompileSession::Stats CompileSession::last_stats() const {
+	return impl->stats;
+}
+
+StringSlice CompileSession::source(Path path) const {
+	return impl->modules.must_get(path)->source;
+}
+
+const LineAndColumnGetter& CompileSession::line_and_column_getter(Path path) {
+	CachedModule& m = impl->modules.must_get(path);
+	if (!m.line_and_column.has())
+		m.line_and_column = LineAndColumnGetter::for_text(m.source, m.arena);
+	return m.line_and_column.get();
+}
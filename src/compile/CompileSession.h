@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../host/DocumentProvider.h"
+#include "../util/store/List.h"
+#include "../util/unique_ptr.h"
+#include "../util/PathCache.h"
+#include "./diag/diag.h"
+#include "./model/BuiltinTypes.h"
+#include "./model/model.h"
+
+// Keeps parsed and checked modules between compiles, so that after an edit only the affected work is redone.
+// A file is parsed again only if its text changed, and then only the declarations that changed, unless the old text had parse errors.
+// A module is checked again only if its text changed, or if the interface of something it depends on changed.
+// A module's interface is every declaration except for function bodies, so editing a function body only checks that one module again.
+class CompileSession {
+	struct Impl;
+	unique_ptr<Impl> impl;
+	CompileSession(const CompileSession& other) = delete;
+
+public:
+	struct Result {
+		Slice<Module> modules; // In the same order as CompiledProgram::modules. Empty if there are diagnostics.
+		List<Diagnostic> diagnostics;
+		BuiltinTypes builtin_types;
+	};
+
+	// How much work the last call to 'compile' did.
+	struct Stats {
+		uint n_parsed;
+		uint n_reparsed; // Of those parsed, how many only parsed the declarations an edit touched.
+		uint n_checked;
+		uint n_started_over; // Modules whose arenas had grown too much, so they were read and checked again from scratch.
+	};
+
+	explicit CompileSession(DocumentProvider& document_provider);
+	~CompileSession();
+
+	// Paths passed to 'compile' must come from here.
+	PathCache& paths();
+	// Reads every file again, but only parses and checks what changed.
+	// Reports every parse error in every file. Modules are still checked unless they have parse errors or depend on a module that does.
+	// The result is valid until the next call.
+	const Result& compile(Path first_path);
+	Stats last_stats() const;
+
+	// For writing diagnostics: the text of a file as a compile last read it, and where its lines start.
+	// 'path' must be a file that some compile read, such as the path of a diagnostic.
+	StringSlice source(Path path) const;
+	// Built the first time it's asked for, and kept until the file's text changes.
+	const LineAndColumnGetter& line_and_column_getter(Path path);
+};
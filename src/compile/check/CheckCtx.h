@@ -4,16 +4,22 @@
 #include "../../util/Path.h"
 #include "../diag/diag.h"
 #include "../model/model.h"
+#include "../parse/ast.h"
 
 struct CheckCtx {
 	Arena& arena;
-	const StringSlice& source;
+	LocalIdentifierCache& identifiers;
+	DeclarationSource source; // Of the declaration being checked
 	Path path; // Path of current module
 	const Slice<Ref<const Module>>& imports;
 	ListBuilder<Diagnostic>& diags;
 
 	inline SourceRange range(StringSlice slice) {
-		return SourceRange::inner_slice(source, slice);
+		return source.range(slice);
+	}
+	// For a range stored in the declaration's AST.
+	inline SourceRange range(const SourceRange& ast_range) {
+		return source.range(ast_range);
 	}
 	inline void diag(SourceRange range, Diag diag) {
 		diags.add({ path, range, diag }, arena);
@@ -27,5 +33,5 @@ struct CheckCtx {
 };
 
 inline Identifier id(CheckCtx& al, StringSlice s) {
-	return Identifier { copy_string(al.arena, s) };
+	return al.identifiers.get(s);
 }
@@ -6,7 +6,7 @@
 #include "./convert_type.h"
 
 namespace {
-	Option<Ref<const SpecDeclaration>> find_spec(const StringSlice& name, CheckCtx& ctx, const SpecsTable& specs_table) {
+	Option<Ref<const SpecDeclaration>> find_spec(Identifier name, CheckCtx& ctx, const SpecsTable& specs_table) {
 		Option<Ref<const SpecDeclaration>> res = copy_inner(specs_table.get(name));
 		for (Ref<const Module> m : ctx.imports) {
 			Option<Ref<const SpecDeclaration>> s = copy_inner(m->specs_table.get(name));
@@ -22,13 +22,14 @@ namespace {
 
 	Slice<TypeParameter> check_type_parameters(const Slice<TypeParameterAst> asts, CheckCtx& al, const Slice<TypeParameter>& spec_type_parameters) {
 		return map_with_prevs<TypeParameter>()(al.arena, asts, [&](const TypeParameterAst& ast, const Slice<TypeParameter>& prevs, uint index) {
-			if (some(spec_type_parameters, [&](const TypeParameter& s) { return s.name == ast.name; }))
+			Identifier name = id(al, ast.name);
+			if (some(spec_type_parameters, [&](const TypeParameter& s) { return s.name == name; }))
 				al.diag(ast.name, Diag::Kind::TypeParameterShadowsSpecTypeParameter);
 			for (const TypeParameter& prev : prevs)
-				if (prev.name == ast.name)
+				if (prev.name == name)
 					al.diag(ast.name, Diag::Kind::TypeParameterShadowsPrevious);
 			assert(index == ast.index);
-			return TypeParameter { al.range(ast.name), id(al, ast.name), index };
+			return TypeParameter { al.range(ast.name), name, index };
 		});
 	}
 
@@ -37,17 +38,18 @@ namespace {
 		const Slice<ParameterAst>& asts, CheckCtx& al,
 		const StructsTable& structs_table, const TypeParametersScope& type_parameters_scope, const FunsTable& funs_table, const Slice<SpecUse>& current_specs) {
 		return map_with_prevs<Parameter>()(al.arena, asts, [&](const ParameterAst& ast, const Slice<Parameter>& prevs, uint index) -> Parameter {
-			check_param_or_local_shadows_fun(al, ast.name, funs_table, current_specs);
-			if (some(prevs, [&](const Parameter& prev) { return prev.name == ast.name; }))
+			Identifier name = id(al, ast.name);
+			check_param_or_local_shadows_fun(al, ast.name, name, funs_table, current_specs);
+			if (some(prevs, [&](const Parameter& prev) { return prev.name == name; }))
 				todo();
 			Type type = type_from_ast(ast.type, al, structs_table, Option<const Slice<Parameter>&> { prevs }, type_parameters_scope);
-			return Parameter { id(al, ast.name), type, index };
+			return Parameter { name, type, index };
 		});
 	}
 
 	Slice<SpecUse> check_spec_uses(const Slice<SpecUseAst>& asts, CheckCtx& ctx, const StructsTable& structs_table, const SpecsTable& specs_table, const TypeParametersScope& type_parameters_scope) {
 		return map_op<SpecUse>()(ctx.arena, asts, [&](const SpecUseAst& ast) -> Option<SpecUse> {
-			Option<Ref<const SpecDeclaration>> spec_op = find_spec(ast.spec, ctx, specs_table);
+			Option<Ref<const SpecDeclaration>> spec_op = find_spec(id(ctx, ast.spec), ctx, specs_table);
 			if (!spec_op.has()) {
 				ctx.diag(ast.spec, Diag::Kind::SpecNameNotFound);
 				return {};
@@ -83,25 +85,43 @@ namespace {
 		});
 	}
 
-	void check_type_headers(const FileAst& file_ast, CheckCtx& ctx, Ref<Module> module) {
+	// When 'reuse' is set, writes over 'old' if it has the right size, so that other modules' references to its elements stay valid.
+	template <typename Out>
+	struct map_in_place {
+		template <typename Collection, typename /*const In& => Out*/ Cb>
+		Slice<Out> operator()(Arena& arena, Slice<Out> old, bool reuse, const Collection& in, Cb cb) {
+			if (!reuse || old.size() != in.size())
+				return map<Out>()(arena, in, cb);
+			uint i = 0;
+			for (const typename Collection::value_type& input : in) {
+				old[i] = cb(input);
+				++i;
+			}
+			return old;
+		}
+	};
+
+	void check_type_headers(const FileAst& file_ast, CheckCtx& ctx, Ref<Module> module, bool reuse_declarations) {
 		if (!file_ast.includes.is_empty()) todo();
 
-		module->specs_declaration_order = map<SpecDeclaration>()(ctx.arena, file_ast.specs, [&](const SpecDeclarationAst& ast) {
-			return SpecDeclaration { module, ast.range, ctx.copy_str(ast.comment), ast.is_public, check_type_parameters(ast.type_parameters, ctx, {}), id(ctx, ast.name) };
+		module->specs_declaration_order = map_in_place<SpecDeclaration>()(ctx.arena, module->specs_declaration_order, reuse_declarations, file_ast.specs, [&](const SpecDeclarationAst& ast) {
+			ctx.source = ast.source;
+			return SpecDeclaration { module, ctx.range(ast.range), ctx.copy_str(ast.comment), ast.is_public, check_type_parameters(ast.type_parameters, ctx, {}), id(ctx, ast.name) };
 		});
-		module->specs_table = build_map<StringSlice, Ref<const SpecDeclaration>, StringSlice::hash>()(
+		module->specs_table = build_map<Identifier, Ref<const SpecDeclaration>, Identifier::hash>()(
 			ctx.arena,
 			module->specs_declaration_order,
 			[](const SpecDeclaration& s) { return s.name; },
 			[](const SpecDeclaration& s) { return Ref<const SpecDeclaration> { &s }; },
 			[&](const SpecDeclaration& a __attribute__((unused)), const SpecDeclaration& b) {
-				ctx.diag(b.name, Diag::Kind::DuplicateDeclaration);
+				ctx.diag(b.range, Diag::Kind::DuplicateDeclaration);
 			});
 
-		module->structs_declaration_order = map<StructDeclaration>()(ctx.arena, file_ast.structs, [&](const StructDeclarationAst& ast) {
-			return StructDeclaration { module, ast.range, ast.is_public, check_type_parameters(ast.type_parameters, ctx, {}), id(ctx, ast.name), ast.copy };
+		module->structs_declaration_order = map_in_place<StructDeclaration>()(ctx.arena, module->structs_declaration_order, reuse_declarations, file_ast.structs, [&](const StructDeclarationAst& ast) {
+			ctx.source = ast.source;
+			return StructDeclaration { module, ctx.range(ast.range), ast.is_public, check_type_parameters(ast.type_parameters, ctx, {}), id(ctx, ast.name), ast.copy };
 		});
-		module->structs_table = build_map<StringSlice, Ref<const StructDeclaration>, StringSlice::hash>()(
+		module->structs_table = build_map<Identifier, Ref<const StructDeclaration>, Identifier::hash>()(
 			ctx.arena,
 			module->structs_declaration_order,
 			[](const StructDeclaration& s) { return s.name; },
@@ -110,10 +130,10 @@ namespace {
 				ctx.diag(b.range, Diag::Kind::DuplicateDeclaration);
 			});
 
-		module->funs_declaration_order = map<FunDeclaration>()(ctx.arena, file_ast.funs, [&](const FunDeclarationAst& ast) {
+		module->funs_declaration_order = map_in_place<FunDeclaration>()(ctx.arena, module->funs_declaration_order, reuse_declarations, file_ast.funs, [&](const FunDeclarationAst& ast) {
 			return FunDeclaration { module, ast.is_public, { id(ctx, ast.signature.name) }, {} };
 		});
-		module->funs_table = build_multi_map<StringSlice, Ref<const FunDeclaration>, StringSlice::hash>()(
+		module->funs_table = build_multi_map<Identifier, Ref<const FunDeclaration>, Identifier::hash>()(
 			ctx.arena,
 			module->funs_declaration_order,
 			[](const FunDeclaration& f) { return f.name(); },
@@ -128,12 +148,14 @@ namespace {
 		const StructsTable& structs_table, const SpecsTable& specs_table, FunsTable& funs_table
 	) {
 		zip(file_ast.specs, specs, [&](const SpecDeclarationAst& spec_ast, SpecDeclaration& spec) {
+			al.source = spec_ast.source;
 			spec.signatures = map<FunSignature>()(al.arena, spec_ast.signatures, [&](const FunSignatureAst& ast) {
 				return check_signature(ast, al, structs_table, specs_table, funs_table, spec.type_parameters, id(al, ast.name));
 			});
 		});
 
 		zip(file_ast.structs, structs, [&](const StructDeclarationAst& struct_ast, StructDeclaration& strukt) {
+			al.source = struct_ast.source;
 			const StructBodyAst& body_ast = struct_ast.body;
 			strukt.body = body_ast.kind() == StructBodyAst::Kind::CppName
 						   ? StructBody{ copy_string(al.arena, body_ast.cpp_name())}
@@ -141,24 +163,28 @@ namespace {
 		});
 
 		zip(file_ast.funs, funs, [&](const FunDeclarationAst& fun_ast, FunDeclaration& fun) {
+			al.source = fun_ast.source;
 			// Name was allocated in the previous step.
 			fun.signature = check_signature(fun_ast.signature, al, structs_table, specs_table, funs_table, {}, fun.signature.name);
 		});
 	}
 
 	Expression check_function_body(
-		const ExprAst& ast, CheckCtx& al, const FunsTable& funs_table, const StructsTable& structs_table, const FunDeclaration& fun, const BuiltinTypes& builtin_types) {
-		Arena scratch_arena;
+		const ExprAst& ast, CheckCtx& al, Arena& scratch_arena, const FunsTable& funs_table, const StructsTable& structs_table, const FunDeclaration& fun, const BuiltinTypes& builtin_types) {
+		ArenaScope scratch_scope { scratch_arena };
 		ExprContext ctx { al, scratch_arena, funs_table, structs_table, &fun, {}, builtin_types };
 		return check_and_expect_stored_type_and_lifetime(ast, ctx, fun.signature.return_type);
 	}
 
 	// Now that we have the bodies of every type and the headers of every function, we can fill in every function.
 	void check_fun_bodies(const FileAst& file_ast, CheckCtx& ctx, const BuiltinTypes& builtin_types, FunsDeclarationOrder& funs, const StructsTable& structs_table, const FunsTable& funs_table) {
+		// Shared by every function body; each releases what it used when done.
+		TempArena scratch_arena;
 		zip(file_ast.funs, funs, [&](const FunDeclarationAst& ast, FunDeclaration& fun) {
+			ctx.source = ast.source;
 			fun.body = ast.body.kind() == FunBodyAst::Kind::CppSource
 				? AnyBody { copy_string(ctx.arena, ast.body.cpp_source()) }
-				: AnyBody { ctx.arena.put(check_function_body(ast.body.expression(), ctx, funs_table, structs_table, fun, builtin_types)) };
+				: AnyBody { ctx.arena.put(check_function_body(ast.body.expression(), ctx, scratch_arena, funs_table, structs_table, fun, builtin_types)) };
 		});
 	}
 
@@ -167,7 +193,7 @@ namespace {
 	const StringSlice VOID = StringSlice { "Void" };
 
 	Option<Type> get_builtin_type(const StructsTable& structs_table, CheckCtx& al, StringSlice type_name) {
-		return map_option<Type>()(structs_table.get(type_name), [&](Ref<const StructDeclaration> strukt) -> Option<Type> {
+		return map_option<Type>()(structs_table.get(id(al, type_name)), [&](Ref<const StructDeclaration> strukt) -> Option<Type> {
 			if (strukt->arity()) {
 				al.diag(strukt->range, Diag::Kind::SpecialTypeShouldNotHaveTypeParameters);
 				return {};
@@ -184,19 +210,42 @@ namespace {
 	}
 }
 
-void check(Ref<Module> m, Option<BuiltinTypes>& builtin_types, const FileAst& ast, Arena& arena, ListBuilder<Diagnostic>& diagnostics) {
-	CheckCtx ctx { arena, ast.source, m->path, m->imports, diagnostics };
+namespace {
+	void check_worker(
+		Ref<Module> m, Option<BuiltinTypes>& builtin_types, const FileAst& ast, Arena& arena, IdentifierCache& identifiers, ListBuilder<Diagnostic>& diagnostics, bool reuse_declarations
+	) {
+		// A check runs on one thread, and most names are used many times in a module.
+		TempArena temp;
+		LocalIdentifierCache local_identifiers { identifiers, temp };
+		CheckCtx ctx { arena, local_identifiers, DeclarationSource { ast.source.begin(), 0 }, m->path, m->imports, diagnostics };
 
-	if (!ast.imports.is_empty()) todo();
+		check_type_headers(ast, ctx, m, reuse_declarations);
 
-	check_type_headers(ast, ctx, m);
+		check_fun_headers_and_type_bodies(ast, ctx,
+			m->structs_declaration_order, m->specs_declaration_order, m->funs_declaration_order,
+			m->structs_table, m->specs_table, m->funs_table);
 
-	check_fun_headers_and_type_bodies(ast, ctx,
-		m->structs_declaration_order, m->specs_declaration_order, m->funs_declaration_order,
-		m->structs_table, m->specs_table, m->funs_table);
+		if (!builtin_types.has())
+			builtin_types = BuiltinTypes { get_builtin_type(m->structs_table, ctx, BOOL), get_builtin_type(m->structs_table, ctx, STRING), get_builtin_type(m->structs_table, ctx, VOID) };
 
-	if (!builtin_types.has())
-		builtin_types = BuiltinTypes { get_builtin_type(m->structs_table, ctx, BOOL), get_builtin_type(m->structs_table, ctx, STRING), get_builtin_type(m->structs_table, ctx, VOID) };
+		check_fun_bodies(ast, ctx, builtin_types.get(), m->funs_declaration_order, m->structs_table, m->funs_table);
+	}
+}
+
+void check(Ref<Module> m, Option<BuiltinTypes>& builtin_types, const FileAst& ast, Arena& arena, IdentifierCache& identifiers, ListBuilder<Diagnostic>& diagnostics) {
+	check_worker(m, builtin_types, ast, arena, identifiers, diagnostics, /*reuse_declarations*/ false);
+}
 
-	check_fun_bodies(ast, ctx, builtin_types.get(), m->funs_declaration_order, m->structs_table, m->funs_table);
+void check_again(Ref<Module> m, Option<BuiltinTypes>& builtin_types, const FileAst& ast, Arena& arena, IdentifierCache& identifiers, ListBuilder<Diagnostic>& diagnostics) {
+	check_worker(m, builtin_types, ast, arena, identifiers, diagnostics, /*reuse_declarations*/ true);
+}
+
+BuiltinTypes get_builtin_types(const Module& m, IdentifierCache& identifiers) {
+	// No need to validate them again, since that was done when the module was checked.
+	auto get = [&](StringSlice type_name) {
+		return map_option<Type>()(m.structs_table.get(identifiers.get(type_name)), [](Ref<const StructDeclaration> strukt) {
+			return Option { Type::noborrow(StoredType { InstStruct { strukt, {} } }) };
+		});
+	};
+	return BuiltinTypes { get(BOOL), get(STRING), get(VOID) };
 }
@@ -7,4 +7,9 @@
 #include "../parse/ast.h"
 
 // builtin_types will be filled in for the first module checked.
-void check(Ref<Module> m, Option<BuiltinTypes>& builtlin_types, const FileAst& ast, Arena& arena, ListBuilder<Diagnostic>& diags);
+void check(Ref<Module> m, Option<BuiltinTypes>& builtlin_types, const FileAst& ast, Arena& arena, IdentifierCache& identifiers, ListBuilder<Diagnostic>& diags);
+// Like 'check', for a module that was already checked from an older version of its file.
+// If the file has as many declarations of each kind as before, they are overwritten in place, so other modules' references to them stay valid.
+void check_again(Ref<Module> m, Option<BuiltinTypes>& builtlin_types, const FileAst& ast, Arena& arena, IdentifierCache& identifiers, ListBuilder<Diagnostic>& diags);
+// For a module that was checked earlier, such as one loaded from its interface: the builtin types 'check' found in it.
+BuiltinTypes get_builtin_types(const Module& m, IdentifierCache& identifiers);
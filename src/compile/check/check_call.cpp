@@ -7,7 +7,7 @@
 
 namespace {
 	template <typename /*CalledDeclaration => void*/ Cb>
-	void each_fun_with_name(const ExprContext& ctx, const StringSlice& name, Cb cb) {
+	void each_fun_with_name(const ExprContext& ctx, Identifier name, Cb cb) {
 		ctx.funs_table.each_with_key(name, [&](Ref<const FunDeclaration> f) { cb(CalledDeclaration { f }); });
 		for (Ref<const Module> m : ctx.check_ctx.imports)
 			m->funs_table.each_with_key(name, [&](Ref<const FunDeclaration> f) {
@@ -62,7 +62,7 @@ namespace {
 	}
 
 	template <typename /*CalledDeclaration => void*/ Cb>
-	void each_initial_candidate(const ExprContext& ctx, const StringSlice& fun_name, Cb cb) {
+	void each_initial_candidate(const ExprContext& ctx, Identifier fun_name, Cb cb) {
 		for (const SpecUse& spec_use : ctx.current_fun->signature.specs)
 			for (const FunSignature& sig : spec_use.spec->signatures)
 				if (sig.name == fun_name)
@@ -70,7 +70,7 @@ namespace {
 		each_fun_with_name(ctx, fun_name, cb);
 	}
 
-	void get_initial_candidates(Candidates& candidates, ExprContext& ctx, const StringSlice& fun_name, const Slice<Type>& explicit_type_arguments, uint arity) {
+	void get_initial_candidates(Candidates& candidates, ExprContext& ctx, Identifier fun_name, const Slice<Type>& explicit_type_arguments, uint arity) {
 		each_initial_candidate(ctx, fun_name, [&](CalledDeclaration called) {
 			const FunSignature& sig = called.sig();
 			if (sig.arity() == arity && (explicit_type_arguments.is_empty() || sig.type_parameters.size() == explicit_type_arguments.size())) {
@@ -207,7 +207,7 @@ namespace {
 	// Special handling for unary calls because:
 	// a) May be a struct access
 	// b) We can be more efficient for overload resolution.
-	Option<StructFieldAccess> try_convert_struct_field_access(StringSlice fun_name, const ExpressionAndType& argument_and_type, ExprContext& ctx, Expected& expected) {
+	Option<StructFieldAccess> try_convert_struct_field_access(Identifier fun_name, const ExpressionAndType& argument_and_type, ExprContext& ctx, Expected& expected) {
 		const Type& arg_type = argument_and_type.type;
 		if (!arg_type.stored_type().is_inst_struct()) return {};
 
@@ -286,7 +286,10 @@ namespace {
 	}
 }
 
-ExpressionAndLifetime check_call(const StringSlice& fun_name, const Slice<ExprAst>& argument_asts, const Slice<TypeAst>& type_argument_asts, ExprContext& ctx, Expected& expected) {
+ExpressionAndLifetime check_call(Identifier fun_name, const Slice<ExprAst>& argument_asts, const Slice<TypeAst>& type_argument_asts, ExprContext& ctx, Expected& expected) {
+	// Candidates' inferred type arguments and argument lifetimes are only needed until we've chosen an overload.
+	ArenaScope scratch_scope { ctx.scratch_arena };
+
 	Slice<Type> explicit_type_arguments = type_arguments_from_asts(
 		type_argument_asts, ctx.check_ctx, ctx.structs_table, Option<const Slice<Parameter>&> { ctx.current_fun->signature.parameters }, ctx.current_fun->signature.type_parameters);
 	uint arity = argument_asts.size();
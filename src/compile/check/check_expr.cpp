@@ -8,10 +8,10 @@
 #include "./convert_type.h"
 
 namespace {
-	Option<Ref<const Parameter>> find_parameter(const ExprContext& ctx, StringSlice name) {
+	Option<Ref<const Parameter>> find_parameter(const ExprContext& ctx, Identifier name) {
 		return find(ctx.current_fun->signature.parameters, [&](const Parameter& p) { return p.name == name; });
 	}
-	Option<Ref<const Let>> find_local(const ExprContext& ctx, StringSlice name) {
+	Option<Ref<const Let>> find_local(const ExprContext& ctx, Identifier name) {
 		Option<Ref<const Ref<const Let>>> o = find(ctx.locals, [name](const Ref<const Let>& l) { return l->name == name; });
 		return o.has() ? Option<Ref<const Let>> { o.get() } : Option<Ref<const Let>> {};
 	}
@@ -55,7 +55,7 @@ namespace {
 	}
 
 	ExpressionAndLifetime check_struct_create(const StructCreateAst& create, ExprContext& ctx, Expected& expected) {
-		Option<const Ref<const StructDeclaration>&> struct_op = ctx.structs_table.get(create.struct_name);
+		Option<const Ref<const StructDeclaration>&> struct_op = ctx.structs_table.get(id(ctx.check_ctx, create.struct_name));
 		if (!struct_op.has()) {
 			ctx.check_ctx.diag(create.struct_name, Diag::Kind::StructNameNotFound);
 			return expected.bogus();
@@ -84,16 +84,16 @@ namespace {
 	}
 
 	ExpressionAndLifetime check_let(const LetAst& ast, ExprContext& ctx, Expected& expected) {
-		StringSlice name = ast.name;
-		check_param_or_local_shadows_fun(ctx.check_ctx, name, ctx.funs_table, ctx.current_fun->signature.specs);
+		Identifier name = id(ctx.check_ctx, ast.name);
+		check_param_or_local_shadows_fun(ctx.check_ctx, ast.name, name, ctx.funs_table, ctx.current_fun->signature.specs);
 		if (find_parameter(ctx, name).has())
-			ctx.check_ctx.diag(name, Diag::Kind::LocalShadowsParameter);
+			ctx.check_ctx.diag(ast.name, Diag::Kind::LocalShadowsParameter);
 		if (find_local(ctx, name).has())
-			ctx.check_ctx.diag(name, Diag::Kind::LocalShadowsLocal);
+			ctx.check_ctx.diag(ast.name, Diag::Kind::LocalShadowsLocal);
 
 		ExpressionAndType init = check_and_infer(*ast.init, ctx);
 		// We'll infer the lifetime in the lifetime checker, not here.
-		Ref<Let> let = ctx.check_ctx.arena.put(Let { init.type, Identifier { copy_string(ctx.check_ctx.arena, name) }, init.expression, {}, {} });
+		Ref<Let> let = ctx.check_ctx.arena.put(Let { init.type, name, init.expression, {}, {} });
 		ctx.locals.push(let);
 		ExpressionAndLifetime then = check_expr(*ast.then, ctx, expected);
 		let->then = then.expression;
@@ -109,7 +109,7 @@ namespace {
 
 	ExpressionAndLifetime check_seq(const SeqAst& ast, ExprContext& ctx, Expected& expected) {
 		if (!ctx.builtin_types.void_type.has()) {
-			ctx.check_ctx.diag(ast.range, Diag::Kind::MissingVoidType);
+			ctx.check_ctx.diag(ctx.check_ctx.range(ast.range), Diag::Kind::MissingVoidType);
 			return expected.bogus();
 		}
 		// Don't check lifetime because Void should be copy.
@@ -120,7 +120,7 @@ namespace {
 
 	ExpressionAndLifetime check_when(const WhenAst& ast, ExprContext& ctx, Expected& expected) {
 		if (!ctx.builtin_types.bool_type.has()) {
-			ctx.check_ctx.diag(ast.range, Diag::Kind::MissingBoolType);
+			ctx.check_ctx.diag(ctx.check_ctx.range(ast.range), Diag::Kind::MissingBoolType);
 			return expected.bogus();
 		}
 
@@ -138,13 +138,13 @@ namespace {
 
 	ExpressionAndLifetime check_assert(const AssertAst& ast, ExprContext& ctx, Expected& expected) {
 		if (!ctx.builtin_types.void_type.has()) {
-			ctx.check_ctx.diag(ast.range, Diag::Kind::MissingVoidType);
+			ctx.check_ctx.diag(ctx.check_ctx.range(ast.range), Diag::Kind::MissingVoidType);
 			return expected.bogus();
 		}
 		expected.check_no_infer(ctx.builtin_types.void_type.get().stored_type());
 
 		if (!ctx.builtin_types.bool_type.has()) {
-			ctx.check_ctx.diag(ast.range, Diag::Kind::MissingBoolType);
+			ctx.check_ctx.diag(ctx.check_ctx.range(ast.range), Diag::Kind::MissingBoolType);
 			return expected.bogus();
 		}
 		Ref<Expression> asserted = ctx.check_ctx.arena.put(check_and_expect_builtin_type(ast.asserted, ctx, ctx.builtin_types.bool_type.get()));
@@ -153,7 +153,7 @@ namespace {
 
 	ExpressionAndLifetime check_pass(const SourceRange& range, ExprContext& ctx, Expected& expected) {
 		if (!ctx.builtin_types.void_type.has()) {
-			ctx.check_ctx.diag(range, Diag::Kind::MissingVoidType);
+			ctx.check_ctx.diag(ctx.check_ctx.range(range), Diag::Kind::MissingVoidType);
 			return expected.bogus();
 		}
 		expected.check_no_infer(ctx.builtin_types.void_type.get().stored_type());
@@ -194,11 +194,12 @@ namespace {
 			b.push(ExprAst { copy_string(ctx.check_ctx.arena, literal.literal) }); // This is a NoCallLiteral
 			for (const ExprAst &arg : literal.arguments)
 				b.push(arg);
-			return check_call(LITERAL, to_arena(b, ctx.scratch_arena), literal.type_arguments, ctx, expected);
+			return check_call(id(ctx.check_ctx, LITERAL), to_arena(b, ctx.scratch_arena), literal.type_arguments, ctx, expected);
 		}
 	}
 
-	ExpressionAndLifetime check_identifier(const StringSlice& name, ExprContext& ctx, Expected& expected) {
+	ExpressionAndLifetime check_identifier(const StringSlice& name_slice, ExprContext& ctx, Expected& expected) {
+		Identifier name = id(ctx.check_ctx, name_slice);
 		Option<Ref<const Parameter>> param_op = find_parameter(ctx, name);
 		if (param_op.has()) {
 			Ref<const Parameter> param = param_op.get();
@@ -231,7 +232,7 @@ ExpressionAndLifetime check_expr(const ExprAst& ast, ExprContext& ctx, Expected&
 			return check_no_call_literal(ast.no_call_literal(), ctx, expected);
 		case ExprAst::Kind::Call: {
 			CallAst c = ast.call();
-			return check_call(c.fun_name, c.arguments, c.type_arguments, ctx, expected);
+			return check_call(id(ctx.check_ctx, c.fun_name), c.arguments, c.type_arguments, ctx, expected);
 		}
 		case ExprAst::Kind::StructCreate:
 			return check_struct_create(ast.struct_create(), ctx, expected);
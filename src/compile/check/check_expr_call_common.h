@@ -16,7 +16,7 @@ struct ExpressionAndLifetime {
 
 struct ExprContext {
 	CheckCtx& check_ctx;
-	Arena& scratch_arena; // cleared after every convert call.
+	Arena& scratch_arena; // Allocations made while checking a call are released when that call is done. See ArenaScope.
 	const FunsTable& funs_table;
 	const StructsTable& structs_table;
 	Ref<const FunDeclaration> current_fun;
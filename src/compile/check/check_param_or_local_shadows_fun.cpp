@@ -1,10 +1,10 @@
 #include "./check_param_or_local_shadows_fun.h"
 
-void check_param_or_local_shadows_fun(CheckCtx& al, const StringSlice& name, const FunsTable& funs_table, const Slice<SpecUse>& current_specs) {
+void check_param_or_local_shadows_fun(CheckCtx& al, const StringSlice& name_slice, Identifier name, const FunsTable& funs_table, const Slice<SpecUse>& current_specs) {
 	if (funs_table.has(name))
-		al.diag(name, Diag::Kind::LocalShadowsFun);
+		al.diag(name_slice, Diag::Kind::LocalShadowsFun);
 	for (const SpecUse& spec_use : current_specs)
 		for (const FunSignature& sig : spec_use.spec->signatures)
 			if (sig.name == name)
-				al.diag(name,Diag::Kind::LocalShadowsSpecSig);
+				al.diag(name_slice,Diag::Kind::LocalShadowsSpecSig);
 }
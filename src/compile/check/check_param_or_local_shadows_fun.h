@@ -3,4 +3,5 @@
 #include "./CheckCtx.h"
 
 // current_specs: the specs from the current function.
-void check_param_or_local_shadows_fun(CheckCtx& al, const StringSlice& name, const FunsTable& funs_table, const Slice<SpecUse>& current_specs);
+// 'name_slice' is the name in the source, for the diagnostic range.
+void check_param_or_local_shadows_fun(CheckCtx& al, const StringSlice& name_slice, Identifier name, const FunsTable& funs_table, const Slice<SpecUse>& current_specs);
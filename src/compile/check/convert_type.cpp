@@ -3,7 +3,7 @@
 #include "../../util/store/collection_util.h" // find_in_either
 
 namespace {
-	Option<Ref<const StructDeclaration>> find_struct(const StringSlice& name, CheckCtx& ctx, const StructsTable& structs_table) {
+	Option<Ref<const StructDeclaration>> find_struct(Identifier name, CheckCtx& ctx, const StructsTable& structs_table) {
 		Option<Ref<const StructDeclaration>> res = copy_inner(structs_table.get(name));
 		for (Ref<const Module> m : ctx.imports) {
 			Option<Ref<const StructDeclaration>> s = copy_inner(m->structs_table.get(name));
@@ -18,7 +18,8 @@ namespace {
 	}
 
 	StoredType type_from_type_parameter(const StringSlice& name, CheckCtx& ctx, const TypeParametersScope& type_parameters_scope) {
-		Option<Ref<const TypeParameter>> tp = find_in_either(type_parameters_scope.outer, type_parameters_scope.inner, [&](const TypeParameter& t) { return t.name == name; });
+		Identifier name_id = id(ctx, name);
+		Option<Ref<const TypeParameter>> tp = find_in_either(type_parameters_scope.outer, type_parameters_scope.inner, [&](const TypeParameter& t) { return t.name == name_id; });
 		if (!tp.has()) {
 			ctx.diag(name, Diag::Kind::TypeParameterNameNotFound);
 			return StoredType::bogus();
@@ -28,7 +29,7 @@ namespace {
 
 	StoredType type_from_struct(
 		const StringSlice& name, const Slice<TypeAst>& type_arguments, CheckCtx& ctx, const StructsTable& structs_table, Option<const Slice<Parameter>&> parameters, const TypeParametersScope& type_parameters_scope) {
-		Option<Ref<const StructDeclaration>> op_strukt = find_struct(name, ctx, structs_table);
+		Option<Ref<const StructDeclaration>> op_strukt = find_struct(id(ctx, name), ctx, structs_table);
 		if (!op_strukt.has()) {
 			ctx.diag(name, Diag::Kind::StructNameNotFound);
 			return StoredType::bogus();
@@ -48,12 +49,13 @@ namespace {
 		}
 	}
 
-	Lifetime lifetime_from_constraint(const LifetimeConstraintAst& ast, Option<const Slice<Parameter>&> parameters) {
+	Lifetime lifetime_from_constraint(const LifetimeConstraintAst& ast, CheckCtx& ctx, Option<const Slice<Parameter>&> parameters) {
 		switch (ast.kind) {
 			case LifetimeConstraintAst::Kind::ParameterName: {
 				if (!parameters.has())
 					todo(); // Diagnostic: Can't use parameter lifetime inside a struct
-				Option<Ref<const Parameter>> param = find(parameters.get(), [&](const Parameter& p) { return p.name == ast.name; });
+				Identifier name = id(ctx, ast.name);
+				Option<Ref<const Parameter>> param = find(parameters.get(), [&](const Parameter& p) { return p.name == name; });
 				if (!param.has())
 					todo(); // Diagnostic: no such parameter
 				return Lifetime::of_parameter(param.get()->index);
@@ -63,10 +65,10 @@ namespace {
 		}
 	}
 
-	Lifetime lifetime_from_constraints(const Slice<LifetimeConstraintAst>& constraints, Option<const Slice<Parameter>&> parameters) {
+	Lifetime lifetime_from_constraints(const Slice<LifetimeConstraintAst>& constraints, CheckCtx& ctx, Option<const Slice<Parameter>&> parameters) {
 		Lifetime::Builder b;
 		for (const LifetimeConstraintAst& constraint : constraints)
-			b.add(lifetime_from_constraint(constraint, parameters));
+			b.add(lifetime_from_constraint(constraint, ctx, parameters));
 		return b.finish();
 	}
 	//	Lifetime::from_ast(ast.lifetime_constraints, [&](const LifetimeConstraintAst& l_ast) { return lifetime_from_constraint(l_ast, parameters); })
@@ -75,7 +77,7 @@ namespace {
 Type type_from_ast(const TypeAst& ast, CheckCtx& ctx, const StructsTable& structs_table, Option<const Slice<Parameter>&> parameters, const TypeParametersScope& type_parameters_scope) {
 	return Type {
 		stored_type_from_ast(ast.stored, ctx, structs_table, parameters, type_parameters_scope),
-		lifetime_from_constraints(ast.lifetime_constraints, parameters)
+		lifetime_from_constraints(ast.lifetime_constraints, ctx, parameters)
 	};
 }
 
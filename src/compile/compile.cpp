@@ -1,118 +1,627 @@
 #include "./compile.h"
 
+#include <condition_variable> // std::condition_variable
+#include <mutex> // std::mutex, std::unique_lock
+#include <new> // placement new
+
+#include "../util/store/ArenaArrayBuilders.h"
+#include "../util/store/collection_util.h" // every, some
 #include "../util/store/ListBuilder.h"
 #include "../util/store/Map.h"
 #include "../util/store/Set.h"
+#include "../util/parallel.h"
 #include "./check/check.h"
+#include "./interface/interface.h"
 #include "./parse/parser.h"
 
 namespace {
-	template <typename Out>
-	struct map_or_fail_reverse {
-		template <uint elements_per_node, typename In, typename /*const In&, uninitialized T* => Out*/ Cb>
-		Option<Slice<Out>> operator()(Arena& arena, const BlockedList<elements_per_node, In>& inputs, Cb cb) {
-			Slice<Out> out = uninitialized_array<Out>(arena, inputs.size());
-			uint i = 0;
-			bool success = true;
-			inputs.each_reverse([&](const In& input) {
-				if (!success) return;
-				success = cb(input, &out[i]);
-				++i;
+	Slice<Path> resolve_imports(const FileAst& f, PathCache& paths, Arena& arena) {
+		return map<Path>()(arena, f.imports, [&](const ImportAst& i) {
+			Option<Path> op_dependency_path = resolve_import(f.path, i, paths);
+			if (!op_dependency_path.has()) todo(); // resolution failed
+			return op_dependency_path.get();
+		});
+	}
+
+	// A file to parse, filled in by whichever thread parses it.
+	struct ParseJob {
+		Path path;
+		Option<Ref<const FileAst>> ast;
+		Slice<Path> dependencies; // Resolved paths of ast.imports
+		List<ParseDiagnostic> diagnostics; // If not empty, 'ast' has only what parsed.
+		// Any other failure. Only rethrown if parsing on a single thread would have reached this file.
+		std::exception_ptr error;
+		// Links the pending jobs while parsing, then the files left to visit in parse_everything.
+		ParseJob* next;
+
+		inline explicit ParseJob(Path _path) : path{_path}, ast{}, dependencies{}, diagnostics{}, error{}, next{nullptr} {}
+	};
+
+	// Shared by every parsing thread. Only use with 'mutex' held.
+	struct ParseQueue {
+		std::mutex mutex;
+		std::condition_variable changed;
+		Arena arena;
+		Map<Path, Ref<ParseJob>, Path::hash> jobs; // Every file discovered so far.
+		ParseJob* pending;
+		uint n_in_progress;
+
+		ParseQueue() : mutex{}, changed{}, arena{}, jobs{arena}, pending{nullptr}, n_in_progress{0} {}
+		ParseQueue(const ParseQueue& other) = delete;
+		void operator=(const ParseQueue& other) = delete;
+		~ParseQueue() {
+			// The arena won't run destructors, and an exception_ptr keeps its exception alive.
+			jobs.each([](const Path& path __attribute__((unused)), const Ref<ParseJob>& job) {
+				job->~ParseJob();
 			});
-			if (success) {
-				assert(i == out.size());
-				return Option { out };
-			} else
-				return {};
+		}
+
+		void add(Path path) {
+			if (jobs.has(path))
+				return;
+			// Not 'arena.put', since that assigns to uninitialized memory.
+			Ref<ParseJob> job = new (arena.allocate_uninitialized<ParseJob>().ptr()) ParseJob { path };
+			jobs.must_insert(path, job);
+			job->next = pending;
+			pending = job.ptr();
 		}
 	};
 
-	Option<Path> resolve_import(Path from, const ImportAst& i, PathCache& paths) {
-		if (!i.n_parents.has()) todo(); // global import resolution
-		return paths.resolve(from, RelPath { i.n_parents.get(), i.path });
+	void parse_job(ParseJob& job, Arena& arena, DocumentProvider& document_provider, PathCache& paths) {
+		try {
+			Option<StringSlice> document = document_provider.try_get_document(job.path, NZ_EXTENSION, arena);
+			if (!document.has()) todo(); // Imported from a file that doesn't exist
+
+			Ref<FileAst> f = arena.put(FileAst { job.path, document.get() });
+			// Even with errors, follow the imports that parsed, so errors in those files are found in the same run.
+			job.diagnostics = parse_file_recovering(f, paths, arena);
+			job.dependencies = resolve_imports(f, paths, arena);
+			job.ast = Option<Ref<const FileAst>> { f };
+		} catch (...) {
+			job.error = std::current_exception();
+		}
 	}
 
-	BlockedList<4, FileAst> parse_everything(ListBuilder<Diagnostic>& diagnostics, Arena& diags_arena, Path first_path, Arena& ast_arena, DocumentProvider& document_provider, PathCache& path_cache) {
-		Arena temp;
-		BlockedList<4, FileAst> out;
-		MaxSizeVector<16, Path> to_parse;
-		to_parse.push(first_path);
-		Set<Path, Path::hash> enqued_set { 32, temp }; // Set of paths that are either already parsed, or in to_parse.
-		enqued_set.must_insert(first_path);
+	void parse_worker(ParseQueue& queue, Arena& arena, DocumentProvider& document_provider, PathCache& paths) {
+		std::unique_lock<std::mutex> lock { queue.mutex };
+		while (true) {
+			if (queue.pending == nullptr) {
+				if (queue.n_in_progress == 0)
+					return;
+				// Someone else's file may import more files.
+				queue.changed.wait(lock);
+				continue;
+			}
 
-		do {
-			Path path = to_parse.pop_and_return();
-			Option<StringSlice> document = document_provider.try_get_document(path, NZ_EXTENSION, ast_arena);
-			if (!document.has()) todo(); // Imported from a file that doesn't exist
+			ParseJob& job = *queue.pending;
+			queue.pending = job.next;
+			++queue.n_in_progress;
+			lock.unlock();
+			parse_job(job, arena, document_provider, paths);
+			lock.lock();
+			for (Path dependency : job.dependencies)
+				queue.add(dependency);
+			--queue.n_in_progress;
+			queue.changed.notify_all();
+		}
+	}
+}
 
-			try {
-				FileAst& f = out.push({ path, document.get() }, ast_arena);
-				parse_file(f, path_cache, ast_arena);
-			} catch (ParseDiagnostic diag) {
-				diagnostics.add({ path, diag }, diags_arena);
-				return {};
-			}
+Option<Path> resolve_import(Path from, const ImportAst& i, PathCache& paths) {
+	if (!i.n_parents.has()) return {}; // TODO: global import resolution
+	return paths.resolve(from, RelPath { i.n_parents.get(), i.path });
+}
 
-			for (const ImportAst& i : out.back().imports) {
-				Option<Path> op_dependency_path = resolve_import(path, i, path_cache);
-				if (!op_dependency_path.has()) todo(); // resolution failed
-				Path dependency_path = op_dependency_path.get();
+bool parse_everything(
+	ParsedProgram& out, ListBuilder<Diagnostic>& diagnostics, Arena& diags_arena, DocumentProvider& document_provider, PathCache& paths, Path first_path, uint n_threads
+) {
+	ParseQueue queue;
+	queue.add(first_path);
+	run_on_threads(n_threads, [&](uint thread_index) {
+		parse_worker(queue, out.thread_arenas[thread_index], document_provider, paths);
+	});
 
-				if (enqued_set.try_insert(dependency_path).was_added)
-					to_parse.push(dependency_path);
+	// Files were finished in whatever order the threads got to them.
+	// Visit them in the order a single thread would have parsed them (depth-first, last import first), so the output doesn't depend on timing.
+	TempArena temp;
+	Set<Path, Path::hash> enqued_set { temp }; // Set of paths that are either already visited, or in to_visit.
+	enqued_set.must_insert(first_path);
+	ParseJob* to_visit = queue.jobs.must_get(first_path).ptr();
+	to_visit->next = nullptr;
+
+	bool success = true;
+	do {
+		ParseJob& job = *to_visit;
+		to_visit = job.next;
+		if (job.error)
+			std::rethrow_exception(job.error);
+		for (const ParseDiagnostic& diag : job.diagnostics)
+			diagnostics.add({ job.path, diag }, diags_arena);
+		if (!job.diagnostics.is_empty())
+			success = false;
+		out.files.push(job.ast.get(), out.arena);
+		for (Path dependency_path : job.dependencies) {
+			if (enqued_set.try_insert(dependency_path).was_added) {
+				Ref<ParseJob> dependency = queue.jobs.must_get(dependency_path);
+				dependency->next = to_visit;
+				to_visit = dependency.ptr();
 			}
-		} while (!to_parse.is_empty());
+		}
+	} while (to_visit != nullptr);
+
+	return success;
+}
+
+namespace {
+	// A module to check. Indexes are into CompiledProgram::modules, which is in reverse parse order, so imports tend to come first.
+	struct CheckJob {
+		Ref<const FileAst> ast;
+		Ref<Module> module;
+		Slice<uint> imports; // Parallel to ast->imports
+		List<uint> dependents; // Modules importing this one
+		uint n_imports_left; // Not yet checked. Once this is 0, the module can be checked.
+		List<Diagnostic> diagnostics;
+		CheckJob* next; // Links the jobs that are ready to check
+	};
 
-		return out;
+	// Shared by every checking thread. Only use with 'mutex' held.
+	struct CheckQueue {
+		std::mutex mutex;
+		std::condition_variable changed;
+		CheckJob* ready;
+		uint n_in_progress;
+		bool failed; // Some thread threw, so the others should stop.
+
+		CheckQueue() : mutex{}, changed{}, ready{nullptr}, n_in_progress{0}, failed{false} {}
+
+		void add(CheckJob& job) {
+			job.next = ready;
+			ready = &job;
+		}
+	};
+
+	void add_ready_dependents(CheckQueue& queue, const CheckJob& job, Slice<CheckJob>& jobs) {
+		for (uint dependent : job.dependents) {
+			--jobs[dependent].n_imports_left;
+			if (jobs[dependent].n_imports_left == 0)
+				queue.add(jobs[dependent]);
+		}
 	}
 
-	using Compiled = Map<Path, Ref<const Module>, Path::hash>;
+	void check_job(CheckJob& job, const BuiltinTypes& builtin_types, Arena& arena, IdentifierCache& identifiers) {
+		// Copy so that 'check' doesn't write to the shared builtin types.
+		Option<BuiltinTypes> b { builtin_types };
+		ListBuilder<Diagnostic> diagnostics;
+		check(job.module, b, *job.ast, arena, identifiers, diagnostics);
+		job.diagnostics = diagnostics.finish();
+	}
 
-	Option<Slice<Ref<const Module>>> get_imports(
-		const Slice<ImportAst>& imports, Path cur_path, const Compiled& compiled, PathCache& paths, Arena& arena, ListBuilder<Diagnostic>& diagnostics
-	) {
-		return map_or_fail<Ref<const Module>>()(arena, imports, [&](const ImportAst& ast) {
-			Path p = resolve_import(cur_path, ast, paths).get(); // Should succeed because we already did this in parse_everything
-			Option<const Ref<const Module>&> m = compiled.get(p);
-			if (!m.has()) {
-				diagnostics.add({ cur_path, ast.range, Diag::Kind::CircularImport }, arena);
-				return Option<Ref<const Module>>{};
+	void check_worker(CheckQueue& queue, Slice<CheckJob>& jobs, const BuiltinTypes& builtin_types, Arena& arena, IdentifierCache& identifiers) {
+		std::unique_lock<std::mutex> lock { queue.mutex };
+		while (true) {
+			if (queue.failed)
+				return;
+			if (queue.ready == nullptr) {
+				// If nothing is in progress either, any modules left import a module that failed.
+				if (queue.n_in_progress == 0)
+					return;
+				queue.changed.wait(lock);
+				continue;
 			}
-			return Option { m.get() };
-		});
+
+			CheckJob& job = *queue.ready;
+			queue.ready = job.next;
+			++queue.n_in_progress;
+			lock.unlock();
+			try {
+				check_job(job, builtin_types, arena, identifiers);
+			} catch (...) {
+				// Wake the other threads so they can stop. run_on_threads will rethrow this.
+				lock.lock();
+				queue.failed = true;
+				--queue.n_in_progress;
+				queue.changed.notify_all();
+				throw;
+			}
+			lock.lock();
+			// Don't check modules that import one with errors.
+			if (job.diagnostics.is_empty())
+				add_ready_dependents(queue, job, jobs);
+			--queue.n_in_progress;
+			queue.changed.notify_all();
+		}
+	}
+
+	// Marks each module whose imports could all be checked before it.
+	// The ones left unmarked are part of a cycle, or import a module that is.
+	template <typename Job>
+	Slice<bool> find_checkable(const Slice<Job>& jobs, Arena& temp) {
+		Slice<bool> checkable = fill_array<bool>()(temp, jobs.size(), [](uint) { return false; });
+		Slice<uint> n_imports_left = fill_array<uint>()(temp, jobs.size(), [&](uint i) { return jobs[i].imports.size(); });
+		Slice<uint> stack = uninitialized_array<uint>(temp, jobs.size());
+		uint stack_size = 0;
+		for (uint i = 0; i != jobs.size(); ++i)
+			if (n_imports_left[i] == 0) {
+				stack[stack_size] = i;
+				++stack_size;
+			}
+		while (stack_size != 0) {
+			--stack_size;
+			uint i = stack[stack_size];
+			checkable[i] = true;
+			for (uint dependent : jobs[i].dependents) {
+				--n_imports_left[dependent];
+				if (n_imports_left[dependent] == 0) {
+					stack[stack_size] = dependent;
+					++stack_size;
+				}
+			}
+		}
+		return checkable;
+	}
+
+	struct CircularImport {
+		uint module;
+		uint import_index; // Index into the module's imports
+	};
+
+	// Every module that isn't checkable has an import that isn't checkable either.
+	// Following those from the first such module must come back around to some module, which is then part of a cycle.
+	template <typename Job>
+	CircularImport find_circular_import(const Slice<Job>& jobs, const Slice<bool>& checkable, Arena& temp) {
+		Slice<bool> visited = fill_array<bool>()(temp, jobs.size(), [](uint) { return false; });
+		Slice<uint> followed_import = uninitialized_array<uint>(temp, jobs.size());
+		uint i = 0;
+		while (checkable[i])
+			++i;
+		while (!visited[i]) {
+			visited[i] = true;
+			const Job& job = jobs[i];
+			uint import_index = 0;
+			while (checkable[job.imports[import_index]])
+				++import_index;
+			followed_import[i] = import_index;
+			i = job.imports[import_index];
+		}
+		return { i, followed_import[i] };
+	}
+
+	Diagnostic circular_import_diagnostic(const FileAst& ast, const CircularImport& c) {
+		return { ast.path, ast.imports[c.import_index].range, Diag::Kind::CircularImport };
+	}
+
+	// The text a compile reads is freed when it returns, so keep the text of each file with diagnostics for writing them.
+	template <typename File, typename Files>
+	void keep_diagnostic_sources(CompiledProgram& out, const Files& files) {
+		if (out.diagnostics.is_empty())
+			return;
+		TempArena temp;
+		Set<Path, Path::hash> paths { temp };
+		for (const Diagnostic& d : out.diagnostics)
+			paths.try_insert(d.path);
+		for (const File& f : files)
+			if (paths.has(f.path) && !out.diagnostic_sources.has(f.path))
+				out.diagnostic_sources.must_insert(f.path, copy_string(out.arena, f.source));
+	}
+}
+
+void write_diagnostics(Writer& out, const CompiledProgram& program) {
+	TempArena temp;
+	// One line index per file, however many diagnostics it has.
+	Map<Path, LineAndColumnGetter, Path::hash> line_and_column_getters { temp };
+	for (const Diagnostic& d : program.diagnostics) {
+		StringSlice source = program.diagnostic_sources.must_get(d.path);
+		Option<LineAndColumnGetter&> lc = line_and_column_getters.get(d.path);
+		if (!lc.has())
+			lc = Option<LineAndColumnGetter&> { line_and_column_getters.must_insert(d.path, LineAndColumnGetter::for_text(source, temp)).value };
+		d.write(out, source, lc.get());
+		out << Writer::nl;
 	}
 }
 
 const StringSlice NZ_EXTENSION = "nz";
 
 // Note: if there are any diagnostics, 'out' should not be used for anything other than printing them.
-void compile(CompiledProgram& out, DocumentProvider& document_provider, Path first_path) {
-	Arena ast_arena;
+void compile(CompiledProgram& out, DocumentProvider& document_provider, Path first_path, uint n_threads) {
+	ParsedProgram parsed;
 	ListBuilder<Diagnostic> diagnostics;
-	auto parsed = parse_everything(diagnostics, out.arena, first_path, ast_arena, document_provider, out.paths);
-	if (diagnostics.is_empty()) {
-		Arena temp;
-		Compiled compiled { 64, temp };
-		Option<BuiltinTypes> builtin_types;
-		// Go in reverse order -- if we ever see some dependency that's not compiled yet, it indicates a circular dependency.
-		Option<Slice<Module>> modules = map_or_fail_reverse<Module>()(out.arena, parsed, [&](const FileAst& ast, Ref<Module> m) {
-			Option<Slice<Ref<const Module>>> imports = get_imports(ast.imports, ast.path, compiled, out.paths, out.arena, diagnostics);
-			if (!imports.has()) {
-				assert(!diagnostics.is_empty());
-				return false;
+	if (parse_everything(parsed, diagnostics, out.arena, document_provider, out.paths, first_path, n_threads)) {
+		TempArena temp;
+		uint n_modules = parsed.files.size();
+		Slice<Module> modules = uninitialized_array<Module>(out.arena, n_modules);
+		Slice<CheckJob> jobs = uninitialized_array<CheckJob>(temp, n_modules);
+		Map<Path, uint, Path::hash> module_indices { temp };
+		uint parse_index = 0;
+		for (const FileAst& ast : parsed.files) {
+			uint i = n_modules - 1 - parse_index;
+			module_indices.must_insert(ast.path, i);
+			jobs[i] = CheckJob { &ast, &modules[i], {}, {}, 0, {}, nullptr };
+			++parse_index;
+		}
+
+		// Build the graph of imports. Modules can be set up now since we know where each one will be.
+		for (uint i = 0; i != n_modules; ++i) {
+			CheckJob& job = jobs[i];
+			const FileAst& ast = *job.ast;
+			// Should succeed because we already did this in parse_everything
+			job.imports = map<uint>()(temp, ast.imports, [&](const ImportAst& import) {
+				return module_indices.must_get(resolve_import(ast.path, import, out.paths).get());
+			});
+			job.n_imports_left = job.imports.size();
+			for (uint imported : job.imports)
+				jobs[imported].dependents.prepend(i, temp);
+			job.module->path = ast.path;
+			job.module->imports = map<Ref<const Module>>()(out.arena, job.imports, [&](uint imported) { return Ref<const Module> { &modules[imported] }; });
+			job.module->comment = ast.comment.has() ? Option { copy_string(out.arena, ast.comment.get()) } : Option<ArenaString> {};
+		}
+
+		Slice<bool> checkable = find_checkable(jobs, temp);
+		if (!every(checkable, [](bool b) { return b; })) {
+			CircularImport c = find_circular_import(jobs, checkable, temp);
+			diagnostics.add(circular_import_diagnostic(*jobs[c.module].ast, c), out.arena);
+		} else {
+			// The builtin types come from the first module without imports, so check it before any others.
+			uint first_index = 0;
+			while (!jobs[first_index].imports.is_empty())
+				++first_index;
+			CheckJob& first = jobs[first_index];
+			Option<BuiltinTypes> builtin_types;
+			ListBuilder<Diagnostic> first_diagnostics;
+			check(first.module, builtin_types, *first.ast, out.arena, out.identifiers, first_diagnostics);
+			first.diagnostics = first_diagnostics.finish();
+			out.builtin_types = builtin_types.get();
+
+			if (first.diagnostics.is_empty()) {
+				CheckQueue queue;
+				add_ready_dependents(queue, first, jobs);
+				for (CheckJob& job : jobs)
+					if (&job != &first && job.imports.is_empty())
+						queue.add(job);
+				run_on_threads(n_threads, [&](uint thread_index) {
+					check_worker(queue, jobs, out.builtin_types, out.thread_arenas[thread_index], out.identifiers);
+				});
+			}
+
+			// Report in module order, regardless of which thread finished first.
+			for (const CheckJob& job : jobs)
+				for (const Diagnostic& d : job.diagnostics)
+					diagnostics.add(d, out.arena);
+			if (diagnostics.is_empty())
+				out.modules = modules;
+		}
+	}
+	out.diagnostics = diagnostics.finish();
+	keep_diagnostic_sources<FileAst>(out, parsed.files);
+}
+
+namespace {
+	// A module for 'check_with_interfaces'. Either loaded from its interface, or parsed and checked.
+	struct InterfaceJob {
+		Path path;
+		StringSlice source;
+		hash_t source_hash;
+		// Only if it was written for the current source. Whether it's up to date also depends on the imports.
+		Option<StringSlice> interface;
+		Option<InterfaceHeader> header;
+		Option<Ref<const FileAst>> ast; // Only parsed if it has no interface, or it turns out to be out of date.
+		Slice<Path> import_paths;
+		Slice<uint> imports; // Indexes are into CompiledProgram::modules, same as for CheckJob.
+		List<uint> dependents;
+		uint n_imports_left;
+		hash_t interface_hash; // Once loaded or checked
+		List<Diagnostic> diagnostics;
+		InterfaceJob* next; // Links the files left to visit while discovering them
+	};
+
+	// On errors, the AST has whatever parsed.
+	List<ParseDiagnostic> parse_interface_job(InterfaceJob& job, PathCache& paths, Arena& arena) {
+		Ref<FileAst> f = arena.put(FileAst { job.path, job.source });
+		List<ParseDiagnostic> diagnostics = parse_file_recovering(f, paths, arena);
+		job.ast = Option<Ref<const FileAst>> { f };
+		return diagnostics;
+	}
+
+	// For a job loaded from its interface, which parsed when that was written.
+	void parse_interface_job_again(InterfaceJob& job, PathCache& paths, Arena& arena) {
+		List<ParseDiagnostic> diagnostics = parse_interface_job(job, paths, arena);
+		assert(diagnostics.is_empty());
+	}
+
+	// Discovers files in the same order as 'parse_everything', so the modules are in the same order as from 'compile'.
+	// Returns the jobs in module order.
+	// Like 'parse_everything', on parse errors or bad imports this adds a diagnostic for each (from every file). Then the jobs can't be checked.
+	Slice<InterfaceJob> discover_interface_jobs(
+		ListBuilder<Diagnostic>& diagnostics, CompiledProgram& out, DocumentProvider& document_provider, InterfaceStore& interfaces, Path first_path, Arena& temp
+	) {
+		Map<Path, Ref<InterfaceJob>, Path::hash> jobs_by_path { temp };
+		ListBuilder<Ref<InterfaceJob>> parse_order;
+		auto add = [&](Path path) -> InterfaceJob* {
+			Ref<InterfaceJob> job = temp.put(InterfaceJob { path, {}, 0, {}, {}, {}, {}, {}, {}, 0, 0, {}, nullptr });
+			jobs_by_path.must_insert(path, job);
+			return job.ptr();
+		};
+		InterfaceJob* to_visit = add(first_path);
+		Set<Path, Path::hash> missing { temp };
+
+		do {
+			InterfaceJob& job = *to_visit;
+			to_visit = job.next;
+			parse_order.add(&job, temp);
+
+			Option<StringSlice> document = document_provider.try_get_document(job.path, NZ_EXTENSION, temp);
+			if (!document.has()) {
+				if (job.path == first_path) todo(); // The file to check doesn't exist
+				// Each import of it gets a diagnostic once every file is discovered.
+				missing.must_insert(job.path);
+				continue;
+			}
+			job.source = document.get();
+			job.source_hash = hash_source(job.source);
+
+			Option<StringSlice> interface = interfaces.try_get_interface(job.path);
+			Option<InterfaceHeader> header = interface.has() ? read_interface_header(interface.get(), out.paths, temp) : Option<InterfaceHeader> {};
+			if (header.has() && header.get().source_hash == job.source_hash) {
+				job.interface = interface;
+				job.header = header;
+				job.import_paths = header.get().imports;
 			}
-			m->path = ast.path;
-			m->imports = imports.get();
-			m->comment = ast.comment.has() ? Option { copy_string(out.arena, ast.comment.get()) } : Option<ArenaString> {};
-			check(m, builtin_types, ast, out.arena, diagnostics);
-			if (!diagnostics.is_empty())
+
+			if (!job.header.has()) {
+				// Even with errors, follow the imports that parsed, so errors in those files are found in the same run.
+				for (const ParseDiagnostic& diag : parse_interface_job(job, out.paths, temp))
+					diagnostics.add({ job.path, diag }, out.arena);
+				job.import_paths = map_op<Path>()(temp, job.ast.get()->imports, [&](const ImportAst& i) {
+					Option<Path> import_path = resolve_import(job.path, i, out.paths);
+					if (!import_path.has())
+						diagnostics.add({ job.path, i.range, Diag::Kind::ImportNotResolved }, out.arena);
+					return import_path;
+				});
+			}
+
+			for (Path dependency_path : job.import_paths) {
+				if (!jobs_by_path.has(dependency_path)) {
+					InterfaceJob* dependency = add(dependency_path);
+					dependency->next = to_visit;
+					to_visit = dependency;
+				}
+			}
+		} while (to_visit != nullptr);
+
+		List<Ref<InterfaceJob>> order = parse_order.finish();
+		for (Ref<InterfaceJob> job : order) {
+			if (missing.has(job->path) || !some(job->import_paths, [&](const Path& p) { return missing.has(p); }))
+				continue;
+			// Loaded from its interface, so there are no import ranges yet.
+			if (!job->ast.has())
+				parse_interface_job_again(job, out.paths, temp);
+			for (const ImportAst& i : job->ast.get()->imports) {
+				Option<Path> import_path = resolve_import(job->path, i, out.paths);
+				if (import_path.has() && missing.has(import_path.get()))
+					diagnostics.add({ job->path, i.range, Diag::Kind::ImportedModuleNotFound }, out.arena);
+			}
+		}
+		uint n_modules = jobs_by_path.size();
+		Slice<InterfaceJob> jobs = uninitialized_array<InterfaceJob>(temp, n_modules);
+		uint parse_index = 0;
+		for (Ref<InterfaceJob> job : order) {
+			jobs[n_modules - 1 - parse_index] = *job;
+			++parse_index;
+		}
+		return jobs;
+	}
+
+	bool imports_unchanged(const InterfaceJob& job, const Slice<InterfaceJob>& jobs) {
+		const Slice<hash_t>& recorded = job.header.get().import_interface_hashes;
+		for (uint i = 0; i != job.imports.size(); ++i)
+			if (jobs[job.imports[i]].interface_hash != recorded[i])
 				return false;
-			compiled.must_insert(m->path, m);
+		return true;
+	}
+
+	// Returns whether the module was loaded from its interface.
+	bool load_or_check(
+		InterfaceJob& job, Ref<Module> module, bool may_load, const Slice<InterfaceJob>& jobs, Option<BuiltinTypes>& builtin_types,
+		CompiledProgram& out, InterfaceStore& interfaces, Arena& temp
+	) {
+		if (may_load && job.header.has() && imports_unchanged(job, jobs)) {
+			read_interface(job.interface.get(), module, out.identifiers, out.arena);
+			job.interface_hash = job.header.get().interface_hash;
+			if (!builtin_types.has())
+				builtin_types = get_builtin_types(module, out.identifiers);
 			return true;
-		});
-		if (modules.has())
-			out.modules = modules.get();
-		out.builtin_types = builtin_types.get();
+		}
+
+		if (!job.ast.has())
+			parse_interface_job_again(job, out.paths, temp);
+		const FileAst& ast = job.ast.get();
+		module->comment = ast.comment.has() ? Option { copy_string(out.arena, ast.comment.get()) } : Option<ArenaString> {};
+		ListBuilder<Diagnostic> diagnostics;
+		check(module, builtin_types, ast, out.arena, out.identifiers, diagnostics);
+		job.diagnostics = diagnostics.finish();
+		if (job.diagnostics.is_empty()) {
+			Slice<hash_t> import_interface_hashes = map<hash_t>()(temp, job.imports, [&](uint imported) { return jobs[imported].interface_hash; });
+			Writer::Output interface = write_interface(module, job.source_hash, import_interface_hashes, job.interface_hash, temp);
+			// If only the imports' function bodies changed, the interface stays the same.
+			if (!job.header.has() || job.header.get().interface_hash != job.interface_hash)
+				interfaces.set_interface(job.path, interface);
+		}
+		return false;
+	}
+}
+
+uint check_with_interfaces(CompiledProgram& out, DocumentProvider& document_provider, InterfaceStore& interfaces, Path first_path) {
+	TempArena temp;
+	ListBuilder<Diagnostic> diagnostics;
+	uint n_loaded = 0;
+	Slice<InterfaceJob> jobs = discover_interface_jobs(diagnostics, out, document_provider, interfaces, first_path, temp);
+	if (diagnostics.is_empty()) {
+		uint n_modules = jobs.size();
+		Slice<Module> modules = uninitialized_array<Module>(out.arena, n_modules);
+		Map<Path, uint, Path::hash> module_indices { temp };
+		for (uint i = 0; i != n_modules; ++i)
+			module_indices.must_insert(jobs[i].path, i);
+
+		for (uint i = 0; i != n_modules; ++i) {
+			InterfaceJob& job = jobs[i];
+			job.imports = map<uint>()(temp, job.import_paths, [&](const Path& p) { return module_indices.must_get(p); });
+			job.n_imports_left = job.imports.size();
+			for (uint imported : job.imports)
+				jobs[imported].dependents.prepend(i, temp);
+			modules[i].path = job.path;
+			modules[i].imports = map<Ref<const Module>>()(out.arena, job.imports, [&](uint imported) { return Ref<const Module> { &modules[imported] }; });
+		}
+
+		Slice<bool> checkable = find_checkable(jobs, temp);
+		if (!every(checkable, [](bool b) { return b; })) {
+			CircularImport c = find_circular_import(jobs, checkable, temp);
+			InterfaceJob& job = jobs[c.module];
+			if (!job.ast.has())
+				parse_interface_job_again(job, out.paths, temp);
+			diagnostics.add(circular_import_diagnostic(job.ast.get(), c), out.arena);
+		} else {
+			// Like in 'compile', the builtin types come from the first module without imports, so do it first.
+			uint first_index = 0;
+			while (!jobs[first_index].imports.is_empty())
+				++first_index;
+			Slice<uint> ready = uninitialized_array<uint>(temp, n_modules);
+			uint n_ready = 0;
+			for (uint i = 0; i != n_modules; ++i)
+				if (i != first_index && jobs[i].imports.is_empty()) {
+					ready[n_ready] = i;
+					++n_ready;
+				}
+			ready[n_ready] = first_index;
+			++n_ready;
+
+			Option<BuiltinTypes> builtin_types;
+			while (n_ready != 0) {
+				--n_ready;
+				uint i = ready[n_ready];
+				InterfaceJob& job = jobs[i];
+				// Always check the first module, since that's what was asked for.
+				bool may_load = i != n_modules - 1;
+				if (load_or_check(job, &modules[i], may_load, jobs, builtin_types, out, interfaces, temp))
+					++n_loaded;
+				// Don't check modules that import one with errors.
+				if (job.diagnostics.is_empty())
+					for (uint dependent : job.dependents) {
+						--jobs[dependent].n_imports_left;
+						if (jobs[dependent].n_imports_left == 0) {
+							ready[n_ready] = dependent;
+							++n_ready;
+						}
+					}
+			}
+			out.builtin_types = builtin_types.get();
+
+			for (const InterfaceJob& job : jobs)
+				for (const Diagnostic& d : job.diagnostics)
+					diagnostics.add(d, out.arena);
+			if (diagnostics.is_empty())
+				out.modules = modules;
+		}
 	}
 	out.diagnostics = diagnostics.finish();
+	keep_diagnostic_sources<InterfaceJob>(out, jobs);
+	return n_loaded;
 }
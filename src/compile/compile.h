@@ -1,20 +1,58 @@
 #pragma once
 
+#include "../util/store/BlockedList.h"
 #include "../util/store/List.h"
+#include "../util/store/ListBuilder.h"
+#include "../util/store/Map.h"
+#include "../util/parallel.h"
 #include "../util/PathCache.h"
 #include "../host/DocumentProvider.h"
+#include "../host/InterfaceStore.h"
 #include "./diag/diag.h"
 #include "./model/BuiltinTypes.h"
 #include "./model/model.h"
+#include "./parse/ast.h"
 
 struct CompiledProgram {
 	Arena arena;
+	// Each checking thread allocates the contents of the modules it checks in its own arena.
+	Arena thread_arenas[MAX_THREADS];
 	PathCache paths;
+	IdentifierCache identifiers;
 	Slice<Module> modules;
 	List<Diagnostic> diagnostics;
+	// The text of each file with diagnostics, as the compile read it.
+	Map<Path, StringSlice, Path::hash> diagnostic_sources { arena };
 	BuiltinTypes builtin_types;
 };
 
+struct ParsedProgram {
+	TempArena arena;
+	// Each parsing thread allocates ASTs in its own arena.
+	TempArena thread_arenas[MAX_THREADS];
+	// In the order they would be parsed by a single thread, so dependencies come after the files that import them.
+	// If 'parse_everything' fails, files with diagnostics have only what parsed.
+	BlockedList<4, FileAst> files;
+};
+
 extern const StringSlice NZ_EXTENSION;
 
-void compile(CompiledProgram& out, DocumentProvider& document_provider, Path first_path);
+// Returns None if the import can't be resolved. (Global imports never can yet.)
+Option<Path> resolve_import(Path from, const ImportAst& i, PathCache& paths);
+
+// Parses 'first_path' and everything it imports, using up to 'n_threads' threads.
+// On parse errors, adds a diagnostic for each (from every file, not just the first bad one) and returns false.
+bool parse_everything(
+	ParsedProgram& out, ListBuilder<Diagnostic>& diagnostics, Arena& diags_arena, DocumentProvider& document_provider, PathCache& paths, Path first_path, uint n_threads);
+
+// 'n_threads' is at most MAX_THREADS. The result is the same for any number of threads.
+void compile(CompiledProgram& out, DocumentProvider& document_provider, Path first_path, uint n_threads);
+
+// Like 'compile', but only checks, and doesn't parse or check an imported module if it has an up-to-date interface in 'interfaces'.
+// Writes the interface of every module it does check.
+// Modules loaded from an interface have no function bodies, so the result can't be emitted.
+// Returns how many modules were loaded from interfaces.
+uint check_with_interfaces(CompiledProgram& out, DocumentProvider& document_provider, InterfaceStore& interfaces, Path first_path);
+
+// Writes each of the program's diagnostics on its own line, with the file and position.
+void write_diagnostics(Writer& out, const CompiledProgram& program);
@@ -1,5 +1,6 @@
 #include "./LineAndColumnGetter.h"
 #include "../../util/store/ArenaArrayBuilders.h"
+#include "../parse/scan.h"
 
 namespace {
 	uint mid(uint a, uint b) {
@@ -8,34 +9,47 @@ namespace {
 }
 
 LineAndColumnGetter LineAndColumnGetter::for_text(const StringSlice& text, Arena& arena) {
-	MaxSizeVector<1024, uint> lines;
-	lines.push(0); // Line 0 starts at text index 0
-	uint i = 0;
-	for (char c : text) {
-		if (c == '\n')
-			lines.push(i + 1);
-		++i;
+	// Counting first means the index is allocated once, at its final size, however long the file is.
+	Slice<uint> line_to_pos = uninitialized_array<uint>(arena, scan::count_newlines(text.begin(), text.end()) + 1);
+	line_to_pos[0] = 0; // Line 0 starts at text index 0
+	uint line = 1;
+	for (const char* nl = scan::find_newline(text.begin(), text.end()); nl != text.end(); nl = scan::find_newline(nl + 1, text.end())) {
+		line_to_pos[line] = to_unsigned(nl + 1 - text.begin());
+		++line;
 	}
-	return LineAndColumnGetter { to_arena(lines, arena) };
+	assert(line == line_to_pos.size());
+	return LineAndColumnGetter { line_to_pos };
 }
 
-LineAndColumn LineAndColumnGetter::line_and_column_at_pos(uint pos) const {
-	uint low_line = 0; // inclusive
-	uint high_line = line_to_pos.size(); // exclusive
-
-	while (low_line < high_line - 1) {
-		uint middle_line = mid(low_line, high_line);
-		uint middle_pos = line_to_pos[middle_line];
-		if (pos == middle_pos)
-			return { middle_line, 0 };
-		else if (pos < middle_pos)
-			high_line = middle_line;
+uint LineAndColumnGetter::line_in(uint pos, uint low, uint high) const {
+	assert(line_to_pos[low] <= pos);
+	while (low < high - 1) {
+		uint middle_line = mid(low, high);
+		if (line_to_pos[middle_line] <= pos)
+			low = middle_line;
 		else
-			low_line = middle_line;
+			high = middle_line;
 	}
+	return low;
+}
 
-	uint line = low_line;
-	uint line_start = line_to_pos[line];
-	assert((pos >= line_start && line == line_to_pos.size() - 1) ||  pos <= line_to_pos[line + 1]);
-	return { line, pos - line_start };
+LineAndColumn LineAndColumnGetter::line_and_column_at_pos(uint pos) const {
+	uint line = line_in(pos, 0, line_to_pos.size());
+	return { line, pos - line_to_pos[line] };
+}
+
+LineAndColumn LineAndColumnGetter::Cursor::at(uint pos) {
+	const Slice<uint>& line_to_pos = getter.line_to_pos;
+	if (pos < line_to_pos[line])
+		line = 0;
+	// Gallop forward to a line past 'pos', then search between.
+	uint low = line;
+	uint step = 1;
+	while (low + step < line_to_pos.size() && line_to_pos[low + step] <= pos) {
+		low += step;
+		step *= 2;
+	}
+	uint high = low + step < line_to_pos.size() ? low + step : line_to_pos.size();
+	line = getter.line_in(pos, low, high);
+	return { line, pos - line_to_pos[line] };
 }
@@ -11,7 +11,22 @@ class LineAndColumnGetter {
 	Slice<uint> line_to_pos; // Maps line to source index of its first character
 	inline LineAndColumnGetter(Slice<uint> _line_to_pos) : line_to_pos(_line_to_pos) {}
 
+	// The last line in [low, high) that starts at or before 'pos'. 'low' must start at or before it.
+	uint line_in(uint pos, uint low, uint high) const;
+
 public:
+	// Looks up positions in order. Each lookup searches forward from the line of the one before,
+	// so a sorted batch of positions (such as a file's diagnostics) costs about O(positions + lines) in all.
+	// Positions out of order still work, but start over from the first line.
+	class Cursor {
+		const LineAndColumnGetter& getter;
+		uint line;
+
+	public:
+		inline explicit Cursor(const LineAndColumnGetter& _getter) : getter{_getter}, line{0} {}
+		LineAndColumn at(uint pos);
+	};
+
 	static LineAndColumnGetter for_text(const StringSlice& text, Arena& arena);
 	LineAndColumn line_and_column_at_pos(uint pos) const;
 };
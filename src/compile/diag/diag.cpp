@@ -6,8 +6,9 @@ namespace {
 	}
 
 	StringSlice slice_from_range(const StringSlice& slice, const SourceRange& range) {
-		assert(range.end < slice.size());
-		return { slice.begin() + range.begin, slice.begin() + range.end };
+		// A diagnostic at the end of the file covers its '\0'.
+		assert(range.end <= slice.size());
+		return range.begin == range.end ? StringSlice {} : StringSlice { slice.begin() + range.begin, slice.begin() + range.end };
 	}
 }
 
@@ -27,6 +28,8 @@ void Diag::operator=(const Diag& other) {
 			data.wrong_number = other.data.wrong_number;
 			break;
 		case Kind::CircularImport:
+		case Kind::ImportNotResolved:
+		case Kind::ImportedModuleNotFound:
 		case Kind::SpecNameNotFound:
 		case Kind::StructNameNotFound:
 		case Kind::TypeParameterNameNotFound:
@@ -54,6 +57,8 @@ Diag::Diag(Kind kind) : _kind(kind) {
 			unreachable();
 
 		case Kind::CircularImport:
+		case Kind::ImportNotResolved:
+		case Kind::ImportedModuleNotFound:
 		case Kind::SpecNameNotFound:
 		case Kind::StructNameNotFound:
 		case Kind::TypeParameterNameNotFound:
@@ -86,6 +91,12 @@ void Diag::write(Writer& out, const StringSlice& slice) const {
 		case Kind::CircularImport:
 			out << "Import of '" << slice << "' is circular";
 			break;
+		case Kind::ImportNotResolved:
+			out << "Could not resolve import of '" << slice << "'";
+			break;
+		case Kind::ImportedModuleNotFound:
+			out << "Could not find a module for import of '" << slice << "'";
+			break;
 		case Kind::SpecNameNotFound:
 			out << "Could not find a spec named '" << slice << "'";
 			break;
@@ -145,5 +156,9 @@ void Diag::write(Writer& out, const StringSlice& slice) const {
 
 void Diagnostic::write(Writer& out, const StringSlice& module_source, const LineAndColumnGetter& lc) const {
 	out << this->path << ' ' << lc.line_and_column_at_pos(range.begin) << '-' << lc.line_and_column_at_pos(range.end) << ": ";
+	write_message(out, module_source);
+}
+
+void Diagnostic::write_message(Writer& out, const StringSlice& module_source) const {
 	diag.write(out, slice_from_range(module_source, range));
 }
@@ -16,6 +16,8 @@ public:
 		Parse,
 
 		CircularImport,
+		ImportNotResolved,
+		ImportedModuleNotFound,
 
 		// Top-level diags
 		StructNameNotFound,
@@ -69,4 +71,6 @@ struct Diagnostic {
 	inline Diagnostic(Path _path, ParseDiagnostic p) : path{_path}, range{p.range}, diag{p.diag} {}
 
 	void write(Writer& out, const StringSlice& source, const LineAndColumnGetter& lc) const;
+	// Without the path and position.
+	void write_message(Writer& out, const StringSlice& source) const;
 };
@@ -0,0 +1,538 @@
+#include "./interface.h"
+
+#include <algorithm> // std::equal
+
+#include "../../util/store/ArenaArrayBuilders.h"
+#include "../../util/store/MultiMap.h"
+#include "../check/convert_type.h" // TypeParametersScope
+
+namespace {
+	// The last byte is the version of the format. Change it whenever the format changes.
+	const char MAGIC[] = { 'n', 'z', 'i', '\x02' };
+	const uint HEADER_SIZE = sizeof(MAGIC) + 3 * sizeof(hash_t);
+
+	// FNV-1a. StringSlice::hash is too weak for this, since a collision means silently using a stale interface.
+	const hash_t HASH_START = 0xcbf29ce484222325ul;
+	inline hash_t hash_byte(hash_t h, char c) {
+		return (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ul;
+	}
+
+	hash_t hash_bytes(const char* begin, const char* end) {
+		hash_t h = HASH_START;
+		for (const char* c = begin; c != end; ++c)
+			h = hash_byte(h, *c);
+		return h;
+	}
+
+	enum class TypeTag : char { Bogus, InstStruct, InnerTypeParameter, OuterTypeParameter };
+	enum class StructBodyTag : char { Fields, CppName };
+
+	class InterfaceWriter {
+		Writer out;
+		hash_t _hash;
+		hash_t _checksum;
+		bool hashing;
+
+	public:
+		explicit InterfaceWriter(Arena& arena) : out{arena}, _hash{HASH_START}, _checksum{HASH_START}, hashing{true} {}
+
+		Writer::Output finish() { return out.finish(); }
+		// Hash of everything written so far, except what was written in 'not_hashed'.
+		hash_t hash() const { return _hash; }
+		// Hash of everything written so far.
+		hash_t checksum() const { return _checksum; }
+
+		// For what importers don't depend on, so changing it doesn't change the hash.
+		template <typename /*() => void*/ Cb>
+		void not_hashed(Cb cb) {
+			assert(hashing);
+			hashing = false;
+			cb();
+			hashing = true;
+		}
+
+		void byte(char c) {
+			out << c;
+			_checksum = hash_byte(_checksum, c);
+			if (hashing)
+				_hash = hash_byte(_hash, c);
+		}
+		void bytes(const StringSlice& s) {
+			for (char c : s)
+				byte(c);
+		}
+		void boolean(bool b) {
+			byte(b ? '\1' : '\0');
+		}
+		// Little-endian base 128, so small numbers take a single byte.
+		void nat(uint u) {
+			while (u >= 0x80) {
+				byte(static_cast<char>((u & 0x7f) | 0x80));
+				u >>= 7;
+			}
+			byte(static_cast<char>(u));
+		}
+		void u64(hash_t h) {
+			for (uint i = 0; i != sizeof(hash_t); ++i)
+				byte(static_cast<char>(h >> (8 * i)));
+		}
+		void str(const StringSlice& s) {
+			nat(s.size());
+			bytes(s);
+		}
+	};
+
+	class InterfaceReader {
+		const char* pos;
+		const char* end;
+
+	public:
+		InterfaceReader(const char* _pos, const char* _end) : pos{_pos}, end{_end} {}
+
+		bool at_end() const { return pos == end; }
+
+		char byte() {
+			assert(pos != end);
+			char c = *pos;
+			++pos;
+			return c;
+		}
+		bool boolean() {
+			return byte() != '\0';
+		}
+		uint nat() {
+			uint u = 0;
+			for (uint shift = 0; ; shift += 7) {
+				assert(shift < 32);
+				unsigned char c = static_cast<unsigned char>(byte());
+				u |= uint(c & 0x7f) << shift;
+				if (c < 0x80)
+					return u;
+			}
+		}
+		hash_t u64() {
+			hash_t h = 0;
+			for (uint i = 0; i != sizeof(hash_t); ++i)
+				h |= hash_t(static_cast<unsigned char>(byte())) << (8 * i);
+			return h;
+		}
+		StringSlice str() {
+			uint size = nat();
+			assert(size <= to_unsigned(end - pos));
+			StringSlice s { pos, pos + size };
+			pos += size;
+			return s;
+		}
+	};
+
+	uint path_depth(const Path& path) {
+		return path.parent().has() ? 1 + path_depth(path.parent().get()) : 1;
+	}
+
+	void write_path_parts(InterfaceWriter& out, const Path& path) {
+		if (path.parent().has())
+			write_path_parts(out, path.parent().get());
+		out.str(path.base_name());
+	}
+
+	void write_path(InterfaceWriter& out, const Path& path) {
+		out.nat(path_depth(path));
+		write_path_parts(out, path);
+	}
+
+	Path read_path(InterfaceReader& in, PathCache& paths) {
+		uint depth = in.nat();
+		assert(depth != 0);
+		Option<Path> path;
+		for (uint i = 0; i != depth; ++i)
+			path = Option<Path> { paths.resolve(path, in.str()) };
+		return path.get();
+	}
+
+	void skip_path(InterfaceReader& in) {
+		uint depth = in.nat();
+		for (uint i = 0; i != depth; ++i)
+			in.str();
+	}
+
+	struct WriteCtx {
+		InterfaceWriter& out;
+		const Module& module;
+	};
+
+	template <typename T>
+	uint index_of(const Slice<T>& slice, Ref<const T> t) {
+		assert(slice.contains_ref(t));
+		return to_unsigned(t.ptr() - slice.begin());
+	}
+
+	// 0 for the module itself, else 1 + the index of the import.
+	void write_module_ref(WriteCtx& ctx, Ref<const Module> m) {
+		if (m.ptr() == &ctx.module) {
+			ctx.out.nat(0);
+			return;
+		}
+		for (uint i = 0; i != ctx.module.imports.size(); ++i)
+			if (ctx.module.imports[i].ptr() == m.ptr()) {
+				ctx.out.nat(1 + i);
+				return;
+			}
+		todo(); // Declarations can only refer to what's in scope, which is this module and its imports.
+	}
+
+	// Ranges and comments only matter to this module's own diagnostics and documentation.
+	// So moving a declaration or editing its comment doesn't make importers check again.
+	void write_range(WriteCtx& ctx, const SourceRange& range) {
+		ctx.out.not_hashed([&]() {
+			ctx.out.nat(range.begin);
+			ctx.out.nat(range.end);
+		});
+	}
+
+	void write_comment(WriteCtx& ctx, const Option<ArenaString>& comment) {
+		ctx.out.not_hashed([&]() {
+			ctx.out.boolean(comment.has());
+			if (comment.has())
+				ctx.out.str(comment.get());
+		});
+	}
+
+	void write_type_parameters(WriteCtx& ctx, const Slice<TypeParameter>& type_parameters) {
+		ctx.out.nat(type_parameters.size());
+		for (const TypeParameter& p : type_parameters) {
+			write_range(ctx, p.range);
+			ctx.out.str(p.name.str());
+		}
+	}
+
+	void write_types(WriteCtx& ctx, const Slice<Type>& types, const TypeParametersScope& scope);
+
+	void write_type(WriteCtx& ctx, const Type& type, const TypeParametersScope& scope) {
+		const StoredType& stored = type.stored_type_or_bogus();
+		switch (stored.kind()) {
+			case StoredType::Kind::Nil:
+				unreachable();
+			case StoredType::Kind::Bogus:
+				ctx.out.byte(static_cast<char>(TypeTag::Bogus));
+				break;
+			case StoredType::Kind::InstStruct: {
+				const InstStruct& i = stored.inst_struct();
+				ctx.out.byte(static_cast<char>(TypeTag::InstStruct));
+				write_module_ref(ctx, i.strukt->containing_module);
+				ctx.out.nat(index_of(i.strukt->containing_module->structs_declaration_order, i.strukt));
+				write_types(ctx, i.type_arguments, scope);
+				break;
+			}
+			case StoredType::Kind::TypeParameter: {
+				Ref<const TypeParameter> p = stored.param();
+				if (scope.inner.contains_ref(p))
+					ctx.out.byte(static_cast<char>(TypeTag::InnerTypeParameter));
+				else {
+					assert(scope.outer.contains_ref(p));
+					ctx.out.byte(static_cast<char>(TypeTag::OuterTypeParameter));
+				}
+				ctx.out.nat(p->index);
+				break;
+			}
+		}
+		ctx.out.nat(type.lifetime().bits());
+	}
+
+	void write_types(WriteCtx& ctx, const Slice<Type>& types, const TypeParametersScope& scope) {
+		ctx.out.nat(types.size());
+		for (const Type& t : types)
+			write_type(ctx, t, scope);
+	}
+
+	// Doesn't include the name, which callers write first.
+	void write_signature(WriteCtx& ctx, const FunSignature& signature, const Slice<TypeParameter>& spec_type_parameters) {
+		TypeParametersScope scope { spec_type_parameters, signature.type_parameters };
+		write_comment(ctx, signature.comment);
+		write_type_parameters(ctx, signature.type_parameters);
+		write_type(ctx, signature.return_type, scope);
+		ctx.out.nat(signature.parameters.size());
+		for (const Parameter& p : signature.parameters) {
+			ctx.out.str(p.name.str());
+			write_type(ctx, p.type, scope);
+		}
+		ctx.out.nat(signature.specs.size());
+		for (const SpecUse& s : signature.specs) {
+			write_module_ref(ctx, s.spec->containing_module);
+			ctx.out.nat(index_of(s.spec->containing_module->specs_declaration_order, s.spec));
+			write_types(ctx, s.type_arguments, scope);
+		}
+	}
+
+	void write_struct_body(WriteCtx& ctx, const StructDeclaration& strukt) {
+		const StructBody& body = strukt.body;
+		switch (body.kind()) {
+			case StructBody::Kind::Nil:
+				unreachable();
+			case StructBody::Kind::Fields:
+				ctx.out.byte(static_cast<char>(StructBodyTag::Fields));
+				ctx.out.nat(body.fields().size());
+				for (const StructField& f : body.fields()) {
+					write_comment(ctx, f.comment);
+					write_type(ctx, f.type, TypeParametersScope { strukt.type_parameters });
+					ctx.out.str(f.name.str());
+				}
+				break;
+			case StructBody::Kind::CppName:
+				ctx.out.byte(static_cast<char>(StructBodyTag::CppName));
+				ctx.out.str(body.cpp_name());
+				break;
+		}
+	}
+
+	struct ReadCtx {
+		InterfaceReader& in;
+		Ref<Module> module;
+		IdentifierCache& identifiers;
+		Arena& arena;
+	};
+
+	Ref<const Module> read_module_ref(ReadCtx& ctx) {
+		uint i = ctx.in.nat();
+		return i == 0 ? Ref<const Module> { ctx.module.ptr() } : ctx.module->imports[i - 1];
+	}
+
+	Identifier read_identifier(ReadCtx& ctx) {
+		return ctx.identifiers.get(ctx.in.str());
+	}
+
+	SourceRange read_range(ReadCtx& ctx) {
+		ushort begin = to_ushort(ctx.in.nat());
+		ushort end = to_ushort(ctx.in.nat());
+		return { begin, end };
+	}
+
+	Option<ArenaString> read_comment(ReadCtx& ctx) {
+		return ctx.in.boolean() ? Option { copy_string(ctx.arena, ctx.in.str()) } : Option<ArenaString> {};
+	}
+
+	Slice<TypeParameter> read_type_parameters(ReadCtx& ctx) {
+		return fill_array<TypeParameter>()(ctx.arena, ctx.in.nat(), [&](uint index) {
+			SourceRange range = read_range(ctx);
+			return TypeParameter { range, read_identifier(ctx), index };
+		});
+	}
+
+	Slice<Type> read_types(ReadCtx& ctx, const TypeParametersScope& scope);
+
+	StoredType read_stored_type(ReadCtx& ctx, const TypeParametersScope& scope) {
+		switch (static_cast<TypeTag>(ctx.in.byte())) {
+			case TypeTag::Bogus:
+				return StoredType::bogus();
+			case TypeTag::InstStruct: {
+				Ref<const Module> m = read_module_ref(ctx);
+				Ref<const StructDeclaration> strukt = &m->structs_declaration_order[ctx.in.nat()];
+				return StoredType { InstStruct { strukt, read_types(ctx, scope) } };
+			}
+			case TypeTag::InnerTypeParameter:
+				return StoredType { Ref<const TypeParameter> { &scope.inner[ctx.in.nat()] } };
+			case TypeTag::OuterTypeParameter:
+				return StoredType { Ref<const TypeParameter> { &scope.outer[ctx.in.nat()] } };
+			default:
+				unreachable();
+		}
+	}
+
+	Type read_type(ReadCtx& ctx, const TypeParametersScope& scope) {
+		StoredType stored = read_stored_type(ctx, scope);
+		Lifetime lifetime = Lifetime::from_bits(to_ushort(ctx.in.nat()));
+		return Type { stored, lifetime };
+	}
+
+	Slice<Type> read_types(ReadCtx& ctx, const TypeParametersScope& scope) {
+		return fill_array<Type>()(ctx.arena, ctx.in.nat(), [&](uint) { return read_type(ctx, scope); });
+	}
+
+	FunSignature read_signature(ReadCtx& ctx, Identifier name, const Slice<TypeParameter>& spec_type_parameters) {
+		Option<ArenaString> comment = read_comment(ctx);
+		Slice<TypeParameter> type_parameters = read_type_parameters(ctx);
+		TypeParametersScope scope { spec_type_parameters, type_parameters };
+		Type return_type = read_type(ctx, scope);
+		Slice<Parameter> parameters = fill_array<Parameter>()(ctx.arena, ctx.in.nat(), [&](uint index) {
+			Identifier parameter_name = read_identifier(ctx);
+			return Parameter { parameter_name, read_type(ctx, scope), index };
+		});
+		Slice<SpecUse> specs = fill_array<SpecUse>()(ctx.arena, ctx.in.nat(), [&](uint) {
+			Ref<const Module> m = read_module_ref(ctx);
+			Ref<const SpecDeclaration> spec = &m->specs_declaration_order[ctx.in.nat()];
+			return SpecUse { spec, read_types(ctx, scope) };
+		});
+		return { comment, type_parameters, return_type, name, parameters, specs };
+	}
+
+	StructBody read_struct_body(ReadCtx& ctx, const StructDeclaration& strukt) {
+		switch (static_cast<StructBodyTag>(ctx.in.byte())) {
+			case StructBodyTag::Fields:
+				return StructBody { fill_array<StructField>()(ctx.arena, ctx.in.nat(), [&](uint) {
+					Option<ArenaString> comment = read_comment(ctx);
+					Type type = read_type(ctx, TypeParametersScope { strukt.type_parameters });
+					return StructField { comment, type, read_identifier(ctx) };
+				}) };
+			case StructBodyTag::CppName:
+				return StructBody { copy_string(ctx.arena, ctx.in.str()) };
+			default:
+				unreachable();
+		}
+	}
+}
+
+hash_t hash_source(const StringSlice& source) {
+	return hash_bytes(source.begin(), source.end());
+}
+
+Option<InterfaceHeader> read_interface_header(const StringSlice& interface, PathCache& paths, Arena& arena) {
+	if (interface.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + sizeof(MAGIC), interface.begin()))
+		return {};
+	InterfaceReader in { interface.begin() + sizeof(MAGIC), interface.end() };
+	hash_t source_hash = in.u64();
+	hash_t interface_hash = in.u64();
+	// Catches a file that was cut off.
+	hash_t checksum = in.u64();
+	if (hash_bytes(interface.begin() + HEADER_SIZE, interface.end()) != checksum)
+		return {};
+
+	uint n_imports = in.nat();
+	Slice<Path> imports;
+	Slice<hash_t> import_interface_hashes;
+	if (n_imports != 0) {
+		imports = uninitialized_array<Path>(arena, n_imports);
+		import_interface_hashes = uninitialized_array<hash_t>(arena, n_imports);
+		for (uint i = 0; i != n_imports; ++i) {
+			imports[i] = read_path(in, paths);
+			import_interface_hashes[i] = in.u64();
+		}
+	}
+	return Option { InterfaceHeader { source_hash, interface_hash, imports, import_interface_hashes } };
+}
+
+void read_interface(const StringSlice& interface, Ref<Module> m, IdentifierCache& identifiers, Arena& arena) {
+	InterfaceReader in { interface.begin() + HEADER_SIZE, interface.end() };
+	// The caller already got the imports from the header.
+	uint n_imports = in.nat();
+	assert(n_imports == m->imports.size());
+	for (uint i = 0; i != n_imports; ++i) {
+		skip_path(in);
+		in.u64();
+	}
+
+	ReadCtx ctx { in, m, identifiers, arena };
+	m->comment = read_comment(ctx);
+	uint n_specs = in.nat();
+	uint n_structs = in.nat();
+	uint n_funs = in.nat();
+
+	// First every declaration, so that types can refer to any of them.
+	m->specs_declaration_order = fill_array<SpecDeclaration>()(arena, n_specs, [&](uint) {
+		SourceRange range = read_range(ctx);
+		Option<ArenaString> comment = read_comment(ctx);
+		bool is_public = in.boolean();
+		Slice<TypeParameter> type_parameters = read_type_parameters(ctx);
+		return SpecDeclaration { m, range, comment, is_public, type_parameters, read_identifier(ctx) };
+	});
+	m->structs_declaration_order = fill_array<StructDeclaration>()(arena, n_structs, [&](uint) {
+		SourceRange range = read_range(ctx);
+		Option<ArenaString> comment = read_comment(ctx);
+		bool is_public = in.boolean();
+		Slice<TypeParameter> type_parameters = read_type_parameters(ctx);
+		Identifier name = read_identifier(ctx);
+		StructDeclaration s { m, range, is_public, type_parameters, name, in.boolean() };
+		s.comment = comment;
+		return s;
+	});
+	m->funs_declaration_order = fill_array<FunDeclaration>()(arena, n_funs, [&](uint) {
+		bool is_public = in.boolean();
+		return FunDeclaration { m, is_public, { read_identifier(ctx) }, {} };
+	});
+
+	// The module had no diagnostics when this was written, so there are no duplicates.
+	m->specs_table = build_map<Identifier, Ref<const SpecDeclaration>, Identifier::hash>()(
+		arena,
+		m->specs_declaration_order,
+		[](const SpecDeclaration& s) { return s.name; },
+		[](const SpecDeclaration& s) { return Ref<const SpecDeclaration> { &s }; },
+		[](const Ref<const SpecDeclaration>& a __attribute__((unused)), const SpecDeclaration& b __attribute__((unused))) { unreachable(); });
+	m->structs_table = build_map<Identifier, Ref<const StructDeclaration>, Identifier::hash>()(
+		arena,
+		m->structs_declaration_order,
+		[](const StructDeclaration& s) { return s.name; },
+		[](const StructDeclaration& s) { return Ref<const StructDeclaration> { &s }; },
+		[](const Ref<const StructDeclaration>& a __attribute__((unused)), const StructDeclaration& b __attribute__((unused))) { unreachable(); });
+	m->funs_table = build_multi_map<Identifier, Ref<const FunDeclaration>, Identifier::hash>()(
+		arena,
+		m->funs_declaration_order,
+		[](const FunDeclaration& f) { return f.name(); },
+		[](const FunDeclaration& f) { return Ref<const FunDeclaration> { &f }; });
+
+	// Then everything that contains types.
+	for (SpecDeclaration& spec : m->specs_declaration_order)
+		spec.signatures = fill_array<FunSignature>()(arena, in.nat(), [&](uint) {
+			Identifier name = read_identifier(ctx);
+			return read_signature(ctx, name, spec.type_parameters);
+		});
+	for (StructDeclaration& strukt : m->structs_declaration_order)
+		strukt.body = read_struct_body(ctx, strukt);
+	for (FunDeclaration& fun : m->funs_declaration_order)
+		fun.signature = read_signature(ctx, fun.signature.name, {});
+	assert(in.at_end());
+}
+
+Writer::Output write_interface(const Module& m, hash_t source_hash, const Slice<hash_t>& import_interface_hashes, hash_t& interface_hash, Arena& arena) {
+	InterfaceWriter body { arena };
+	WriteCtx ctx { body, m };
+	body.nat(m.imports.size());
+	for (uint i = 0; i != m.imports.size(); ++i) {
+		write_path(body, m.imports[i]->path);
+		body.u64(import_interface_hashes[i]);
+	}
+
+	write_comment(ctx, m.comment);
+	body.nat(m.specs_declaration_order.size());
+	body.nat(m.structs_declaration_order.size());
+	body.nat(m.funs_declaration_order.size());
+
+	for (const SpecDeclaration& spec : m.specs_declaration_order) {
+		write_range(ctx, spec.range);
+		write_comment(ctx, spec.comment);
+		body.boolean(spec.is_public);
+		write_type_parameters(ctx, spec.type_parameters);
+		body.str(spec.name.str());
+	}
+	for (const StructDeclaration& strukt : m.structs_declaration_order) {
+		write_range(ctx, strukt.range);
+		write_comment(ctx, strukt.comment);
+		body.boolean(strukt.is_public);
+		write_type_parameters(ctx, strukt.type_parameters);
+		body.str(strukt.name.str());
+		body.boolean(strukt.copy);
+	}
+	for (const FunDeclaration& fun : m.funs_declaration_order) {
+		body.boolean(fun.is_public);
+		body.str(fun.name().str());
+	}
+
+	for (const SpecDeclaration& spec : m.specs_declaration_order) {
+		body.nat(spec.signatures.size());
+		for (const FunSignature& signature : spec.signatures) {
+			body.str(signature.name.str());
+			write_signature(ctx, signature, spec.type_parameters);
+		}
+	}
+	for (const StructDeclaration& strukt : m.structs_declaration_order)
+		write_struct_body(ctx, strukt);
+	for (const FunDeclaration& fun : m.funs_declaration_order)
+		write_signature(ctx, fun.signature, {});
+
+	interface_hash = body.hash();
+	InterfaceWriter out { arena };
+	for (char c : MAGIC)
+		out.byte(c);
+	out.u64(source_hash);
+	out.u64(interface_hash);
+	out.u64(body.checksum());
+	out.bytes(body.finish());
+	return out.finish();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../../util/PathCache.h"
+#include "../../util/Writer.h"
+#include "../model/model.h"
+
+// A module's interface is everything other modules can see of it: every declaration, but no function bodies.
+// It's stored in a compact binary form with no pointers in it, so it can be used straight from a mapped file.
+// Declarations refer to other declarations by their module (this one or one of its imports) and their index in it.
+
+struct InterfaceHeader {
+	hash_t source_hash;
+	// Changes whenever anything in the interface changes, including the interface of anything it imports.
+	// Source ranges and comments are left out, since importers don't depend on them.
+	hash_t interface_hash;
+	Slice<Path> imports;
+	Slice<hash_t> import_interface_hashes; // Parallel to 'imports'
+};
+
+// A hash of a module's source text, to tell whether an interface was written for it.
+hash_t hash_source(const StringSlice& source);
+
+// Returns None if 'interface' is not a valid interface, e.g. because it was written by another version of the compiler.
+Option<InterfaceHeader> read_interface_header(const StringSlice& interface, PathCache& paths, Arena& arena);
+
+// 'm' should already have its path and imports. Fills in everything else.
+// 'interface' should have been validated by 'read_interface_header'.
+void read_interface(const StringSlice& interface, Ref<Module> m, IdentifierCache& identifiers, Arena& arena);
+
+// 'm' must have been checked without diagnostics. 'import_interface_hashes' is parallel to m.imports.
+// Sets 'interface_hash' to what 'read_interface_header' will return.
+Writer::Output write_interface(const Module& m, hash_t source_hash, const Slice<hash_t>& import_interface_hashes, hash_t& interface_hash, Arena& arena);
@@ -0,0 +1,41 @@
+#include "./Identifier.h"
+
+#include <mutex> // std::lock_guard, std::mutex
+
+struct IdentifierCache::Impl {
+	mutable std::mutex mutex; // Modules may be checked in parallel.
+	Arena arena;
+	// Keys point to the interned strings.
+	Map<StringSlice, Ref<const Identifier::Impl>, StringSlice::hash> ids;
+
+	Impl() : mutex{}, arena{}, ids{arena} {}
+};
+
+IdentifierCache::IdentifierCache() : impl(unique_ptr<IdentifierCache::Impl> { new IdentifierCache::Impl() }) {}
+IdentifierCache::~IdentifierCache() {} // impl implicitly deleted
+
+Identifier IdentifierCache::get(const StringSlice& s) {
+	std::lock_guard<std::mutex> lock { impl->mutex };
+	Option<Ref<const Identifier::Impl>&> already = impl->ids.get(s);
+	if (already.has())
+		return Identifier { already.get() };
+	Ref<const Identifier::Impl> i = impl->arena.put(Identifier::Impl { StringSlice::hash{}(s), copy_string(impl->arena, s) });
+	impl->ids.must_insert(i->str, i);
+	return Identifier { i };
+}
+
+Option<Identifier> IdentifierCache::try_get(const StringSlice& s) const {
+	std::lock_guard<std::mutex> lock { impl->mutex };
+	const Map<StringSlice, Ref<const Identifier::Impl>, StringSlice::hash>& ids = impl->ids;
+	Option<const Ref<const Identifier::Impl>&> i = ids.get(s);
+	return i.has() ? Option { Identifier { i.get() } } : Option<Identifier> {};
+}
+
+Identifier LocalIdentifierCache::get(const StringSlice& s) {
+	Option<Ref<const Identifier::Impl>&> already = ids.get(s);
+	if (already.has())
+		return Identifier { already.get() };
+	Identifier i = shared.get(s);
+	ids.must_insert(i.str(), i.impl);
+	return i;
+}
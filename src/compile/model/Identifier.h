@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../../util/store/ArenaString.h"
+#include "../../util/store/Map.h"
+#include "../../util/unique_ptr.h"
+#include "../../util/Option.h"
+#include "../../util/Writer.h"
+
+// Can only be constructed through an IdentifierCache.
+class Identifier {
+	struct Impl {
+		hash_t hash; // Of the string, computed once when interned.
+		ArenaString str;
+	};
+	friend class IdentifierCache;
+	friend class LocalIdentifierCache;
+	Ref<const Impl> impl;
+
+	inline explicit Identifier(Ref<const Impl> _impl) : impl{_impl} {}
+
+public:
+	inline const ArenaString& str() const { return impl->str; }
+
+	inline friend bool operator==(const Identifier& a, const Identifier& b) {
+		// Identifiers are interned, so we can just compare references.
+		return a.impl == b.impl;
+	}
+	inline friend bool operator!=(const Identifier& a, const Identifier& b) {
+		return !(a == b);
+	}
+	inline friend Writer& operator<<(Writer& out, const Identifier& i) {
+		return out << i.str();
+	}
+
+	struct hash {
+		// Hash of the string, not the address, so that iterating a map keyed by identifiers doesn't depend on thread timing.
+		inline hash_t operator()(const Identifier& i) const {
+			return i.impl->hash;
+		}
+	};
+};
+
+// Interns identifiers for a whole compilation, so that each name is hashed and compared as a string only once.
+// Safe to use from multiple threads, but every call takes a lock. So threads should look names up through a LocalIdentifierCache.
+class IdentifierCache {
+	struct Impl;
+	unique_ptr<Impl> impl;
+	IdentifierCache(const IdentifierCache& other) = delete;
+
+public:
+	IdentifierCache();
+	~IdentifierCache();
+	Identifier get(const StringSlice& s);
+	// Returns None if nothing has been interned with this name, meaning nothing could be declared with it.
+	Option<Identifier> try_get(const StringSlice& s) const;
+};
+
+// Sits in front of an IdentifierCache for one thread, so only the first lookup of each name takes the shared lock.
+// Must not be used by more than one thread at a time.
+class LocalIdentifierCache {
+	IdentifierCache& shared;
+	// Keys point to the strings interned in 'shared'.
+	Map<StringSlice, Ref<const Identifier::Impl>, StringSlice::hash> ids;
+
+public:
+	inline LocalIdentifierCache(IdentifierCache& _shared, Arena& arena) : shared{_shared}, ids{arena} {}
+	LocalIdentifierCache(const LocalIdentifierCache& other) = delete;
+	Identifier get(const StringSlice& s);
+};
@@ -10,8 +10,7 @@
 #include "../../util/Path.h"
 #include "../diag/SourceRange.h"
 #include "./effect.h"
-
-using Identifier = ArenaString;
+#include "./Identifier.h"
 
 class Expression;
 
@@ -209,6 +208,10 @@ public:
 		return _flags == other._flags;
 	}
 
+	// For module interfaces.
+	inline unsigned short bits() const { return static_cast<unsigned short>(_flags); }
+	inline static Lifetime from_bits(unsigned short bits) { return { static_cast<Flags>(bits) }; }
+
 	class Builder {
 		Flags flags = Flags::None;
 
@@ -374,11 +377,11 @@ struct SpecDeclaration {
 };
 
 // Within a single module, maps a struct name to declaration.
-using StructsTable = Map<StringSlice, Ref<const StructDeclaration>, StringSlice::hash>;
+using StructsTable = Map<Identifier, Ref<const StructDeclaration>, Identifier::hash>;
 // Within a single module, maps a spec name to declaration.
-using SpecsTable = Map<StringSlice, Ref<const SpecDeclaration>, StringSlice::hash>;
+using SpecsTable = Map<Identifier, Ref<const SpecDeclaration>, Identifier::hash>;
 // Within a single module, maps a fun name to the list of functions *in that module* with that name.
-using FunsTable = MultiMap<StringSlice, Ref<const FunDeclaration>, StringSlice::hash>;
+using FunsTable = MultiMap<Identifier, Ref<const FunDeclaration>, Identifier::hash>;
 using StructsDeclarationOrder = Slice<StructDeclaration>;
 using SpecsDeclarationOrder = Slice<SpecDeclaration>;
 using FunsDeclarationOrder = Slice<FunDeclaration>;
@@ -1,166 +1,143 @@
 #include "./Lexer.h"
 
 namespace {
-	bool is_operator_char(char c) {
-		switch (c) {
-			case '+':
-			case '-':
-			case '*':
-			case '/':
-			case '<':
-			case '>':
-			case '=':
-				return true;
-			default:
-				return false;
-		}
-	}
-
 	bool is_lower_case_letter(char c) {
 		return 'a' <= c && c <= 'z';
 	}
-	bool is_upper_case_letter(char c) {
-		return 'A' <= c && c <= 'Z';
-	}
-	bool is_digit(char c) {
-		return '0' <= c && c <= '9';
-	}
-
-	bool is_value_name_continue(char c) {
-		return is_lower_case_letter(c) || c == '-';
-	}
-	bool is_type_name_continue(char c) {
-		return is_upper_case_letter(c) || is_lower_case_letter(c);
-	}
 
-	ArenaString take_string_literal(const char* &ptr, StringBuilder b) {
-		++ptr;
-		while (*ptr != '"' && *ptr != '\0') {
-			//TODO:ESCAPING
-			b << *ptr;
-			++ptr;
+	// The character a single-char token is written as, or '\0' for tokens with variable text.
+	char token_char(TokenKind kind) {
+		switch (kind) {
+			case TokenKind::Newline: return '\n';
+			case TokenKind::Space: return ' ';
+			case TokenKind::Comma: return ',';
+			case TokenKind::Dot: return '.';
+			case TokenKind::Lparen: return '(';
+			case TokenKind::Rparen: return ')';
+			case TokenKind::Less: return '<';
+			case TokenKind::Greater: return '>';
+			case TokenKind::Question: return '?';
+			case TokenKind::Dollar: return '$';
+			case TokenKind::End:
+			case TokenKind::Invalid:
+			case TokenKind::TypeName:
+			case TokenKind::StringLiteral:
+			case TokenKind::NumberLiteral:
+			case TokenKind::Comment:
+			case TokenKind::RestOfLine:
+			case TokenKind::CppBody:
+			case TokenKind::Name:
+			case TokenKind::Operator:
+			case TokenKind::KwAssert:
+			case TokenKind::KwC:
+			case TokenKind::KwCopy:
+			case TokenKind::KwElse:
+			case TokenKind::KwGet:
+			case TokenKind::KwImport:
+			case TokenKind::KwInclude:
+			case TokenKind::KwIo:
+			case TokenKind::KwOwn:
+			case TokenKind::KwPass:
+			case TokenKind::KwPrivate:
+			case TokenKind::KwSet:
+			case TokenKind::KwWhen:
+				return '\0';
 		}
-		if (*ptr != '\0') ++ptr;
-		return b.finish();
 	}
-
-	// Literals are allowed to be written as +123.456.789 instead of "+123.456.789" since numeric literals are common.
-	ArenaString take_numeric_literal(const char* &ptr, Arena& arena) {
-		const char* begin = ptr;
-		while (is_digit(*ptr) || *ptr == '.') ++ptr;
-		return copy_string(arena, { begin, ptr });
-	}
-
-	// Assumes the first char is validated already.
-	StringSlice take_name_helper(const char* begin, const char* &ptr, bool next_char_pred(char)) {
-		assert(ptr > begin);
-		while (next_char_pred(*ptr)) ++ptr;
-		return { begin, ptr };
-	}
-}
-
-ParseDiagnostic Lexer::unexpected() {
-	return diag_at_char({ ParseDiag::Kind::UnexpectedCharacter, *ptr });
-}
-
-void Lexer::validate_file(const StringSlice& source) {
-	assert(!source.is_empty() && *(source.end() - 1) == '\0'); // Should be guaranteed by file reader
-
-	// Look for trailing whitespace.
-	for (const char* ptr = source.begin() + 1; *ptr != '\0'; ++ptr)
-		if (*ptr == '\n' && (*(ptr - 1) == ' ' || *(ptr - 1) == '\t'))
-			throw ParseDiagnostic { SourceRange::inner_slice(source, { ptr - 1, ptr }), ParseDiag::Kind::TrailingSpace };
-
-	if (source.size() == 1 || *(source.end() - 2) != '\n')
-		throw ParseDiagnostic { SourceRange::inner_slice(source, { source.end() - 1, source.end() }), ParseDiag::Kind::MustEndInBlankLine };
-}
-
-ParseDiagnostic Lexer::diag_at_char(ParseDiag diag) {
-	return { SourceRange::inner_slice(source, { ptr, ptr + 1 }), diag };
 }
 
-StringBuilder Lexer::string_builder(Arena& arena) {
-	return StringBuilder { arena, to_unsigned(source.end() - ptr) };
+ParseDiagnostic Lexer::unexpected_at(const char* c) {
+	return { SourceRange::inner_slice(source, { c, c + 1 }), { ParseDiag::Kind::UnexpectedCharacter, *c } };
 }
 
-void Lexer::expect(const char* expected) {
-	for (; *expected != 0; ++expected) {
-		take(*expected);
-	}
-}
-
-uint Lexer::take_tabs() {
-	const char* const begin = ptr;
-	while (*ptr == '\t')
-		++ptr;
-	return uint(ptr - begin);
+ParseDiagnostic Lexer::diag_at_token(ParseDiag diag) {
+	return { SourceRange::inner_slice(source, { token_begin(index), token_begin(index) + 1 }), diag };
 }
 
-void Lexer::take(char expected) {
-	if (!try_take(expected))
-		throw diag_at_char({ ParseDiag::Kind::ExpectedCharacter, expected });
+void Lexer::take(TokenKind expected) {
+	if (try_take(expected))
+		return;
+	char c = token_char(expected);
+	throw c == '\0' || kind() == TokenKind::Invalid ? unexpected() : diag_at_token({ ParseDiag::Kind::ExpectedCharacter, c });
 }
 
-bool Lexer::try_take_copy_keyword() {
-	if (ptr[0] == 'c' && ptr[1] == 'o' && ptr[2] == 'p' && ptr[3] == 'y') {
-		ptr += 4;
-		return true;
-	}
-	return false;
-}
-bool Lexer::try_take_from_keyword() {
-	if (ptr[0] == 'f' && ptr[1] == 'r' && ptr[2] == 'o' && ptr[3] == 'm') {
-		ptr += 4;
+bool Lexer::try_take_operator(const StringSlice& op) {
+	if (kind() == TokenKind::Operator && text(index) == op) {
+		++index;
 		return true;
 	}
 	return false;
 }
-bool Lexer::try_take_else_keyword() {
-	if (ptr[0] == 'e' && ptr[1] == 'l' && ptr[2] == 's' && ptr[3] == 'e') {
-		ptr += 4;
-		return true;
-	}
-	return false;
+
+void Lexer::take_operator(const StringSlice& op) {
+	if (!try_take_operator(op))
+		throw unexpected();
 }
+
 bool Lexer::try_take_import_space() {
-	if (ptr[0] == 'i' && ptr[1] == 'm' && ptr[2] == 'p' && ptr[3] == 'o' && ptr[4] == 'r' && ptr[5] == 't' && ptr[6] == ' ') {
-		ptr += 7;
+	if (kind() == TokenKind::KwImport && peek(1) == TokenKind::Space) {
+		index += 2;
 		return true;
 	}
 	return false;
 }
+
 bool Lexer::try_take_private_nl() {
-	if (ptr[0] == 'p' && ptr[1] == 'r' && ptr[2] == 'i' && ptr[3] == 'v' && ptr[4] == 'a' && ptr[5] == 't' && ptr[6] == 'e' && ptr[7] == '\n') {
-		ptr += 8;
+	if (kind() == TokenKind::KwPrivate && peek(1) == TokenKind::Newline) {
+		++index;
+		if (take_newline() != 0)
+			throw unexpected_at(token_begin(index - 1) + 1);
 		return true;
 	}
 	return false;
 }
 
 Option<Effect> Lexer::try_take_effect() {
-	const char c = *ptr;
-	switch (c) {
-		case 'g':
-		case 's':
-		case 'i':
-		case 'o':
-			++ptr;
-			if (c == 'g' || c == 's') expect("et"); else if (c == 'i') take('o'); else expect("wn");
-			take(' ');
-			return Option { c == 'g' ? Effect::EGet : c == 's' ? Effect::ESet : c == 'i' ? Effect::EIo : Effect::EOwn };
-		default:
-			return {};
+	Option<Effect> effect = kind() == TokenKind::KwGet ? Option { Effect::EGet }
+		: kind() == TokenKind::KwSet ? Option { Effect::ESet }
+		: kind() == TokenKind::KwIo ? Option { Effect::EIo }
+		: kind() == TokenKind::KwOwn ? Option { Effect::EOwn }
+		: Option<Effect> {};
+	if (effect.has()) {
+		++index;
+		take(TokenKind::Space);
 	}
+	return effect;
+}
+
+uint Lexer::take_newline() {
+	signed char delta = tokens.indent_deltas[index];
+	take(TokenKind::Newline);
+	line_indent = uint(int(line_indent) + delta);
+	return line_indent;
 }
 
 void Lexer::skip_blank_lines() {
-	while (*ptr == '\n')
-		++ptr;
+	while (kind() == TokenKind::Newline)
+		if (take_newline() != 0)
+			throw unexpected_at(token_begin(index - 1) + 1);
+}
+
+void Lexer::skip_to_next_declaration(uint declaration_start) {
+	_indent = 0;
+	// If the error came at the start of a line after the declaration's first, that line may start a fine declaration.
+	auto at_declaration = [&]() {
+		return index > declaration_start && line_indent == 0 && tokens.kinds[index - 1] == TokenKind::Newline && kind() != TokenKind::Newline;
+	};
+	if (at_declaration())
+		return;
+	do {
+		if (kind() == TokenKind::End)
+			return;
+		else if (kind() == TokenKind::Newline)
+			take_newline();
+		else
+			++index;
+	} while (!at_declaration());
 }
 
 NewlineOrDedent Lexer::take_newline_or_dedent() {
-	take('\n');
-	uint new_indent = take_tabs();
+	uint new_indent = take_newline();
 	if (new_indent == _indent - 1) {
 		_indent = new_indent;
 		return NewlineOrDedent::Dedent;
@@ -168,171 +145,143 @@ NewlineOrDedent Lexer::take_newline_or_dedent() {
 	else if (new_indent == _indent)
 		return NewlineOrDedent::Newline;
 	else
-		throw unexpected();
+		throw unexpected_at(token_end(index - 1));
 }
 
 void Lexer::take_dedent() {
-	take('\n');
-	uint new_indent = take_tabs();
+	uint new_indent = take_newline();
 	if (new_indent != _indent - 1)
-		throw unexpected();
+		throw unexpected_at(token_end(index - 1));
 	_indent = new_indent;
 }
 
 void Lexer::take_newline_same_indent() {
-	take('\n');
-	uint new_indent = take_tabs();
+	uint new_indent = take_newline();
 	if (new_indent != _indent)
-		throw unexpected();
-	_indent = new_indent;
+		throw unexpected_at(token_end(index - 1));
 }
 
 bool Lexer::try_take_indent() {
-	take('\n');
-	uint new_indent = take_tabs();
+	uint new_indent = take_newline();
 	if (new_indent == _indent)
 		return false;
 	if (new_indent != _indent + 1)
-		throw unexpected();
+		throw unexpected_at(token_end(index - 1));
 	_indent = new_indent;
 	return true;
 }
 
 void Lexer::take_indent() {
-	take('\n');
-	uint new_indent = take_tabs();
+	uint new_indent = take_newline();
 	if (new_indent != _indent + 1)
-		throw unexpected();
+		throw unexpected_at(token_end(index - 1));
 	_indent = new_indent;
 }
 
+StringSlice Lexer::take_cpp_body() {
+	if (kind() == TokenKind::CppBody)
+		return take_text();
+	// The tokenizer makes a CppBody whenever there's an indented line after a 'c' declaration.
+	else if (kind() == TokenKind::Newline)
+		throw ParseDiagnostic { SourceRange::inner_slice(source, { token_begin(index) + 1, token_begin(index) + 2 }), { ParseDiag::Kind::ExpectedCharacter, '\t' } };
+	else
+		throw diag_at_token({ ParseDiag::Kind::ExpectedCharacter, '\n' });
+}
+
 ArenaString Lexer::take_indented_string(Arena& arena) {
 	assert(_indent == 0);
-	take('\n');
-	take('\t');
-
-	assert(*ptr != '\n');
-
-	StringBuilder b = string_builder(arena);
-	// Keep eating until we see a line that begins in something other than '\n'.
-	while (true) {
-		char c = next();
-		assert(c != '\0'); // File will end in a blank line, so this should never happen.
-		if (c != '\n') {
-			b << c;
-			continue;
-		}
-
-		b << '\n';
-		for (; *ptr == '\n'; ++ptr) b << '\n';
-		if (*ptr != '\t') break;
-		++ptr;
+	StringSlice body = take_cpp_body();
+
+	// Each line's leading tab isn't part of the string.
+	uint n_tabs = 0;
+	for (const char* c = body.begin(); c != body.end(); ++c)
+		if (*c == '\n' && *(c + 1) == '\t')
+			++n_tabs;
+
+	StringBuilder b { arena, body.size() - n_tabs };
+	for (const char* c = body.begin(); c != body.end(); ++c) {
+		b << *c;
+		if (*c == '\n' && *(c + 1) == '\t')
+			++c;
 	}
-
-	// Remove trailing newlines
-	while (b.back() == '\n')
-		b.pop();
 	return b.finish();
 }
 
-namespace {
-	StringSlice take_rest_of_line(const char* &ptr) {
-		const char* start = ptr;
-		while (*ptr != '\n') ++ptr;
-		StringSlice res { start, ptr };
-		++ptr;
-		return res;
-	}
-}
-
 Option<ArenaString> Lexer::try_take_comment(Arena& arena) {
-	if (*ptr != '|') return {};
-	StringBuilder b = string_builder(arena);
+	if (kind() != TokenKind::Comment) return {};
+
+	// Measure first, so we can allocate exactly what's needed.
+	const uint first = index;
+	uint size = 0;
 	do {
-		++ptr;
-		take(' ');
-		if (!b.is_empty()) b << '\n';
-		for (uint i = _indent; i != 0; --i) take('\t');
-		b << take_rest_of_line(ptr);
-	} while (*ptr == '|');
+		if (index != first) ++size; // For the '\n'
+		size += tokens.lengths[index];
+		++index;
+		// A comment is always followed by a newline, since the file ends in one.
+		uint indent = line_indent;
+		if (take_newline() != indent)
+			throw unexpected_at(token_begin(index - 1) + 1);
+	} while (kind() == TokenKind::Comment);
+	assert(size != 0); // An empty line would end in '| ', which is trailing space.
+
+	StringBuilder b { arena, size };
+	for (uint i = first; i != index; i += 2) { // Skipping the newlines
+		if (i != first) b << '\n';
+		b << text(i);
+	}
 	return Option { b.finish() };
 }
 
 StringSlice Lexer::take_cpp_include() {
-	const char* begin = ptr;
-	while (*ptr != '\n') ++ptr;
-	return StringSlice { begin, ptr };
+	if (kind() != TokenKind::RestOfLine) throw unexpected();
+	return take_text();
 }
 
 StringSlice Lexer::take_type_name() {
-	const char* begin = ptr;
-	if (!is_upper_case_letter(*ptr)) throw unexpected();
-	++ptr;
-	return take_name_helper(begin, ptr, is_type_name_continue);
+	if (kind() != TokenKind::TypeName) throw unexpected();
+	return take_text();
 }
 
 StringSlice Lexer::take_spec_name() {
-	if (*ptr != '$') throw unexpected();
-	++ptr;
+	if (kind() != TokenKind::Dollar) throw unexpected();
+	++index;
 	return take_type_name();
 }
 
 StringSlice Lexer::take_value_name() {
-	const char* begin = ptr;
-	if (is_operator_char(*ptr)) {
-		++ptr;
-		return take_name_helper(begin, ptr, is_operator_char);
-	} else if (is_lower_case_letter(*ptr)) {
-		++ptr;
-		return take_name_helper(begin, ptr, is_value_name_continue);
-	} else {
-		throw unexpected();
-	}
+	if (!is_value_name(kind())) throw unexpected();
+	return take_text();
 }
 
 Lexer::ValueOrTypeName Lexer::take_value_or_type_name() {
-	return is_upper_case_letter(*ptr) ? ValueOrTypeName { false, take_type_name() } : ValueOrTypeName { true, take_value_name() };
+	return kind() == TokenKind::TypeName ? ValueOrTypeName { false, take_type_name() } : ValueOrTypeName { true, take_value_name() };
 }
 
 StringSlice Lexer::take_cpp_type_name() {
-	const char* begin = ptr;
-	if (!is_lower_case_letter(*ptr)) throw unexpected();
-	++ptr;
-	return take_name_helper(begin, ptr, [](char c) { return c != '\n' && c != '\0'; });
-}
-
-namespace {
-	const StringSlice WHEN { "when" };
-	const StringSlice ASSERT { "assert" };
-	const StringSlice PASS { "pass" };
+	StringSlice body = take_cpp_body();
+	if (!is_lower_case_letter(*body.begin())) throw unexpected_at(body.begin());
+	for (const char* c = body.begin(); c != body.end(); ++c)
+		if (*c == '\n')
+			throw unexpected_at(c + 1);
+	return body;
 }
 
 // Take a token in an expression.
-ExpressionToken Lexer::take_expression_token(Arena& arena) {
-	const char* begin = ptr;
-	char c = *ptr;
-	if (c == '(') {
-		++ptr;
+ExpressionToken Lexer::take_expression_token() {
+	TokenKind k = kind();
+	if (k == TokenKind::Lparen) {
+		++index;
 		return { ExpressionToken::Kind::Lparen, {} };
-	} else if (c == '"') {
-		return { ExpressionToken::Kind::Literal, { take_string_literal(ptr, string_builder(arena)) } };
-	} else if (is_operator_char(c)) {
-		++ptr;
-		return { ExpressionToken::Kind::Name, { take_name_helper(begin, ptr, is_operator_char) } };
-	} else if (is_lower_case_letter(c)) {
-		++ptr;
-		StringSlice name = take_name_helper(begin, ptr, is_value_name_continue);
-		ExpressionToken::Kind kind = name == WHEN ? ExpressionToken::Kind::When
-			: name == PASS ? ExpressionToken::Kind::Pass
-			: name == ASSERT ? ExpressionToken::Kind::Assert
+	} else if (k == TokenKind::StringLiteral || k == TokenKind::NumberLiteral)
+		return { ExpressionToken::Kind::Literal, { take_text() } };
+	else if (k == TokenKind::TypeName)
+		return { ExpressionToken::Kind::TypeName, { take_text() } };
+	else if (is_value_name(k)) {
+		ExpressionToken::Kind et_kind = k == TokenKind::KwWhen ? ExpressionToken::Kind::When
+			: k == TokenKind::KwPass ? ExpressionToken::Kind::Pass
+			: k == TokenKind::KwAssert ? ExpressionToken::Kind::Assert
 			: ExpressionToken::Kind::Name;
-		return { kind, { name } };
-	} else if (is_upper_case_letter(c)) {
-		++ptr;
-		return { ExpressionToken::Kind::TypeName, { take_name_helper(begin, ptr, is_type_name_continue) } };
-	} else if (is_digit(c) || c == '+' || c == '-') {
-		return { ExpressionToken::Kind::Literal, { take_numeric_literal(ptr, arena) } };
-	} else {
+		return { et_kind, { take_text() } };
+	} else
 		throw unexpected();
-	}
 }
@@ -5,6 +5,7 @@
 #include "../../util/store/Arena.h"
 #include "../../util/store/ArenaString.h"
 #include "../../util/store/StringSlice.h"
+#include "./tokenize.h"
 
 struct ExpressionToken {
 	enum class Kind {
@@ -13,63 +14,75 @@ struct ExpressionToken {
 	Kind kind;
 	union {
 		StringSlice name;
-		ArenaString literal;
+		StringSlice literal; // Points into the source, since literals have no escapes.
 	};
 };
 
 enum class NewlineOrDedent { Newline, Dedent };
 
+// Walks over the tokens from 'tokenize'. Since tokens are stored by index, looking ahead or going back is cheap.
 class Lexer {
 	const StringSlice source;
-	const char* ptr; // current pointer into source
-	uint _indent;
-
-	inline char next() {
-		char c = *ptr;
-		++ptr;
-		return c;
+	const Tokens tokens;
+	uint index; // Index of the next token
+	uint line_indent; // Indentation of the current line
+	uint _indent; // Indentation the parser expects, which is less than 'line_indent' after 'reduce_indent_by_2'.
+
+	inline TokenKind kind() const { return tokens.kinds[index]; }
+	inline const char* token_begin(uint i) const { return source.begin() + tokens.offsets[i]; }
+	inline const char* token_end(uint i) const { return token_begin(i) + tokens.lengths[i]; }
+	inline StringSlice text(uint i) const { return { token_begin(i), token_end(i) }; }
+	inline StringSlice take_text() {
+		StringSlice res = text(index);
+		++index;
+		return res;
 	}
 
-	inline ParseDiagnostic unexpected();
-
-	void expect(const char* expected);
-	uint take_tabs();
+	ParseDiagnostic unexpected_at(const char* c);
+	inline ParseDiagnostic unexpected() { return unexpected_at(token_begin(index)); }
 
-	StringBuilder string_builder(Arena& arena);
+	// Returns the new indentation.
+	uint take_newline();
+	StringSlice take_cpp_body();
 
 public:
-	// May throw a ParseDiagnostic.
-	static void validate_file(const StringSlice& source);
+	inline Lexer(StringSlice _source, Tokens _tokens) : source{_source}, tokens{_tokens}, index{0}, line_indent{0}, _indent{0} {}
 
-	inline const char* at() { return ptr; }
-	inline SourceRange range(const char* start) {
-		return SourceRange::inner_slice(source, { start, ptr });
+	// To be passed back to 'range'.
+	inline uint at() const { return index; }
+	// From the start of token 'start' to the end of the last token taken.
+	inline SourceRange range(uint start) const {
+		return SourceRange::inner_slice(source, { token_begin(start), token_end(index - 1) });
 	}
 
-	inline Lexer(StringSlice _source) : source{_source}, ptr{_source.begin()}, _indent{0} {}
+	inline TokenKind peek(uint n = 0) const {
+		assert(index + n < tokens.size());
+		return tokens.kinds[index + n];
+	}
 
-	ParseDiagnostic diag_at_char(ParseDiag diag);
+	ParseDiagnostic diag_at_token(ParseDiag diag);
 
-	void take(char expected);
-	inline bool try_take(char expected) {
-		if (*ptr == expected) {
-			++ptr;
+	// Throws ExpectedCharacter for single-char tokens, otherwise UnexpectedCharacter.
+	void take(TokenKind expected);
+	inline bool try_take(TokenKind expected) {
+		if (kind() == expected) {
+			++index;
 			return true;
 		} else
 			return false;
 	}
 
+	bool try_take_operator(const StringSlice& op);
+	void take_operator(const StringSlice& op);
+
 	Option<Effect> try_take_effect();
 
-	bool try_take_copy_keyword();
-	bool try_take_from_keyword();
-	bool try_take_else_keyword();
 	bool try_take_import_space();
 	bool try_take_private_nl();
 
 	inline bool try_take_comma_space() {
-		if (try_take(',')) {
-			take(' ');
+		if (try_take(TokenKind::Comma)) {
+			take(TokenKind::Space);
 			return true;
 		}
 		return false;
@@ -85,6 +98,8 @@ public:
 	}
 
 	void skip_blank_lines();
+	// After a ParseDiagnostic, skips to the first line after 'declaration_start' that's at indent 0 and not blank, or to the end.
+	void skip_to_next_declaration(uint declaration_start);
 
 	NewlineOrDedent take_newline_or_dedent();
 	void take_dedent();
@@ -104,6 +119,5 @@ public:
 	ValueOrTypeName take_value_or_type_name();
 	StringSlice take_cpp_type_name();
 
-	// arena used to place literals.
-	ExpressionToken take_expression_token(Arena& arena);
+	ExpressionToken take_expression_token();
 };
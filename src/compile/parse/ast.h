@@ -8,6 +8,24 @@
 #include "../model/effect.h"
 #include "./expr_ast.h"
 
+// The text a top-level declaration was parsed from, which is where its slices point.
+// After 'reparse_file', a declaration the edit didn't touch still points into an older version of the source.
+struct DeclarationSource {
+	const char* begin; // Ranges in the declaration are relative to this.
+	int shift; // Where 'begin' is in the current source.
+
+	inline uint position(const char* p) const {
+		return to_unsigned(int(p - begin) + shift);
+	}
+	// Range in the current source of a slice or range from the declaration.
+	inline SourceRange range(const StringSlice& s) const {
+		return { to_ushort(position(s.begin())), to_ushort(position(s.end())) };
+	}
+	inline SourceRange range(const SourceRange& r) const {
+		return { to_ushort(to_unsigned(int(r.begin) + shift)), to_ushort(to_unsigned(int(r.end) + shift)) };
+	}
+};
+
 struct TypeParameterAst {
 	StringSlice name;
 	uint index;
@@ -66,6 +84,7 @@ struct FunSignatureAst {
 };
 
 struct StructDeclarationAst {
+	DeclarationSource source;
 	Option<ArenaString> comment;
 	SourceRange range;
 	bool is_public;
@@ -76,6 +95,7 @@ struct StructDeclarationAst {
 };
 
 struct SpecDeclarationAst {
+	DeclarationSource source;
 	Option<ArenaString> comment;
 	SourceRange range;
 	bool is_public;
@@ -114,11 +134,17 @@ public:
 };
 
 struct FunDeclarationAst {
+	DeclarationSource source;
 	bool is_public;
 	FunSignatureAst signature;
 	FunBodyAst body;
 };
 
+struct IncludeAst {
+	DeclarationSource source;
+	StringSlice name;
+};
+
 struct ImportAst {
 	SourceRange range;
 	Option<uint> n_parents; // None for global import
@@ -130,7 +156,7 @@ struct FileAst {
 	StringSlice source;
 	Option<ArenaString> comment;
 	Slice<ImportAst> imports;
-	List<StringSlice> includes;
+	List<IncludeAst> includes;
 	List<SpecDeclarationAst> specs;
 	List<StructDeclarationAst> structs;
 	List<FunDeclarationAst> funs;
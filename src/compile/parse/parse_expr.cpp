@@ -7,14 +7,16 @@ namespace {
 	// In Statement allow anything; in EqualsRhs anything but `=`; in Case anything single-line.
 	enum class ExprCtx { Statement, EqualsRhs, Case };
 
+	const StringSlice EQUALS { "=" };
+
 	ExprAst parse_expr(Lexer& lexer, Arena& arena, ExprCtx where);
 	ExprAst parse_expr_arg(Lexer& lexer, Arena& arena, ExpressionToken et);
 	ExprAst parse_expr_arg(Lexer& lexer, Arena& arena) {
-		return parse_expr_arg(lexer, arena, lexer.take_expression_token(arena));
+		return parse_expr_arg(lexer, arena, lexer.take_expression_token());
 	}
 
 	Slice<ExprAst> parse_prefix_args(Lexer& lexer, Arena& arena) {
-		if (!lexer.try_take(' '))
+		if (!lexer.try_take(TokenKind::Space))
 			return {};
 		MaxSizeVector<4, ExprAst> args;
 		do {
@@ -23,10 +25,10 @@ namespace {
 		return to_arena(args, arena);
 	}
 
-	WhenAst parse_when(Lexer& lexer, Arena& arena, const char* start) {
+	WhenAst parse_when(Lexer& lexer, Arena& arena, uint start) {
 		lexer.take_indent();
 		MaxSizeVector<4, CaseAst> cases;
-		while (!lexer.try_take_else_keyword()) {
+		while (!lexer.try_take(TokenKind::KwElse)) {
 
 			ExprAst cond = parse_expr(lexer, arena, ExprCtx::Case);
 			lexer.take_indent();
@@ -43,7 +45,7 @@ namespace {
 
 	LetAst parse_let(Lexer& lexer, Arena& arena, const StringSlice& name) {
 		// `a = b`
-		lexer.take(' ');
+		lexer.take(TokenKind::Space);
 		Ref<ExprAst> init = arena.put(parse_expr(lexer, arena, ExprCtx::EqualsRhs));
 		lexer.take_newline_same_indent();
 		Ref<ExprAst> then = arena.put(parse_expr(lexer, arena, ExprCtx::Statement));
@@ -56,7 +58,7 @@ namespace {
 		Slice<TypeAst> type_arguments = parse_type_arguments(lexer, arena);
 		MaxSizeVector<4, ExprAst> args;
 		args.push(arg0);
-		if (lexer.try_take(' '))
+		if (lexer.try_take(TokenKind::Space))
 			do {
 				args.push(parse_expr_arg(lexer, arena));
 			} while (lexer.try_take_comma_space());
@@ -64,12 +66,12 @@ namespace {
 	}
 
 	ExprAst parse_expr(Lexer& lexer, Arena& arena, ExprCtx where) {
-		const char* start = lexer.at();
-		ExpressionToken et = lexer.take_expression_token(arena);
+		uint start = lexer.at();
+		ExpressionToken et = lexer.take_expression_token();
 		if (where != ExprCtx::Case) {
 			switch (et.kind) {
 				case ExpressionToken::Kind::Assert: {
-					lexer.take(' ');
+					lexer.take(TokenKind::Space);
 					Ref<ExprAst> asserted = arena.put(parse_expr(lexer, arena, ExprCtx::EqualsRhs));
 					return ExprAst { AssertAst { lexer.range(start), asserted } };
 				}
@@ -87,9 +89,9 @@ namespace {
 
 		// Start by parsing a simple expr
 		ExprAst arg0 = parse_expr_arg(lexer, arena, et);
-		if (!lexer.try_take(' '))
+		if (!lexer.try_take(TokenKind::Space))
 			return arg0;
-		else if (where == ExprCtx::Statement && arg0.kind() == ExprAst::Kind::Identifier && lexer.try_take('='))
+		else if (where == ExprCtx::Statement && arg0.kind() == ExprAst::Kind::Identifier && lexer.try_take_operator(EQUALS))
 			return ExprAst { parse_let(lexer, arena, arg0.identifier()) };
 		else
 			return ExprAst { parse_call(lexer, arena, arg0) };
@@ -108,30 +110,30 @@ namespace {
 			}
 			case ExpressionToken::Kind::Lparen: {
 				auto inner = parse_expr(lexer, arena, ExprCtx::Case);
-				lexer.take(')');
+				lexer.take(TokenKind::Rparen);
 				return { inner, true };
 			}
 			case ExpressionToken::Kind::Literal: {
 				Slice<TypeAst> type_args = parse_type_arguments(lexer, arena);
 				// e.g. `BigInt i = 123456789(arena)`
 				Slice<ExprAst> args;
-				if (lexer.try_take('(')) {
+				if (lexer.try_take(TokenKind::Lparen)) {
 					args = parse_prefix_args(lexer, arena);
-					lexer.take(')');
+					lexer.take(TokenKind::Rparen);
 				}
 				return { ExprAst { LiteralAst { et.literal, type_args, args } }, true };
 			}
 			case ExpressionToken::Kind::Assert:
-				throw ParseDiagnostic { lexer.diag_at_char(ParseDiag::Kind::AssertMayNotAppearInsideArg ) };
+				throw ParseDiagnostic { lexer.diag_at_token(ParseDiag::Kind::AssertMayNotAppearInsideArg ) };
 			case ExpressionToken::Kind::Pass:
-				throw ParseDiagnostic { lexer.diag_at_char(ParseDiag::Kind::PassMayNotAppearInsideArg ) };
+				throw ParseDiagnostic { lexer.diag_at_token(ParseDiag::Kind::PassMayNotAppearInsideArg ) };
 			case ExpressionToken::Kind::When:
-				throw ParseDiagnostic { lexer.diag_at_char(ParseDiag::Kind::WhenMayNotAppearInsideArg ) };
+				throw ParseDiagnostic { lexer.diag_at_token(ParseDiag::Kind::WhenMayNotAppearInsideArg ) };
 		}
 	}
 
 	ExprAst parse_dots(ExprAst initial, Lexer& lexer, Arena& arena) {
-		return lexer.try_take('.')
+		return lexer.try_take(TokenKind::Dot)
 			? parse_dots(ExprAst { CallAst { lexer.take_value_name(), {}, single_element_slice(arena, initial) } }, lexer, arena)
 			: initial;
 	}
@@ -144,7 +146,7 @@ namespace {
 
 ExprAst parse_body(Lexer& lexer, Arena& arena) {
 	lexer.take_indent();
-	const char* start = lexer.at();
+	uint start = lexer.at();
 	ExprAst res = parse_expr(lexer, arena, ExprCtx::Statement);
 	while (lexer.take_newline_or_dedent() == NewlineOrDedent::Newline) {
 		ExprAst next_line = parse_expr(lexer, arena, ExprCtx::Statement);
@@ -3,19 +3,21 @@
 #include "../../util/store/ArenaArrayBuilders.h"
 
 namespace {
+	const StringSlice STAR { "*" };
+
 	StoredTypeAst parse_stored_type(Lexer& lexer, Arena& arena) {
-		bool is_type_parameter = lexer.try_take('?');
+		bool is_type_parameter = lexer.try_take(TokenKind::Question);
 		StringSlice name = lexer.take_type_name();
 		return is_type_parameter ? StoredTypeAst { name } : StoredTypeAst { name, parse_type_arguments(lexer, arena) };
 	}
 }
 
 Slice<TypeAst> parse_type_arguments(Lexer& lexer, Arena& arena) {
-	if (!lexer.try_take('<'))
+	if (!lexer.try_take(TokenKind::Less))
 		return {};
 	MaxSizeVector<4, TypeAst> args;
 	do { args.push(parse_type(lexer, arena)); } while (lexer.try_take_comma_space());
-	lexer.take('>');
+	lexer.take(TokenKind::Greater);
 	return to_arena(args, arena);
 }
 
@@ -23,9 +25,9 @@ TypeAst parse_type(Lexer& lexer, Arena& arena) {
 	StoredTypeAst s = parse_stored_type(lexer, arena);
 	MaxSizeVector<4, LifetimeConstraintAst> lifetimes;
 	// Parse lifetimes
-	if (lexer.try_take(' ')) {
-		lexer.take('*');
-		LifetimeConstraintAst::Kind kind = lexer.try_take('?') ? LifetimeConstraintAst::Kind::LifetimeVariableName : LifetimeConstraintAst::Kind::ParameterName;
+	if (lexer.try_take(TokenKind::Space)) {
+		lexer.take_operator(STAR);
+		LifetimeConstraintAst::Kind kind = lexer.try_take(TokenKind::Question) ? LifetimeConstraintAst::Kind::LifetimeVariableName : LifetimeConstraintAst::Kind::ParameterName;
 		StringSlice name = lexer.take_value_name();
 		lifetimes.push(LifetimeConstraintAst { kind, name });
 	}
@@ -12,10 +12,10 @@ namespace {
 		MaxSizeVector<4, TypeParameterAst> type_parameters;
 		uint index = 0;
 		do {
-			lexer.take('?');
+			lexer.take(TokenKind::Question);
 			type_parameters.push({ lexer.take_type_name(), index });
 			++index;
-		} while (lexer.try_take(' '));
+		} while (lexer.try_take(TokenKind::Space));
 		return to_arena(type_parameters, arena);
 	}
 
@@ -28,12 +28,12 @@ namespace {
 		MaxSizeVector<4, SpecUseAst> spec_uses;
 		uint index = 0;
 		while (true) {
-			if (!lexer.try_take(' ')) break;
-			if (!lexer.try_take('?')) {
+			if (!lexer.try_take(TokenKind::Space)) break;
+			if (!lexer.try_take(TokenKind::Question)) {
 				do {
 					StringSlice name = lexer.take_spec_name();
 					spec_uses.push({ name, parse_type_arguments(lexer, arena) });
-				} while (lexer.try_take(' '));
+				} while (lexer.try_take(TokenKind::Space));
 				break;
 			}
 			type_parameters.push({ lexer.take_type_name(), index });
@@ -43,19 +43,19 @@ namespace {
 	}
 
 	Slice<ParameterAst> parse_parameters(Lexer& lexer, Arena& arena) {
-		if (!lexer.try_take('('))
+		if (!lexer.try_take(TokenKind::Lparen))
 			return {};
 		MaxSizeVector<4, ParameterAst> parameters;
 		while (true) {
-			if (lexer.try_take(')')) todo(); //error: Don't write `()`
+			if (lexer.try_take(TokenKind::Rparen)) todo(); //error: Don't write `()`
 
 			StringSlice name = lexer.take_value_name();
-			lexer.take(' ');
+			lexer.take(TokenKind::Space);
 			TypeAst type = parse_type(lexer, arena);
 			parameters.push({ name, type });
-			if (lexer.try_take(')')) break;
-			lexer.take(',');
-			lexer.take(' ');
+			if (lexer.try_take(TokenKind::Rparen)) break;
+			lexer.take(TokenKind::Comma);
+			lexer.take(TokenKind::Space);
 		}
 		return to_arena(parameters, arena);
 	}
@@ -76,74 +76,68 @@ namespace {
 		do {
 			Option<ArenaString> comment = lexer.try_take_comment(arena);
 			StringSlice name = lexer.take_value_name();
-			lexer.take(' ');
+			lexer.take(TokenKind::Space);
 			TypeAst type = parse_type(lexer, arena);
 			b.push({ comment, name, type });
 		} while (lexer.take_newline_or_dedent() == NewlineOrDedent::Newline);
 		return to_arena(b, arena);
 	}
 
-	StringSlice parse_cpp_struct_body(Lexer& lexer) {
-		lexer.take_indent();
-		StringSlice name = lexer.take_cpp_type_name();
-		lexer.take_dedent();
-		return name;
-	}
-
-	const StringSlice INCLUDE { "include" };
-
-	SpecDeclarationAst parse_spec(Lexer& lexer, Arena& arena, bool is_public, Option<ArenaString> comment) {
-		const char* start = lexer.at();
+	SpecDeclarationAst parse_spec(Lexer& lexer, Arena& arena, const DeclarationSource& source, bool is_public, Option<ArenaString> comment) {
+		uint start = lexer.at();
 		StringSlice name = lexer.take_type_name();
-		Slice<TypeParameterAst> type_parameters = lexer.try_take(' ') ? parse_type_parameters(lexer, arena) : Slice<TypeParameterAst>{};
+		Slice<TypeParameterAst> type_parameters = lexer.try_take(TokenKind::Space) ? parse_type_parameters(lexer, arena) : Slice<TypeParameterAst>{};
 		lexer.take_indent();
 		MaxSizeVector<4, FunSignatureAst> sigs;
 		do {
 			Option<ArenaString> sig_comment = lexer.try_take_comment(arena);
 			StringSlice sig_name = lexer.take_value_name();
-			lexer.take(' ');
+			lexer.take(TokenKind::Space);
 			sigs.push(parse_signature(lexer, arena, sig_name, sig_comment));
 		} while (lexer.take_newline_or_dedent() == NewlineOrDedent::Newline);
-		return SpecDeclarationAst { comment, lexer.range(start), is_public, name, type_parameters, to_arena(sigs, arena) };
+		return SpecDeclarationAst { source, comment, lexer.range(start), is_public, name, type_parameters, to_arena(sigs, arena) };
 	}
 
-	void parse_struct_or_fun(Lexer& lexer, Arena& arena, bool is_public, const char* start, Option<ArenaString> comment,
-		ListBuilder<StringSlice>& includes, ListBuilder<StructDeclarationAst>& structs, ListBuilder<FunDeclarationAst>& funs) {
-		bool c = lexer.try_take('c');
-		if (c) lexer.take(' ');
+	void parse_struct_or_fun(Lexer& lexer, Arena& arena, const DeclarationSource& source, bool is_public, uint start, Option<ArenaString> comment,
+		ListBuilder<IncludeAst>& includes, ListBuilder<StructDeclarationAst>& structs, ListBuilder<FunDeclarationAst>& funs) {
+		bool c = lexer.try_take(TokenKind::KwC);
+		if (c) lexer.take(TokenKind::Space);
+
+		if (lexer.peek() == TokenKind::KwInclude && lexer.peek(1) == TokenKind::Space) {
+			lexer.take(TokenKind::KwInclude);
+			lexer.take(TokenKind::Space);
+			// is_public is irrelevant for these
+			includes.add({ source, lexer.take_cpp_include() }, arena);
+			return;
+		}
 
 		Lexer::ValueOrTypeName name = lexer.take_value_or_type_name();
 		if (name.is_value) {
-			lexer.take(' ');
-			if (name.name == INCLUDE) {
-				// is_public is irrelevant for these
-				includes.add(lexer.take_cpp_include(), arena);
-			} else {
-				FunSignatureAst signature = parse_signature(lexer, arena, name.name, comment);
-				FunBodyAst body = c ? FunBodyAst { lexer.take_indented_string(arena) } : FunBodyAst { parse_body(lexer, arena) };
-				funs.add({ is_public, signature, body }, arena);
-			}
+			lexer.take(TokenKind::Space);
+			FunSignatureAst signature = parse_signature(lexer, arena, name.name, comment);
+			FunBodyAst body = c ? FunBodyAst { lexer.take_indented_string(arena) } : FunBodyAst { parse_body(lexer, arena) };
+			funs.add({ source, is_public, signature, body }, arena);
 		} else {
 			bool copy = false;
 			Slice<TypeParameterAst> type_parameters;
-			if (lexer.try_take(' ')) {
-				copy = lexer.try_take_copy_keyword();
-				if (!copy || lexer.try_take(' '))
+			if (lexer.try_take(TokenKind::Space)) {
+				copy = lexer.try_take(TokenKind::KwCopy);
+				if (!copy || lexer.try_take(TokenKind::Space))
 					type_parameters = parse_type_parameters(lexer, arena);
 			}
-			StructBodyAst body = c ? StructBodyAst { parse_cpp_struct_body(lexer) } : StructBodyAst { parse_struct_fields(lexer, arena) };
-			structs.add({ comment, lexer.range(start), is_public, name.name, type_parameters, copy, body }, arena);
+			StructBodyAst body = c ? StructBodyAst { lexer.take_cpp_type_name() } : StructBodyAst { parse_struct_fields(lexer, arena) };
+			structs.add({ source, comment, lexer.range(start), is_public, name.name, type_parameters, copy, body }, arena);
 		}
 	}
 
 	ImportAst parse_single_import(Lexer& lexer, PathCache& path_cache) {
 		// Note: 1 dot = 0 parents
-		const char* start = lexer.at();
+		uint start = lexer.at();
 		uint n_dots = 0;
-		while (lexer.try_take('.')) ++n_dots;
+		while (lexer.try_take(TokenKind::Dot)) ++n_dots;
 
 		Path path = path_cache.from_part_slice(lexer.take_value_name());
-		while (lexer.try_take('.'))
+		while (lexer.try_take(TokenKind::Dot))
 			path = path_cache.resolve(path, lexer.take_value_name());
 		return { lexer.range(start), n_dots == 0 ? Option<uint>{} : Option<uint>{ n_dots - 1 }, path };
 	}
@@ -152,48 +146,114 @@ namespace {
 		MaxSizeVector<4, ImportAst> b;
 		do {
 			b.push(parse_single_import(lexer, path_cache));
-		} while (lexer.try_take(' '));
+		} while (lexer.try_take(TokenKind::Space));
 		return to_arena(b, arena);
 	}
-}
 
-void parse_file(FileAst& ast, PathCache& path_cache, Arena& arena) {
-	Lexer::validate_file(ast.source);
-	Lexer lexer { ast.source };
+	// Without 'diagnostics', throws the first ParseDiagnostic.
+	// With it, adds each ParseDiagnostic and goes on from the next top-level declaration.
+	// If something other than a ParseDiagnostic is thrown after there are diagnostics, stops there, since those are reason enough for the failure.
+	// Unless 'at_file_start', the lexer starts at a declaration, and there's no comment or imports for the file.
+	void parse_tokens(
+		FileAst& ast, Lexer& lexer, PathCache& path_cache, Arena& arena, bool at_file_start, bool is_public, Option<ListBuilder<ParseDiagnostic>&> diagnostics
+	) {
+		auto recover = [&](const ParseDiagnostic& diag, uint declaration_start) {
+			if (!diagnostics.has()) throw diag;
+			diagnostics.get().add(diag, arena);
+			lexer.skip_to_next_declaration(declaration_start);
+		};
+		auto should_stop = [&]() {
+			return diagnostics.has() && !diagnostics.get().is_empty();
+		};
 
-	ast.comment = lexer.try_take_comment(arena);
+		if (at_file_start) {
+			try {
+				ast.comment = lexer.try_take_comment(arena);
+				if (lexer.try_take_import_space()) {
+					ast.imports = parse_imports(lexer, arena, path_cache);
+					lexer.take(TokenKind::Newline);
+				}
+			} catch (ParseDiagnostic diag) {
+				recover(diag, 0);
+			}
+		}
 
-	if (lexer.try_take_import_space()) {
-		ast.imports = parse_imports(lexer, arena, path_cache);
-		lexer.take('\n');
-	}
+		const DeclarationSource source { ast.source.begin(), 0 };
+		ListBuilder<IncludeAst> includes;
+		ListBuilder<SpecDeclarationAst> specs;
+		ListBuilder<StructDeclarationAst> structs;
+		ListBuilder<FunDeclarationAst> funs;
+
+		while (true) {
+			uint declaration_start = lexer.at();
+			try {
+				lexer.skip_blank_lines();
+				if (lexer.try_take(TokenKind::End))
+					break;
+				if (lexer.try_take_private_nl()) {
+					if (!is_public) todo(); // we're already private, so this is unnecessary
+					is_public = false;
+					lexer.skip_blank_lines();
+				}
 
-	ListBuilder<StringSlice> includes;
-	ListBuilder<SpecDeclarationAst> specs;
-	ListBuilder<StructDeclarationAst> structs;
-	ListBuilder<FunDeclarationAst> funs;
-
-	bool is_public = true;
-	while (true) {
-		lexer.skip_blank_lines();
-		if (lexer.try_take('\0'))
-			break;
-		if (lexer.try_take_private_nl()) {
-			if (!is_public) todo(); // we're already private, so this is unnecessary
-			is_public = false;
-			lexer.skip_blank_lines();
+				Option<ArenaString> comment = lexer.try_take_comment(arena);
+				declaration_start = lexer.at();
+				if (lexer.try_take(TokenKind::Dollar))
+					specs.add(parse_spec(lexer, arena, source, is_public, comment), arena);
+				else
+					parse_struct_or_fun(lexer, arena, source, is_public, declaration_start, comment, includes, structs, funs);
+			} catch (ParseDiagnostic diag) {
+				recover(diag, declaration_start);
+			} catch (...) {
+				if (!should_stop()) throw;
+				break;
+			}
 		}
 
-		Option<ArenaString> comment = lexer.try_take_comment(arena);
-		const char* start = lexer.at();
-		if (lexer.try_take('$'))
-			specs.add(parse_spec(lexer, arena, is_public, comment), arena);
-		else
-			parse_struct_or_fun(lexer, arena, is_public, start, comment, includes, structs, funs);
+		ast.includes = includes.finish();
+		ast.specs = specs.finish();
+		ast.structs = structs.finish();
+		ast.funs = funs.finish();
+	}
+
+	List<ParseDiagnostic> parse_recovering(FileAst& ast, bool at_file_start, bool is_public, PathCache& path_cache, Arena& arena) {
+		TempArena token_arena;
+		ListBuilder<ParseDiagnostic> token_diagnostics;
+		Lexer lexer { ast.source, tokenize(ast.source, token_arena, token_diagnostics, token_arena) };
+		ListBuilder<ParseDiagnostic> parse_diagnostics;
+		parse_tokens(ast, lexer, path_cache, arena, at_file_start, is_public, Option<ListBuilder<ParseDiagnostic>&> { parse_diagnostics });
+
+		// Both are in source order, so merge them.
+		List<ParseDiagnostic> from_tokens = token_diagnostics.finish();
+		List<ParseDiagnostic> from_parser = parse_diagnostics.finish();
+		ListBuilder<ParseDiagnostic> all;
+		List<ParseDiagnostic>::const_iterator t = from_tokens.begin();
+		List<ParseDiagnostic>::const_iterator p = from_parser.begin();
+		while (true) {
+			bool has_token = t != from_tokens.end(), has_parse = p != from_parser.end();
+			if (!has_token && !has_parse) break;
+			bool take_token = !has_parse || (has_token && (*t).range.begin <= (*p).range.begin);
+			all.add(take_token ? *t : *p, arena);
+			if (take_token) ++t; else ++p;
+		}
+		return all.finish();
 	}
+}
+
+void parse_file(FileAst& ast, PathCache& path_cache, Arena& arena) {
+	TempArena token_arena;
+	ListBuilder<ParseDiagnostic> token_diagnostics;
+	Lexer lexer { ast.source, tokenize(ast.source, token_arena, token_diagnostics, token_arena) };
+	// These used to be found by a pass before parsing, so they come first.
+	if (!token_diagnostics.is_empty())
+		throw *token_diagnostics.finish().begin();
+	parse_tokens(ast, lexer, path_cache, arena, /*at_file_start*/ true, /*is_public*/ true, {});
+}
+
+List<ParseDiagnostic> parse_file_recovering(FileAst& ast, PathCache& path_cache, Arena& arena) {
+	return parse_recovering(ast, /*at_file_start*/ true, /*is_public*/ true, path_cache, arena);
+}
 
-	ast.includes = includes.finish();
-	ast.specs = specs.finish();
-	ast.structs = structs.finish();
-	ast.funs = funs.finish();
+List<ParseDiagnostic> parse_declarations_recovering(FileAst& ast, bool is_public, PathCache& path_cache, Arena& arena) {
+	return parse_recovering(ast, /*at_file_start*/ false, is_public, path_cache, arena);
 }
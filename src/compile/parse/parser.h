@@ -1,8 +1,19 @@
 #pragma once
 
+#include "../diag/parse_diag.h"
 #include "../../util/store/Arena.h"
+#include "../../util/store/List.h"
 #include "../../util/PathCache.h"
 #include "./ast.h"
 
 // May throw a ParseDiagnostic.
 void parse_file(FileAst& ast, PathCache& path_cache, Arena& arena);
+
+// Doesn't stop at the first problem: after a ParseDiagnostic, goes on from the next line at indent 0.
+// 'ast' gets every declaration that parsed. Returns every diagnostic in the file, in source order.
+List<ParseDiagnostic> parse_file_recovering(FileAst& ast, PathCache& path_cache, Arena& arena);
+
+// Like 'parse_file_recovering', but 'ast.source' holds only declarations, as if cut out of a file at a line at indent 0 after the imports.
+// Only fills in the declarations, and they're public until a 'private' line unless '!is_public'.
+// Used by 'reparse_file', which passes in just the declarations an edit touched.
+List<ParseDiagnostic> parse_declarations_recovering(FileAst& ast, bool is_public, PathCache& path_cache, Arena& arena);
@@ -0,0 +1,156 @@
+#include "./reparse.h"
+
+#include <algorithm> // std::copy
+#include "../../util/store/ListBuilder.h"
+#include "./parser.h"
+
+namespace {
+	const StringSlice PRIVATE_LINE { "private\n" };
+
+	const char* line_start(const char* p, const char* source_begin) {
+		while (p != source_begin && *(p - 1) != '\n')
+			--p;
+		return p;
+	}
+
+	// The line after the one containing 'p'.
+	const char* next_line(const char* p, const char* last) {
+		while (p != last && *p != '\n')
+			++p;
+		return p == last ? last : p + 1;
+	}
+
+	// A group is one top-level declaration with its comment, or the file's comment and imports.
+	// It starts at a line at indent 0 that isn't blank and doesn't continue a comment.
+	bool starts_group(const char* line, const char* source_begin) {
+		if (*line == '\t' || *line == '\n' || *line == '\0')
+			return false;
+		return line == source_begin || *line_start(line - 1, source_begin) != '|';
+	}
+
+	// Start of the group containing 'p'.
+	const char* group_start(const char* p, const char* source_begin) {
+		const char* line = line_start(p, source_begin);
+		while (line != source_begin && !starts_group(line, source_begin))
+			line = line_start(line - 1, source_begin);
+		return line;
+	}
+
+	// Start of the first group beginning on a line after the one containing 'p', or the final '\0'.
+	const char* next_group_start(const char* p, const char* source_begin, const char* last) {
+		const char* line = next_line(p, last);
+		while (line != last && !starts_group(line, source_begin))
+			line = next_line(line, last);
+		return line;
+	}
+
+	bool has_private_line(const char* begin, const char* end) {
+		for (const char* line = begin; line < end; line = next_line(line, end))
+			if (uint(end - line) >= PRIVATE_LINE.size() && StringSlice { line, line + PRIVATE_LINE.size() } == PRIVATE_LINE)
+				return true;
+		return false;
+	}
+
+	// Where a declaration is in the current source, to tell which side of the reparsed part it's on.
+	inline uint position(const IncludeAst& i) { return i.source.position(i.name.begin()); }
+	inline uint position(const SpecDeclarationAst& s) { return s.source.position(s.name.begin()); }
+	inline uint position(const StructDeclarationAst& s) { return s.source.position(s.name.begin()); }
+	inline uint position(const FunDeclarationAst& f) { return f.source.position(f.signature.name.begin()); }
+
+	template <typename T>
+	T shifted(const T& declaration, int shift) {
+		T res = declaration;
+		res.source.shift += shift;
+		return res;
+	}
+
+	// Old declarations before 'old_begin', then the reparsed ones, then old declarations from 'old_end' on.
+	// Old declarations aren't copied: they keep pointing into the source they were parsed from, and only their shift changes.
+	template <typename T>
+	List<T> splice(const List<T>& old, const List<T>& reparsed, uint old_begin, uint old_end, int reparsed_shift, int shift, Arena& arena) {
+		ListBuilder<T> b;
+		typename List<T>::const_iterator o = old.begin();
+		for (; o != old.end() && position(*o) < old_begin; ++o)
+			b.add(*o, arena);
+		for (const T& r : reparsed)
+			b.add(shifted(r, reparsed_shift), arena);
+		for (; o != old.end(); ++o)
+			if (position(*o) >= old_end)
+				b.add(shifted(*o, shift), arena);
+		return b.finish();
+	}
+
+	// Whether declarations from 'group' on start out public.
+	bool is_public_at(const FileAst& previous, uint group) {
+		// The last declaration before 'group' tells, unless there's a 'private' line after it.
+		uint last_before = 0;
+		bool is_public = true;
+		auto consider = [&](uint p, bool p_is_public) {
+			if (p < group && p >= last_before) {
+				last_before = p;
+				is_public = p_is_public;
+			}
+		};
+		for (const SpecDeclarationAst& s : previous.specs) consider(position(s), s.is_public);
+		for (const StructDeclarationAst& s : previous.structs) consider(position(s), s.is_public);
+		for (const FunDeclarationAst& f : previous.funs) consider(position(f), f.is_public);
+		const char* source = previous.source.begin();
+		return is_public && !has_private_line(line_start(source + last_before, source), source + group);
+	}
+}
+
+ReparseResult reparse_file(const FileAst& previous, const StringSlice& new_source, const TextEdit& edit, PathCache& path_cache, Arena& arena) {
+	const StringSlice old_source = previous.source;
+	const char* const old_last = old_source.end() - 1;
+	assert(edit.range.end < old_source.size()); // Can't touch the final '\0'
+	const int shift = int(new_source.size()) - int(old_source.size());
+	assert(shift == int(edit.new_text.size()) - int(edit.range.end - edit.range.begin));
+	to_ushort(new_source.size()); // Source ranges limit files to 64KB.
+	auto to_new = [&](const char* old) { return new_source.begin() + (old - old_source.begin()) + (old - old_source.begin() >= edit.range.end ? shift : 0); };
+
+	// Reparse from the group before the edit (in case the edit joins lines onto it) to the first group after it.
+	const char* old_begin = group_start(old_source.begin() + (edit.range.begin == 0 ? 0 : edit.range.begin - 1), old_source.begin());
+	const char* old_end = next_group_start(old_source.begin() + edit.range.end, old_source.begin(), old_last);
+	// A comment written at the end attaches to the next declaration, so that must be reparsed too.
+	while (old_end != old_last && *line_start(to_new(old_end) - 1, new_source.begin()) == '|')
+		old_end = next_group_start(old_end, old_source.begin(), old_last);
+	// A 'private' line affects every declaration after it.
+	if (has_private_line(old_begin, old_end) || has_private_line(to_new(old_begin), to_new(old_end)))
+		old_end = old_last;
+
+	// Only the reparsed part is copied, to be parsed as if it were the whole file. Its declarations point into the copy.
+	const char* new_begin = to_new(old_begin);
+	const char* new_end = to_new(old_end);
+	ArenaString part = allocate_slice(arena, uint(new_end - new_begin) + 1);
+	*std::copy(new_begin, new_end, part.begin()) = '\0';
+	const int part_shift = int(new_begin - new_source.begin());
+	const bool at_file_start = old_begin == old_source.begin();
+	Ref<FileAst> reparsed = arena.put(FileAst { previous.path, part.slice() });
+	List<ParseDiagnostic> part_diagnostics = at_file_start
+		? parse_file_recovering(reparsed, path_cache, arena)
+		: parse_declarations_recovering(reparsed, is_public_at(previous, uint(old_begin - old_source.begin())), path_cache, arena);
+	ListBuilder<ParseDiagnostic> diagnostics;
+	for (const ParseDiagnostic& d : part_diagnostics)
+		diagnostics.add({ DeclarationSource { part.begin(), part_shift }.range(d.range), d.diag }, arena);
+
+	Ref<FileAst> ast = arena.put(FileAst { previous.path, new_source });
+	// Everything before the reparsed part stays where it was, including the imports.
+	ast->comment = at_file_start ? reparsed->comment : previous.comment;
+	ast->imports = at_file_start ? reparsed->imports : previous.imports;
+	const uint begin = uint(old_begin - old_source.begin()), end = uint(old_end - old_source.begin());
+	ast->includes = splice(previous.includes, reparsed->includes, begin, end, part_shift, shift, arena);
+	ast->specs = splice(previous.specs, reparsed->specs, begin, end, part_shift, shift, arena);
+	ast->structs = splice(previous.structs, reparsed->structs, begin, end, part_shift, shift, arena);
+	ast->funs = splice(previous.funs, reparsed->funs, begin, end, part_shift, shift, arena);
+	return { ast, diagnostics.finish(), uint(new_end - new_begin) };
+}
+
+ArenaString apply_edit(const StringSlice& source, const TextEdit& edit, Arena& arena) {
+	// Not 'StringBuilder', which would copy a char at a time.
+	ArenaString res = allocate_slice(arena, source.size() - (edit.range.end - edit.range.begin) + edit.new_text.size());
+	char* out = std::copy(source.begin(), source.begin() + edit.range.begin, res.begin());
+	out = std::copy(edit.new_text.begin(), edit.new_text.end(), out);
+	out = std::copy(source.begin() + edit.range.end, source.end(), out);
+	assert(out == res.end());
+	return res;
+}
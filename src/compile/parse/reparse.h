@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../diag/parse_diag.h"
+#include "../../util/store/Arena.h"
+#include "../../util/store/List.h"
+#include "../../util/PathCache.h"
+#include "./ast.h"
+
+// Replaces 'range' of the old source with 'new_text'.
+struct TextEdit {
+	SourceRange range;
+	StringSlice new_text; // Default-constructed for a deletion.
+};
+
+struct ReparseResult {
+	Ref<FileAst> ast; // Its source is the new source.
+	List<ParseDiagnostic> diagnostics;
+	uint n_reparsed; // How many bytes of the new source were parsed again.
+};
+
+// For an editor, where each keystroke is an edit: parses again only the top-level declarations the edit touched.
+// 'new_source' is the old source with 'edit' applied, and becomes the result's source.
+// Only the reparsed part of it is copied. The other declarations are shared with 'previous', and keep pointing into the source they were parsed from.
+// Their 'DeclarationSource' tells where they are now. So the arena of 'previous' must outlive the result, but 'previous.source' need not.
+// 'previous' must have parsed with no diagnostics. (Otherwise, use 'parse_file_recovering' until it does.)
+// The result is the same as from 'parse_file_recovering' on the new source.
+ReparseResult reparse_file(const FileAst& previous, const StringSlice& new_source, const TextEdit& edit, PathCache& path_cache, Arena& arena);
+
+// The source 'reparse_file' expects: 'source' with 'edit' applied.
+ArenaString apply_edit(const StringSlice& source, const TextEdit& edit, Arena& arena);
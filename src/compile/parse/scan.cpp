@@ -0,0 +1,162 @@
+#include "./scan.h"
+
+#include "../../util/int.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h> // _mm_*
+#endif
+
+namespace {
+	bool is_lower_case_letter(char c) {
+		return 'a' <= c && c <= 'z';
+	}
+	bool is_upper_case_letter(char c) {
+		return 'A' <= c && c <= 'Z';
+	}
+	bool is_operator_char(char c) {
+		switch (c) {
+			case '+':
+			case '-':
+			case '*':
+			case '/':
+			case '<':
+			case '>':
+			case '=':
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	template <typename /*char => bool*/ Pred>
+	const char* skip_while(const char* ptr, const char* end, Pred pred) {
+		while (ptr != end && pred(*ptr))
+			++ptr;
+		return ptr;
+	}
+
+#ifdef __SSE2__
+	const long BLOCK = 16;
+
+	inline __m128i load(const char* ptr) {
+		// Through void* since it needn't be aligned.
+		return _mm_loadu_si128(static_cast<const __m128i*>(static_cast<const void*>(ptr)));
+	}
+	inline __m128i eq(__m128i v, char c) {
+		return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+	}
+	// Bytes are compared as signed, which is fine since we only look for ASCII.
+	inline __m128i in_range(__m128i v, char lo, char hi) {
+		return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(char(lo - 1))), _mm_cmplt_epi8(v, _mm_set1_epi8(char(hi + 1))));
+	}
+	inline uint mask_of(__m128i v) {
+		return uint(_mm_movemask_epi8(v));
+	}
+
+	// 'matches' gives a byte of all ones for each char in the run. Finishes the last partial block one char at a time.
+	template <typename /*__m128i => __m128i*/ Matches, typename /*char => bool*/ Pred>
+	const char* skip_blocks(const char* ptr, const char* end, Matches matches, Pred pred) {
+		for (; end - ptr >= BLOCK; ptr += BLOCK) {
+			uint mask = mask_of(matches(load(ptr)));
+			if (mask != 0xffff)
+				return ptr + __builtin_ctz(~mask);
+		}
+		return skip_while(ptr, end, pred);
+	}
+
+	// 'matches' gives a byte of all ones for each char that ends the search.
+	template <typename /*__m128i => __m128i*/ Matches, typename /*const char* => bool*/ Pred>
+	const char* find_blocks(const char* ptr, const char* end, Matches matches, Pred pred) {
+		for (; end - ptr >= BLOCK; ptr += BLOCK) {
+			uint mask = mask_of(matches(ptr));
+			if (mask != 0)
+				return ptr + __builtin_ctz(mask);
+		}
+		while (ptr != end && !pred(ptr))
+			++ptr;
+		return ptr;
+	}
+#endif
+}
+
+namespace scan {
+	namespace portable {
+		const char* skip_value_name_continue(const char* ptr, const char* end) {
+			return skip_while(ptr, end, [](char c) { return is_lower_case_letter(c) || c == '-'; });
+		}
+		const char* skip_type_name_continue(const char* ptr, const char* end) {
+			return skip_while(ptr, end, [](char c) { return is_lower_case_letter(c) || is_upper_case_letter(c); });
+		}
+		const char* skip_operator_chars(const char* ptr, const char* end) {
+			return skip_while(ptr, end, is_operator_char);
+		}
+		const char* skip_tabs(const char* ptr, const char* end) {
+			return skip_while(ptr, end, [](char c) { return c == '\t'; });
+		}
+		const char* find_newline(const char* ptr, const char* end) {
+			return skip_while(ptr, end, [](char c) { return c != '\n'; });
+		}
+		const char* find_trailing_space(const char* ptr, const char* end) {
+			for (; ptr != end; ++ptr)
+				if (*ptr == '\n' && (*(ptr - 1) == ' ' || *(ptr - 1) == '\t'))
+					return ptr;
+			return end;
+		}
+		uint count_newlines(const char* ptr, const char* end) {
+			uint n = 0;
+			for (; ptr != end; ++ptr)
+				if (*ptr == '\n')
+					++n;
+			return n;
+		}
+	}
+
+#ifdef __SSE2__
+	const char* skip_value_name_continue(const char* ptr, const char* end) {
+		return skip_blocks(ptr, end,
+			[](__m128i v) { return _mm_or_si128(in_range(v, 'a', 'z'), eq(v, '-')); },
+			[](char c) { return is_lower_case_letter(c) || c == '-'; });
+	}
+	const char* skip_type_name_continue(const char* ptr, const char* end) {
+		return skip_blocks(ptr, end,
+			[](__m128i v) { return _mm_or_si128(in_range(v, 'a', 'z'), in_range(v, 'A', 'Z')); },
+			[](char c) { return is_lower_case_letter(c) || is_upper_case_letter(c); });
+	}
+	const char* skip_operator_chars(const char* ptr, const char* end) {
+		return skip_blocks(ptr, end,
+			[](__m128i v) {
+				// '*' '+' are adjacent, as are '<' '=' '>'.
+				return _mm_or_si128(_mm_or_si128(in_range(v, '*', '+'), in_range(v, '<', '>')), _mm_or_si128(eq(v, '-'), eq(v, '/')));
+			},
+			is_operator_char);
+	}
+	const char* skip_tabs(const char* ptr, const char* end) {
+		return skip_blocks(ptr, end, [](__m128i v) { return eq(v, '\t'); }, [](char c) { return c == '\t'; });
+	}
+	const char* find_newline(const char* ptr, const char* end) {
+		return find_blocks(ptr, end, [](const char* p) { return eq(load(p), '\n'); }, [](const char* p) { return *p == '\n'; });
+	}
+	const char* find_trailing_space(const char* ptr, const char* end) {
+		return find_blocks(ptr, end,
+			[](const char* p) {
+				__m128i prev = load(p - 1);
+				return _mm_and_si128(eq(load(p), '\n'), _mm_or_si128(eq(prev, ' '), eq(prev, '\t')));
+			},
+			[](const char* p) { return *p == '\n' && (*(p - 1) == ' ' || *(p - 1) == '\t'); });
+	}
+	uint count_newlines(const char* ptr, const char* end) {
+		uint n = 0;
+		for (; end - ptr >= BLOCK; ptr += BLOCK)
+			n += uint(__builtin_popcount(mask_of(eq(load(ptr), '\n'))));
+		return n + portable::count_newlines(ptr, end);
+	}
+#else
+	const char* skip_value_name_continue(const char* ptr, const char* end) { return portable::skip_value_name_continue(ptr, end); }
+	const char* skip_type_name_continue(const char* ptr, const char* end) { return portable::skip_type_name_continue(ptr, end); }
+	const char* skip_operator_chars(const char* ptr, const char* end) { return portable::skip_operator_chars(ptr, end); }
+	const char* skip_tabs(const char* ptr, const char* end) { return portable::skip_tabs(ptr, end); }
+	const char* find_newline(const char* ptr, const char* end) { return portable::find_newline(ptr, end); }
+	const char* find_trailing_space(const char* ptr, const char* end) { return portable::find_trailing_space(ptr, end); }
+	uint count_newlines(const char* ptr, const char* end) { return portable::count_newlines(ptr, end); }
+#endif
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../../util/int.h"
+
+// Loops the lexer spends most of its time in.
+// Where SSE2 is available these look at 16 bytes at a time. They never read at or past 'end'.
+namespace scan {
+	// Each returns the first char from 'ptr' that doesn't continue the run, or 'end'.
+	const char* skip_value_name_continue(const char* ptr, const char* end); // [a-z-]
+	const char* skip_type_name_continue(const char* ptr, const char* end); // [A-Za-z]
+	const char* skip_operator_chars(const char* ptr, const char* end); // [-+*/<>=]
+	const char* skip_tabs(const char* ptr, const char* end);
+	// Returns the first '\n' from 'ptr', or 'end'.
+	const char* find_newline(const char* ptr, const char* end);
+	// Returns the first '\n' from 'ptr' that comes right after a ' ' or '\t', or 'end'. 'ptr - 1' must be readable.
+	const char* find_trailing_space(const char* ptr, const char* end);
+	uint count_newlines(const char* ptr, const char* end);
+
+	// The same, one char at a time. Used when SSE2 isn't available, and for comparison in tests and benchmarks.
+	namespace portable {
+		const char* skip_value_name_continue(const char* ptr, const char* end);
+		const char* skip_type_name_continue(const char* ptr, const char* end);
+		const char* skip_operator_chars(const char* ptr, const char* end);
+		const char* skip_tabs(const char* ptr, const char* end);
+		const char* find_newline(const char* ptr, const char* end);
+		const char* find_trailing_space(const char* ptr, const char* end);
+		uint count_newlines(const char* ptr, const char* end);
+	}
+}
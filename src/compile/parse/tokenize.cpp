@@ -0,0 +1,326 @@
+#include "./tokenize.h"
+
+#include "../../util/store/ArenaArrayBuilders.h"
+#include "./scan.h"
+
+namespace {
+	bool is_lower_case_letter(char c) {
+		return 'a' <= c && c <= 'z';
+	}
+	bool is_upper_case_letter(char c) {
+		return 'A' <= c && c <= 'Z';
+	}
+	bool is_digit(char c) {
+		return '0' <= c && c <= '9';
+	}
+	bool is_operator_char(char c) {
+		switch (c) {
+			case '+':
+			case '-':
+			case '*':
+			case '/':
+			case '<':
+			case '>':
+			case '=':
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	const StringSlice ASSERT { "assert" };
+	const StringSlice COPY { "copy" };
+	const StringSlice ELSE { "else" };
+	const StringSlice GET { "get" };
+	const StringSlice IMPORT { "import" };
+	const StringSlice INCLUDE { "include" };
+	const StringSlice OWN { "own" };
+	const StringSlice PASS { "pass" };
+	const StringSlice PRIVATE { "private" };
+	const StringSlice SET { "set" };
+	const StringSlice WHEN { "when" };
+
+	TokenKind name_kind(const StringSlice& name) {
+		switch (name.size()) {
+			case 1:
+				return *name.begin() == 'c' ? TokenKind::KwC : TokenKind::Name;
+			case 2:
+				return name.begin()[0] == 'i' && name.begin()[1] == 'o' ? TokenKind::KwIo : TokenKind::Name;
+			case 3:
+				return name == GET ? TokenKind::KwGet : name == SET ? TokenKind::KwSet : name == OWN ? TokenKind::KwOwn : TokenKind::Name;
+			case 4:
+				return name == COPY ? TokenKind::KwCopy
+					: name == ELSE ? TokenKind::KwElse
+					: name == PASS ? TokenKind::KwPass
+					: name == WHEN ? TokenKind::KwWhen
+					: TokenKind::Name;
+			case 6:
+				return name == ASSERT ? TokenKind::KwAssert : name == IMPORT ? TokenKind::KwImport : TokenKind::Name;
+			case 7:
+				return name == INCLUDE ? TokenKind::KwInclude : name == PRIVATE ? TokenKind::KwPrivate : TokenKind::Name;
+			default:
+				return TokenKind::Name;
+		}
+	}
+
+	bool is_name_but_not_operator(TokenKind kind) {
+		return is_value_name(kind) && kind != TokenKind::Operator;
+	}
+	// Whether a '<' right after this opens type arguments, rather than starting an operator.
+	bool may_open_type_arguments(TokenKind kind) {
+		return kind == TokenKind::TypeName || kind == TokenKind::StringLiteral || kind == TokenKind::NumberLiteral || is_name_but_not_operator(kind);
+	}
+	// Whether a '>' right after this closes type arguments, rather than starting an operator.
+	bool may_close_type_arguments(TokenKind kind) {
+		return kind == TokenKind::TypeName || kind == TokenKind::Greater || is_name_but_not_operator(kind);
+	}
+
+	const uint MAX_INDENT = 127; // So indent deltas fit in a signed char.
+
+	class Tokenizer {
+		const StringSlice source;
+		const char* const last; // The final '\0'
+		const char* ptr;
+
+		TokenKind* const kinds;
+		ushort* const offsets;
+		ushort* const lengths;
+		signed char* const indent_deltas;
+		uint n_tokens;
+
+		ListBuilder<ParseDiagnostic>& diagnostics;
+		Arena& diags_arena;
+
+		uint line_indent;
+		uint line_first_token;
+		// Set when a line at indent 0 starts with 'c ', meaning an indented block after it is C++.
+		bool cpp_line;
+
+		// The constructor checks that the source fits, so these can't overflow.
+		inline ushort offset_of(const char* p) const {
+			return static_cast<ushort>(p - source.begin());
+		}
+
+		inline void add(TokenKind kind, const char* begin, const char* end, signed char indent_delta = 0) {
+			kinds[n_tokens] = kind;
+			offsets[n_tokens] = offset_of(begin);
+			lengths[n_tokens] = static_cast<ushort>(end - begin);
+			indent_deltas[n_tokens] = indent_delta;
+			++n_tokens;
+		}
+
+		inline void add_char(TokenKind kind) {
+			add(kind, ptr, ptr + 1);
+			++ptr;
+		}
+
+		inline TokenKind previous_kind() const {
+			return n_tokens == 0 ? TokenKind::Newline : kinds[n_tokens - 1];
+		}
+
+		void add_diag(const char* begin, const char* end, ParseDiag diag) {
+			diagnostics.add({ SourceRange::inner_slice(source, { begin, end }), diag }, diags_arena);
+		}
+		void add_diag_at(const char* p, ParseDiag diag) {
+			add_diag(p, p + 1, diag);
+		}
+		void add_trailing_space(const char* newline) {
+			add_diag(newline - 1, newline, ParseDiag::Kind::TrailingSpace);
+		}
+		// Checks every '\n' in [begin, end). 'begin - 1' must be in the source.
+		void check_no_trailing_space(const char* begin, const char* end) {
+			for (const char* trailing = scan::find_trailing_space(begin, end); trailing != end; trailing = scan::find_trailing_space(trailing + 1, end))
+				add_trailing_space(trailing);
+		}
+
+		void start_line() {
+			line_first_token = n_tokens;
+			cpp_line = false;
+			if (*ptr == '|')
+				take_comment();
+		}
+
+		void take_comment() {
+			++ptr;
+			if (*ptr == ' ')
+				++ptr;
+			else
+				add_diag_at(ptr, { ParseDiag::Kind::ExpectedCharacter, ' ' });
+			const char* begin = ptr;
+			ptr = scan::find_newline(ptr, last);
+			add(TokenKind::Comment, begin, ptr);
+		}
+
+		void take_newline() {
+			if (ptr != source.begin() && (*(ptr - 1) == ' ' || *(ptr - 1) == '\t'))
+				add_trailing_space(ptr);
+			if (cpp_line && *(ptr + 1) == '\t') {
+				take_cpp_body();
+				return;
+			}
+
+			const char* begin = ptr;
+			++ptr;
+			const char* tabs_end = scan::skip_tabs(ptr, last);
+			uint indent = uint(tabs_end - ptr);
+			if (indent > MAX_INDENT) {
+				add_diag_at(ptr + MAX_INDENT, { ParseDiag::Kind::UnexpectedCharacter, '\t' });
+				indent = MAX_INDENT;
+			}
+			ptr = tabs_end;
+			add(TokenKind::Newline, begin, ptr, static_cast<signed char>(int(indent) - int(line_indent)));
+			line_indent = indent;
+			start_line();
+		}
+
+		// Keep eating until we see a line that begins in something other than '\t'.
+		void take_cpp_body() {
+			ptr += 2; // "\n\t"
+			const char* const begin = ptr;
+			while (true) {
+				ptr = scan::find_newline(ptr, last);
+				while (*ptr == '\n') ++ptr;
+				if (*ptr != '\t') break;
+				++ptr;
+			}
+			// Trailing newlines are left for the next tokens, and 'take_newline' checks before those.
+			const char* end = ptr;
+			while (*(end - 1) == '\n')
+				--end;
+			check_no_trailing_space(begin, end);
+			add(TokenKind::CppBody, begin, end);
+			ptr = end;
+			cpp_line = false;
+		}
+
+		void take_string_literal() {
+			++ptr;
+			const char* begin = ptr;
+			//TODO:ESCAPING (then literals with escapes will need to be copied)
+			while (*ptr != '"' && *ptr != '\0')
+				++ptr;
+			check_no_trailing_space(begin, ptr);
+			add(TokenKind::StringLiteral, begin, ptr);
+			if (*ptr != '\0') ++ptr;
+		}
+
+		// Literals are allowed to be written as +123.456.789 instead of "+123.456.789" since numeric literals are common.
+		void take_numeric_literal() {
+			const char* begin = ptr;
+			while (is_digit(*ptr) || *ptr == '.') ++ptr;
+			add(TokenKind::NumberLiteral, begin, ptr);
+		}
+
+		void take_name() {
+			const char* begin = ptr;
+			ptr = scan::skip_value_name_continue(ptr + 1, last);
+			TokenKind kind = name_kind({ begin, ptr });
+			bool first_on_line = n_tokens == line_first_token;
+			add(kind, begin, ptr);
+
+			if (line_indent != 0 || *ptr != ' ')
+				return;
+			if (kind == TokenKind::KwC && first_on_line)
+				cpp_line = true;
+			else if (kind == TokenKind::KwInclude && (first_on_line || (cpp_line && n_tokens == line_first_token + 3))) {
+				add_char(TokenKind::Space);
+				const char* rest = ptr;
+				ptr = scan::find_newline(ptr, last);
+				add(TokenKind::RestOfLine, rest, ptr);
+			}
+		}
+
+		void take_operator() {
+			const char* begin = ptr;
+			ptr = scan::skip_operator_chars(ptr + 1, last);
+			add(TokenKind::Operator, begin, ptr);
+		}
+
+	public:
+		Tokenizer(const StringSlice& _source, Arena& arena, ListBuilder<ParseDiagnostic>& _diagnostics, Arena& _diags_arena)
+			: source{_source},
+			last{_source.end() - 1},
+			ptr{_source.begin()},
+			// Every token takes at least one char.
+			kinds{uninitialized_array<TokenKind>(arena, _source.size()).begin()},
+			offsets{uninitialized_array<ushort>(arena, _source.size()).begin()},
+			lengths{uninitialized_array<ushort>(arena, _source.size()).begin()},
+			indent_deltas{uninitialized_array<signed char>(arena, _source.size()).begin()},
+			n_tokens{0},
+			diagnostics{_diagnostics},
+			diags_arena{_diags_arena},
+			line_indent{0},
+			line_first_token{0},
+			cpp_line{false} {
+			assert(!source.is_empty() && *last == '\0'); // Should be guaranteed by file reader
+			to_ushort(source.size()); // Source ranges limit files to 64KB.
+		}
+
+		Tokens run() {
+			start_line();
+			while (true) {
+				char c = *ptr;
+				switch (c) {
+					case '\0':
+						if (ptr != last) {
+							add_char(TokenKind::Invalid);
+							break;
+						}
+						if (last == source.begin() || *(last - 1) != '\n')
+							add_diag(last, source.end(), ParseDiag::Kind::MustEndInBlankLine);
+						add(TokenKind::End, last, source.end());
+						return {
+							{ kinds, n_tokens },
+							{ offsets, n_tokens },
+							{ lengths, n_tokens },
+							{ indent_deltas, n_tokens },
+						};
+					case '\n':
+						take_newline();
+						break;
+					case '\t': {
+						// Before a newline, this is trailing space, which 'take_newline' reports.
+						const char* begin = ptr;
+						ptr = scan::skip_tabs(ptr, last);
+						if (*ptr != '\n')
+							add(TokenKind::Invalid, begin, ptr);
+						break;
+					}
+					case ' ': add_char(TokenKind::Space); break;
+					case ',': add_char(TokenKind::Comma); break;
+					case '.': add_char(TokenKind::Dot); break;
+					case '(': add_char(TokenKind::Lparen); break;
+					case ')': add_char(TokenKind::Rparen); break;
+					case '?': add_char(TokenKind::Question); break;
+					case '$': add_char(TokenKind::Dollar); break;
+					case '"':
+						take_string_literal();
+						break;
+					case '<':
+						if (may_open_type_arguments(previous_kind())) add_char(TokenKind::Less); else take_operator();
+						break;
+					case '>':
+						if (may_close_type_arguments(previous_kind())) add_char(TokenKind::Greater); else take_operator();
+						break;
+					default:
+						if (is_lower_case_letter(c))
+							take_name();
+						else if (is_upper_case_letter(c)) {
+							const char* begin = ptr;
+							ptr = scan::skip_type_name_continue(ptr + 1, last);
+							add(TokenKind::TypeName, begin, ptr);
+						} else if (is_digit(c))
+							take_numeric_literal();
+						else if (is_operator_char(c))
+							take_operator();
+						else
+							add_char(TokenKind::Invalid);
+				}
+			}
+		}
+	};
+}
+
+Tokens tokenize(const StringSlice& source, Arena& arena, ListBuilder<ParseDiagnostic>& diagnostics, Arena& diags_arena) {
+	return Tokenizer { source, arena, diagnostics, diags_arena }.run();
+}
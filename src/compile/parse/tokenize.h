@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../diag/parse_diag.h"
+#include "../../util/store/Arena.h"
+#include "../../util/store/ListBuilder.h"
+#include "../../util/store/Slice.h"
+#include "../../util/store/StringSlice.h"
+
+enum class TokenKind : unsigned char {
+	End, // The final '\0'
+	// A '\n' and the tabs after it. Blank lines are their own tokens.
+	Newline,
+
+	Space,
+	Comma,
+	Dot,
+	Lparen,
+	Rparen,
+	Less, // Opens type arguments. Only right after a name, type name or literal.
+	Greater, // Closes type arguments. Only right after a name, type name or '>'.
+	Question,
+	Dollar,
+	// A run of characters that can't start a token. The parser reports it as unexpected.
+	Invalid,
+
+	TypeName,
+	StringLiteral, // The text between the quotes
+	NumberLiteral,
+	// One line of a comment, not including the '| '.
+	Comment,
+	// The rest of the line after 'include '.
+	RestOfLine,
+	// The indented block after a line starting with 'c '. Starts after its first tab and ends at its last non-blank line.
+	CppBody,
+
+	// Everything from here on can be used as a value name.
+	Name,
+	Operator,
+	// Keywords are also ordinary names everywhere the parser doesn't look for them.
+	KwAssert,
+	KwC,
+	KwCopy,
+	KwElse,
+	KwGet,
+	KwImport,
+	KwInclude,
+	KwIo,
+	KwOwn,
+	KwPass,
+	KwPrivate,
+	KwSet,
+	KwWhen,
+};
+
+inline bool is_value_name(TokenKind kind) {
+	return kind >= TokenKind::Name;
+}
+
+// Structure of arrays, so the parser's scans over 'kinds' stay in cache.
+struct Tokens {
+	Slice<TokenKind> kinds;
+	Slice<ushort> offsets; // From the start of the source
+	Slice<ushort> lengths;
+	// Only for Newline tokens: the new line's indentation minus the previous line's.
+	Slice<signed char> indent_deltas;
+
+	inline uint size() const { return kinds.size(); }
+};
+
+// Also checks what used to be checked by a separate pass: no trailing spaces, and the file ends in a blank line.
+// Those problems are added to 'diagnostics' in source order, and tokenizing goes on.
+// 'source' must end in '\0'.
+Tokens tokenize(const StringSlice& source, Arena& arena, ListBuilder<ParseDiagnostic>& diagnostics, Arena& diags_arena);
@@ -160,10 +160,12 @@ void write_emittable_struct(Writer& out, const EmittableStruct& e, const Names&
 			break;
 		case StructBody::Kind::Fields:
 			out << "struct " << names.name(e) << " {" << Writer::indent << Writer::nl;
+			bool first_field = true;
 			zip(body.fields(), e.field_types, [&](const StructField& field, const EmittableType& field_type) {
+				if (first_field) first_field = false; else out << Writer::nl;
 				write_type(out, field_type, names);
 				out << ' ';
-				out << names.name(field);
+				out << names.name(field) << ';';
 			});
 			out << Writer::dedent << Writer::nl << "};";
 	}
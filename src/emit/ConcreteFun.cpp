@@ -20,57 +20,77 @@ ConcreteFun::ConcreteFun(
 	assert(parameter_types.size() == fun_declaration->signature.arity());
 }
 
+ConcreteFunsCache::Key ConcreteFunsCache::Key::make(
+	Ref<const FunDeclaration> fun_declaration, const Slice<EmittableType>& type_arguments, const Slice<Slice<Ref<const ConcreteFun>>>& spec_impls) {
+	hash_t h = hash_combine(Ref<const FunDeclaration>::hash{}(fun_declaration), hash_arr(type_arguments, EmittableType::hash{}));
+	for (const Slice<Ref<const ConcreteFun>>& impls : spec_impls)
+		h = hash_combine(h, hash_arr(impls, Ref<const ConcreteFun>::hash{}));
+	return { fun_declaration, type_arguments, spec_impls, h };
+}
+
 Ref<const ConcreteFun> ConcreteFunsCache::get_concrete_fun_for_main(const FunDeclaration& main, EmittableTypeCache& type_cache) {
 	const FunSignature& sig = main.signature;
 	if (sig.is_generic()) todo(); //compile error
+	TempArena scratch;
 	auto get_type = [&](const Type& t) -> EmittableType { return type_cache.get_type(t, {}, {}); };
-	EmittableType return_type = type_cache.get_type(sig.return_type, {}, {});
-	Slice<EmittableType> parameter_types = map<EmittableType>{}(arena, sig.parameters, [&](const Parameter& p) { return get_type(p.type); });
-	return &funs_map.must_insert(&main, NonEmptyList<ConcreteFun> { ConcreteFun { &main, {}, {}, return_type, parameter_types } }).value.first();
+	EmittableType return_type = get_type(sig.return_type);
+	Slice<EmittableType> temp_parameter_types = map<EmittableType>{}(scratch, sig.parameters, [&](const Parameter& p) { return get_type(p.type); });
+	InsertResult<Key, Ref<const ConcreteFun>> inserted = funs_map.get_or_insert(Key::make(&main, {}, {}), [&](Arena& arena) {
+		Ref<const ConcreteFun> res = arena.put(ConcreteFun { &main, {}, {}, return_type, clone(temp_parameter_types, arena) });
+		return Pair<Key, Ref<const ConcreteFun>> { Key::make(&main, {}, {}), res };
+	});
+	assert(inserted.was_added);
+	return inserted.pair.value;
 }
 
 TryInsertResult<ConcreteFun> ConcreteFunsCache::get_concrete_fun_for_call(
 	Ref<const ConcreteFun> current_concrete_fun, const Called& called, EmittableTypeCache& type_cache) {
-
 	Ref<const FunDeclaration> called_fun = called.called_declaration.fun(); //TODO: handle spec calls
 	const FunSignature& called_sig = called.called_declaration.sig();
 
-	//TODO: don't always allocate this in out arena. Only if we need to insert it into the map.
-	Arena temp;
-	// Allocated in temp arena because we'll probably use a cached result and not need this.
-	Slice<EmittableType> temp_type_arguments = map<EmittableType>{}(temp, called.type_arguments, [&](const Type& type_argument) {
+	// Nothing is locked while the key is built, so 'type_cache' takes its own locks one at a time.
+	// The key is allocated in a scratch arena, because we'll probably use a cached result and not need it.
+	TempArena scratch;
+	Slice<EmittableType> temp_type_arguments = map<EmittableType>{}(scratch, called.type_arguments, [&](const Type& type_argument) {
 		return type_cache.get_type(type_argument, current_concrete_fun->fun_declaration->signature.type_parameters, current_concrete_fun->type_arguments);
 	});
 
-	Slice<Slice<Ref<const ConcreteFun>>> temp_concrete_spec_impls = map<Slice<Ref<const ConcreteFun>>>{}(temp, called.spec_impls, [&](const Slice<CalledDeclaration>& called_specs) {
-		return map<Ref<const ConcreteFun>>{}(arena, called_specs, [&](const CalledDeclaration& called_spec) {
+	Slice<Slice<Ref<const ConcreteFun>>> temp_concrete_spec_impls = map<Slice<Ref<const ConcreteFun>>>{}(scratch, called.spec_impls, [&](const Slice<CalledDeclaration>& called_specs) {
+		return map<Ref<const ConcreteFun>>{}(scratch, called_specs, [&](const CalledDeclaration& called_spec) {
 			switch (called_spec.kind()) {
 				case CalledDeclaration::Kind::Spec:
 					todo();
 				case CalledDeclaration::Kind::Fun: {
 					Ref<const FunDeclaration> spec_impl = called_spec.fun();
 					if (spec_impl->signature.is_generic()) todo();
-					// Since it's non-generic, should have exactly 1 instantiation.
-					const NonEmptyList<ConcreteFun>& list = funs_map.get(spec_impl).get();
-					assert(!list.has_more_than_one());
-					return &list.first();
+					// Since it's non-generic, its only instantiation has no type arguments or spec implementations.
+					Option<Ref<const ConcreteFun>> impl = funs_map.get(Key::make(spec_impl, {}, {}));
+					assert(impl.has());
+					return impl.get();
 				}
 			}
 		});
 	});
 
-	return add_to_map_of_lists(
-		funs_map, called_fun, arena,
-		/*is_match*/ [&](const ConcreteFun& cf) {
-			return cf.fun_declaration == called_fun && cf.type_arguments == temp_type_arguments && cf.spec_impls == temp_concrete_spec_impls;
-		},
-		/*create_value*/ [&]() {
-			auto get_type = [&](const Type& t) -> EmittableType {
-				return type_cache.get_type(t, called_sig.type_parameters, temp_type_arguments);
-			};
-			Slice<EmittableType> type_arguments = clone(temp_type_arguments, arena);
-			Slice<Slice<Ref<const ConcreteFun>>> concrete_spec_impls = clone(temp_concrete_spec_impls, arena);
-			Slice<EmittableType> parameter_types = map<EmittableType> {}(arena, called_sig.parameters, [&](const Parameter& p) { return get_type(p.type); });
-			return ConcreteFun { called_fun, type_arguments, concrete_spec_impls, get_type(called_sig.return_type), parameter_types };
+	Key temp_key = Key::make(called_fun, temp_type_arguments, temp_concrete_spec_impls);
+	Option<Ref<const ConcreteFun>> found = funs_map.get(temp_key);
+	if (found.has())
+		return { found.get(), false };
+
+	auto get_type = [&](const Type& t) -> EmittableType {
+		return type_cache.get_type(t, called_sig.type_parameters, temp_type_arguments);
+	};
+	EmittableType return_type = get_type(called_sig.return_type);
+	Slice<EmittableType> temp_parameter_types = map<EmittableType> {}(scratch, called_sig.parameters, [&](const Parameter& p) { return get_type(p.type); });
+	// Another thread may have added it meanwhile, in which case this is thrown away and that thread emits it.
+	InsertResult<Key, Ref<const ConcreteFun>> inserted = funs_map.get_or_insert(temp_key, [&](Arena& arena) {
+		Slice<EmittableType> type_arguments = clone(temp_type_arguments, arena);
+		Slice<Slice<Ref<const ConcreteFun>>> concrete_spec_impls = map<Slice<Ref<const ConcreteFun>>>{}(arena, temp_concrete_spec_impls, [&](const Slice<Ref<const ConcreteFun>>& impls) {
+			return clone(impls, arena);
 		});
+		Ref<const ConcreteFun> res = arena.put(ConcreteFun { called_fun, type_arguments, concrete_spec_impls, return_type, clone(temp_parameter_types, arena) });
+		// The key must outlive the scratch arena, so point it at the function's own arguments.
+		return Pair<Key, Ref<const ConcreteFun>> { { called_fun, type_arguments, concrete_spec_impls, temp_key.hash_value }, res };
+	});
+	return { inserted.pair.value, inserted.was_added };
 }
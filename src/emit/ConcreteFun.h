@@ -4,13 +4,18 @@
 #include "../compile/model/expr.h" // Called
 
 #include "../util/store/collection_util.h"
-#include "../util/store/Map.h"
-#include "../util/store/NonEmptyList.h"
-#include "../util/store/map_of_lists_util.h" // TODO: just for TryInsertResult, move that
+#include "../util/store/slice_util.h" // ==
+#include "../util/store/StripedMap.h"
 #include "../util/Ref.h"
 
 #include "./EmittableType.h"
 
+template <typename T>
+struct TryInsertResult {
+	Ref<const T> value;
+	bool was_inserted; // true if we just added it in the map, false if got a cached result.
+};
+
 struct ConcreteFun {
 	Ref<const FunDeclaration> fun_declaration;
 	Slice<EmittableType> type_arguments;
@@ -27,21 +32,38 @@ private:
 		EmittableType return_type, Slice<EmittableType> parameter_types);
 };
 
+// Safe to use from several threads.
 class ConcreteFunsCache {
-	Arena arena;
-	Map<Ref<const FunDeclaration>, NonEmptyList<ConcreteFun>, Ref<const FunDeclaration>::hash> funs_map;
+	// Identifies a ConcreteFun. Type arguments and spec implementations are hash-consed, so they're hashed and compared by identity.
+	struct Key {
+		Ref<const FunDeclaration> fun_declaration;
+		Slice<EmittableType> type_arguments;
+		Slice<Slice<Ref<const ConcreteFun>>> spec_impls;
+		hash_t hash_value; // Computed once, not each time the table is probed
+
+		static Key make(Ref<const FunDeclaration> fun_declaration, const Slice<EmittableType>& type_arguments, const Slice<Slice<Ref<const ConcreteFun>>>& spec_impls);
+
+		struct hash {
+			inline hash_t operator()(const Key& k) const { return k.hash_value; }
+		};
+		inline friend bool operator==(const Key& a, const Key& b) {
+			return a.hash_value == b.hash_value && a.fun_declaration == b.fun_declaration && a.type_arguments == b.type_arguments && a.spec_impls == b.spec_impls;
+		}
+	};
+
+	// Each instantiation is here exactly once, so finding one takes a single lookup however many instantiations there are.
+	// Functions are emitted in parallel, so this only locks the stripe a key is in, and only while looking it up or adding it.
+	StripedMap<Key, Ref<const ConcreteFun>, Key::hash> funs_map;
 
 public:
-	inline ConcreteFunsCache() : arena{}, funs_map{64, arena} {}
+	inline ConcreteFunsCache() : funs_map{} {}
 
 	Ref<const ConcreteFun> get_concrete_fun_for_main(const FunDeclaration& main, EmittableTypeCache& type_cache);
 	TryInsertResult<ConcreteFun> get_concrete_fun_for_call(Ref<const ConcreteFun> current_concrete_fun, const Called& called, EmittableTypeCache& type_cache);
-	inline Option<const NonEmptyList<ConcreteFun>&> get_funs_for_declaration(const FunDeclaration& decl) const {
-		return funs_map.get(&decl);
-	}
-
-	template <typename /*Ref<const FunDeclaration>, const NonEmptyList<ConcreteFun>&*/ Cb>
+	// Only call this once no thread is calling the above.
+	// Visits instantiations in no particular order. See InstantiationOrder.
+	template <typename /*const ConcreteFun& => void*/ Cb>
 	void each(Cb cb) const {
-		funs_map.each(cb);
+		funs_map.each([&](const Key&, Ref<const ConcreteFun> f) { cb(*f); });
 	}
 };
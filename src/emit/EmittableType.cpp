@@ -1,7 +1,7 @@
 #include "./EmittableType.h"
 
 #include "../util/hash_util.h"
-#include "../util/store/map_of_lists_util.h"
+#include "../util/store/ArenaArrayBuilders.h" // clone, map
 #include "../util/store/slice_util.h" // ==
 
 namespace {
@@ -19,24 +19,34 @@ hash_t EmittableType::hash::operator()(const EmittableType& e) const {
 	return hash_combine(Ref<const EmittableStruct>::hash{}(e.inst_struct), hash_bool(e.is_pointer));
 }
 
+EmittableTypeCache::Key EmittableTypeCache::Key::make(Ref<const StructDeclaration> strukt, const Slice<EmittableType>& type_arguments) {
+	return { strukt, type_arguments, hash_combine(Ref<const StructDeclaration>::hash{}(strukt), hash_arr(type_arguments, EmittableType::hash{})) };
+}
+
 Ref<const EmittableStruct> EmittableTypeCache::get_inst_struct(const InstStruct& inst_struct, const Slice<TypeParameter>& type_parameters, const Slice<EmittableType>& type_arguments) {
-	Arena temp;
-	// Allocated in temp arena because we'll probably use a cached result and not need this.
-	Slice<EmittableType> temp_type_arguments = map<EmittableType>{}(temp, inst_struct.type_arguments, [&](const Type& t) {
+	// Nothing is locked while the key is built, so nested type arguments take their own locks one at a time.
+	// The key is allocated in a scratch arena, because we'll probably use a cached result and not need it.
+	TempArena scratch;
+	Slice<EmittableType> temp_type_arguments = map<EmittableType>{}(scratch, inst_struct.type_arguments, [&](const Type& t) {
 		return get_type(t, type_parameters, type_arguments);
 	});
-	return add_to_map_of_lists(
-		cache, inst_struct.strukt, arena,
-		/*is_match*/ [&](const EmittableStruct& e) { return e.strukt == inst_struct.strukt && e.type_arguments == temp_type_arguments; },
-		/*create_value*/ [&]() {
-			const StructBody& body = inst_struct.strukt->body;
-			Slice<EmittableType> struct_type_arguments = clone(temp_type_arguments, arena);
-			Slice<EmittableType> field_types = body.kind() == StructBody::Kind::CppName ? Slice<EmittableType> {} : map<EmittableType>{}(arena, body.fields(), [&](const StructField& field) {
-				return get_type(field.type, inst_struct.strukt->type_parameters, struct_type_arguments);
-			});
-			return EmittableStruct { inst_struct.strukt, struct_type_arguments, field_types };
-		}
-	).value;
+	Key temp_key = Key::make(inst_struct.strukt, temp_type_arguments);
+	Option<Ref<const EmittableStruct>> found = cache.get(temp_key);
+	if (found.has())
+		return found.get();
+
+	// Likewise for the fields, which may be new instantiations themselves.
+	const StructBody& body = inst_struct.strukt->body;
+	Slice<EmittableType> temp_field_types = body.kind() == StructBody::Kind::CppName ? Slice<EmittableType> {} : map<EmittableType>{}(scratch, body.fields(), [&](const StructField& field) {
+		return get_type(field.type, inst_struct.strukt->type_parameters, temp_type_arguments);
+	});
+	// Another thread may have added it meanwhile, in which case this is thrown away.
+	return cache.get_or_insert(temp_key, [&](Arena& arena) {
+		Slice<EmittableType> struct_type_arguments = clone(temp_type_arguments, arena);
+		Ref<const EmittableStruct> res = arena.put(EmittableStruct { inst_struct.strukt, struct_type_arguments, clone(temp_field_types, arena) });
+		// The key must outlive the scratch arena, so point it at the struct's own type arguments.
+		return Pair<Key, Ref<const EmittableStruct>> { { inst_struct.strukt, struct_type_arguments, temp_key.hash_value }, res };
+	}).pair.value;
 }
 
 EmittableType EmittableTypeCache::get_type(const Type& type, const Slice<TypeParameter>& type_parameters, const Slice<EmittableType>& type_arguments) {
@@ -1,6 +1,7 @@
 #pragma once
 
-#include "../util/store/Map.h"
+#include "../util/store/slice_util.h" // ==
+#include "../util/store/StripedMap.h"
 #include "../compile/model/model.h"
 
 struct EmittableType;
@@ -32,23 +33,39 @@ inline bool operator!=(const EmittableType& a, const EmittableType& b) {
 	return !(a == b);
 }
 
+// Safe to use from several threads.
 class EmittableTypeCache {
-	Arena arena;
-	Map<Ref<const StructDeclaration>, NonEmptyList<EmittableStruct>, Ref<const StructDeclaration>::hash> cache;
+	// Identifies an EmittableStruct. Since type arguments are hash-consed by this cache too, they're hashed and compared by identity.
+	struct Key {
+		Ref<const StructDeclaration> strukt;
+		Slice<EmittableType> type_arguments;
+		hash_t hash_value; // Computed once, not each time the table is probed
+
+		static Key make(Ref<const StructDeclaration> strukt, const Slice<EmittableType>& type_arguments);
+
+		struct hash {
+			inline hash_t operator()(const Key& k) const { return k.hash_value; }
+		};
+		inline friend bool operator==(const Key& a, const Key& b) {
+			return a.hash_value == b.hash_value && a.strukt == b.strukt && a.type_arguments == b.type_arguments;
+		}
+	};
+
+	// Each struct instantiation is here exactly once, so finding one takes a single lookup however many instantiations there are.
+	// Nested type arguments are looked up one at a time, each locking only its own stripe.
+	StripedMap<Key, Ref<const EmittableStruct>, Key::hash> cache;
 
 	Ref<const EmittableStruct> get_inst_struct(const InstStruct& inst_struct, const Slice<TypeParameter>& type_parameters, const Slice<EmittableType>& type_arguments);
 
 public:
-	inline EmittableTypeCache() : arena{}, cache{64, arena} {}
+	inline EmittableTypeCache() : cache{} {}
 
 	EmittableType get_type(const Type& type, const Slice<TypeParameter>& type_parameters, const Slice<EmittableType>& type_arguments);
 
-	inline Option<const NonEmptyList<EmittableStruct>&> get_types_for_struct(const StructDeclaration& decl) const {
-		return cache.get(&decl);
-	}
-
-	template <typename /*const StructDeclaration&, const NonEmptyList<EmittableStruct>& => void*/ Cb>
+	// Only call this once no thread is calling 'get_type'.
+	// Visits instantiations in no particular order. See InstantiationOrder.
+	template <typename /*const EmittableStruct& => void*/ Cb>
 	inline void each(Cb cb) const {
-		cache.each(cb);
+		cache.each([&](const Key&, Ref<const EmittableStruct> e) { cb(*e); });
 	}
 };
@@ -0,0 +1,138 @@
+#include "./InstantiationOrder.h"
+
+#include <algorithm> // std::sort
+#include "../util/store/Set.h"
+
+namespace {
+	// Position of each declaration among all the modules' declarations.
+	struct Ordinals {
+		Map<Ref<const StructDeclaration>, uint, Ref<const StructDeclaration>::hash> structs;
+		Map<Ref<const FunDeclaration>, uint, Ref<const FunDeclaration>::hash> funs;
+
+		Ordinals(const Slice<Module>& modules, Arena& arena) : structs{arena}, funs{arena} {
+			uint n_structs = 0;
+			uint n_funs = 0;
+			for (const Module& m : modules) {
+				for (const StructDeclaration& s : m.structs_declaration_order) {
+					structs.must_insert(&s, n_structs);
+					++n_structs;
+				}
+				for (const FunDeclaration& f : m.funs_declaration_order) {
+					funs.must_insert(&f, n_funs);
+					++n_funs;
+				}
+			}
+		}
+	};
+
+	// Negative if a comes first, 0 if equal, positive if b comes first.
+	int compare_uint(uint a, uint b) {
+		return a < b ? -1 : a > b ? 1 : 0;
+	}
+
+	int compare_types(const Ordinals& ordinals, const Slice<EmittableType>& a, const Slice<EmittableType>& b);
+
+	int compare_struct(const Ordinals& ordinals, const EmittableStruct& a, const EmittableStruct& b) {
+		if (&a == &b)
+			return 0;
+		int c = compare_uint(ordinals.structs.must_get(a.strukt), ordinals.structs.must_get(b.strukt));
+		return c != 0 ? c : compare_types(ordinals, a.type_arguments, b.type_arguments);
+	}
+
+	int compare_type(const Ordinals& ordinals, const EmittableType& a, const EmittableType& b) {
+		int c = compare_struct(ordinals, a.inst_struct, b.inst_struct);
+		return c != 0 ? c : compare_uint(a.is_pointer, b.is_pointer);
+	}
+
+	int compare_types(const Ordinals& ordinals, const Slice<EmittableType>& a, const Slice<EmittableType>& b) {
+		for (uint i = 0; i != a.size() && i != b.size(); ++i) {
+			int c = compare_type(ordinals, a[i], b[i]);
+			if (c != 0)
+				return c;
+		}
+		return compare_uint(a.size(), b.size());
+	}
+
+	int compare_fun(const Ordinals& ordinals, const ConcreteFun& a, const ConcreteFun& b) {
+		if (&a == &b)
+			return 0;
+		int c = compare_uint(ordinals.funs.must_get(a.fun_declaration), ordinals.funs.must_get(b.fun_declaration));
+		if (c == 0)
+			c = compare_types(ordinals, a.type_arguments, b.type_arguments);
+		// Same declaration, so the same number of specs and signatures.
+		for (uint spec = 0; c == 0 && spec != a.spec_impls.size(); ++spec)
+			for (uint sig = 0; c == 0 && sig != a.spec_impls[spec].size(); ++sig)
+				c = compare_fun(ordinals, a.spec_impls[spec][sig], b.spec_impls[spec][sig]);
+		return c;
+	}
+
+	// 'each' visits every instantiation of every declaration. 'declaration' gets the declaration of one.
+	// Each declaration's instantiations are then sorted with 'compare'.
+	template <
+		typename Declaration, typename T,
+		typename /*(const T& => void) => void*/ Each, typename /*const T& => Ref<const Declaration>*/ GetDeclaration, typename /*const T&, const T& => int*/ Compare>
+	void group_and_sort(
+		Map<Ref<const Declaration>, Slice<Ref<const T>>, typename Ref<const Declaration>::hash>& out, Arena& arena,
+		Each each, GetDeclaration declaration, Compare compare) {
+		TempArena temp;
+		Map<Ref<const Declaration>, uint, typename Ref<const Declaration>::hash> counts { temp };
+		each([&](const T& t) {
+			InsertResult<Ref<const Declaration>, uint> inserted = counts.try_insert(declaration(t), 1);
+			if (!inserted.was_added)
+				++inserted.pair.value;
+		});
+		// Then reuse the counts to track how many are filled in.
+		counts.each([&](Ref<const Declaration> d, const uint& count) {
+			out.must_insert(d, uninitialized_array<Ref<const T>>(arena, count));
+		});
+		each([&](const T& t) {
+			Ref<const Declaration> d = declaration(t);
+			uint& count = counts.must_get(d);
+			--count;
+			out.must_get(d)[count] = &t;
+		});
+		out.each([&](Ref<const Declaration>, const Slice<Ref<const T>>& instantiations) {
+			Slice<Ref<const T>> to_sort = instantiations;
+			std::sort(to_sort.begin(), to_sort.end(), [&](Ref<const T> a, Ref<const T> b) { return compare(a, b) < 0; });
+		});
+	}
+
+	// Depth-first, so the structs 'e' has fields of are added before it.
+	void add_by_dependency(Ref<const EmittableStruct> e, Set<Ref<const EmittableStruct>, Ref<const EmittableStruct>::hash>& seen, Slice<Ref<const EmittableStruct>>& out, uint& n_out) {
+		if (!seen.try_insert(e).was_added)
+			return;
+		for (const EmittableType& field_type : e->field_types)
+			if (!field_type.is_pointer)
+				add_by_dependency(field_type.inst_struct, seen, out, n_out);
+		out[n_out] = e;
+		++n_out;
+	}
+}
+
+InstantiationOrder::InstantiationOrder(const Slice<Module>& _modules, const EmittableTypeCache& types, const ConcreteFunsCache& concrete_funs, Arena& arena)
+	: modules{_modules}, structs{arena}, funs{arena}, structs_by_dependency{} {
+	TempArena temp;
+	Ordinals ordinals { modules, temp };
+	group_and_sort<StructDeclaration, EmittableStruct>(
+		structs, arena,
+		[&](auto cb) { types.each(cb); },
+		[](const EmittableStruct& e) { return e.strukt; },
+		[&](const EmittableStruct& a, const EmittableStruct& b) { return compare_struct(ordinals, a, b); });
+	group_and_sort<FunDeclaration, ConcreteFun>(
+		funs, arena,
+		[&](auto cb) { concrete_funs.each(cb); },
+		[](const ConcreteFun& f) { return f.fun_declaration; },
+		[&](const ConcreteFun& a, const ConcreteFun& b) { return compare_fun(ordinals, a, b); });
+
+	// Starting from each struct in the order above, so the result only depends on the program too.
+	uint n_structs = 0;
+	structs.each([&](Ref<const StructDeclaration>, const Slice<Ref<const EmittableStruct>>& emittables) { n_structs += emittables.size(); });
+	structs_by_dependency = uninitialized_array<Ref<const EmittableStruct>>(arena, n_structs);
+	Set<Ref<const EmittableStruct>, Ref<const EmittableStruct>::hash> seen { temp };
+	uint n_added = 0;
+	each_struct([&](const StructDeclaration&, const Slice<Ref<const EmittableStruct>>& emittables) {
+		for (Ref<const EmittableStruct> e : emittables)
+			add_by_dependency(e, seen, structs_by_dependency, n_added);
+	});
+	assert(n_added == n_structs);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../util/store/collection_util.h" // some
+#include "../util/store/Map.h"
+#include "../compile/model/model.h"
+#include "./ConcreteFun.h"
+#include "./EmittableType.h"
+
+// The caches list instantiations in the order threads happened to find them.
+// This puts them in an order that only depends on the program, so the output is the same for any number of threads:
+// declarations in module order, and each declaration's instantiations sorted by type arguments (then by spec implementations).
+// That order numbers the instantiations, but structs are defined in 'structs_by_dependency' order.
+class InstantiationOrder {
+	const Slice<Module> modules;
+	Map<Ref<const StructDeclaration>, Slice<Ref<const EmittableStruct>>, Ref<const StructDeclaration>::hash> structs;
+	Map<Ref<const FunDeclaration>, Slice<Ref<const ConcreteFun>>, Ref<const FunDeclaration>::hash> funs;
+	// Every struct after the structs it has fields of (not pointers to), so C++ sees each definition before it's needed.
+	Slice<Ref<const EmittableStruct>> structs_by_dependency;
+
+public:
+	// Call once nothing is being added to the caches.
+	InstantiationOrder(const Slice<Module>& modules, const EmittableTypeCache& types, const ConcreteFunsCache& concrete_funs, Arena& arena);
+
+	// Only visits declarations with at least one instantiation.
+	template <typename /*const StructDeclaration&, const Slice<Ref<const EmittableStruct>>& => void*/ Cb>
+	void each_struct(Cb cb) const {
+		for (const Module& m : modules)
+			for (const StructDeclaration& s : m.structs_declaration_order) {
+				Option<const Slice<Ref<const EmittableStruct>>&> o = structs.get(&s);
+				if (o.has())
+					cb(s, o.get());
+			}
+	}
+
+	// For defining structs, rather than naming them.
+	template <typename /*const EmittableStruct& => void*/ Cb>
+	void each_struct_by_dependency(Cb cb) const {
+		for (Ref<const EmittableStruct> e : structs_by_dependency)
+			cb(e);
+	}
+
+	template <typename /*const FunDeclaration&, const Slice<Ref<const ConcreteFun>>& => void*/ Cb>
+	void each_fun(Cb cb) const {
+		for (const Module& m : modules)
+			each_fun_in(m, cb);
+	}
+
+	template <typename /*const FunDeclaration&, const Slice<Ref<const ConcreteFun>>& => void*/ Cb>
+	void each_fun_in(const Module& m, Cb cb) const {
+		for (const FunDeclaration& f : m.funs_declaration_order) {
+			Option<const Slice<Ref<const ConcreteFun>>&> o = funs.get(&f);
+			if (o.has())
+				cb(f, o.get());
+		}
+	}
+
+	inline bool has_funs(const Module& m) const {
+		return some(m.funs_declaration_order, [&](const FunDeclaration& f) { return funs.has(&f); });
+	}
+};
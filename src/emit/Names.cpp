@@ -51,51 +51,69 @@ namespace {
 		}
 	}
 
-	ArenaString mangled(const StringSlice& name, Arena& out) {
-		assert(needs_mangle(name));
-		StringBuilder sb { out, name.size() * 2 };
-		write_mangled(sb, name);
-		return sb.finish();
+	void add_identifier_name(Names& names, Identifier name, Arena& out) {
+		if (names.identifier_names.has(name))
+			return;
+		if (needs_mangle(name.str())) {
+			StringBuilder sb { out, name.str().slice().size() * 2 };
+			write_mangled(sb, name.str());
+			names.identifier_names.must_insert(name, Option { sb.finish() });
+		} else
+			names.identifier_names.must_insert(name, Option<ArenaString> {});
 	}
 
-	ArenaString mangled(const StringSlice& name, uint id, Arena& out) {
-		StringBuilder sb { out, name.size() * 2 };
-		write_mangled(sb, name);
+	ArenaString mangled(Identifier name, uint id, Arena& out) {
+		// Room for the id's digits too.
+		StringBuilder sb { out, name.str().slice().size() * 2 + 10 };
+		write_mangled(sb, name.str());
 		sb << id;
 		return sb.finish();
 	}
+
+	Writer& write_identifier(Writer& out, const Names& names, Identifier name) {
+		Option<const Option<ArenaString>&> m = names.identifier_names.get(name);
+		if (!m.has())
+			write_mangled(out, name.str());
+		else if (m.get().has())
+			out << m.get().get();
+		else
+			out << name;
+		return out;
+	}
 }
 
-Names get_names(const EmittableTypeCache& types, const ConcreteFunsCache& funs, Arena& out_arena) {
-	Names names { { 32, out_arena }, { 32, out_arena }, { 32, out_arena } };
+Names get_names(const InstantiationOrder& order, Arena& out_arena) {
+	Names names { out_arena };
 
-	types.each([&](const StructDeclaration& strukt, const NonEmptyList<EmittableStruct> emittables) {
-		if (emittables.has_more_than_one()) {
+	// Instantiations are numbered in 'order', so the names don't depend on which thread found them first.
+	order.each_struct([&](const StructDeclaration& strukt, const Slice<Ref<const EmittableStruct>>& emittables) {
+		if (emittables.size() > 1) {
 			uint id = 0;
-			for (const EmittableStruct& e : emittables) {
-				names.struct_names.must_insert(&e, mangled(strukt.name, id, out_arena));
+			for (Ref<const EmittableStruct> e : emittables) {
+				names.struct_names.must_insert(e, mangled(strukt.name, id, out_arena));
 				++id;
 			}
-		} else if (needs_mangle(strukt.name))
-			names.struct_names.must_insert(&emittables.only(), mangled(strukt.name, out_arena));
+		} else
+			add_identifier_name(names, strukt.name, out_arena);
 
 		if (strukt.body.is_fields())
 			for (const StructField& f : strukt.body.fields())
-				if (needs_mangle(f.name))
-					names.field_names.must_insert(&f, mangled(f.name, out_arena));
+				add_identifier_name(names, f.name, out_arena);
 	});
 
-	funs.each([&](const FunDeclaration& fun, const NonEmptyList<ConcreteFun>& concretes) {
-		const StringSlice& name = fun.name();
-		if (concretes.has_more_than_one()) {
+	order.each_fun([&](const FunDeclaration& fun, const Slice<Ref<const ConcreteFun>>& concretes) {
+		Identifier name = fun.name();
+		if (concretes.size() > 1) {
 			uint id = 0;
-			for (const ConcreteFun& cf : concretes) {
-				names.fun_names.must_insert(&cf, mangled(name, id, out_arena));
+			for (Ref<const ConcreteFun> cf : concretes) {
+				names.fun_names.must_insert(cf, mangled(name, id, out_arena));
 				++id;
 			}
-		} else if (needs_mangle(name)) {
-			names.fun_names.must_insert(&concretes.only(), mangled(name, out_arena));
-		}
+		} else
+			add_identifier_name(names, name, out_arena);
+
+		for (const Parameter& p : fun.signature.parameters)
+			add_identifier_name(names, p.name, out_arena);
 	});
 
 	return names;
@@ -103,20 +121,18 @@ Names get_names(const EmittableTypeCache& types, const ConcreteFunsCache& funs,
 
 Writer& operator<<(Writer& out, const Names::StructNameWriter& s) {
 	Option<const ArenaString&> name = s.names.struct_names.get(&s.strukt);
-	return out << (name.has() ? name.get() : s.strukt.strukt->name);
+	return name.has() ? out << name.get() : write_identifier(out, s.names, s.strukt.strukt->name);
 }
 
 Writer& operator<<(Writer& out, const Names::FieldNameWriter& s) {
-	Option<const ArenaString&> name = s.names.field_names.get(&s.field);
-	return out << (name.has() ? name.get() : s.field.name);
+	return write_identifier(out, s.names, s.field.name);
 }
 
 Writer& operator<<(Writer& out, const Names::FunNameWriter& f) {
 	Option<const ArenaString&> name = f.names.fun_names.get(&f.fun);
-	return out << (name.has() ? name.get() : f.fun.fun_declaration->name());
+	return name.has() ? out << name.get() : write_identifier(out, f.names, f.fun.fun_declaration->name());
 }
 
 Writer& operator<<(Writer& out, const Names::ParameterNameWriter& p) {
-	write_mangled(out, p.parameter.name);
-	return out;
+	return write_identifier(out, p.names, p.parameter.name);
 }
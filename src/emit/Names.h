@@ -7,13 +7,17 @@
 #include "../compile/model/model.h"
 
 #include "ConcreteFun.h"
+#include "InstantiationOrder.h"
 
 struct Names {
-	// These will have an entry only if mangling is needed.
+	// Mangled spelling of every identifier we emit, or None if it can be used as-is. Keyed by identifier so each name is only mangled once.
+	Map<Identifier, Option<ArenaString>, Identifier::hash> identifier_names;
+	// These will have an entry only if a declaration has more than one instantiation, so its name needs a number.
 	Map<Ref<const EmittableStruct>, ArenaString, Ref<const EmittableStruct>::hash> struct_names;
-	Map<Ref<const StructField>, ArenaString, Ref<const StructField>::hash> field_names;
 	Map<Ref<const ConcreteFun>, ArenaString, Ref<const ConcreteFun>::hash> fun_names;
 
+	inline explicit Names(Arena& arena) : identifier_names{arena}, struct_names{arena}, fun_names{arena} {}
+
 	struct StructNameWriter {
 		const EmittableStruct& strukt;
 		const Names& names;
@@ -36,9 +40,10 @@ struct Names {
 
 	struct ParameterNameWriter {
 		const Parameter& parameter;
+		const Names& names;
 		friend Writer& operator<<(Writer& out, const ParameterNameWriter& p);
 	};
-	inline ParameterNameWriter name(const Parameter& p) const { return { p }; }
+	inline ParameterNameWriter name(const Parameter& p) const { return { p, *this }; }
 };
 
-Names get_names(const EmittableTypeCache& types, const ConcreteFunsCache& funs, Arena& out_arena);
+Names get_names(const InstantiationOrder& order, Arena& out_arena);
@@ -1,86 +1,202 @@
 #include "./emit.h"
 
-#include "../util/store/Map.h"
+#include <condition_variable> // std::condition_variable
+#include <mutex> // std::mutex, std::unique_lock
+#include "../util/parallel.h"
 #include "../compile/model/expr.h"
 #include "./ConcreteFun.h"
 #include "./emit_body.h"
 #include "./emit_comment.h"
+#include "./InstantiationOrder.h"
 #include "./Names.h"
 #include "./CAst_emit.h"
 
 namespace {
-	using Bodies = Map<Ref<const ConcreteFun>, CFunctionBody, Ref<const ConcreteFun>::hash>;
+	// A function whose body hasn't been emitted yet.
+	struct EmitJob {
+		Ref<const ConcreteFun> fun;
+		EmitJob* next;
+	};
 
-	void emit_bodies(Ref<const ConcreteFun> main, Bodies& bodies, const BuiltinTypes& builtin_types, ConcreteFunsCache& concrete_funs, EmittableTypeCache& types_cache, Arena& ast_arena) {
-		MaxSizeVector<16, Ref<const ConcreteFun>> to_emit;
-		to_emit.push(main);
+	// Shared by every emitting thread. Only use with 'mutex' held.
+	struct EmitQueue {
+		std::mutex mutex;
+		std::condition_variable changed;
+		TempArena arena; // For jobs
+		EmitJob* pending; // Used as a stack, so with 1 thread functions are emitted in the same order as they always were.
+		uint n_in_progress;
+		bool failed; // Some thread threw, so the others should stop.
 
-		while (!to_emit.is_empty()) {
-			Ref<const ConcreteFun> f = to_emit.pop_and_return();
-			bodies.must_insert(f, emit_body(f, builtin_types, concrete_funs, types_cache, to_emit, ast_arena));
+		EmitQueue() : mutex{}, changed{}, arena{}, pending{nullptr}, n_in_progress{0}, failed{false} {}
+
+		void add(Ref<const ConcreteFun> fun) {
+			pending = arena.put(EmitJob { fun, pending }).ptr();
 		}
-	}
+	};
+
+	// Each body may call functions that haven't been seen before, which are added to the queue for any thread to lower.
+	// The body itself is thrown away: it's lowered again when it's written, once every function has a name.
+	void emit_worker(EmitQueue& queue, const BuiltinTypes& builtin_types, ConcreteFunsCache& concrete_funs, EmittableTypeCache& types_cache) {
+		TempArena scratch;
+		std::unique_lock<std::mutex> lock { queue.mutex };
+		while (true) {
+			if (queue.failed)
+				return;
+			if (queue.pending == nullptr) {
+				// A function in progress may still call new ones.
+				if (queue.n_in_progress == 0)
+					return;
+				queue.changed.wait(lock);
+				continue;
+			}
 
-	template <typename /*EmittableStruct => void*/ Cb>
-	void each_emittable_type(const Slice<Module>& modules, const EmittableTypeCache& types, Cb cb) {
-		for (const Module& m : modules) {
-			for (const StructDeclaration& s : m.structs_declaration_order) {
-				Option<const NonEmptyList<EmittableStruct>&> o = types.get_types_for_struct(s);
-				if (!o.has()) continue;
-				for (const EmittableStruct& e : o.get())
-					cb(e);
+			Ref<const ConcreteFun> f = queue.pending->fun;
+			queue.pending = queue.pending->next;
+			++queue.n_in_progress;
+			lock.unlock();
+			ToEmit to_emit;
+			try {
+				ArenaScope scratch_scope { scratch };
+				emit_body(f, builtin_types, concrete_funs, types_cache, to_emit, scratch);
+			} catch (...) {
+				// Wake the other threads so they can stop. run_on_threads will rethrow this.
+				lock.lock();
+				queue.failed = true;
+				--queue.n_in_progress;
+				queue.changed.notify_all();
+				throw;
 			}
+			lock.lock();
+			for (Ref<const ConcreteFun> called : to_emit)
+				queue.add(called);
+			--queue.n_in_progress;
+			queue.changed.notify_all();
 		}
 	}
 
-	template<typename /*ConcreteFun => void*/ Cb>
-	void each_concrete_fun(const Slice<Module>& modules, const ConcreteFunsCache& concrete_funs, Cb cb) {
-		for (const Module& m : modules) {
-			for (const FunDeclaration& f : m.funs_declaration_order) {
-				Option<const NonEmptyList<ConcreteFun>&> o = concrete_funs.get_funs_for_declaration(f);
-				if (!o.has()) continue;
-				for (const ConcreteFun& cf : o.get()) {
-					cb(cf);
-				}
-			}
+	Ref<const FunDeclaration> find_main(const Slice<Module>& modules) {
+		assert(!modules.is_empty());
+		Option<Ref<const FunDeclaration>> main = find(modules[modules.size() - 1].funs_declaration_order, [&](const FunDeclaration& f) { return f.name().str() == "main"; });
+		if (!main.has()) todo();
+		return main.get();
+	}
+
+	// Every function reachable from 'main', and every type they use.
+	struct Instantiations {
+		ConcreteFunsCache concrete_funs;
+		EmittableTypeCache types_cache;
+
+		// Lowering function bodies will generate types and functions along the way.
+		Instantiations(const Slice<Module>& modules, const BuiltinTypes& builtin_types, uint n_threads) : concrete_funs{}, types_cache{} {
+			EmitQueue queue;
+			queue.add(concrete_funs.get_concrete_fun_for_main(find_main(modules), types_cache));
+			run_on_threads(n_threads, [&](uint) {
+				emit_worker(queue, builtin_types, concrete_funs, types_cache);
+			});
 		}
+	};
+}
+
+const StringSlice EMITTED_PROLOGUE = "#include <assert.h>\n\n";
+
+struct LoweredProgram::Impl {
+	TempArena arena;
+	const BuiltinTypes& builtin_types;
+	Instantiations instantiations;
+	InstantiationOrder order;
+	Names names;
+	Slice<Ref<const Module>> shards; // Modules with any functions to emit
+
+	Impl(const Slice<Module>& modules, const BuiltinTypes& _builtin_types, uint n_threads)
+		: arena{}, builtin_types{_builtin_types}, instantiations{modules, builtin_types, n_threads},
+		order{modules, instantiations.types_cache, instantiations.concrete_funs, arena},
+		names{get_names(order, arena)},
+		shards{} {
+		uint n_shards = 0;
+		for (const Module& m : modules)
+			if (order.has_funs(m))
+				++n_shards;
+		shards = uninitialized_array<Ref<const Module>>(arena, n_shards);
+		uint i = 0;
+		for (const Module& m : modules)
+			if (order.has_funs(m)) {
+				shards[i] = &m;
+				++i;
+			}
+	}
+
+	void write_header(Writer& out) const {
+		out << EMITTED_PROLOGUE;
+
+		// First write all structs
+		order.each_struct_by_dependency([&](const EmittableStruct& e) {
+			write_emittable_struct(out, e, names);
+			out << Writer::nl << Writer::nl;
+		});
+		order.each_fun([&](const FunDeclaration&, const Slice<Ref<const ConcreteFun>>& concretes) {
+			for (Ref<const ConcreteFun> f : concretes) {
+				write_fun_header(out, f, names);
+				out << ';' << Writer::nl;
+			}
+		});
+		out << Writer::nl;
+	}
+
+	// Each body is lowered just before it's written, so only one is in memory at a time.
+	void write_implementations(Writer& out, const Module& m) {
+		TempArena scratch;
+		order.each_fun_in(m, [&](const FunDeclaration&, const Slice<Ref<const ConcreteFun>>& concretes) {
+			for (Ref<const ConcreteFun> f : concretes) {
+				ArenaScope scratch_scope { scratch };
+				ToEmit to_emit;
+				CFunctionBody body = emit_body(f, builtin_types, instantiations.concrete_funs, instantiations.types_cache, to_emit, scratch);
+				// Every function it calls was found already.
+				assert(to_emit.is_empty());
+				write_fun_implementation(out, f, body, names);
+				out << Writer::nl << Writer::nl;
+			}
+		});
+	}
+
+	void write_main(Writer& out) const {
+		out << "int main() { Void v; _main(&v); }\n";
 	}
+};
+
+LoweredProgram::LoweredProgram(const Slice<Module>& modules, const BuiltinTypes& builtin_types, uint n_threads)
+	: impl{unique_ptr<Impl> { new Impl(modules, builtin_types, n_threads) }} {}
+
+LoweredProgram::~LoweredProgram() {}
+
+void LoweredProgram::write(Writer& out) {
+	impl->write_header(out);
+	for (Ref<const Module> m : impl->shards)
+		impl->write_implementations(out, m);
+	impl->write_main(out);
 }
 
-Writer::Output emit(const Slice<Module>& modules, const BuiltinTypes& builtin_types, Arena& out_arena) {
-	Arena temp;
+uint LoweredProgram::n_shards() const {
+	return impl->shards.size();
+}
 
-	assert(!modules.is_empty());
-	Option<Ref<const FunDeclaration>> main = find(modules[modules.size() - 1].funs_declaration_order, [&](const FunDeclaration& f) { return f.name() == "main"; });
-	if (!main.has()) todo();
+void LoweredProgram::write_header(Writer& out) const {
+	impl->write_header(out);
+}
 
-	ConcreteFunsCache concrete_funs;
-	EmittableTypeCache types_cache;
-	Bodies bodies { 64, temp };
-	// Emitting function bodies will generate types and functions along the way.
-	emit_bodies(concrete_funs.get_concrete_fun_for_main(main.get(), types_cache), bodies, builtin_types, concrete_funs, types_cache, temp);
+void LoweredProgram::write_shard(Writer& out, uint index, const StringSlice& header_name) {
+	out << "#include \"" << header_name << '"' << Writer::nl << Writer::nl;
+	impl->write_implementations(out, impl->shards[index]);
+	// 'main' is in the last module.
+	if (index == impl->shards.size() - 1)
+		impl->write_main(out);
+}
 
-	Names names = get_names(types_cache, concrete_funs, temp);
+void emit(Writer& out, const Slice<Module>& modules, const BuiltinTypes& builtin_types, uint n_threads) {
+	LoweredProgram { modules, builtin_types, n_threads }.write(out);
+}
 
+Writer::Output emit(const Slice<Module>& modules, const BuiltinTypes& builtin_types, uint n_threads, Arena& out_arena) {
 	Writer out { out_arena };
-	out << "#include <assert.h>\n\n";
-
-	// First write all structs
-	each_emittable_type(modules, types_cache, [&](const EmittableStruct& e) {
-		write_emittable_struct(out, e, names);
-		out << Writer::nl << Writer::nl;
-	});
-	each_concrete_fun(modules, concrete_funs, [&](const ConcreteFun& f) {
-		write_fun_header(out, f, names);
-		out << ';' << Writer::nl;
-	});
-	out << Writer::nl;
-	each_concrete_fun(modules, concrete_funs, [&](const ConcreteFun& f) {
-		write_fun_implementation(out, f, bodies.must_get(&f), names);
-		out << Writer::nl << Writer::nl;
-	});
-
-	out << "int main() { Void v; _main(&v); }\n";
-
+	emit(out, modules, builtin_types, n_threads);
 	return out.finish();
 }
@@ -3,5 +3,36 @@
 #include "../util/Writer.h"
 #include "../compile/model/BuiltinTypes.h"
 #include "../compile/model/model.h"
+#include "../util/unique_ptr.h"
 
-Writer::Output emit(const Slice<Module>& modules, const BuiltinTypes& builtin_types, Arena& out_arena);
+// Every emitted file starts with this, so it can be precompiled once for many files.
+extern const StringSlice EMITTED_PROLOGUE;
+
+// A program lowered to C++, ready to be written as a single file, or as a header and several shards that can be compiled separately.
+// Function bodies are lowered on up to 'n_threads' threads (at most MAX_THREADS) to find every function and type the program needs.
+// They're lowered again one at a time as they're written, so the lowered bodies are never all in memory at once.
+// The output is the same for any number of threads.
+class LoweredProgram {
+	struct Impl;
+	unique_ptr<Impl> impl;
+
+public:
+	LoweredProgram(const Slice<Module>& modules, const BuiltinTypes& builtin_types, uint n_threads);
+	LoweredProgram(const LoweredProgram& other) = delete;
+	~LoweredProgram();
+
+	// The whole program in one file.
+	void write(Writer& out);
+
+	// One shard for each module with functions, in module order.
+	uint n_shards() const;
+	// Starts with EMITTED_PROLOGUE, then declares every struct and function.
+	void write_header(Writer& out) const;
+	// Includes the header by 'header_name', then defines the functions from one module.
+	// The last shard also has the C++ 'main', so link all of them together.
+	void write_shard(Writer& out, uint index, const StringSlice& header_name);
+};
+
+// Give 'out' a sink to write the program out as it's generated, instead of keeping all of it in memory.
+void emit(Writer& out, const Slice<Module>& modules, const BuiltinTypes& builtin_types, uint n_threads);
+Writer::Output emit(const Slice<Module>& modules, const BuiltinTypes& builtin_types, uint n_threads, Arena& out_arena);
@@ -3,6 +3,8 @@
 #include "../util/io.h"
 
 namespace {
+	// Copies each document into the caller's arena, so it lives exactly as long as whatever was built from it.
+	// Mapping the user's files instead would leave ASTs pointing at bytes an editor can rewrite in place (or truncate, making them fault).
 	struct FileDocumentProvider final : public DocumentProvider {
 		const StringSlice root;
 		FileDocumentProvider(StringSlice _root) : root(_root) {}
@@ -8,10 +8,12 @@
 /*abstract*/ class DocumentProvider {
 public:
 	// Should be 0 terminated, meaning s[s.size() - 1] == '\0'
+	// May be called from several threads at once when compiling with more than one thread.
 	virtual Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension, Arena& out) = 0;
 	// https://stackoverflow.com/a/29217604
 	// If we make this '= 0' there is a compiler warning.
 	virtual ~DocumentProvider();
 };
 
+// Reads each document into 'out'. Nothing is kept between calls.
 unique_ptr<DocumentProvider> file_system_document_provider(StringSlice root);
@@ -0,0 +1,111 @@
+#include "./ExeCache.h"
+
+#include <cstdlib> // getenv
+#include <cstring> // strlen
+#include "../util/PathCache.h"
+
+namespace {
+	const StringSlice EXE_EXTENSION = "exe";
+	const StringSlice OBJECT_EXTENSION = "o";
+
+	// FNV-1a. Unlike StringSlice::hash, every byte affects every bit of the result.
+	hash_t fnv1a_byte(hash_t h, uint8_t b) {
+		return (h ^ b) * 0x100000001b3;
+	}
+
+	hash_t fnv1a(hash_t h, const StringSlice& s) {
+		for (char c : s)
+			h = fnv1a_byte(h, uint8_t(c));
+		return h;
+	}
+
+	StringSlice c_string_slice(const char* s) {
+		return { s, s + strlen(s) };
+	}
+
+	struct FileExeCache final : public ExeCache {
+		const StringSlice dir;
+		PathCache paths;
+
+		FileExeCache(StringSlice _dir) : dir{_dir}, paths{} {}
+
+		FileLocator loc(const ExeCacheKey& key, const StringSlice& extension) {
+			const char* hex = "0123456789abcdef";
+			MaxSizeString<32> name = MaxSizeString<32>::make([&](MaxSizeStringWriter& w) {
+				for (uint shift = 64; shift != 0; shift -= 4)
+					w << hex[(key.hash >> (shift - 4)) & 0xf];
+				w << '-';
+				for (uint size = key.size, shift = 32; shift != 0; shift -= 4)
+					w << hex[(size >> (shift - 4)) & 0xf];
+			});
+			return { dir, paths.from_part_slice(name.slice()), extension };
+		}
+
+		bool try_get_exe(const ExeCacheKey& key, const FileLocator& exe) override {
+			FileLocator cached = loc(key, EXE_EXTENSION);
+			if (!file_exists(cached))
+				return false;
+			link_file(cached, exe);
+			return true;
+		}
+
+		void set_exe(const ExeCacheKey& key, const FileLocator& exe) override {
+			link_file(exe, loc(key, EXE_EXTENSION));
+		}
+
+		bool try_get_object(const ExeCacheKey& key, const FileLocator& object) override {
+			FileLocator cached = loc(key, OBJECT_EXTENSION);
+			if (!file_exists(cached))
+				return false;
+			link_file(cached, object);
+			return true;
+		}
+
+		void set_object(const ExeCacheKey& key, const FileLocator& object) override {
+			link_file(object, loc(key, OBJECT_EXTENSION));
+		}
+	};
+}
+
+ExeCacheKey exe_cache_key(const StringSlice& command, const StringSlice& cpp) {
+	hash_t h = 0xcbf29ce484222325;
+	h = fnv1a(h, command);
+	h = fnv1a(h, "\n");
+	return { fnv1a(h, cpp), cpp.size() };
+}
+
+ExeCacheKey exe_cache_key(const StringSlice& command, const Slice<StringSlice>& files) {
+	hash_t h = 0xcbf29ce484222325;
+	h = fnv1a(h, command);
+	uint size = 0;
+	for (const StringSlice& file : files) {
+		// Each file's size goes first, so moving text from the end of one file to the start of the next changes the hash.
+		for (uint shift = 0; shift != 32; shift += 8)
+			h = fnv1a_byte(h, uint8_t(file.size() >> shift));
+		h = fnv1a(h, file);
+		size += file.size();
+	}
+	return { h, size };
+}
+
+ExeCache::~ExeCache() {}
+
+unique_ptr<ExeCache> file_system_exe_cache(StringSlice dir) {
+	return unique_ptr<ExeCache> { new FileExeCache(dir) };
+}
+
+MaxSizeString<128> default_exe_cache_dir() {
+	const char* xdg = getenv("XDG_CACHE_HOME");
+	if (xdg != nullptr && *xdg != '\0') {
+		MaxSizeString<128> res = MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << c_string_slice(xdg) << "/noze"; });
+		make_directory(res.slice());
+		return res;
+	}
+	const char* home = getenv("HOME");
+	if (home == nullptr || *home == '\0') todo();
+	MaxSizeString<128> cache = MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << c_string_slice(home) << "/.cache"; });
+	make_directory(cache.slice());
+	MaxSizeString<128> res = MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << cache.slice() << "/noze"; });
+	make_directory(res.slice());
+	return res;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../util/store/Slice.h"
+#include "../util/store/StringSlice.h"
+#include "../util/store/MaxSizeString.h"
+#include "../util/io.h"
+#include "../util/unique_ptr.h"
+
+// Identifies the exe built from some C++ by some command.
+struct ExeCacheKey {
+	hash_t hash;
+	uint size; // Of the C++, so a collision also needs the same size
+};
+
+// Both are part of the key, so changing the compiler's flags doesn't reuse exes built with the old ones.
+ExeCacheKey exe_cache_key(const StringSlice& command, const StringSlice& cpp);
+// For something built from several files, such as a shard and the header it includes.
+ExeCacheKey exe_cache_key(const StringSlice& command, const Slice<StringSlice>& files);
+
+// Keeps exes between runs, so rebuilding a program whose emitted C++ hasn't changed costs only a hash.
+/*abstract*/ class ExeCache {
+public:
+	// Links the cached exe to 'exe'. Returns false if there is none.
+	virtual bool try_get_exe(const ExeCacheKey& key, const FileLocator& exe) = 0;
+	virtual void set_exe(const ExeCacheKey& key, const FileLocator& exe) = 0;
+	// Objects compiled from the shards of a program, so only the shards that changed are compiled again.
+	virtual bool try_get_object(const ExeCacheKey& key, const FileLocator& object) = 0;
+	virtual void set_object(const ExeCacheKey& key, const FileLocator& object) = 0;
+	// https://stackoverflow.com/a/29217604
+	// If we make this '= 0' there is a compiler warning.
+	virtual ~ExeCache();
+};
+
+// Stores the exe for a key as '<key>.exe' in 'dir', and objects as '<key>.o'.
+// Since keys are never reused for different contents, any number of processes may share the directory.
+unique_ptr<ExeCache> file_system_exe_cache(StringSlice dir);
+
+// '$XDG_CACHE_HOME/noze', or '$HOME/.cache/noze'. Creates it if it doesn't exist.
+MaxSizeString<128> default_exe_cache_dir();
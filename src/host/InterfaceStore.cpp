@@ -0,0 +1,42 @@
+#include "./InterfaceStore.h"
+
+#include "../util/store/List.h"
+#include "../util/io.h"
+
+namespace {
+	const StringSlice NZI_EXTENSION = "nzi";
+	const StringSlice NZI_TEMP_EXTENSION = "nzi.tmp";
+
+	struct FileInterfaceStore final : public InterfaceStore {
+		const StringSlice root;
+		Arena arena;
+		List<MappedFile> mapped;
+
+		FileInterfaceStore(StringSlice _root) : root{_root}, arena{}, mapped{} {}
+		~FileInterfaceStore() override {
+			for (const MappedFile& m : mapped)
+				unmap_file(m);
+		}
+
+		Option<StringSlice> try_get_interface(const Path& path) override {
+			Option<MappedFile> file = try_map_file({ root, path, NZI_EXTENSION }, /*null_terminated*/ false);
+			if (!file.has())
+				return {};
+			mapped.prepend(file.get(), arena);
+			return Option { file.get().contents };
+		}
+
+		void set_interface(const Path& path, const Writer::Output& interface) override {
+			// Write a new file and move it into place, so that anything mapped from the old file is unaffected.
+			FileLocator temp { root, path, NZI_TEMP_EXTENSION };
+			write_file(temp, interface);
+			rename_file(temp, { root, path, NZI_EXTENSION });
+		}
+	};
+}
+
+InterfaceStore::~InterfaceStore() {}
+
+unique_ptr<InterfaceStore> file_system_interface_store(StringSlice root) {
+	return unique_ptr<InterfaceStore> { new FileInterfaceStore(root) };
+}
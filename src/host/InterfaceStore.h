@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../util/store/StringSlice.h"
+#include "../util/unique_ptr.h"
+#include "../util/Path.h"
+#include "../util/Writer.h"
+
+// Keeps module interfaces (see compile/interface/interface.h) between compiles.
+/*abstract*/ class InterfaceStore {
+public:
+	// The result stays valid as long as the store does, even if 'set_interface' is called for the same path.
+	virtual Option<StringSlice> try_get_interface(const Path& path) = 0;
+	virtual void set_interface(const Path& path, const Writer::Output& interface) = 0;
+	// https://stackoverflow.com/a/29217604
+	// If we make this '= 0' there is a compiler warning.
+	virtual ~InterfaceStore();
+};
+
+// Stores the interface for 'a/b.nz' in 'a/b.nzi', and maps it into memory instead of reading it.
+unique_ptr<InterfaceStore> file_system_interface_store(StringSlice root);
@@ -0,0 +1,504 @@
+#include "./LanguageServer.h"
+
+#include <algorithm> // std::copy
+#include <cstring> // strlen
+#include <istream>
+#include <ostream>
+#include <unistd.h> // getcwd
+
+#include "../compile/compile.h"
+#include "../compile/CompileSession.h"
+#include "../util/store/ArenaString.h"
+#include "../util/store/ListBuilder.h"
+#include "../util/store/Map.h"
+#include "../util/io.h"
+#include "../util/json.h"
+#include "./OverlayDocumentProvider.h"
+
+namespace {
+	bool starts_with(const StringSlice& s, const StringSlice& prefix) {
+		return s.size() >= prefix.size() && StringSlice { s.begin(), s.begin() + prefix.size() } == prefix;
+	}
+
+	bool ends_with(const StringSlice& s, const StringSlice& suffix) {
+		return s.size() >= suffix.size() && StringSlice { s.end() - suffix.size(), s.end() } == suffix;
+	}
+
+	// Messages are framed by a 'Content-Length' header.
+	class Connection {
+		std::istream& in;
+		std::ostream& out;
+
+	public:
+		Connection(std::istream& _in, std::ostream& _out) : in{_in}, out{_out} {}
+
+		// Returns None at the end of input. A message with no content is empty.
+		Option<StringSlice> read(Arena& arena) {
+			const StringSlice content_length_header = "Content-Length: ";
+			uint content_length = 0;
+			// Headers end with an empty line.
+			while (true) {
+				char line[128];
+				if (!in.getline(line, sizeof(line)))
+					return {};
+				uint length = uint(std::strlen(line));
+				if (length != 0 && line[length - 1] == '\r')
+					--length;
+				if (length == 0)
+					break;
+				StringSlice header { line, line + length };
+				if (starts_with(header, content_length_header))
+					for (const char* c = header.begin() + content_length_header.size(); c != header.end() && '0' <= *c && *c <= '9'; ++c)
+						content_length = content_length * 10 + uint(*c - '0');
+			}
+			if (content_length == 0)
+				return Option { StringSlice {} };
+			ArenaString content = allocate_slice(arena, content_length);
+			if (!in.read(content.begin(), long(content_length)))
+				return {};
+			return Option { content.slice() };
+		}
+
+		void send(const Writer::Output& message) {
+			out << "Content-Length: " << message.size() << "\r\n\r\n";
+			out.write(message.begin(), long(message.size()));
+			out.flush();
+		}
+
+		// 'write_members' writes the members of the message other than "jsonrpc".
+		template <typename /*Writer& => void*/ Cb>
+		void send(Cb write_members) {
+			TempArena temp;
+			Writer w { temp };
+			w << "{\"jsonrpc\":\"2.0\",";
+			write_members(w);
+			w << '}';
+			send(w.finish());
+		}
+
+		void respond(const Json& id, const StringSlice& result) {
+			send([&](Writer& w) { w << "\"id\":" << id << ",\"result\":" << result; });
+		}
+
+		// 'code' is one of the protocol's error codes, which are negative.
+		void respond_error(const Json& id, const StringSlice& code, const StringSlice& message) {
+			send([&](Writer& w) {
+				w << "\"id\":" << id << ",\"error\":{\"code\":" << code << ",\"message\":";
+				write_json_string(w, message);
+				w << '}';
+			});
+		}
+	};
+
+	const StringSlice FILE_SCHEME = "file://";
+
+	uint hex_value(char c) {
+		return '0' <= c && c <= '9' ? uint(c - '0') : 'a' <= c && c <= 'f' ? uint(c - 'a' + 10) : 'A' <= c && c <= 'F' ? uint(c - 'A' + 10) : 16;
+	}
+
+	// Decodes a 'file:' URI to a file path. None for any other kind of URI.
+	Option<StringSlice> file_path_of_uri(const StringSlice& uri, Arena& arena) {
+		if (!starts_with(uri, FILE_SCHEME) || uri.size() == FILE_SCHEME.size())
+			return {};
+		StringBuilder b { arena, uri.size() };
+		for (const char* c = uri.begin() + FILE_SCHEME.size(); c != uri.end(); ++c) {
+			if (*c == '%' && uri.end() - c > 2 && hex_value(c[1]) < 16 && hex_value(c[2]) < 16) {
+				b << char(hex_value(c[1]) * 16 + hex_value(c[2]));
+				c += 2;
+			} else
+				b << *c;
+		}
+		return Option { b.finish().slice() };
+	}
+
+	// Unreserved characters from RFC 3986, plus '/' since it separates the path.
+	bool needs_no_escape(char c) {
+		return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~' || c == '/';
+	}
+
+	ArenaString file_uri(const StringSlice& file_path, Arena& arena) {
+		const char* hex = "0123456789ABCDEF";
+		StringBuilder b { arena, FILE_SCHEME.size() + file_path.size() * 3 };
+		b << FILE_SCHEME;
+		for (char c : file_path) {
+			if (needs_no_escape(c))
+				b << c;
+			else
+				b << '%' << hex[uint8_t(c) >> 4] << hex[uint8_t(c) & 0xf];
+		}
+		return b.finish();
+	}
+
+	// Answers 'initialize', which tells us where the workspace is. Before that, the only thing to answer is 'exit'.
+	// Returns the workspace's root directory, or None if the client exits first.
+	Option<StringSlice> wait_for_initialize(Connection& connection, Arena& arena) {
+		while (true) {
+			TempArena temp;
+			Option<StringSlice> content = connection.read(temp);
+			if (!content.has())
+				return {};
+			Option<Json> op_message = parse_json(content.get(), temp);
+			if (!op_message.has())
+				continue;
+			const Json& message = op_message.get();
+			Option<StringSlice> method = message.get_string("method");
+			Option<const Json&> id = message.get("id");
+			if (!method.has())
+				continue;
+			if (method.get() == "exit")
+				return {};
+			if (!id.has())
+				continue;
+			if (method.get() != "initialize") {
+				connection.respond_error(id.get(), "-32002", "The server is not initialized yet");
+				continue;
+			}
+
+			Option<const Json&> params = message.get("params");
+			Option<StringSlice> root_uri = params.has() ? params.get().get_string("rootUri") : Option<StringSlice> {};
+			Option<StringSlice> root = root_uri.has() ? file_path_of_uri(root_uri.get(), temp) : Option<StringSlice> {};
+			if (!root.has() && params.has())
+				root = params.get().get_string("rootPath");
+			char cwd[256];
+			if (!root.has() && getcwd(cwd, sizeof(cwd)))
+				root = Option { StringSlice { cwd, cwd + std::strlen(cwd) } };
+			if (!root.has()) todo();
+			// Paths are written as root + '/' + path, so the root shouldn't end in '/'.
+			StringSlice r = root.get();
+			while (!r.is_empty() && *(r.end() - 1) == '/')
+				r = r.size() == 1 ? StringSlice {} : StringSlice { r.begin(), r.end() - 1 };
+
+			connection.respond(id.get(), "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2}},\"serverInfo\":{\"name\":\"oohoo\"}}");
+			return Option { r.is_empty() ? StringSlice {} : copy_string(arena, r).slice() };
+		}
+	}
+
+	struct DocumentState {
+		ArenaString uri;
+		bool is_open;
+		bool has_diagnostics; // As last published
+		// Index of the compile (in this round of compiling every open document) whose diagnostics for this document we publish.
+		// Other compiles that import this document would just find the same diagnostics again. 0 for none.
+		uint diagnostics_from;
+	};
+
+	struct LspDiagnostic {
+		Path path;
+		SourceRange range;
+		Writer::Output message;
+	};
+
+	// The protocol counts characters in UTF-16 code units.
+	void write_position(Writer& out, const StringSlice& text, LineAndColumnGetter::Cursor& cursor, uint pos) {
+		LineAndColumn line_and_column = cursor.at(pos);
+		uint character = 0;
+		for (const char* c = text.begin() + (pos - line_and_column.column); c != text.begin() + pos; ++c) {
+			uint8_t u = uint8_t(*c);
+			if ((u & 0xc0) != 0x80) ++character;
+			if ((u & 0xf8) == 0xf0) ++character; // Takes a surrogate pair
+		}
+		out << "{\"line\":" << line_and_column.line << ",\"character\":" << character << '}';
+	}
+
+	// None unless 'object' has a member 'key' that is a whole number.
+	Option<uint> get_uint(const Json& object, const StringSlice& key) {
+		Option<const Json&> j = object.get(key);
+		if (!j.has() || j.get().kind() != Json::Kind::Number)
+			return {};
+		uint n = 0;
+		for (char c : j.get().number()) {
+			if (c < '0' || c > '9' || n > 100000000) return {};
+			n = n * 10 + uint(c - '0');
+		}
+		return Option { n };
+	}
+
+	// Inverse of 'write_position'. A character past the end of its line means the end of the line.
+	// None if the line is past the end of 'text'.
+	Option<uint> pos_of_position(const StringSlice& text, const Json& position) {
+		Option<uint> line = get_uint(position, "line");
+		Option<uint> character = get_uint(position, "character");
+		if (!line.has() || !character.has())
+			return {};
+		const char* c = text.begin();
+		for (uint l = 0; l != line.get(); ++l) {
+			while (c != text.end() && *c != '\n')
+				++c;
+			if (c == text.end())
+				return {};
+			++c;
+		}
+		for (uint n_units = 0; n_units < character.get() && c != text.end() && *c != '\n'; ) {
+			n_units += (uint8_t(*c) & 0xf8) == 0xf0 ? 2 : 1; // Takes a surrogate pair
+			++c;
+			while (c != text.end() && (uint8_t(*c) & 0xc0) == 0x80)
+				++c;
+		}
+		return Option { uint(c - text.begin()) };
+	}
+
+	// Applies one of a 'didChange' notification's changes. Without a range, the change is the new text of the whole document.
+	// None if the change is malformed.
+	Option<StringSlice> apply_change(const StringSlice& text, const Json& change, Arena& arena) {
+		Option<StringSlice> new_text = change.get_string("text");
+		if (!new_text.has())
+			return {};
+		Option<const Json&> range = change.get("range");
+		if (!range.has())
+			return new_text;
+		Option<const Json&> start = range.get().get("start");
+		Option<const Json&> end = range.get().get("end");
+		Option<uint> begin_pos = start.has() ? pos_of_position(text, start.get()) : Option<uint> {};
+		Option<uint> end_pos = end.has() ? pos_of_position(text, end.get()) : Option<uint> {};
+		if (!begin_pos.has() || !end_pos.has() || end_pos.get() < begin_pos.get())
+			return {};
+		uint size = text.size() - (end_pos.get() - begin_pos.get()) + new_text.get().size();
+		if (size == 0)
+			return Option { StringSlice {} };
+		ArenaString res = allocate_slice(arena, size);
+		char* out = std::copy(text.begin(), text.begin() + begin_pos.get(), res.begin());
+		out = std::copy(new_text.get().begin(), new_text.get().end(), out);
+		std::copy(text.begin() + end_pos.get(), text.end(), out);
+		return Option { res.slice() };
+	}
+
+	class Server {
+		Connection& connection;
+		const StringSlice root;
+		OverlayDocumentProvider documents;
+		CompileSession session;
+		Arena arena;
+		Map<Path, Ref<DocumentState>, Path::hash> states;
+		bool shutting_down;
+
+		DocumentState& get_state(Path path) {
+			Option<Ref<DocumentState>&> already = states.get(path);
+			if (already.has())
+				return already.get();
+			MaxSizeString<256> file_path = MaxSizeString<256>::make([&](MaxSizeStringWriter& w) { w << FileLocator { root, path, NZ_EXTENSION }; });
+			Ref<DocumentState> state = arena.put(DocumentState { file_uri(file_path.slice(), arena), false, false, 0 });
+			states.must_insert(path, state);
+			return state;
+		}
+
+		// None for a document outside the workspace, or that isn't a module.
+		Option<Path> path_of_uri(const StringSlice& uri, Arena& temp) {
+			Option<StringSlice> op_file_path = file_path_of_uri(uri, temp);
+			if (!op_file_path.has())
+				return {};
+			StringSlice file_path = op_file_path.get();
+			if (!starts_with(file_path, root) || file_path.size() <= root.size() + 1 || *(file_path.begin() + root.size()) != '/')
+				return {};
+			StringSlice relative { file_path.begin() + root.size() + 1, file_path.end() };
+			if (!ends_with(relative, NZ_EXTENSION) || relative.size() <= NZ_EXTENSION.size() + 1 || *(relative.end() - NZ_EXTENSION.size() - 1) != '.')
+				return {};
+
+			Option<Path> path;
+			const char* part_begin = relative.begin();
+			const char* end = relative.end() - NZ_EXTENSION.size() - 1;
+			for (const char* c = part_begin; ; ++c) {
+				if (c == end || *c == '/') {
+					if (c == part_begin) return {};
+					path = session.paths().resolve(path, StringSlice { part_begin, c });
+					if (c == end) break;
+					part_begin = c + 1;
+				}
+			}
+			return path;
+		}
+
+		void write_diagnostics(Writer& w, Path path, const List<LspDiagnostic>& diagnostics) {
+			StringSlice text = session.source(path);
+			// A module's diagnostics are mostly in order, so a cursor beats searching from scratch for each.
+			LineAndColumnGetter::Cursor cursor { session.line_and_column_getter(path) };
+			bool first = true;
+			for (const LspDiagnostic& d : diagnostics) {
+				if (d.path != path) continue;
+				if (!first) w << ',';
+				first = false;
+				w << "{\"range\":{\"start\":";
+				write_position(w, text, cursor, d.range.begin);
+				w << ",\"end\":";
+				write_position(w, text, cursor, d.range.end);
+				w << "},\"severity\":1,\"source\":\"noze\",\"message\":";
+				write_json_string(w, d.message);
+				w << '}';
+			}
+		}
+
+		// Each document only has one set of diagnostics, so this compiles every open document and then publishes for each.
+		// Also publishes for every open document with no diagnostics, and for every document whose diagnostics went away.
+		void publish_diagnostics() {
+			TempArena temp;
+			List<Path> open;
+			states.each([&](const Path& path, const Ref<DocumentState>& s) {
+				Ref<DocumentState> state = s;
+				state->diagnostics_from = 0;
+				if (state->is_open)
+					open.prepend(path, temp);
+			});
+
+			ListBuilder<LspDiagnostic> diagnostics;
+			uint n_compiles = 0;
+			for (Path path : open) {
+				++n_compiles;
+				List<Diagnostic> result;
+				try {
+					result = session.compile(path).diagnostics;
+				} catch (...) {
+					// Only something the compiler doesn't support yet (a 'todo') gets here. Then there's nothing to publish.
+					continue;
+				}
+				for (const Diagnostic& d : result) {
+					DocumentState& state = get_state(d.path);
+					if (state.diagnostics_from == 0)
+						state.diagnostics_from = n_compiles;
+					if (state.diagnostics_from != n_compiles)
+						continue;
+					Writer message { temp };
+					d.write_message(message, session.source(d.path));
+					diagnostics.add({ d.path, d.range, message.finish() }, temp);
+				}
+			}
+
+			List<LspDiagnostic> all = diagnostics.finish();
+			states.each([&](const Path& path, const Ref<DocumentState>& s) {
+				Ref<DocumentState> state = s;
+				bool has_diagnostics = state->diagnostics_from != 0;
+				if (!state->is_open && !has_diagnostics && !state->has_diagnostics)
+					return;
+				state->has_diagnostics = has_diagnostics;
+				connection.send([&](Writer& w) {
+					w << "\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":";
+					write_json_string(w, state->uri.slice());
+					w << ",\"diagnostics\":[";
+					if (has_diagnostics)
+						write_diagnostics(w, path, all);
+					w << "]}";
+				});
+			});
+		}
+
+		// Returns false if the document isn't a module in the workspace.
+		bool did_open_or_change(const StringSlice& uri, const StringSlice& text, Arena& temp) {
+			Option<Path> path = path_of_uri(uri, temp);
+			if (!path.has())
+				return false;
+			documents.set(path.get(), NZ_EXTENSION, text);
+			DocumentState& state = get_state(path.get());
+			if (!state.is_open) {
+				// Use the client's spelling of the URI, since that's what it will look for.
+				if (!(state.uri == uri))
+					state.uri = copy_string(arena, uri);
+				state.is_open = true;
+			}
+			return true;
+		}
+
+		bool did_change(const StringSlice& uri, const Slice<Json>& changes, Arena& temp) {
+			Option<Path> path = path_of_uri(uri, temp);
+			if (!path.has())
+				return false;
+			Option<StringSlice> document = documents.try_get_document(path.get(), NZ_EXTENSION, temp);
+			if (!document.has())
+				return false;
+			// Documents end in a '\0' that isn't part of the text.
+			StringSlice text = document.get().size() == 1 ? StringSlice {} : StringSlice { document.get().begin(), document.get().end() - 1 };
+			// Each change applies to the text as left by the one before.
+			for (const Json& change : changes) {
+				Option<StringSlice> changed = apply_change(text, change, temp);
+				if (!changed.has())
+					return false;
+				text = changed.get();
+			}
+			return did_open_or_change(uri, text, temp);
+		}
+
+		bool did_close(const StringSlice& uri, Arena& temp) {
+			Option<Path> path = path_of_uri(uri, temp);
+			if (!path.has())
+				return false;
+			documents.remove(path.get(), NZ_EXTENSION);
+			get_state(path.get()).is_open = false;
+			return true;
+		}
+
+		// Returns whether diagnostics may have changed.
+		bool handle_notification(const StringSlice& method, const Json& params, Arena& temp) {
+			Option<const Json&> document = params.get("textDocument");
+			Option<StringSlice> uri = document.has() ? document.get().get_string("uri") : Option<StringSlice> {};
+			if (!uri.has())
+				return false;
+
+			if (method == "textDocument/didOpen") {
+				Option<StringSlice> text = document.get().get_string("text");
+				return text.has() && did_open_or_change(uri.get(), text.get(), temp);
+			} else if (method == "textDocument/didChange") {
+				// We asked for incremental changes, so each only has the text of the range it replaces.
+				Option<const Json&> changes = params.get("contentChanges");
+				return changes.has() && changes.get().kind() == Json::Kind::Array && did_change(uri.get(), changes.get().array(), temp);
+			} else if (method == "textDocument/didClose")
+				return did_close(uri.get(), temp);
+			else
+				// Includes 'didSave': we already have the text from 'didChange'.
+				return false;
+		}
+
+	public:
+		Server(Connection& _connection, DocumentProvider& files, StringSlice _root)
+			: connection{_connection}, root{_root}, documents{files}, session{documents}, arena{}, states{arena}, shutting_down{false} {}
+
+		// Returns the exit code once the client says to exit.
+		int serve() {
+			while (true) {
+				TempArena temp;
+				Option<StringSlice> content = connection.read(temp);
+				if (!content.has())
+					return 1; // The client went away without saying to exit.
+				Option<Json> op_message = parse_json(content.get(), temp);
+				if (!op_message.has()) {
+					connection.respond_error(Json::null(), "-32700", "Could not parse the message");
+					continue;
+				}
+				const Json& message = op_message.get();
+				Option<StringSlice> method = message.get_string("method");
+				Option<const Json&> id = message.get("id");
+				if (!method.has())
+					continue; // A response, but we never send requests.
+
+				if (method.get() == "exit")
+					return shutting_down ? 0 : 1;
+				else if (!id.has()) {
+					Option<const Json&> params = message.get("params");
+					if (!shutting_down && params.has() && handle_notification(method.get(), params.get(), temp))
+						publish_diagnostics();
+				} else if (shutting_down)
+					connection.respond_error(id.get(), "-32600", "The server is shutting down");
+				else if (method.get() == "shutdown") {
+					shutting_down = true;
+					connection.respond(id.get(), "null");
+				} else
+					connection.respond_error(id.get(), "-32601", "Unsupported method");
+			}
+		}
+	};
+}
+
+int run_language_server(std::istream& in, std::ostream& out) {
+	Connection connection { in, out };
+	Arena arena;
+	Option<StringSlice> root = wait_for_initialize(connection, arena);
+	if (!root.has())
+		return 1;
+	unique_ptr<DocumentProvider> files = file_system_document_provider(root.get());
+	return Server { connection, *files, root.get() }.serve();
+}
+
+int run_language_server(std::istream& in, std::ostream& out, DocumentProvider& files) {
+	Connection connection { in, out };
+	Arena arena;
+	Option<StringSlice> root = wait_for_initialize(connection, arena);
+	if (!root.has())
+		return 1;
+	return Server { connection, files, root.get() }.serve();
+}
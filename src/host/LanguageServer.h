@@ -0,0 +1,13 @@
+#pragma once
+
+#include <iosfwd> // std::istream, std::ostream
+
+#include "./DocumentProvider.h"
+
+// Speaks the language server protocol (https://microsoft.github.io/language-server-protocol/) over 'in' and 'out' until the client says to exit.
+// Returns the exit code.
+// One CompileSession lasts for the life of the server, reading the workspace's files with the client's unsaved changes layered over them.
+// After each change, compiles every open document and publishes diagnostics for it and for anything it imports.
+int run_language_server(std::istream& in, std::ostream& out);
+// Same, but 'files' provides the workspace's files instead of the file system.
+int run_language_server(std::istream& in, std::ostream& out, DocumentProvider& files);
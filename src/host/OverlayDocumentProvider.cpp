@@ -0,0 +1,58 @@
+#include "./OverlayDocumentProvider.h"
+
+#include <algorithm> // std::copy, std::equal
+#include <new> // placement new
+
+#include "../util/store/ArenaString.h"
+#include "../util/io.h"
+
+namespace {
+	using Key = MaxSizeString<128>;
+
+	Key get_key(const Path& path, const StringSlice& extension) {
+		return Key::make([&](MaxSizeStringWriter& w) { w << FileLocator { "", path, extension }; });
+	}
+
+	// Documents end in a '\0' that isn't part of the text.
+	StringSlice copy_document(Arena& arena, const StringSlice& text) {
+		ArenaString res = allocate_slice(arena, text.size() + 1);
+		std::copy(text.begin(), text.end(), res.begin());
+		res[text.size()] = '\0';
+		return res;
+	}
+
+	bool document_is(const StringSlice& document, const StringSlice& text) {
+		return document.size() == text.size() + 1 && std::equal(text.begin(), text.end(), document.begin());
+	}
+}
+
+OverlayDocumentProvider::~OverlayDocumentProvider() {
+	overlays.each([](const StringSlice& key __attribute__((unused)), const Ref<Overlay>& o) {
+		o->~Overlay();
+	});
+}
+
+void OverlayDocumentProvider::set(const Path& path, const StringSlice& extension, const StringSlice& text) {
+	Key key = get_key(path, extension);
+	Option<Ref<Overlay>&> already = overlays.get(key.slice());
+	Ref<Overlay> overlay = already.has() ? already.get() : overlays.must_insert(copy_string(arena, key.slice()), new (arena.allocate_uninitialized<Overlay>().ptr()) Overlay {}).value;
+	// Editors often send the same text again, as on saving.
+	if (overlay->text.has() && document_is(overlay->text.get(), text))
+		return;
+	// 'text' may not point into the old version, since that's freed here.
+	overlay->arena.release(overlay->empty);
+	overlay->text = Option { copy_document(overlay->arena, text) };
+}
+
+void OverlayDocumentProvider::remove(const Path& path, const StringSlice& extension) {
+	Option<Ref<Overlay>&> overlay = overlays.get(get_key(path, extension).slice());
+	if (overlay.has()) {
+		overlay.get()->text = Option<StringSlice> {};
+		overlay.get()->arena.release(overlay.get()->empty);
+	}
+}
+
+Option<StringSlice> OverlayDocumentProvider::try_get_document(const Path& path, const StringSlice& extension, Arena& out) {
+	Option<Ref<Overlay>&> overlay = overlays.get(get_key(path, extension).slice());
+	return overlay.has() && overlay.get()->text.has() ? overlay.get()->text : base.try_get_document(path, extension, out);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../util/store/Map.h"
+#include "./DocumentProvider.h"
+
+// Layers documents that aren't saved yet, such as a text editor's open buffers, over another provider.
+// 'set' and 'remove' must not be called while anything may be in 'try_get_document', such as during a compile.
+// They free the old version of the document, so a document from 'try_get_document' is only valid until then.
+class OverlayDocumentProvider final : public DocumentProvider {
+	struct Overlay {
+		Arena arena; // Holds only the current version of 'text'.
+		const Arena::Mark empty;
+		Option<StringSlice> text; // None after 'remove'.
+
+		inline Overlay() : arena{}, empty{arena.mark()}, text{} {}
+		Overlay(const Overlay& other) = delete;
+		void operator=(const Overlay& other) = delete;
+	};
+
+	DocumentProvider& base;
+	Arena arena;
+	// Keyed by the full path of the document, like FileDocumentProvider.
+	Map<StringSlice, Ref<Overlay>, StringSlice::hash> overlays;
+
+public:
+	explicit OverlayDocumentProvider(DocumentProvider& _base) : base{_base}, arena{}, overlays{arena} {}
+	OverlayDocumentProvider(const OverlayDocumentProvider& other) = delete;
+	void operator=(const OverlayDocumentProvider& other) = delete;
+	~OverlayDocumentProvider();
+
+	// Until 'remove', the document is 'text' instead of whatever 'base' has. 'text' is copied.
+	void set(const Path& path, const StringSlice& extension, const StringSlice& text);
+	void remove(const Path& path, const StringSlice& extension);
+
+	Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension, Arena& out) override;
+};
@@ -0,0 +1,142 @@
+#include "./build.h"
+
+#include <iostream> // std::endl, std::ostream
+#include <thread> // std::thread::hardware_concurrency
+#include "../compile/compile.h"
+#include "../emit/emit.h"
+#include "../util/store/ArenaArrayBuilders.h"
+#include "../util/store/ArenaString.h"
+#include "../util/io.h"
+#include "../clang.h"
+#include "./DocumentProvider.h"
+#include "./ExeCache.h"
+#include "./InterfaceStore.h"
+
+namespace {
+	std::ostream& operator<<(std::ostream& out, const StringSlice& slice) {
+		for (char c : slice)
+			out << c;
+		return out;
+	}
+
+	// From the sources the compile already read, with one LineAndColumnGetter per file.
+	void write_diagnostics(const CompiledProgram& program, std::ostream& out) {
+		TempArena temp;
+		Writer w { temp };
+		::write_diagnostics(w, program);
+		out << w.finish() << std::flush;
+	}
+
+	// Shards are named 'main.0.cpp', 'main.1.cpp', and so on.
+	StringSlice shard_extension(uint index, Arena& arena) {
+		StringBuilder b { arena, 16 };
+		b << index << ".cpp";
+		return b.finish();
+	}
+
+	int build_shards(const StringSlice& root, const CompiledProgram& program, uint n_threads, std::ostream& out) {
+		TempArena temp;
+		PathCache paths;
+		LoweredProgram lowered { program.modules, program.builtin_types, n_threads };
+		CppShardedProgram cpp_program = write_shards(lowered, root, paths.from_part_slice("main"), temp);
+
+		MaxSizeString<128> cache_dir = default_exe_cache_dir();
+		unique_ptr<ExeCache> cache = file_system_exe_cache(cache_dir.slice());
+		CppShardedBuild b = compile_cpp_shards(cpp_program, *cache, n_threads);
+		MaxSizeString<128> exe = MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << cpp_program.exe; });
+		if (!b.built) {
+			out << "clang failed to build " << exe.slice() << std::endl;
+			return 1;
+		}
+		if (b.cached)
+			out << exe.slice() << " is up to date" << std::endl;
+		else
+			out << "built " << exe.slice() << " in " << b.precompile_ms + b.compile_ms + b.link_ms << "ms, compiling "
+				<< b.n_compiled << " of " << cpp_program.shards.size() << " shards" << std::endl;
+		return 0;
+	}
+}
+
+CppShardedProgram write_shards(LoweredProgram& lowered, const StringSlice& root, const Path& main_path, Arena& arena) {
+	CppShardedProgram cpp_program {
+		{ root, main_path, "h" },
+		fill_array<FileLocator>()(arena, lowered.n_shards(), [&](uint i) { return FileLocator { root, main_path, shard_extension(i, arena) }; }),
+		{ root, main_path, "exe" },
+	};
+	TempArena temp;
+	{
+		FileSink sink { cpp_program.header };
+		Writer w { temp, sink };
+		lowered.write_header(w);
+		w.finish();
+	}
+	for (uint i = 0; i != cpp_program.shards.size(); ++i) {
+		FileSink sink { cpp_program.shards[i] };
+		Writer w { temp, sink };
+		lowered.write_shard(w, i, "main.h");
+		w.finish();
+	}
+	// Shards are always numbered from 0, so the leftovers start right after these.
+	for (uint i = cpp_program.shards.size(); ; ++i) {
+		FileLocator stale { root, main_path, shard_extension(i, temp) };
+		if (!file_exists(stale))
+			break;
+		delete_file(stale);
+	}
+	return cpp_program;
+}
+
+int build(const StringSlice& root, bool shards, std::ostream& out) {
+	unique_ptr<DocumentProvider> document_provider = file_system_document_provider(root);
+	CompiledProgram program;
+	uint n_threads = std::thread::hardware_concurrency();
+	n_threads = n_threads == 0 ? 1 : n_threads < MAX_THREADS ? n_threads : MAX_THREADS;
+	compile(program, *document_provider, program.paths.from_part_slice("main"), n_threads);
+	if (!program.diagnostics.is_empty()) {
+		write_diagnostics(program, out);
+		return 1;
+	}
+
+	if (shards)
+		return build_shards(root, program, n_threads, out);
+
+	TempArena temp;
+	PathCache paths;
+	Path main_path = paths.from_part_slice("main");
+	CppProgram cpp_program { { root, main_path, "cpp" }, { root, main_path, "exe" } };
+	{
+		// Straight to the file, however big the program is.
+		FileSink sink { cpp_program.cpp };
+		Writer w { temp, sink };
+		emit(w, program.modules, program.builtin_types, n_threads);
+		w.finish();
+	}
+
+	MaxSizeString<128> cache_dir = default_exe_cache_dir();
+	unique_ptr<ExeCache> cache = file_system_exe_cache(cache_dir.slice());
+	CppBatch batch = compile_cpp_files({ &cpp_program, 1 }, *cache, temp);
+	MaxSizeString<128> exe = MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << cpp_program.exe; });
+	const CppBuild& b = batch.builds[0];
+	if (!b.built) {
+		out << "clang failed to build " << exe.slice() << std::endl;
+		return 1;
+	}
+	if (b.cached)
+		out << exe.slice() << " is up to date" << std::endl;
+	else
+		out << "built " << exe.slice() << " in " << batch.precompile_ms + batch.compile_ms + b.link_ms << "ms" << std::endl;
+	return 0;
+}
+
+int check_program(const StringSlice& root, std::ostream& out) {
+	unique_ptr<DocumentProvider> document_provider = file_system_document_provider(root);
+	unique_ptr<InterfaceStore> interfaces = file_system_interface_store(root);
+	CompiledProgram program;
+	uint n_loaded = check_with_interfaces(program, *document_provider, *interfaces, program.paths.from_part_slice("main"));
+	if (!program.diagnostics.is_empty()) {
+		write_diagnostics(program, out);
+		return 1;
+	}
+	out << "checked " << program.modules.size() - n_loaded << " of " << program.modules.size() << " modules" << std::endl;
+	return 0;
+}
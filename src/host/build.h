@@ -0,0 +1,22 @@
+#pragma once
+
+#include <iosfwd> // std::ostream
+
+#include "../util/store/StringSlice.h"
+#include "../emit/emit.h"
+#include "../clang.h"
+
+// Compiles 'root/main.nz' and everything it imports to 'root/main.cpp', then builds that into 'root/main.exe'.
+// If the emitted C++ was built before, reuses that exe instead of running clang.
+// With 'shards', instead writes 'root/main.h' and one 'root/main.<n>.cpp' per module, and compiles those in parallel.
+// Then only shards that changed since they were last built are compiled again.
+// Writes diagnostics and progress to 'out'. Returns the exit code.
+int build(const StringSlice& root, bool shards, std::ostream& out);
+
+// Writes 'root/main.h' and one 'root/main.<n>.cpp' per shard of 'lowered', with the locators allocated in 'arena'.
+// Deletes shards left over from a build with more of them, which would otherwise look like part of the program.
+CppShardedProgram write_shards(LoweredProgram& lowered, const StringSlice& root, const Path& main_path, Arena& arena);
+
+// Only checks 'root/main.nz' and everything it imports, and writes diagnostics to 'out'. Returns the exit code.
+// Keeps each module's interface in a '.nzi' file next to it, so an imported module that didn't change isn't parsed or checked again.
+int check_program(const StringSlice& root, std::ostream& out);
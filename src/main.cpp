@@ -1,10 +1,14 @@
+#include <cstring> // strcmp
 #include <iostream> // cout
 #include <unistd.h> // getcwd
 
+#include "./test/benchmarks.h"
 #include "./test/unit_tests.h"
 #include "./test/test.h"
 
+#include "./host/build.h"
 #include "./host/DocumentProvider.h"
+#include "./host/LanguageServer.h"
 #include "./util/rlimit.h"
 #include "util/store/collection_util.h"
 
@@ -79,22 +83,59 @@ namespace {
 		}
 	};
 
-	int go() {
+	// Returns 0 if 's' isn't a positive number.
+	uint parse_n_jobs(const char* s) {
+		uint n = 0;
+		for (; *s != '\0'; ++s) {
+			if (*s < '0' || *s > '9' || n > 1000) return 0;
+			n = n * 10 + uint(*s - '0');
+		}
+		return n;
+	}
+
+	int go(uint n_jobs) {
 		unit_tests();
 
 		MaxSizeString<128> test_dir = MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { get_test_directory(w); });
 		auto filter = SubstrTestFilter { "simple" }; // EveryTestFilter{};
-		int exit_code = test(test_dir.slice(), filter, TestMode::Accept);
+		int exit_code = test(test_dir.slice(), filter, TestMode::Accept, n_jobs);
 		std::cout << "done" << std::endl;
 		return exit_code;
 	}
 }
 
-int main() {
+int main(int argc, char** argv) {
+	// Benchmarks run without limits.
+	if (argc == 2 && std::strcmp(argv[1], "bench") == 0) {
+		benchmarks();
+		return 0;
+	}
+	// Started by an editor, which talks to it over stdin and stdout.
+	if (argc == 2 && std::strcmp(argv[1], "lsp") == 0)
+		return run_language_server(std::cin, std::cout);
+	// Building runs clang, which shouldn't be limited either.
+	if (argc == 3 && std::strcmp(argv[1], "build") == 0)
+		return build({ argv[2], argv[2] + std::strlen(argv[2]) }, /*shards*/ false, std::cout);
+	if (argc == 4 && std::strcmp(argv[1], "build") == 0 && std::strcmp(argv[2], "--shards") == 0)
+		return build({ argv[3], argv[3] + std::strlen(argv[3]) }, /*shards*/ true, std::cout);
+	if (argc == 3 && std::strcmp(argv[1], "check") == 0)
+		return check_program({ argv[2], argv[2] + std::strlen(argv[2]) }, std::cout);
+
+	// '-j N' runs tests in up to N processes at once.
+	uint n_jobs = 1;
+	if (argc == 3 && std::strcmp(argv[1], "-j") == 0)
+		n_jobs = parse_n_jobs(argv[2]);
+	else if (argc != 1)
+		n_jobs = 0;
+	if (n_jobs == 0) {
+		std::cerr << "Usage: " << argv[0] << " [bench | lsp | build [--shards] DIRECTORY | check DIRECTORY | -j N]" << std::endl;
+		return 1;
+	}
+
 	set_limits();
 	int exit_code;
 	try {
-		exit_code = go();
+		exit_code = go(n_jobs);
 	} catch (std::bad_alloc a) {
 		std::cerr << "Bad allocation -- probably due to memory limit" << std::endl;
 		throw a;
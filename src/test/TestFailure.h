@@ -4,7 +4,8 @@
 #include "../util/store/MaxSizeString.h"
 
 struct TestFailure {
-	enum class Kind { BaselineAdded, BaselineChanged, BaselineRemoved, CppCompilationFailed };
+	enum class Kind { BaselineAdded, BaselineChanged, BaselineRemoved, CppCompilationFailed, RunFailed, Crashed };
 	Kind kind;
 	MaxSizeString<128> loc;
+	int exit_status; // For RunFailed, what the program exited with. Otherwise 0.
 };
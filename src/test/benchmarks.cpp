@@ -0,0 +1,749 @@
+#include "./benchmarks.h"
+
+#include <chrono> // std::chrono
+#include <iostream> // std::cout
+#include <new> // ::operator new
+#include "../compile/compile.h"
+#include "../compile/CompileSession.h"
+#include "../compile/parse/parser.h"
+#include "../compile/parse/reparse.h"
+#include "../compile/parse/scan.h"
+#include "../compile/parse/tokenize.h"
+#include "../emit/emit.h"
+#include "../util/store/Arena.h"
+#include "../util/store/BlockedList.h"
+#include "../util/store/Map.h"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// Benchmarks return a checksum that's written here so their work can't be optimized away.
+	volatile ulong sink;
+
+	// Returns the best time (in milliseconds) of several runs.
+	template <typename /*() => ulong*/ Cb>
+	double best_time_ms(Cb cb) {
+		double best = 0;
+		for (uint run = 0; run != 5; ++run) {
+			Clock::time_point start = Clock::now();
+			sink = cb();
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			if (run == 0 || ms < best)
+				best = ms;
+		}
+		return best;
+	}
+
+	void report(const char* name, double ms, double n_ops, const char* op_name) {
+		std::cout << name << ": " << ms << "ms, " << (ms * 1000000 / n_ops) << "ns per " << op_name << std::endl;
+	}
+
+	// The arena as it was before it could grow: a single buffer of fixed size.
+	class FixedBumpArena {
+		char* begin;
+		char* next;
+		char* end;
+
+	public:
+		FixedBumpArena(uint size) : begin{static_cast<char*>(::operator new(size))}, next{begin}, end{begin + size} {}
+		FixedBumpArena(const FixedBumpArena& other) = delete;
+		~FixedBumpArena() { ::operator delete(begin); }
+
+		inline void* allocate(uint n_bytes, uint alignment __attribute__((unused))) {
+			void* res = next;
+			next += n_bytes;
+			assert(next <= end);
+			return res;
+		}
+	};
+
+	const uint N_ALLOCATIONS = 1000000;
+
+	// Allocates objects of 8 to 32 bytes, like the small nodes the compiler allocates.
+	template <typename ArenaLike>
+	ulong allocate_many(ArenaLike& arena) {
+		ulong sum = 0;
+		for (uint i = 0; i != N_ALLOCATIONS; ++i) {
+			uint n_words = 1 + (i & 3);
+			ulong* p = static_cast<ulong*>(arena.allocate(n_words * sizeof(ulong), alignof(ulong)));
+			p[n_words - 1] = i;
+			sum += p[n_words - 1];
+		}
+		return sum;
+	}
+
+	void bench_arena() {
+		// 1 + 2 + 3 + 4 words on average is 2.5 words per allocation
+		uint fixed_size = N_ALLOCATIONS * 3 * sizeof(ulong);
+		double fixed = best_time_ms([&]() {
+			FixedBumpArena arena { fixed_size };
+			return allocate_many(arena);
+		});
+		report("arena: fixed bump allocator", fixed, N_ALLOCATIONS, "allocation");
+
+		double chunked = best_time_ms([&]() {
+			Arena arena;
+			return allocate_many(arena);
+		});
+		report("arena: chunked allocator", chunked, N_ALLOCATIONS, "allocation");
+	}
+
+	// The map as it was before it could grow: coalesced hashing in a fixed-size array. Only what the benchmark needs.
+	template <typename K, typename V, typename Hash>
+	class CoalescedMap {
+		struct Entry {
+			K key;
+			V value;
+			Entry* next_in_chain;
+		};
+		Slice<Option<Entry>> arr;
+		Option<Entry>* leftmost_conflict_slot;
+		Option<Entry>* next_conflict_slot;
+
+		uint index(const K& key) const {
+			return uint(Hash{}(key) % (arr.size() * 3 / 4));
+		}
+
+	public:
+		CoalescedMap(uint capacity, Arena& arena)
+			: arr{fill_array<Option<Entry>>{}(arena, capacity, [](uint i __attribute__((unused))) { return Option<Entry> {}; })},
+			leftmost_conflict_slot{arr.begin() + capacity * 3 / 4},
+			next_conflict_slot{arr.begin() + capacity - 1} {}
+
+		bool try_insert(K key, V value) {
+			Option<Entry>& op_entry = arr[index(key)];
+			if (!op_entry.has()) {
+				op_entry = Entry { key, value, nullptr };
+				return true;
+			}
+			Entry* entry = &op_entry.get();
+			while (true) {
+				if (entry->key == key)
+					return false;
+				if (entry->next_in_chain == nullptr) {
+					assert(next_conflict_slot >= leftmost_conflict_slot);
+					*next_conflict_slot = Entry { key, value, nullptr };
+					entry->next_in_chain = &next_conflict_slot->get();
+					--next_conflict_slot;
+					return true;
+				}
+				entry = entry->next_in_chain;
+			}
+		}
+
+		Option<const V&> get(const K& key) const {
+			const Option<Entry>& op_entry = arr[index(key)];
+			if (!op_entry.has())
+				return {};
+			for (const Entry* entry = &op_entry.get(); entry != nullptr; entry = entry->next_in_chain)
+				if (entry->key == key)
+					return Option<const V&> { entry->value };
+			return {};
+		}
+	};
+
+	// Keys are pointers to arena-allocated nodes, like most keys in the compiler.
+	struct Node {
+		ulong a;
+		ulong b;
+		ulong c;
+	};
+	using NodeRef = Ref<const Node>;
+
+	const uint N_LOOKUPS = 1000000;
+
+	template <typename MapLike>
+	ulong insert_and_look_up(MapLike& map, const Slice<Node>& nodes, uint n_keys) {
+		for (uint i = 0; i != n_keys; ++i)
+			map.try_insert(&nodes[i], i);
+		const MapLike& const_map = map;
+		ulong sum = 0;
+		// Look up in a scattered order. Half of the lookups miss.
+		uint r = 1;
+		for (uint i = 0; i != N_LOOKUPS; ++i) {
+			r = r * 1103515245 + 12345;
+			Option<const uint&> v = const_map.get(&nodes[(r >> 8) % (n_keys * 2)]);
+			if (v.has())
+				sum += v.get();
+		}
+		return sum;
+	}
+
+	void bench_map(uint n_keys) {
+		Arena nodes_arena;
+		Slice<Node> nodes = uninitialized_array<Node>(nodes_arena, n_keys * 2);
+		double n_ops = n_keys + N_LOOKUPS;
+		std::cout << "map with " << n_keys << " keys:" << std::endl;
+		double coalesced = best_time_ms([&]() {
+			Arena arena;
+			// Twice the number of keys, like build_map used.
+			CoalescedMap<NodeRef, uint, NodeRef::hash> map { n_keys * 2, arena };
+			return insert_and_look_up(map, nodes, n_keys);
+		});
+		report("  coalesced hashing, fixed capacity", coalesced, n_ops, "operation");
+
+		double grouped = best_time_ms([&]() {
+			Arena arena;
+			Map<NodeRef, uint, NodeRef::hash> map { arena };
+			return insert_and_look_up(map, nodes, n_keys);
+		});
+		report("  grouped open addressing, growing", grouped, n_ops, "operation");
+	}
+
+	// A tree of modules where module i imports modules 4i+1 through 4i+4.
+	const uint N_MODULES = 64;
+	const uint FUNS_PER_MODULE = 500;
+	const char FUN_SOURCE[] = "f Void\n\tb = true\n\tassert b\n\n";
+
+	// Names can't contain digits, so write the index in base 26.
+	void write_name(StringBuilder& sb, char first, uint index) {
+		sb << first;
+		do {
+			sb << char('a' + index % 26);
+			index /= 26;
+		} while (index != 0);
+	}
+
+	void write_module_name(StringBuilder& sb, uint index) {
+		write_name(sb, 'm', index);
+	}
+
+	uint module_index(const StringSlice& name) {
+		uint index = 0;
+		uint place = 1;
+		for (const char* c = name.begin() + 1; c != name.end(); ++c) {
+			index += uint(*c - 'a') * place;
+			place *= 26;
+		}
+		return index;
+	}
+
+	class ModuleTreeDocumentProvider : public DocumentProvider {
+	public:
+		Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension __attribute__((unused)), Arena& out) override {
+			uint index = module_index(path.base_name());
+			StringBuilder sb { out, 64 + FUNS_PER_MODULE * uint(sizeof(FUN_SOURCE)) };
+			if (4 * index + 1 < N_MODULES) {
+				sb << "import";
+				for (uint i = 4 * index + 1; i <= 4 * index + 4 && i < N_MODULES; ++i) {
+					sb << " .";
+					write_module_name(sb, i);
+				}
+				sb << "\n\n";
+			}
+			for (uint i = 0; i != FUNS_PER_MODULE; ++i)
+				sb << FUN_SOURCE;
+			sb << '\0';
+			return Option<StringSlice> { sb.finish() };
+		}
+	};
+
+	// Returns a checksum of the order files were parsed in, which should not depend on the number of threads.
+	ulong parse_module_tree(uint n_threads) {
+		ModuleTreeDocumentProvider document_provider;
+		PathCache paths;
+		ParsedProgram parsed;
+		ListBuilder<Diagnostic> diagnostics;
+		TempArena diags_arena;
+		bool success = parse_everything(parsed, diagnostics, diags_arena, document_provider, paths, paths.from_part_slice("ma"), n_threads);
+		assert(success && parsed.files.size() == N_MODULES);
+		ulong checksum = 0;
+		for (const FileAst& f : parsed.files)
+			checksum = checksum * 31 + module_index(f.path.base_name());
+		return checksum;
+	}
+
+	void bench_parse_everything() {
+		ulong expected = parse_module_tree(1);
+		for (uint n_threads : { 1u, 2u, 4u, 8u }) {
+			double ms = best_time_ms([&]() {
+				ulong checksum = parse_module_tree(n_threads);
+				assert(checksum == expected);
+				return checksum;
+			});
+			std::cout << "parse " << N_MODULES << " modules on " << n_threads << " threads: " << ms << "ms" << std::endl;
+		}
+	}
+
+	// Every literal, comment and C++ body used to reserve the rest of the file, so this measures how much the parser allocates.
+	const uint N_LITERAL_FUNS = 500; // Source ranges limit files to 64KB.
+	const char LITERAL_FUN_SOURCE[] = "| Says hello.\n| Twice.\nf Void\n\ts = \"hello, world\"\n\tassert s\n\n| Does nothing.\nc g Void\n\tint x = 0;\n\n\tx++;\n\n";
+
+	void bench_parse_literals_and_comments() {
+		TempArena source_arena;
+		StringBuilder sb { source_arena, N_LITERAL_FUNS * uint(sizeof(LITERAL_FUN_SOURCE)) + 1 };
+		for (uint i = 0; i != N_LITERAL_FUNS; ++i)
+			sb << LITERAL_FUN_SOURCE;
+		sb << '\0';
+		StringSlice source = sb.finish();
+
+		PathCache paths;
+		ulong n_bytes_held = 0;
+		double ms = best_time_ms([&]() {
+			Arena arena;
+			FileAst ast { paths.from_part_slice("literals"), source };
+			parse_file(ast, paths, arena);
+			n_bytes_held = arena.n_bytes_held();
+			return ulong(ast.funs.size());
+		});
+		std::cout << "parse " << (source.size() / 1024) << "KB with " << (N_LITERAL_FUNS * 3) << " literals and comments: "
+			<< ms << "ms, " << (n_bytes_held / 1024) << "KB of arena" << std::endl;
+	}
+
+	// Same as test/simple/main.nz, so the benchmark doesn't depend on the file system.
+	const char SIMPLE_SOURCE[] = "Void copy\nc Bool copy\n\tbool\nc true Bool\n\t*_ret = true;\n\nmain Void\n\tb = true\n\tassert b\n";
+
+	// Long names, comments and C++ bodies, where the lexer spends its time scanning.
+	const char LEXER_FUN_SOURCE[] = "| Combines several-things-at-once with another-thing.\nc combine-several-things-at-once AnotherLongTypeName\n\tAnotherLongTypeName result = make_another_long_type_name(several, things, at, once);\n\treturn result;\n\n";
+	const uint N_LEXER_FUNS = 300; // Source ranges limit files to 64KB.
+
+	ulong count_lines(const StringSlice& source, const char* find_newline(const char*, const char*)) {
+		ulong n_lines = 0;
+		for (const char* ptr = source.begin(); ptr != source.end(); ++ptr) {
+			ptr = find_newline(ptr, source.end());
+			if (ptr == source.end()) break;
+			++n_lines;
+		}
+		return n_lines;
+	}
+
+	ulong count_names(const StringSlice& source, const char* skip_name(const char*, const char*)) {
+		ulong n_names = 0;
+		for (const char* ptr = source.begin(); ptr != source.end(); ) {
+			const char* end = skip_name(ptr, source.end());
+			if (end == ptr)
+				++ptr;
+			else {
+				++n_names;
+				ptr = end;
+			}
+		}
+		return n_names;
+	}
+
+	// Reports megabytes per second, since that's easy to compare across inputs.
+	void report_throughput(const char* name, ulong n_bytes, double ms) {
+		std::cout << name << ": " << (double(n_bytes) / 1000 / ms) << "MB/s" << std::endl;
+	}
+
+	void bench_lexer() {
+		TempArena source_arena;
+		StringBuilder sb { source_arena, N_LEXER_FUNS * uint(sizeof(LEXER_FUN_SOURCE)) + 1 };
+		for (uint i = 0; i != N_LEXER_FUNS; ++i)
+			sb << LEXER_FUN_SOURCE;
+		sb << '\0';
+		StringSlice source = sb.finish();
+		StringSlice text { source.begin() + 1, source.end() - 1 }; // find_trailing_space reads the char before.
+		const uint N_PASSES = 100;
+
+		report_throughput("find trailing space, portable", N_PASSES * text.size(), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) n += ulong(scan::portable::find_trailing_space(text.begin(), text.end()) - text.begin());
+			return n;
+		}));
+		report_throughput("find trailing space", N_PASSES * text.size(), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) n += ulong(scan::find_trailing_space(text.begin(), text.end()) - text.begin());
+			return n;
+		}));
+
+		assert(count_lines(text, scan::portable::find_newline) == count_lines(text, scan::find_newline));
+		report_throughput("find newlines, portable", N_PASSES * text.size(), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) n += count_lines(text, scan::portable::find_newline);
+			return n;
+		}));
+		report_throughput("find newlines", N_PASSES * text.size(), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) n += count_lines(text, scan::find_newline);
+			return n;
+		}));
+
+		report_throughput("index lines", N_PASSES * text.size(), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) {
+				TempArena arena;
+				n += LineAndColumnGetter::for_text(text, arena).line_and_column_at_pos(text.size() - 1).line;
+			}
+			return n;
+		}));
+		{
+			// Like writing diagnostics in order: a lookup for every 8th char.
+			TempArena arena;
+			LineAndColumnGetter lc = LineAndColumnGetter::for_text(text, arena);
+			const uint N_POSITIONS = text.size() / 8;
+			report("look up positions in order, binary search", best_time_ms([&]() {
+				ulong n = 0;
+				for (uint pos = 0; pos < text.size(); pos += 8)
+					n += lc.line_and_column_at_pos(pos).column;
+				return n;
+			}), N_POSITIONS, "lookup");
+			report("look up positions in order, cursor", best_time_ms([&]() {
+				ulong n = 0;
+				LineAndColumnGetter::Cursor cursor { lc };
+				for (uint pos = 0; pos < text.size(); pos += 8)
+					n += cursor.at(pos).column;
+				return n;
+			}), N_POSITIONS, "lookup");
+		}
+
+		assert(count_names(text, scan::portable::skip_value_name_continue) == count_names(text, scan::skip_value_name_continue));
+		report_throughput("skip value names, portable", N_PASSES * text.size(), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) n += count_names(text, scan::portable::skip_value_name_continue);
+			return n;
+		}));
+		report_throughput("skip value names", N_PASSES * text.size(), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) n += count_names(text, scan::skip_value_name_continue);
+			return n;
+		}));
+
+		report_throughput("tokenize", source.size(), best_time_ms([&]() {
+			TempArena arena;
+			ListBuilder<ParseDiagnostic> diagnostics;
+			return ulong(tokenize(source, arena, diagnostics, arena).size());
+		}));
+		PathCache paths;
+		report_throughput("parse", source.size(), best_time_ms([&]() {
+			Arena arena;
+			FileAst ast { paths.from_part_slice("lexer"), source };
+			parse_file(ast, paths, arena);
+			return ulong(ast.funs.size());
+		}));
+		{
+			// A keystroke in the middle declaration: only that one is parsed again.
+			Arena arena;
+			FileAst ast { paths.from_part_slice("lexer"), source };
+			parse_file(ast, paths, arena);
+			const ushort at = to_ushort((N_LEXER_FUNS / 2) * uint(sizeof(LEXER_FUN_SOURCE) - 1) + 4);
+			const uint N_KEYSTROKES = 100;
+			const TextEdit edit { { at, at }, { "x" } };
+			const StringSlice edited = apply_edit(source, edit, arena);
+			report("reparse after a keystroke", best_time_ms([&]() {
+				TempArena temp;
+				ulong n = 0;
+				for (uint i = 0; i != N_KEYSTROKES; ++i)
+					n += reparse_file(ast, edited, edit, paths, temp).n_reparsed;
+				return n;
+			}), N_KEYSTROKES, "keystroke");
+		}
+		report_throughput("parse test/simple", sizeof(SIMPLE_SOURCE), best_time_ms([&]() {
+			ulong n = 0;
+			for (uint i = 0; i != N_PASSES; ++i) {
+				Arena arena;
+				FileAst ast { paths.from_part_slice("simple"), StringSlice { SIMPLE_SOURCE, SIMPLE_SOURCE + sizeof(SIMPLE_SOURCE) } };
+				parse_file(ast, paths, arena);
+				n += ast.funs.size();
+			}
+			return n;
+		}) / N_PASSES);
+	}
+
+	class InMemoryDocumentProvider : public DocumentProvider {
+	public:
+		Option<StringSlice> try_get_document(const Path& path __attribute__((unused)), const StringSlice& extension __attribute__((unused)), Arena& out __attribute__((unused))) override {
+			// sizeof includes the '\0'
+			return Option<StringSlice> { StringSlice { SIMPLE_SOURCE, SIMPLE_SOURCE + sizeof(SIMPLE_SOURCE) } };
+		}
+	};
+
+	ulong compile_and_emit_once(InMemoryDocumentProvider& document_provider) {
+		CompiledProgram program;
+		compile(program, document_provider, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		TempArena out_arena;
+		Writer::Output output = emit(program.modules, program.builtin_types, /*n_threads*/ 1, out_arena);
+		return output.size();
+	}
+
+	// Compiling in a loop should reach a steady state where temp arenas never allocate from the system.
+	void bench_temp_arena_pool() {
+		const uint n_compiles = 1000;
+		InMemoryDocumentProvider document_provider;
+		compile_and_emit_once(document_provider); // warm up the pool
+		TempArena::PoolStats before = TempArena::pool_stats();
+		double ms = best_time_ms([&]() {
+			ulong sum = 0;
+			for (uint i = 0; i != n_compiles; ++i)
+				sum += compile_and_emit_once(document_provider);
+			return sum;
+		});
+		TempArena::PoolStats after = TempArena::pool_stats();
+		report("temp arena pool: compile and emit", ms, n_compiles, "compile");
+		std::cout << "temp arena pool: " << (after.hits - before.hits) << " hits, " << (after.misses - before.misses) << " misses after warm-up" << std::endl;
+	}
+
+	// 'main' imports the first module, and module i imports modules 3i+1 through 3i+3. Every module imports 'core'.
+	// (A file can have at most 4 imports.)
+	const uint N_EDITABLE_MODULES = 64;
+	const uint FUNS_PER_EDITABLE_MODULE = 100;
+	const char CORE_SOURCE[] = "Void copy\nc Bool copy\n\tbool\nc true Bool\n\t*_ret = true;\n";
+	// FUN_SOURCE with a local renamed, which doesn't change the interface.
+	const char EDITED_FUN_SOURCE[] = "f Void\n\tc = true\n\tassert c\n\n";
+
+	class EditableModulesDocumentProvider : public DocumentProvider {
+	public:
+		bool edited = false; // Whether the first function in the first module is EDITED_FUN_SOURCE.
+
+		Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension __attribute__((unused)), Arena& out) override {
+			StringSlice name = path.base_name();
+			if (name == "core")
+				return Option<StringSlice> { StringSlice { CORE_SOURCE, CORE_SOURCE + sizeof(CORE_SOURCE) } };
+
+			StringBuilder sb { out, 64 + FUNS_PER_EDITABLE_MODULE * uint(sizeof(FUN_SOURCE)) };
+			sb << "import .core";
+			if (name == "main")
+				sb << " .ma\n\nmain Void\n\tb = true\n\tassert b\n";
+			else {
+				uint index = module_index(name);
+				for (uint i = 3 * index + 1; i <= 3 * index + 3 && i < N_EDITABLE_MODULES; ++i) {
+					sb << " .";
+					write_module_name(sb, i);
+				}
+				bool edit_first = edited && index == 0;
+				sb << "\n\n";
+				for (uint i = 0; i != FUNS_PER_EDITABLE_MODULE; ++i)
+					sb << (edit_first && i == 0 ? StringSlice { EDITED_FUN_SOURCE } : StringSlice { FUN_SOURCE });
+			}
+			sb << '\0';
+			return Option<StringSlice> { sb.finish() };
+		}
+	};
+
+	void bench_compile_session() {
+		EditableModulesDocumentProvider documents;
+		double from_scratch = best_time_ms([&]() {
+			CompileSession session { documents };
+			const CompileSession::Result& result = session.compile(session.paths().from_part_slice("main"));
+			assert(result.diagnostics.is_empty());
+			return ulong(result.modules.size());
+		});
+
+		CompileSession session { documents };
+		Path main_path = session.paths().from_part_slice("main");
+		session.compile(main_path);
+		double after_edit = best_time_ms([&]() {
+			documents.edited = !documents.edited;
+			const CompileSession::Result& result = session.compile(main_path);
+			assert(result.diagnostics.is_empty() && session.last_stats().n_parsed == 1 && session.last_stats().n_checked == 1);
+			return ulong(result.modules.size());
+		});
+		std::cout << "compile session with " << (N_EDITABLE_MODULES + 2) << " modules: from scratch " << from_scratch
+			<< "ms, after editing one function body " << after_edit << "ms" << std::endl;
+	}
+
+	// The Writer as it was before: a BlockedList written to one byte at a time.
+	class BlockedWriter {
+		BlockedList<1024, char> out;
+		Arena& arena;
+
+	public:
+		BlockedWriter(Arena& _arena) : out{}, arena{_arena} {}
+		BlockedWriter(const BlockedWriter& other) = delete;
+
+		inline BlockedWriter& operator<<(const StringSlice& s) {
+			for (char c : s)
+				out.push(c, arena);
+			return *this;
+		}
+		uint size() const { return out.size(); }
+	};
+
+	// Writes 'text' a line at a time, the way emit writes a piece at a time.
+	template <typename W>
+	void write_lines(W& w, const StringSlice& text) {
+		const char* line_begin = text.begin();
+		for (const char* c = text.begin(); c != text.end(); ++c)
+			if (*c == '\n') {
+				w << StringSlice { line_begin, c + 1 };
+				line_begin = c + 1;
+			}
+	}
+
+	// 'funs' has this many 'c' functions, and 'main' imports it and calls every one. Any more and 'funs' would pass the 64KB limit on a file.
+	const uint N_GENERATED_FUNS = 2500;
+	const char GENERATED_FUN_BODY[] = " Void\n\treturn;\n\n";
+	// The emitter only takes 16 statements in a body, and each call takes 2. So 'main' calls them through a tree of functions.
+	const uint CALLS_PER_FUN = 8;
+	const uint MAX_MAIN_CALLS = 6; // Leaves room for the assert at the end
+	// Enough copies of the emitted text to take a while to write.
+	const uint N_COPIES = 30;
+
+	// Writes functions named 'caller' followed by 0, 1, and so on, that between them call the 'n' functions named 'callee' followed by 0 to n - 1.
+	// Returns how many functions it wrote.
+	uint write_callers(StringBuilder& sb, char caller, char callee, uint n) {
+		uint n_callers = (n + CALLS_PER_FUN - 1) / CALLS_PER_FUN;
+		for (uint i = 0; i != n_callers; ++i) {
+			write_name(sb, caller, i);
+			sb << " Void\n";
+			for (uint j = i * CALLS_PER_FUN; j != n && j != (i + 1) * CALLS_PER_FUN; ++j) {
+				sb << '\t';
+				write_name(sb, callee, j);
+				sb << '\n';
+			}
+			sb << "\tpass\n\n";
+		}
+		return n_callers;
+	}
+
+	class GeneratedFunsDocumentProvider : public DocumentProvider {
+	public:
+		Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension __attribute__((unused)), Arena& out) override {
+			// Room for each call, and for "c " and a name of up to 5 letters per function.
+			StringBuilder sb { out, 64 + uint(sizeof(CORE_SOURCE)) + N_GENERATED_FUNS * (uint(sizeof(GENERATED_FUN_BODY)) + 16) };
+			if (path.base_name() == "main") {
+				sb << "import .funs\n\n";
+				char callee = 'f';
+				uint n = N_GENERATED_FUNS;
+				for (char caller = 'g'; n > MAX_MAIN_CALLS; ++caller) {
+					n = write_callers(sb, caller, callee, n);
+					callee = caller;
+				}
+				sb << "main Void\n";
+				for (uint i = 0; i != n; ++i) {
+					sb << '\t';
+					write_name(sb, callee, i);
+					sb << '\n';
+				}
+				// The last expression can't be a call yet.
+				sb << "\tb = true\n\tassert b\n";
+			} else {
+				sb << CORE_SOURCE << '\n';
+				for (uint i = 0; i != N_GENERATED_FUNS; ++i) {
+					sb << "c ";
+					write_name(sb, 'f', i);
+					sb << GENERATED_FUN_BODY;
+				}
+			}
+			sb << '\0';
+			return Option<StringSlice> { sb.finish() };
+		}
+	};
+
+	void bench_emit() {
+		GeneratedFunsDocumentProvider document_provider;
+		CompiledProgram program;
+		compile(program, document_provider, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		assert(program.diagnostics.is_empty());
+
+		TempArena text_arena;
+		StringSlice text = emit(program.modules, program.builtin_types, /*n_threads*/ 1, text_arena);
+		double emit_mb = double(text.size()) / 1000000;
+		for (uint n_threads : { 1u, 2u, 4u }) {
+			double emit_ms = best_time_ms([&]() {
+				TempArena out_arena;
+				return ulong(emit(program.modules, program.builtin_types, n_threads, out_arena).size());
+			});
+			std::cout << "emit " << N_GENERATED_FUNS << " C++ functions called from main on " << n_threads << " threads: " << emit_ms << "ms, " << (emit_mb / emit_ms * 1000) << "MB/s" << std::endl;
+		}
+
+		// Just the writing, to see what the buffer itself costs.
+		double blocked_ms = best_time_ms([&]() {
+			TempArena arena;
+			BlockedWriter w { arena };
+			for (uint i = 0; i != N_COPIES; ++i)
+				write_lines(w, text);
+			return ulong(w.size());
+		});
+		double contiguous_ms = best_time_ms([&]() {
+			TempArena arena;
+			Writer w { arena };
+			for (uint i = 0; i != N_COPIES; ++i)
+				write_lines(w, text);
+			return ulong(w.finish().size());
+		});
+		double write_mb = double(text.size()) * N_COPIES / 1000000;
+		std::cout << "write emitted lines " << N_COPIES << " times: blocked list a byte at a time " << (write_mb / blocked_ms * 1000)
+			<< "MB/s, contiguous buffer " << (write_mb / contiguous_ms * 1000) << "MB/s" << std::endl;
+	}
+
+	// 'generics' has this many generic 'c' functions and types to instantiate them with, and 'main' calls each function with each type.
+	const uint N_GENERIC_FUNS = 10;
+	const uint N_TYPE_ARGUMENTS = 250;
+	const uint N_INSTANTIATIONS = N_GENERIC_FUNS * N_TYPE_ARGUMENTS;
+	const char GENERIC_FUN_BODY[] = " Void(b Bool) ?T\n\treturn;\n\n";
+	// Each call takes 4 statements, since the argument goes in a temporary too.
+	const uint MAX_INSTANTIATIONS_PER_FUN = 4;
+
+	class GeneratedGenericsDocumentProvider : public DocumentProvider {
+	public:
+		Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension __attribute__((unused)), Arena& out) override {
+			// Room for each call to take up to 24 characters.
+			StringBuilder sb { out, 64 + uint(sizeof(CORE_SOURCE)) + N_INSTANTIATIONS * 24 + N_GENERIC_FUNS * uint(sizeof(GENERIC_FUN_BODY)) };
+			if (path.base_name() == "main") {
+				sb << "import .generics\n\n";
+				// Calls each generic function with every type before moving on to the next function.
+				uint n = (N_INSTANTIATIONS + MAX_INSTANTIATIONS_PER_FUN - 1) / MAX_INSTANTIATIONS_PER_FUN;
+				for (uint i = 0; i != n; ++i) {
+					write_name(sb, 'g', i);
+					sb << " Void\n";
+					for (uint j = i * MAX_INSTANTIATIONS_PER_FUN; j != N_INSTANTIATIONS && j != (i + 1) * MAX_INSTANTIATIONS_PER_FUN; ++j) {
+						sb << "\ttrue ";
+						write_name(sb, 'u', j / N_TYPE_ARGUMENTS);
+						sb << '<';
+						write_name(sb, 'T', j % N_TYPE_ARGUMENTS);
+						sb << ">\n";
+					}
+					sb << "\tpass\n\n";
+				}
+				char callee = 'g';
+				for (char caller = 'h'; n > MAX_MAIN_CALLS; ++caller) {
+					n = write_callers(sb, caller, callee, n);
+					callee = caller;
+				}
+				sb << "main Void\n";
+				for (uint i = 0; i != n; ++i) {
+					sb << '\t';
+					write_name(sb, callee, i);
+					sb << '\n';
+				}
+				sb << "\tb = true\n\tassert b\n";
+			} else {
+				sb << CORE_SOURCE << '\n';
+				for (uint i = 0; i != N_TYPE_ARGUMENTS; ++i) {
+					sb << "c ";
+					write_name(sb, 'T', i);
+					sb << " copy\n\tint\n";
+				}
+				sb << '\n';
+				for (uint i = 0; i != N_GENERIC_FUNS; ++i) {
+					sb << "c ";
+					write_name(sb, 'u', i);
+					sb << GENERIC_FUN_BODY;
+				}
+			}
+			sb << '\0';
+			return Option<StringSlice> { sb.finish() };
+		}
+	};
+
+	// Every function called is a new instantiation, so this is mostly spent in the caches of types and instantiated functions.
+	void bench_emit_generics() {
+		GeneratedGenericsDocumentProvider document_provider;
+		CompiledProgram program;
+		compile(program, document_provider, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		assert(program.diagnostics.is_empty());
+
+		for (uint n_threads : { 1u, 2u, 4u }) {
+			double ms = best_time_ms([&]() {
+				LoweredProgram lowered { program.modules, program.builtin_types, n_threads };
+				return ulong(lowered.n_shards());
+			});
+			std::cout << "instantiate " << N_INSTANTIATIONS << " generic functions on " << n_threads << " threads: " << ms << "ms" << std::endl;
+		}
+	}
+}
+
+void benchmarks() {
+	bench_arena();
+	// Typical of a module's tables, and of the caches used by emit.
+	bench_map(64);
+	bench_map(100000);
+	bench_temp_arena_pool();
+	bench_parse_everything();
+	bench_parse_literals_and_comments();
+	bench_lexer();
+	bench_compile_session();
+	bench_emit();
+	bench_emit_generics();
+}
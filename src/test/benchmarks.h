@@ -0,0 +1,5 @@
+#pragma once
+
+// Times some hot paths and prints the results.
+// Not part of 'unit_tests' since these take longer than 'set_limits' allows.
+void benchmarks();
@@ -1,7 +1,14 @@
 #include "./test.h"
 
+#include <algorithm> // std::lexicographical_compare
+#include <cstdio> // std::FILE, std::tmpfile
+#include <cstring> // std::strlen
 #include <iostream> // std::cerr, std::ostream
+#include <sys/wait.h> // waitpid
+#include <unistd.h> // dup2, fork, _exit
+#include "../util/store/ArenaArrayBuilders.h"
 #include "../util/store/ListBuilder.h"
+#include "../util/rlimit.h"
 #include "../compile/compile.h"
 #include "./test_single.h"
 
@@ -22,17 +29,38 @@ namespace {
 				return "Baseline removed";
 			case TestFailure::Kind::CppCompilationFailed:
 				return ".cpp compilation failed.";
+			case TestFailure::Kind::RunFailed:
+				return "Program failed with exit status";
+			case TestFailure::Kind::Crashed:
+				return "Test crashed or hit a limit.";
 		}
 	}
 
 	std::ostream& operator<<(std::ostream& out, const TestFailure& failure) {
-		return out << failure.loc.slice() << ' ' << baseline_name(failure.kind);
+		out << failure.loc.slice() << ' ' << baseline_name(failure.kind);
+		if (failure.kind == TestFailure::Kind::RunFailed)
+			out << ' ' << failure.exit_status << '.';
+		return out;
+	}
+
+	template <typename T>
+	Slice<T> to_slice(const List<T>& list, Arena& arena) {
+		typename List<T>::const_iterator iter = list.begin();
+		return fill_array<T>()(arena, list.size(), [&](uint i __attribute__((unused))) {
+			T value = *iter;
+			++iter;
+			return value;
+		});
+	}
+
+	bool less(const StringSlice& a, const StringSlice& b) {
+		return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
 	}
 
 	struct TestDirectoryIteratee : DirectoryIteratee {
 		PathCache& paths;
 		Option<Path> directory_path;
-		MaxSizeVector<64, Path> to_test;
+		MaxSizeVector<64, Path> to_test; // Sorted by name, since directories are listed in no particular order.
 		bool any_files;
 		bool main_nz;
 		TestDirectoryIteratee(PathCache& _paths, Option<Path> _directory_path) : paths(_paths), directory_path(_directory_path), to_test{}, any_files{false}, main_nz{false} {}
@@ -43,31 +71,191 @@ namespace {
 		}
 		void on_directory(const StringSlice& name) override {
 			to_test.push(paths.resolve(directory_path, name));
+			for (uint i = to_test.size() - 1; i != 0 && less(to_test[i].base_name(), to_test[i - 1].base_name()); --i) {
+				Path p = to_test[i];
+				to_test[i] = to_test[i - 1];
+				to_test[i - 1] = p;
+			}
 		}
 	};
 
-	// Returns the # tests run.
-	uint do_test_recur(const StringSlice& dir, const TestFilter& filter, TestMode mode, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& arena) {
+	void find_tests(const StringSlice& dir, const TestFilter& filter, PathCache& paths, ListBuilder<StringSlice>& tests, Arena& arena) {
 		TestDirectoryIteratee iteratee { paths, {} };
 		list_directory(dir, iteratee);
 		if (iteratee.any_files) {
 			if (!iteratee.main_nz) todo(); // Non-test directory?
-			if (filter.should_test(dir)) {
-				std::cout << "testing " << dir << std::endl;
-				test_single(dir, mode, paths, failures, arena);
-				return 1;
-			}
-			return 0;
+			if (filter.should_test(dir))
+				tests.add(copy_string(arena, dir), arena);
 		} else {
-			uint n_tests_run = 0;
 			for (const Path& directory_path : iteratee.to_test) {
 				MaxSizeString<256> nested = MaxSizeString<256>::make([&](MaxSizeStringWriter& w) {
 					directory_path.write(w, dir, {});
 				});
-				n_tests_run += do_test_recur(nested.slice(), filter, mode, paths, failures, arena);
+				find_tests(nested.slice(), filter, paths, tests, arena);
+			}
+		}
+	}
+
+	struct WorkerResult {
+		StringSlice output; // Everything the process wrote
+		bool emitted_program; // For a test, not a batch of programs
+		List<TestFailure> failures;
+	};
+
+	// A process running one test, or building and running one batch of programs.
+	struct Worker {
+		pid_t pid;
+		uint index; // Of the test or batch
+		std::FILE* output; // The process's stdout and stderr
+		std::FILE* failures; // Whether a test emitted a program, then one line per TestFailure: its kind, exit status, and loc
+	};
+
+	// 'run' is 'ListBuilder<TestFailure>&, Arena& => bool', and returns whether a test emitted a program.
+	template <typename Run>
+	Worker start_worker(uint index, Run run) {
+		std::FILE* output = std::tmpfile();
+		std::FILE* failures = std::tmpfile();
+		if (output == nullptr || failures == nullptr) todo();
+		// Or whatever is buffered would be written again by the child.
+		std::cout.flush();
+		std::cerr.flush();
+		std::fflush(nullptr);
+
+		pid_t pid = fork();
+		if (pid == -1) todo();
+		if (pid != 0)
+			return { pid, index, output, failures };
+
+		// In the child, which never returns from here.
+		dup2(fileno(output), STDOUT_FILENO);
+		dup2(fileno(output), STDERR_FILENO);
+		// Inherited, but set again so this process's own CPU time counts from here.
+		set_limits();
+		int exit_code = 0;
+		try {
+			Arena arena;
+			ListBuilder<TestFailure> worker_failures;
+			bool emitted_program = run(worker_failures, arena);
+			std::fprintf(failures, "%d\n", emitted_program ? 1 : 0);
+			for (const TestFailure& f : worker_failures.finish()) {
+				StringSlice loc = f.loc.slice();
+				std::fprintf(failures, "%u %d %.*s\n", uint(f.kind), f.exit_status, int(loc.size()), loc.begin());
 			}
-			return n_tests_run;
+		} catch (const char* e) {
+			std::cerr << e << std::endl;
+			exit_code = 1;
+		} catch (...) {
+			exit_code = 1;
 		}
+		std::cout.flush();
+		std::cerr.flush();
+		std::fflush(nullptr);
+		// Not 'exit', which would run the parent's atexit handlers and destructors a second time.
+		_exit(exit_code);
+	}
+
+	StringSlice read_all(std::FILE* file, Arena& arena) {
+		long size = std::ftell(file);
+		if (size <= 0)
+			return {};
+		std::rewind(file);
+		ArenaString res = allocate_slice(arena, uint(size));
+		if (std::fread(res.begin(), 1, ulong(size), file) != ulong(size)) todo();
+		return res.slice();
+	}
+
+	// A crash is reported at 'name'.
+	WorkerResult finish_worker(const Worker& worker, int status, const StringSlice& name, Arena& arena) {
+		StringSlice output = read_all(worker.output, arena);
+		ListBuilder<TestFailure> failures;
+		std::rewind(worker.failures);
+		int emitted_program = 0;
+		if (std::fscanf(worker.failures, "%d\n", &emitted_program) != 1)
+			emitted_program = 0; // It crashed before finishing.
+		uint kind;
+		int exit_status;
+		char loc[128];
+		while (std::fscanf(worker.failures, "%u %d %127[^\n]\n", &kind, &exit_status, loc) == 3) {
+			StringSlice loc_slice { loc, loc + std::strlen(loc) };
+			failures.add({ TestFailure::Kind(kind), MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << loc_slice; }), exit_status }, arena);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failures.add({ TestFailure::Kind::Crashed, MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << name; }), 0 }, arena);
+		std::fclose(worker.output);
+		std::fclose(worker.failures);
+		return { output, emitted_program == 1, failures.finish() };
+	}
+
+	const uint MAX_JOBS = 64;
+
+	// Runs 'run(i, failures, arena)' for each 'i' below 'n', each in its own process, up to 'n_jobs' at once. See 'start_worker'.
+	// Calls 'on_result(i, result)' in order, as soon as everything before it is done. If process 'i' crashes, that's reported at 'name(i)'.
+	template <typename Run, typename Name, typename OnResult>
+	void run_in_processes(uint n, uint n_jobs, Run run, Name name, OnResult on_result, Arena& arena) {
+		Slice<Option<WorkerResult>> results = fill_array<Option<WorkerResult>>()(arena, n, [](uint i __attribute__((unused))) { return Option<WorkerResult> {}; });
+		MaxSizeVector<MAX_JOBS, Worker> workers;
+		n_jobs = n_jobs < MAX_JOBS ? n_jobs : MAX_JOBS;
+		uint next_to_start = 0;
+		uint next_to_write = 0;
+		while (next_to_write != n) {
+			while (workers.size() != n_jobs && next_to_start != n) {
+				uint index = next_to_start;
+				workers.push(start_worker(index, [&](ListBuilder<TestFailure>& failures, Arena& worker_arena) { return run(index, failures, worker_arena); }));
+				++next_to_start;
+			}
+
+			int status;
+			pid_t pid = waitpid(-1, &status, 0);
+			if (pid == -1) todo();
+			for (uint i = 0; i != workers.size(); ++i) {
+				if (workers[i].pid != pid)
+					continue;
+				Worker done = workers[i];
+				workers[i] = workers[workers.size() - 1];
+				workers.pop();
+				results[done.index] = finish_worker(done, status, name(done.index), arena);
+				break;
+			}
+
+			// Write results in order, as soon as everything before them is written.
+			for (; next_to_write != n && results[next_to_write].has(); ++next_to_write)
+				on_result(next_to_write, results[next_to_write].get());
+		}
+	}
+
+	// Each test in its own process, then the programs they emitted are split into a batch for each job.
+	// Each batch is compiled with one clang invocation, and its programs are run, in its own process.
+	void test_in_processes(const Slice<StringSlice>& tests, TestMode mode, uint n_jobs, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& arena) {
+		ListBuilder<StringSlice> programs_builder;
+		auto on_result = [&](const WorkerResult& result) {
+			std::cout << result.output << std::flush;
+			for (const TestFailure& f : result.failures)
+				failures.add(f, arena);
+		};
+		run_in_processes(tests.size(), n_jobs,
+			[&](uint i, ListBuilder<TestFailure>& test_failures, Arena& test_arena) {
+				std::cout << "testing " << tests[i] << std::endl;
+				return test_single(tests[i], mode, paths, test_failures, test_arena);
+			},
+			[&](uint i) { return tests[i]; },
+			[&](uint i, const WorkerResult& result) {
+				on_result(result);
+				if (result.emitted_program)
+					programs_builder.add(tests[i], arena);
+			},
+			arena);
+
+		Slice<StringSlice> programs = to_slice(programs_builder.finish(), arena);
+		uint n_batches = n_jobs < programs.size() ? n_jobs : programs.size();
+		auto batch = [&](uint i) { return programs.slice(i * programs.size() / n_batches, (i + 1) * programs.size() / n_batches); };
+		run_in_processes(n_batches, n_jobs,
+			[&](uint i, ListBuilder<TestFailure>& batch_failures, Arena& batch_arena) {
+				build_and_run_programs(batch(i), std::cout, paths, batch_failures, batch_arena);
+				return false;
+			},
+			[&](uint i) { return batch(i)[0]; },
+			[&](uint i __attribute__((unused)), const WorkerResult& result) { on_result(result); },
+			arena);
 	}
 }
 
@@ -75,12 +263,27 @@ TestFilter::~TestFilter() {}
 
 bool EveryTestFilter::should_test(const StringSlice& directory __attribute__((unused))) const { return true; }
 
-int test(const StringSlice& test_dir, const TestFilter& filter, TestMode mode) {
+int test(const StringSlice& test_dir, const TestFilter& filter, TestMode mode, uint n_jobs) {
+	assert(n_jobs != 0);
 	PathCache paths;
 	ListBuilder<TestFailure> failures_builder;
 	Arena arena;
-	uint n_tests_run = do_test_recur(test_dir, filter, mode, paths, failures_builder, arena);
-	std::cout << n_tests_run << " tests run" << std::endl;
+	ListBuilder<StringSlice> tests_builder;
+	find_tests(test_dir, filter, paths, tests_builder, arena);
+	List<StringSlice> tests = tests_builder.finish();
+
+	if (n_jobs == 1 || tests.size() <= 1) {
+		ListBuilder<StringSlice> programs_builder;
+		for (const StringSlice& dir : tests) {
+			std::cout << "testing " << dir << std::endl;
+			if (test_single(dir, mode, paths, failures_builder, arena))
+				programs_builder.add(dir, arena);
+		}
+		// Every program at once, so clang starts just once.
+		build_and_run_programs(to_slice(programs_builder.finish(), arena), std::cout, paths, failures_builder, arena);
+	} else
+		test_in_processes(to_slice(tests, arena), mode, n_jobs, paths, failures_builder, arena);
+	std::cout << tests.size() << " tests run" << std::endl;
 
 	List<TestFailure> failures = failures_builder.finish();
 	for (const TestFailure& failure : failures)
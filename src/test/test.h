@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../util/store/StringSlice.h"
+#include "../util/int.h"
 #include "./TestMode.h"
 
 /*abstract*/ class TestFilter {
@@ -13,4 +14,7 @@ class EveryTestFilter final : public TestFilter {
 };
 
 // Returns exit code
-int test(const StringSlice& test_dir, const TestFilter& filter, TestMode mode);
+// With more than one job, each test runs in its own process, up to 'n_jobs' at once. Each process has its own limits from 'set_limits'.
+// Then the programs the tests emitted are split into a batch per job, each compiled with one clang invocation and run in its own process.
+// Either way, tests run in order of their directory names, and their output and failures are written in that order.
+int test(const StringSlice& test_dir, const TestFilter& filter, TestMode mode, uint n_jobs);
@@ -1,52 +1,31 @@
 #include "./test_single.h"
 
+#include <algorithm> // std::equal
+#include <iostream> // std::endl, std::ostream
 #include "../compile/compile.h"
 #include "../emit/emit.h"
 #include "../host/DocumentProvider.h"
+#include "../host/ExeCache.h"
+#include "../util/store/ArenaArrayBuilders.h"
 #include "../util/io.h"
 #include "../clang.h"
 
 namespace {
-	//TODO:MOVE
-	template <typename A, typename B>
-	bool collection_equal(const A& a, const B& b) {
-		if (a.size() != b.size()) return false;
-
-		typename A::const_iterator a_it = a.begin();
-		typename B::const_iterator b_it = b.begin();
-		typename A::const_iterator a_end = a.end();
-		typename B::const_iterator b_end = b.end();
-		while (true) {
-			if (*a_it != *b_it) return false;
-			++a_it;
-			++b_it;
-			if (a_it == a_end) {
-				assert(b_it == b_end);
-				return true;
-			}
-		}
-	};
+	std::ostream& operator<<(std::ostream& out, const StringSlice& slice) {
+		for (char c : slice)
+			out << c;
+		return out;
+	}
 
 	MaxSizeString<128> loc_to_string(const FileLocator& loc) {
 		return MaxSizeString<128>::make([&](MaxSizeStringWriter& w) { w << loc; });
 	}
 
-	Writer::Output diagnostics_baseline(const List<Diagnostic>& diags, DocumentProvider& document_provider, Arena& arena) {
-		Writer out { arena };
-		Arena temp;
-		for (const Diagnostic& d : diags) {
-			StringSlice document = document_provider.try_get_document(d.path, NZ_EXTENSION, temp).get();
-			d.write(out, document, LineAndColumnGetter::for_text(document, temp));
-			out << Writer::nl;
-		}
-		return out.finish();
-	}
-
 	void no_baseline(const FileLocator& loc, TestMode mode, ListBuilder<TestFailure>& failures, Arena& failures_arena) {
 		if (file_exists(loc)) {
 			switch (mode) {
 				case TestMode::Test:
-					failures.add({ TestFailure::Kind::BaselineRemoved, loc_to_string(loc) }, failures_arena);
+					failures.add({ TestFailure::Kind::BaselineRemoved, loc_to_string(loc), 0 }, failures_arena);
 					todo();
 				case TestMode::Accept:
 					delete_file(loc);
@@ -55,56 +34,97 @@ namespace {
 		}
 	}
 
-	// Returns true on success. Always succeeds with TestMode::Accept
-	void baseline(const FileLocator& loc, const StringSlice& error_extension, const Writer::Output& actual, TestMode mode, ListBuilder<TestFailure>& failures, Arena& failures_arena) {
-		bool should_write_new = false;
-		bool should_delete_new = false;
-		bool should_overwrite = false;
-		Arena expected_arena; //TODO:PERF
-		Option<StringSlice> expected = try_read_file(loc, expected_arena, /*null_terminated*/ false);
-		if (expected.has()) {
-			if (collection_equal(actual, expected.get()))
-				should_delete_new = true;
-			else {
-				switch (mode) {
-					case TestMode::Test:
-						should_write_new = true;
-						break;
-					case TestMode::Accept:
-						should_overwrite = true;
-						should_delete_new = true;
-						break;
+	// Compares what's written with the old baseline as it's written, and only starts writing to a file once they differ.
+	class BaselineSink final : public WriterSink {
+		Option<MappedFile> expected;
+		uint n_matched; // Everything written so far, which all matches 'expected'
+		bool differs;
+		FileSink out;
+
+		void start_writing() {
+			differs = true;
+			if (n_matched != 0)
+				out.write({ expected.get().contents.begin(), expected.get().contents.begin() + n_matched });
+		}
+
+	public:
+		BaselineSink(const FileLocator& expected_loc, const FileLocator& out_loc)
+			: expected{try_map_file(expected_loc, /*null_terminated*/ false)}, n_matched{0}, differs{false}, out{out_loc} {}
+		BaselineSink(const BaselineSink& other) = delete;
+		~BaselineSink() override {
+			if (expected.has())
+				unmap_file(expected.get());
+		}
+
+		inline bool has_expected() const { return expected.has(); }
+
+		void write(const StringSlice& chunk) override {
+			if (!differs) {
+				if (expected.has()
+					&& chunk.size() <= expected.get().contents.size() - n_matched
+					&& std::equal(chunk.begin(), chunk.end(), expected.get().contents.begin() + n_matched)) {
+					n_matched += chunk.size();
+					return;
 				}
+				start_writing();
 			}
-		} else {
-			switch (mode) {
-				case TestMode::Test:
-					should_write_new = true;
-					break;
-				case TestMode::Accept:
-					should_overwrite = true;
-					should_delete_new = true;
-					break;
-			}
+			out.write(chunk);
 		}
 
-		if (should_write_new) {
-			write_file(loc.with_extension(error_extension), actual);
-			failures.add({ expected.has() ? TestFailure::Kind::BaselineChanged : TestFailure::Kind::BaselineAdded, loc_to_string(loc) }, failures_arena);
-		} else if (should_delete_new) {
-			delete_file(loc.with_extension(error_extension));
-			if (should_overwrite)
-				write_file(loc, actual);
+		// Call after the last write. Returns true if the output matched the baseline. Otherwise, all of it is in the output file.
+		bool finish() {
+			if (!differs && expected.has() && n_matched == expected.get().contents.size())
+				return true;
+			if (!differs)
+				start_writing();
+			if (!out.any_written())
+				out.write({});
+			return false;
+		}
+	};
+
+	// Always succeeds with TestMode::Accept.
+	// 'write' writes the actual output. It isn't kept in memory, so it can be as big as it likes.
+	template <typename /*Writer& => void*/ Cb>
+	void baseline(const FileLocator& loc, const StringSlice& error_extension, TestMode mode, ListBuilder<TestFailure>& failures, Arena& failures_arena, Cb write) {
+		FileLocator temp_loc = loc.with_extension("tmp");
+		bool had_expected;
+		bool matches;
+		{
+			BaselineSink sink { loc, temp_loc };
+			TempArena temp;
+			Writer w { temp, sink };
+			write(w);
+			w.finish();
+			had_expected = sink.has_expected();
+			matches = sink.finish();
+		}
+
+		FileLocator new_loc = loc.with_extension(error_extension);
+		if (matches) {
+			delete_file(new_loc);
+			return;
+		}
+		switch (mode) {
+			case TestMode::Test:
+				rename_file(temp_loc, new_loc);
+				failures.add({ had_expected ? TestFailure::Kind::BaselineChanged : TestFailure::Kind::BaselineAdded, loc_to_string(loc), 0 }, failures_arena);
+				break;
+			case TestMode::Accept:
+				delete_file(new_loc);
+				rename_file(temp_loc, loc);
+				break;
 		}
 	}
 }
 
-void test_single(const StringSlice& root, TestMode mode, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& failures_arena) {
+bool test_single(const StringSlice& root, TestMode mode, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& failures_arena) {
 	unique_ptr<DocumentProvider> document_provider = file_system_document_provider(root);
 
 	CompiledProgram out;
 	Path out_main_path = out.paths.from_part_slice("main");
-	compile(out, *document_provider, out_main_path);
+	// Single-threaded, since threads' stacks would count against the memory limit.
+	compile(out, *document_provider, out_main_path, /*n_threads*/ 1);
 
 	Path main_path = paths.from_part_slice("main");
 
@@ -113,17 +133,53 @@ void test_single(const StringSlice& root, TestMode mode, PathCache& paths, ListB
 	FileLocator exe_path { root, main_path, "exe" };
 
 	if (out.diagnostics.is_empty()) {
-		Arena temp; //TODO:PERF
 		no_baseline(diags_path, mode, failures, failures_arena);
-		baseline({ root, main_path, "cpp" }, "cpp.new", emit(out.modules, out.builtin_types, temp), mode, failures, failures_arena);
-		compile_cpp_file(cpp_path, exe_path); // No error if this produces different code... that's clang's problem
-		int exit_code = execute_file(exe_path);
-		if (exit_code != 0)
-			failures.add({ TestFailure::Kind::CppCompilationFailed, loc_to_string(cpp_path) }, failures_arena);
+		baseline(cpp_path, "cpp.new", mode, failures, failures_arena, [&](Writer& w) {
+			emit(w, out.modules, out.builtin_types, /*n_threads*/ 1);
+		});
+		return true;
 	} else {
-		Arena temp; //TODO:PERF
-		baseline(diags_path, "txt.new", diagnostics_baseline(out.diagnostics, *document_provider, temp), mode, failures, failures_arena);
+		baseline(diags_path, "txt.new", mode, failures, failures_arena, [&](Writer& w) {
+			write_diagnostics(w, out);
+		});
 		no_baseline(cpp_path, mode, failures, failures_arena);
 		no_baseline(exe_path, mode, failures, failures_arena);
+		return false;
+	}
+}
+
+void build_and_run_programs(const Slice<StringSlice>& roots, std::ostream& out, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& failures_arena) {
+	if (roots.is_empty())
+		return;
+
+	TempArena temp;
+	Path main_path = paths.from_part_slice("main");
+	Slice<CppProgram> programs = map<CppProgram>()(temp, roots, [&](const StringSlice& root) {
+		return CppProgram { { root, main_path, "cpp" }, { root, main_path, "exe" } };
+	});
+	MaxSizeString<128> cache_dir = default_exe_cache_dir();
+	unique_ptr<ExeCache> cache = file_system_exe_cache(cache_dir.slice());
+	CppBatch batch = compile_cpp_files(programs, *cache, temp); // No error if this produces different code... that's clang's problem
+
+	if (batch.n_compiled != 0)
+		out << "compiled " << batch.n_compiled << " programs in " << batch.compile_ms << "ms (" << batch.compile_ms / batch.n_compiled
+			<< "ms each), after " << batch.precompile_ms << "ms to precompile the prologue" << std::endl;
+	for (uint i = 0; i != programs.size(); ++i) {
+		const CppProgram& program = programs[i];
+		const CppBuild& build = batch.builds[i];
+		if (!build.built) {
+			out << "failed to compile " << loc_to_string(program.cpp).slice() << std::endl;
+			failures.add({ TestFailure::Kind::CppCompilationFailed, loc_to_string(program.cpp), 0 }, failures_arena);
+			continue;
+		}
+		if (build.cached)
+			out << "reused " << loc_to_string(program.exe).slice() << std::endl;
+		else
+			out << "linked " << loc_to_string(program.exe).slice() << " in " << build.link_ms << "ms" << std::endl;
+		int exit_status = execute_file(program.exe);
+		if (exit_status != 0) {
+			out << loc_to_string(program.exe).slice() << " exited with status " << exit_status << std::endl;
+			failures.add({ TestFailure::Kind::RunFailed, loc_to_string(program.exe), exit_status }, failures_arena);
+		}
 	}
 }
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <iosfwd> // std::ostream
+
 #include "../util/store/ListBuilder.h"
+#include "../util/store/Slice.h"
 #include "../util/store/StringSlice.h"
 #include "../util/PathCache.h"
 #include "./TestMode.h"
 #include "./TestFailure.h"
 
-void test_single(const StringSlice& root, TestMode mode, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& failures_arena);
+// Returns true if the test emitted a program.
+// Those aren't built here, so that 'build_and_run_programs' can build every test's program at once.
+bool test_single(const StringSlice& root, TestMode mode, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& failures_arena);
+// 'roots' are the tests for which 'test_single' returned true.
+// Compiles every program that isn't cached with one clang invocation, then runs each.
+// Writes how long compiling took, and how long each link took, to 'out'.
+void build_and_run_programs(const Slice<StringSlice>& roots, std::ostream& out, PathCache& paths, ListBuilder<TestFailure>& failures, Arena& failures_arena);
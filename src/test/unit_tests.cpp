@@ -1,5 +1,23 @@
 #include "./unit_tests.h"
 
+#include <sstream> // std::istringstream, std::ostringstream
+
+#include "../compile/model/Identifier.h"
+#include "../compile/compile.h"
+#include "../compile/CompileSession.h"
+#include "../compile/interface/interface.h"
+#include "../compile/parse/parser.h"
+#include "../compile/parse/reparse.h"
+#include "../compile/parse/scan.h"
+#include "../compile/parse/tokenize.h"
+#include "../emit/emit.h"
+#include "../host/build.h"
+#include "../host/ExeCache.h"
+#include "../host/LanguageServer.h"
+#include "../host/OverlayDocumentProvider.h"
+#include "../util/io.h"
+#include "../util/json.h"
+#include "../util/store/ArenaString.h"
 #include "../util/store/collection_util.h"
 #include "../util/store/Map.h"
 
@@ -12,7 +30,7 @@ namespace {
 
 	void unit_test_map() {
 		Arena temp;
-		Map<uint, uint, uint_hash> fast { 64, temp };
+		Map<uint, uint, uint_hash> fast { temp };
 
 		MaxSizeVector<3, Pair<uint, uint>> pairs;
 		pairs.push({ 1, 1 });
@@ -33,8 +51,1035 @@ namespace {
 			assert(pair.second == value);
 		});
 	}
+
+	void unit_test_map_growth() {
+		Arena temp;
+		Map<uint, uint, uint_hash> map { temp };
+		// Keys with the low bits clear, like pointers.
+		KeyValuePair<uint, uint>& first = map.must_insert(0, 0);
+		for (uint i = 1; i != 1000; ++i)
+			map.must_insert(i * 64, i);
+		assert(map.size() == 1000);
+		// Pairs don't move when the table grows.
+		assert(&map.get_pair(0).get() == &first);
+		for (uint i = 0; i != 1000; ++i)
+			assert(map.must_get(i * 64) == i);
+		assert(!map.has(1));
+	}
+
+	void unit_test_identifier_cache() {
+		IdentifierCache identifiers;
+		assert(!identifiers.try_get("a").has());
+		Identifier a = identifiers.get("a");
+		Identifier b = identifiers.get("b");
+		assert(a != b);
+		assert(identifiers.get("a") == a && identifiers.try_get("a").get() == a);
+		assert(a.str() == StringSlice { "a" });
+
+		TempArena temp;
+		LocalIdentifierCache local { identifiers, temp };
+		assert(local.get("a") == a && local.get("a") == a);
+		Identifier c = local.get("c");
+		assert(identifiers.try_get("c").get() == c);
+	}
+
+	// Documents must include the '\0'.
+	template <uint N>
+	StringSlice document(char const (&c)[N]) {
+		return { c, c + N };
+	}
+
+	const char SESSION_A[] = "Void copy\nc Bool copy\n\tbool\nc true Bool\n\t*_ret = true;\n";
+	const char SESSION_A_BODY_EDITED[] = "Void copy\nc Bool copy\n\tbool\nc true Bool\n\t*_ret = 1;\n";
+	// Adds a comment, which also moves every declaration after it.
+	const char SESSION_A_COMMENTED[] = "Void copy\n| Either true or false.\nc Bool copy\n\tbool\nc true Bool\n\t*_ret = 1;\n";
+	const char SESSION_B[] = "import .a\n\nc yes Bool\n\t*_ret = true;\n";
+	const char SESSION_B_BODY_EDITED[] = "import .a\n\nc yes Bool\n\t*_ret = 1;\n";
+	const char SESSION_B_FUN_ADDED[] = "import .a\n\nc yes Bool\n\t*_ret = 1;\n\nc no Bool\n\t*_ret = false;\n";
+	const char SESSION_B_TWO_ERRORS[] = "import .a\n\nc yes Bool\n\t*_ret = 1;\n\nc Bool\n\nc no Bool\n\t*_ret = false;\n\nc Bool\n";
+	// 'c' doesn't exist, and global imports aren't supported.
+	const char SESSION_B_BAD_IMPORTS[] = "import .a .c d\n\nc yes Bool\n\t*_ret = 1;\n";
+	const char SESSION_MAIN[] = "import .b .a\n\nmain Void\n\tb = yes\n\tassert b\n";
+
+	class EditableDocumentProvider : public DocumentProvider {
+	public:
+		StringSlice a = document(SESSION_A);
+		StringSlice b = document(SESSION_B);
+
+		Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension __attribute__((unused)), Arena& out __attribute__((unused))) override {
+			StringSlice name = path.base_name();
+			if (name == "a") return Option { a };
+			if (name == "b") return Option { b };
+			if (name == "main") return Option { document(SESSION_MAIN) };
+			return {};
+		}
+	};
+
+	bool outputs_equal(const Writer::Output& a, const Writer::Output& b) {
+		if (a.size() != b.size())
+			return false;
+		Writer::Output::const_iterator b_iter = b.begin();
+		for (char c : a) {
+			if (c != *b_iter)
+				return false;
+			++b_iter;
+		}
+		return true;
+	}
+
+	void assert_session_compile(CompileSession& session, uint n_parsed, uint n_checked) {
+		const CompileSession::Result& result = session.compile(session.paths().from_part_slice("main"));
+		assert(result.diagnostics.is_empty() && result.modules.size() == 3);
+		CompileSession::Stats stats = session.last_stats();
+		assert(stats.n_parsed == n_parsed && stats.n_checked == n_checked);
+	}
+
+	void unit_test_compile_session() {
+		EditableDocumentProvider documents;
+		CompileSession session { documents };
+		assert_session_compile(session, 3, 3);
+		Path a = session.paths().from_part_slice("a");
+		const LineAndColumnGetter& a_lines = session.line_and_column_getter(a);
+		assert(a_lines.line_and_column_at_pos(12).line == 1);
+		assert_session_compile(session, 0, 0);
+		// Kept while the text is the same.
+		assert(&session.line_and_column_getter(a) == &a_lines);
+		// Only 'b' is checked again, since its interface didn't change.
+		documents.b = document(SESSION_B_BODY_EDITED);
+		assert_session_compile(session, 1, 1);
+		// And only the edited function was parsed again.
+		assert(session.last_stats().n_reparsed == 1);
+		// Now 'main' must be checked again too. 'a' doesn't depend on 'b'.
+		documents.b = document(SESSION_B_FUN_ADDED);
+		assert_session_compile(session, 1, 2);
+		documents.a = document(SESSION_A_BODY_EDITED);
+		assert_session_compile(session, 1, 1);
+
+		// Both errors are reported. 'a' is still checked, but not 'main', which imports 'b'.
+		documents.b = document(SESSION_B_TWO_ERRORS);
+		documents.a = document(SESSION_A);
+		assert(session.compile(session.paths().from_part_slice("main")).diagnostics.size() == 2);
+		assert(session.last_stats().n_parsed == 2 && session.last_stats().n_checked == 1);
+		documents.a = document(SESSION_A_BODY_EDITED);
+		documents.b = document(SESSION_B_FUN_ADDED);
+		// The interface of 'b' is what 'main' was last checked against, so 'main' isn't checked again.
+		assert_session_compile(session, 2, 2);
+		// 'b' had parse errors, so it was parsed from scratch.
+		assert(session.last_stats().n_reparsed == 1);
+
+		// Bad imports are diagnostics on the import, not errors.
+		documents.b = document(SESSION_B_BAD_IMPORTS);
+		const List<Diagnostic>& import_diagnostics = session.compile(session.paths().from_part_slice("main")).diagnostics;
+		assert(import_diagnostics.size() == 2);
+		for (const Diagnostic& d : import_diagnostics)
+			assert(d.path == session.paths().from_part_slice("b") && d.range.begin >= 7 && d.range.end <= 14);
+		documents.b = document(SESSION_B_FUN_ADDED);
+		assert_session_compile(session, 1, 1);
+
+		// Editing 'b' over and over eventually starts it over in a fresh arena, along with 'main', which depends on it.
+		for (uint i = 0; session.last_stats().n_started_over == 0; ++i) {
+			assert(i != 10000);
+			documents.b = i % 2 == 0 ? document(SESSION_B_BODY_EDITED) : document(SESSION_B_FUN_ADDED);
+			assert(session.compile(session.paths().from_part_slice("main")).diagnostics.is_empty());
+		}
+		assert(session.last_stats().n_started_over == 2 && session.last_stats().n_parsed == 2);
+		documents.b = document(SESSION_B_FUN_ADDED);
+
+		// Should emit the same as compiling from scratch.
+		const CompileSession::Result& result = session.compile(session.paths().from_part_slice("main"));
+		CompiledProgram program;
+		compile(program, documents, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		assert(program.diagnostics.is_empty());
+		TempArena temp;
+		Writer::Output from_session = emit(result.modules, result.builtin_types, /*n_threads*/ 1, temp);
+		Writer::Output from_scratch = emit(program.modules, program.builtin_types, /*n_threads*/ 1, temp);
+		assert(outputs_equal(from_session, from_scratch));
+	}
+
+	class MemoryInterfaceStore : public InterfaceStore {
+		Arena arena;
+		// Keyed by name, since each program has its own PathCache.
+		Map<StringSlice, StringSlice, StringSlice::hash> interfaces { arena };
+
+	public:
+		uint n_written = 0;
+
+		Option<StringSlice> try_get_interface(const Path& path) override {
+			Option<StringSlice&> interface = interfaces.get(path.base_name());
+			return interface.has() ? Option { interface.get() } : Option<StringSlice> {};
+		}
+
+		void set_interface(const Path& path, const Writer::Output& interface) override {
+			StringBuilder b { arena, interface.size() };
+			for (char c : interface)
+				b << c;
+			StringSlice s = b.finish().slice();
+			InsertResult<StringSlice, StringSlice> res = interfaces.try_insert(copy_string(arena, path.base_name()), s);
+			if (!res.was_added)
+				res.pair.value = s;
+			++n_written;
+		}
+	};
+
+	void assert_check_with_interfaces(EditableDocumentProvider& documents, MemoryInterfaceStore& interfaces, uint n_loaded, uint n_written) {
+		CompiledProgram program;
+		uint n_written_before = interfaces.n_written;
+		uint loaded = check_with_interfaces(program, documents, interfaces, program.paths.from_part_slice("main"));
+		assert(loaded == n_loaded);
+		assert(program.diagnostics.is_empty() && program.modules.size() == 3);
+		assert(interfaces.n_written - n_written_before == n_written);
+
+		// Writing a loaded module's interface again should give back the same interface.
+		TempArena temp;
+		for (const Module& m : program.modules) {
+			InterfaceHeader header = read_interface_header(interfaces.try_get_interface(m.path).get(), program.paths, temp).get();
+			hash_t interface_hash;
+			write_interface(m, header.source_hash, header.import_interface_hashes, interface_hash, temp);
+			assert(interface_hash == header.interface_hash);
+		}
+	}
+
+	void unit_test_check_with_interfaces() {
+		EditableDocumentProvider documents;
+		MemoryInterfaceStore interfaces;
+		assert_check_with_interfaces(documents, interfaces, 0, 3);
+		// 'main' is always checked, but its interface didn't change.
+		assert_check_with_interfaces(documents, interfaces, 2, 0);
+		documents.b = document(SESSION_B_BODY_EDITED);
+		assert_check_with_interfaces(documents, interfaces, 1, 1);
+		// 'main' imports the changed interface of 'b'.
+		documents.b = document(SESSION_B_FUN_ADDED);
+		assert_check_with_interfaces(documents, interfaces, 1, 2);
+		// 'b' only depends on the interface of 'a', which didn't change.
+		documents.a = document(SESSION_A_BODY_EDITED);
+		assert_check_with_interfaces(documents, interfaces, 1, 1);
+		// Comments and source ranges aren't part of the interface hash, so 'b' still doesn't need checking.
+		documents.a = document(SESSION_A_COMMENTED);
+		assert_check_with_interfaces(documents, interfaces, 1, 1);
+
+		// Every parse error and bad import is a diagnostic, instead of stopping at the first.
+		for (StringSlice b : { document(SESSION_B_TWO_ERRORS), document(SESSION_B_BAD_IMPORTS) }) {
+			documents.b = b;
+			CompiledProgram program;
+			check_with_interfaces(program, documents, interfaces, program.paths.from_part_slice("main"));
+			assert(program.diagnostics.size() == 2);
+			for (const Diagnostic& d : program.diagnostics)
+				assert(d.path == program.paths.from_part_slice("b"));
+		}
+	}
+
+	void unit_test_write_diagnostics() {
+		EditableDocumentProvider documents;
+		documents.b = document(SESSION_B_TWO_ERRORS);
+		CompiledProgram program;
+		compile(program, documents, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		// Written from the text the compile read, not whatever the file has now.
+		documents.b = document(SESSION_B);
+		TempArena temp;
+		Writer w { temp };
+		write_diagnostics(w, program);
+		assert(w.finish() == StringSlice { "b 7:1-8:1: expected '\t'\nb 12:1-12:2: expected '\t'\n" });
+	}
+
+	void unit_test_emit_threads() {
+		EditableDocumentProvider documents;
+		CompiledProgram program;
+		compile(program, documents, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		assert(program.diagnostics.is_empty());
+		TempArena temp;
+		Writer::Output expected = emit(program.modules, program.builtin_types, /*n_threads*/ 1, temp);
+		// Which thread gets to which function varies from run to run, so try a few times.
+		for (uint i = 0; i != 20; ++i) {
+			ArenaScope scope { temp };
+			assert(outputs_equal(emit(program.modules, program.builtin_types, /*n_threads*/ 2, temp), expected));
+		}
+	}
+
+	// 'Pair<A, Pair<B, A>>' is numbered first, but needs 'Pair<B, A>' to be defined before it.
+	const char STRUCT_ORDER_MAIN[] = "Void copy\nc Bool copy\n\tbool\nc true Bool\n\t*_ret = true;\nc A copy\n\tint\nc B copy\n\tint\n"
+		"Pair copy ?T ?U\n\tfirst ?T\n\tsecond ?U\n\nc mk Pair<A, Pair<B, A>>\n\treturn;\n\nmain Void\n\tp = mk\n\tb = true\n\tassert b\n";
+	const char STRUCT_ORDER_HEADER[] = "#include <assert.h>\n\nstruct Void {\n\t\n};\n\ntypedef bool Bool;\n\ntypedef int A;\n\ntypedef int B;\n\n"
+		"struct Pair1 {\n\tB first;\n\tA second;\n};\n\nstruct Pair0 {\n\tA first;\n\tPair1 second;\n};\n\n"
+		"void _true(Bool* _ret);\nvoid mk(Pair0* _ret);\nvoid _main(Void* _ret);\n\n";
+
+	class StructOrderDocumentProvider : public DocumentProvider {
+	public:
+		Option<StringSlice> try_get_document(const Path& path, const StringSlice& extension __attribute__((unused)), Arena& out __attribute__((unused))) override {
+			return path.base_name() == "main" ? Option { document(STRUCT_ORDER_MAIN) } : Option<StringSlice> {};
+		}
+	};
+
+	void unit_test_emit_struct_order() {
+		StructOrderDocumentProvider documents;
+		CompiledProgram program;
+		compile(program, documents, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		assert(program.diagnostics.is_empty());
+		LoweredProgram lowered { program.modules, program.builtin_types, /*n_threads*/ 1 };
+		TempArena temp;
+		Writer w { temp };
+		lowered.write_header(w);
+		assert(w.finish() == StringSlice { STRUCT_ORDER_HEADER });
+	}
+
+	void write_test_file(const FileLocator& loc, uint size, char c) {
+		TempArena temp;
+		Writer w { temp };
+		for (uint i = 0; i != size; ++i)
+			w << c;
+		write_file(loc, w.finish());
+	}
+
+	void unit_test_file_document_provider() {
+		PathCache paths;
+		FileLocator loc { "/tmp", paths.from_part_slice("oohoo-unit-test-document"), NZ_EXTENSION };
+		unique_ptr<DocumentProvider> documents = file_system_document_provider(loc.root);
+		TempArena temp;
+
+		write_test_file(loc, 4096, 'a');
+		StringSlice a = documents->try_get_document(loc.path, loc.extension, temp).get();
+		assert(a.size() == 4097 && *a.begin() == 'a' && *(a.end() - 2) == 'a' && *(a.end() - 1) == '\0');
+
+		// Truncates and writes the same file, as some editors save. The old document is unaffected.
+		write_test_file(loc, 10, 'b');
+		StringSlice b = documents->try_get_document(loc.path, loc.extension, temp).get();
+		assert(b.size() == 11 && *b.begin() == 'b' && *(b.end() - 1) == '\0');
+		assert(a.size() == 4097 && *(a.end() - 2) == 'a');
+
+		delete_file(loc);
+		assert(!documents->try_get_document(loc.path, loc.extension, temp).has());
+	}
+
+	void unit_test_map_empty_file() {
+		PathCache paths;
+		FileLocator loc { "/tmp", paths.from_part_slice("oohoo-unit-test-empty"), "txt" };
+		write_test_file(loc, 0, 'a');
+		MappedFile empty = try_map_file(loc, /*null_terminated*/ false).get();
+		assert(empty.contents.is_empty());
+		unmap_file(empty);
+		MappedFile terminated = try_map_file(loc, /*null_terminated*/ true).get();
+		assert(terminated.contents.size() == 1 && *terminated.contents.begin() == '\0');
+		unmap_file(terminated);
+		delete_file(loc);
+	}
+
+	struct DeleteFilesIteratee : DirectoryIteratee {
+		const StringSlice dir;
+		PathCache paths;
+		DeleteFilesIteratee(StringSlice _dir) : dir{_dir}, paths{} {}
+		// Every file in the cache has an extension.
+		void on_file(const StringSlice& name) override {
+			const char* dot = name.begin();
+			while (*dot != '.') ++dot;
+			delete_file({ dir, paths.from_part_slice({ name.begin(), dot }), { dot + 1, name.end() } });
+		}
+		void on_directory(const StringSlice& name __attribute__((unused))) override {}
+	};
+
+	void unit_test_exe_cache() {
+		ExeCacheKey key = exe_cache_key("clang", "int main() {}");
+		assert(exe_cache_key("clang", "int main() {}").hash == key.hash);
+		assert(exe_cache_key("clang -O2", "int main() {}").hash != key.hash);
+		assert(exe_cache_key("clang", "int main() { }").hash != key.hash);
+
+		const StringSlice dir = "/tmp/oohoo-unit-test-exe-cache";
+		make_directory(dir);
+		unique_ptr<ExeCache> cache = file_system_exe_cache(dir);
+		PathCache paths;
+		FileLocator built { "/tmp", paths.from_part_slice("oohoo-unit-test-built"), "exe" };
+		FileLocator reused { "/tmp", paths.from_part_slice("oohoo-unit-test-reused"), "exe" };
+		assert(!cache->try_get_exe(key, reused));
+
+		write_test_file(built, 10, 'x');
+		cache->set_exe(key, built);
+		assert(cache->try_get_exe(key, reused));
+		TempArena temp;
+		StringSlice contents = try_read_file(reused, temp, /*null_terminated*/ false).get();
+		assert(contents.size() == 10 && *contents.begin() == 'x');
+
+		// Moving text from one file to another is a different build.
+		StringSlice header_and_shard[] = { "struct A {};", "int main() {}" };
+		StringSlice moved[] = { "struct A {};int", " main() {}" };
+		ExeCacheKey object_key = exe_cache_key("clang", Slice<StringSlice> { header_and_shard, 2 });
+		assert(exe_cache_key("clang", Slice<StringSlice> { moved, 2 }).hash != object_key.hash);
+		assert(!cache->try_get_object(object_key, reused));
+		cache->set_object(object_key, built);
+		assert(cache->try_get_object(object_key, reused));
+
+		delete_file(built);
+		delete_file(reused);
+		DeleteFilesIteratee cached_files { dir };
+		list_directory(dir, cached_files);
+	}
+
+	void unit_test_emit_shards() {
+		EditableDocumentProvider documents;
+		CompiledProgram program;
+		compile(program, documents, program.paths.from_part_slice("main"), /*n_threads*/ 1);
+		assert(program.diagnostics.is_empty());
+		TempArena temp;
+		Writer::Output expected = emit(program.modules, program.builtin_types, /*n_threads*/ 1, temp);
+
+		// The header followed by each shard, without its include, is the same program.
+		{
+			LoweredProgram lowered { program.modules, program.builtin_types, /*n_threads*/ 1 };
+			// a's only function is never called, so only b and main have shards.
+			assert(lowered.n_shards() == 2);
+			ArenaScope scope { temp };
+			Writer all { temp };
+			lowered.write_header(all);
+			const StringSlice include = "#include \"main.h\"\n\n";
+			for (uint i = 0; i != lowered.n_shards(); ++i) {
+				TempArena shard_arena;
+				Writer w { shard_arena };
+				lowered.write_shard(w, i, "main.h");
+				StringSlice shard = w.finish();
+				assert(shard.size() >= include.size());
+				StringSlice body { shard.begin() + include.size(), shard.end() };
+				assert((StringSlice { shard.begin(), body.begin() } == include));
+				all << body;
+			}
+			assert(outputs_equal(all.finish(), expected));
+		}
+
+		const StringSlice root = "/tmp/oohoo-unit-test-shards";
+		const StringSlice cache_dir = "/tmp/oohoo-unit-test-shard-cache";
+		make_directory(root);
+		make_directory(cache_dir);
+		unique_ptr<ExeCache> cache = file_system_exe_cache(cache_dir);
+		PathCache paths;
+		Path main_path = paths.from_part_slice("main");
+		// Left over from a build with more shards.
+		FileLocator stale { root, main_path, "2.cpp" };
+		write_test_file(stale, 10, 'x');
+		{
+			LoweredProgram lowered { program.modules, program.builtin_types, /*n_threads*/ 1 };
+			CppShardedProgram cpp_program = write_shards(lowered, root, main_path, temp);
+			assert(!file_exists(stale));
+			CppShardedBuild b = compile_cpp_shards(cpp_program, *cache, /*n_threads*/ 1);
+			assert(b.built && !b.cached && b.n_compiled == 2);
+		}
+
+		// Only b's shard changes.
+		documents.b = document(SESSION_B_BODY_EDITED);
+		CompiledProgram edited;
+		compile(edited, documents, edited.paths.from_part_slice("main"), /*n_threads*/ 1);
+		assert(edited.diagnostics.is_empty());
+		{
+			LoweredProgram lowered { edited.modules, edited.builtin_types, /*n_threads*/ 1 };
+			CppShardedProgram cpp_program = write_shards(lowered, root, main_path, temp);
+			CppShardedBuild b = compile_cpp_shards(cpp_program, *cache, /*n_threads*/ 1);
+			assert(b.built && !b.cached && b.n_compiled == 1);
+		}
+
+		DeleteFilesIteratee shard_files { root };
+		list_directory(root, shard_files);
+		DeleteFilesIteratee cached_files { cache_dir };
+		list_directory(cache_dir, cached_files);
+	}
+
+	using ScanFn = const char*(const char*, const char*);
+
+	// Every start and end in 'text', so runs cross 16-byte blocks in every position.
+	void assert_scan_same(const StringSlice& text, ScanFn fast, ScanFn portable) {
+		for (const char* begin = text.begin(); begin != text.end(); ++begin)
+			for (const char* end = begin; end <= text.end(); ++end)
+				assert(fast(begin, end) == portable(begin, end));
+	}
+
+	void unit_test_scan() {
+		const char source[] = " some-long-value-name and SomeLongTypeNameThatGoesOn \t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\tx <=>+-*/== y \ntrailing \nz\t\nw\xff\x80";
+		StringSlice text { source + 1, source + sizeof(source) - 1 };
+		assert_scan_same(text, scan::skip_value_name_continue, scan::portable::skip_value_name_continue);
+		assert_scan_same(text, scan::skip_type_name_continue, scan::portable::skip_type_name_continue);
+		assert_scan_same(text, scan::skip_operator_chars, scan::portable::skip_operator_chars);
+		assert_scan_same(text, scan::skip_tabs, scan::portable::skip_tabs);
+		assert_scan_same(text, scan::find_newline, scan::portable::find_newline);
+		assert_scan_same(text, scan::find_trailing_space, scan::portable::find_trailing_space);
+
+		assert(scan::skip_value_name_continue(text.begin(), text.end()) == text.begin() + 20);
+		assert(*scan::find_trailing_space(text.begin(), text.end() - 1) == '\n');
+
+		for (const char* begin = text.begin(); begin != text.end(); ++begin)
+			for (const char* end = begin; end <= text.end(); ++end)
+				assert(scan::count_newlines(begin, end) == scan::portable::count_newlines(begin, end));
+	}
+
+	void unit_test_line_and_column_getter() {
+		// Longer than the old limit of 1024 lines, with lines of every length up to a few blocks.
+		const uint N_LINES = 3000;
+		TempArena arena;
+		StringBuilder b { arena, N_LINES * 50 };
+		for (uint line = 0; line != N_LINES; ++line) {
+			for (uint i = 0; i != line % 49; ++i)
+				b << 'x';
+			b << '\n';
+		}
+		StringSlice text = b.finish();
+		LineAndColumnGetter lc = LineAndColumnGetter::for_text(text, arena);
+
+		LineAndColumnGetter::Cursor in_order { lc };
+		LineAndColumnGetter::Cursor out_of_order { lc };
+		uint line = 0, column = 0;
+		for (uint pos = 0; pos != text.size(); ++pos) {
+			LineAndColumn expected { line, column };
+			LineAndColumn a = lc.line_and_column_at_pos(pos);
+			LineAndColumn c = in_order.at(pos);
+			// Backwards from the end, so every lookup starts over.
+			uint back_pos = text.size() - 1 - pos;
+			LineAndColumn back = out_of_order.at(back_pos);
+			LineAndColumn back_expected = lc.line_and_column_at_pos(back_pos);
+			assert(a.line == expected.line && a.column == expected.column);
+			assert(c.line == expected.line && c.column == expected.column);
+			assert(back.line == back_expected.line && back.column == back_expected.column);
+			if (*(text.begin() + pos) == '\n') {
+				++line;
+				column = 0;
+			} else
+				++column;
+		}
+		assert(line == N_LINES);
+	}
+
+	const char PARSE_SOURCE[] = "| Module comment.\nimport .a ..b.c\n\nc include <vector>\n\n| A struct.\nPair copy ?T\n\t| The first.\n\tfirst ?T\n\tsecond ?T\n\nc Bool copy\n\tbool\n\n$Eq ?T\n\t== Bool(a ?T, b ?T)\n\nc true Bool\n\treturn true;\n\n\t// after a blank line\n\nprivate\nf Void(x Bool *a)\n\tb = true\n\twhen\n\t\tb\n\t\t\tpass\n\t\telse\n\t\t\tb g<Bool> 1.5, \"s\"\n";
+
+	template <typename T>
+	const T& first(const List<T>& list) {
+		return *list.begin();
+	}
+
+	template <uint N>
+	FileAst parse_source(const char (&source)[N], PathCache& paths, Arena& arena) {
+		FileAst ast { paths.from_part_slice("test"), StringSlice { source, source + N } }; // Including the '\0'
+		parse_file(ast, paths, arena);
+		return ast;
+	}
+
+	template <uint N>
+	void assert_parse_diagnostic(const char (&source)[N], ushort begin, ushort end) {
+		PathCache paths;
+		TempArena arena;
+		try {
+			parse_source(source, paths, arena);
+			assert(false);
+		} catch (ParseDiagnostic d) {
+			assert(d.range.begin == begin && d.range.end == end);
+		}
+	}
+
+	void unit_test_tokenize() {
+		TempArena arena;
+		const char source[] = "f<Int> a >= \"s\"<T>\n";
+		ListBuilder<ParseDiagnostic> diagnostics;
+		Tokens tokens = tokenize({ source, source + sizeof(source) }, arena, diagnostics, arena);
+		assert(diagnostics.is_empty());
+		const TokenKind expected[] = {
+			TokenKind::Name, TokenKind::Less, TokenKind::TypeName, TokenKind::Greater, TokenKind::Space, TokenKind::Name, TokenKind::Space,
+			TokenKind::Operator, TokenKind::Space, TokenKind::StringLiteral, TokenKind::Less, TokenKind::TypeName, TokenKind::Greater,
+			TokenKind::Newline, TokenKind::End,
+		};
+		assert(tokens.size() == sizeof(expected) / sizeof(TokenKind));
+		for (uint i = 0; i != tokens.size(); ++i)
+			assert(tokens.kinds[i] == expected[i]);
+		assert(tokens.offsets[7] == 9 && tokens.lengths[7] == 2); // '>='
+		assert(tokens.offsets[9] == 13 && tokens.lengths[9] == 1); // The literal's text, without quotes
+
+		PathCache paths;
+		FileAst ast = parse_source(PARSE_SOURCE, paths, arena);
+		assert(ast.comment.get() == StringSlice { "Module comment." });
+		assert(ast.imports.size() == 2);
+		assert(ast.includes.size() == 1 && first(ast.includes).name == StringSlice { "<vector>" });
+		assert(ast.specs.size() == 1 && first(ast.specs).signatures.size() == 1);
+		assert(ast.structs.size() == 2 && ast.funs.size() == 2);
+		for (const StructDeclarationAst& s : ast.structs) {
+			assert(s.copy && s.is_public);
+			if (s.name == StringSlice { "Pair" }) {
+				assert(s.comment.get() == StringSlice { "A struct." });
+				assert(s.body.fields().size() == 2 && s.body.fields()[0].comment.get() == StringSlice { "The first." });
+			} else
+				assert(s.body.cpp_name() == StringSlice { "bool" });
+		}
+		for (const FunDeclarationAst& f : ast.funs) {
+			if (f.signature.name == StringSlice { "true" }) {
+				assert(f.is_public);
+				assert(f.body.cpp_source() == StringSlice { "return true;\n\n// after a blank line" });
+			} else
+				assert(!f.is_public && f.body.kind() == FunBodyAst::Kind::Expression);
+		}
+
+		assert_parse_diagnostic("f Void \n", 6, 7); // Trailing space
+		assert_parse_diagnostic("c f Void\n\tx;\t\n", 12, 13); // Trailing space in a C++ body
+		assert_parse_diagnostic("f Void", 6, 7); // No blank line at the end
+		assert_parse_diagnostic("f Void\n\tb = true\n\n\tassert b\n", 17, 18); // Blank line inside a body
+		assert_parse_diagnostic("f Void\n\tb\tc\n", 9, 10); // Tab inside a line
+	}
+
+	const char RECOVER_SOURCE[] = "f Void\n\tb\tc\n\nc ok Bool\n\t*_ret = true;\n\ng Void)\n\t*_ret = 0;\n\n|x\nc k Bool\n\t*_ret = false;\n";
+
+	void unit_test_parse_recovering() {
+		PathCache paths;
+		TempArena arena;
+		FileAst ast { paths.from_part_slice("test"), StringSlice { RECOVER_SOURCE, RECOVER_SOURCE + sizeof(RECOVER_SOURCE) } };
+		List<ParseDiagnostic> diagnostics = parse_file_recovering(ast, paths, arena);
+		// A bad character in 'f', a bad character in 'g', and no space after the '|'. The last comes from the tokenizer, so this checks the merge.
+		const ushort expected_begins[] = { 9, 45, 61 };
+		assert(diagnostics.size() == 3);
+		uint i = 0;
+		for (const ParseDiagnostic& d : diagnostics) {
+			assert(d.range.begin == expected_begins[i]);
+			++i;
+		}
+		// The good declarations are still there.
+		assert(ast.funs.size() == 2);
+		for (const FunDeclarationAst& f : ast.funs)
+			assert(f.signature.name == StringSlice { "ok" } || (f.signature.name == StringSlice { "k" } && f.signature.comment.get() == StringSlice { "x" }));
+
+		// Every bad file is reported in one run.
+		EditableDocumentProvider documents;
+		documents.a = document("Void copy)\n");
+		documents.b = document("import .a\n\nc yes Bool\n\t*_ret = true;\n\nc no Bool \n\t*_ret = false;\n");
+		ParsedProgram program;
+		ListBuilder<Diagnostic> all;
+		assert(!parse_everything(program, all, arena, documents, paths, paths.from_part_slice("main"), /*n_threads*/ 2));
+		uint n_a = 0, n_b = 0;
+		for (const Diagnostic& d : all.finish()) {
+			if (d.path.base_name() == StringSlice { "a" }) ++n_a;
+			else if (d.path.base_name() == StringSlice { "b" }) ++n_b;
+			else assert(false);
+		}
+		assert(n_a == 1 && n_b != 0);
+	}
+
+	// For ASTs of the same source. A declaration may point into an older version of it, so names are compared by where they are now.
+	class SameAst {
+		DeclarationSource a_source { nullptr, 0 };
+		DeclarationSource b_source { nullptr, 0 };
+
+		bool same(const StringSlice& a, const StringSlice& b) const {
+			return a == b && a_source.position(a.begin()) == b_source.position(b.begin());
+		}
+		bool same_range(const SourceRange& a, const SourceRange& b) const {
+			return same_position(a_source.range(a), b_source.range(b));
+		}
+		static bool same_position(const SourceRange& a, const SourceRange& b) { return a.begin == b.begin && a.end == b.end; }
+		static bool same(const Option<ArenaString>& a, const Option<ArenaString>& b) { return a.has() ? b.has() && a.get() == b.get() : !b.has(); }
+		bool same(const TypeParameterAst& a, const TypeParameterAst& b) const { return same(a.name, b.name) && a.index == b.index; }
+		bool same(const LifetimeConstraintAst& a, const LifetimeConstraintAst& b) const { return a.kind == b.kind && same(a.name, b.name); }
+		template <typename T>
+		bool same(const Slice<T>& a, const Slice<T>& b) const {
+			if (a.size() != b.size()) return false;
+			for (uint i = 0; i != a.size(); ++i)
+				if (!same(a[i], b[i])) return false;
+			return true;
+		}
+		bool same(const TypeAst& a, const TypeAst& b) const {
+			return a.stored.kind() == b.stored.kind() && same(a.stored.name(), b.stored.name())
+				&& (a.stored.kind() == StoredTypeAst::Kind::TypeParameter || same(a.stored.type_arguments(), b.stored.type_arguments()))
+				&& same(a.lifetime_constraints, b.lifetime_constraints);
+		}
+		bool same(const Ref<ExprAst>& a, const Ref<ExprAst>& b) const { return same(*a, *b); }
+		bool same(const CaseAst& a, const CaseAst& b) const { return same(a.condition, b.condition) && same(a.then, b.then); }
+		bool same(const ExprAst& a, const ExprAst& b) const {
+			if (a.kind() != b.kind()) return false;
+			switch (a.kind()) {
+				case ExprAst::Kind::Identifier:
+					return same(a.identifier(), b.identifier());
+				case ExprAst::Kind::Literal:
+					return same(a.literal().literal, b.literal().literal) && same(a.literal().type_arguments, b.literal().type_arguments) && same(a.literal().arguments, b.literal().arguments);
+				case ExprAst::Kind::NoCallLiteral:
+					return a.no_call_literal() == b.no_call_literal();
+				case ExprAst::Kind::Call:
+					return same(a.call().fun_name, b.call().fun_name) && same(a.call().type_arguments, b.call().type_arguments) && same(a.call().arguments, b.call().arguments);
+				case ExprAst::Kind::StructCreate:
+					return same(a.struct_create().struct_name, b.struct_create().struct_name) && same(a.struct_create().type_arguments, b.struct_create().type_arguments)
+						&& same(a.struct_create().arguments, b.struct_create().arguments);
+				case ExprAst::Kind::Let:
+					return same(a.let().name, b.let().name) && same(a.let().init, b.let().init) && same(a.let().then, b.let().then);
+				case ExprAst::Kind::Seq:
+					return same_range(a.seq().range, b.seq().range) && same(a.seq().first, b.seq().first) && same(a.seq().then, b.seq().then);
+				case ExprAst::Kind::When:
+					return same_range(a.when().range, b.when().range) && same(a.when().cases, b.when().cases) && same(a.when().elze, b.when().elze);
+				case ExprAst::Kind::Assert:
+					return same_range(a.assert_ast().range, b.assert_ast().range) && same(a.assert_ast().asserted, b.assert_ast().asserted);
+				case ExprAst::Kind::Pass:
+					return same_range(a.pass(), b.pass());
+			}
+		}
+		bool same(const ParameterAst& a, const ParameterAst& b) const { return same(a.name, b.name) && same(a.type, b.type); }
+		bool same(const SpecUseAst& a, const SpecUseAst& b) const { return same(a.spec, b.spec) && same(a.type_arguments, b.type_arguments); }
+		bool same(const FunSignatureAst& a, const FunSignatureAst& b) const {
+			return same(a.comment, b.comment) && same(a.name, b.name) && a.effect == b.effect && same(a.return_type, b.return_type)
+				&& same(a.parameters, b.parameters) && same(a.type_parameters, b.type_parameters) && same(a.spec_uses, b.spec_uses);
+		}
+		bool same(const StructFieldAst& a, const StructFieldAst& b) const { return same(a.comment, b.comment) && same(a.name, b.name) && same(a.type, b.type); }
+
+		bool same_declaration(const IncludeAst& a, const IncludeAst& b) const { return same(a.name, b.name); }
+		bool same_declaration(const StructDeclarationAst& a, const StructDeclarationAst& b) const {
+			return same(a.comment, b.comment) && same_range(a.range, b.range) && a.is_public == b.is_public && same(a.name, b.name) && same(a.type_parameters, b.type_parameters) && a.copy == b.copy
+				&& a.body.kind() == b.body.kind()
+				&& (a.body.kind() == StructBodyAst::Kind::CppName ? same(a.body.cpp_name(), b.body.cpp_name()) : same(a.body.fields(), b.body.fields()));
+		}
+		bool same_declaration(const SpecDeclarationAst& a, const SpecDeclarationAst& b) const {
+			return same(a.comment, b.comment) && same_range(a.range, b.range) && a.is_public == b.is_public && same(a.name, b.name)
+				&& same(a.type_parameters, b.type_parameters) && same(a.signatures, b.signatures);
+		}
+		bool same_declaration(const FunDeclarationAst& a, const FunDeclarationAst& b) const {
+			return a.is_public == b.is_public && same(a.signature, b.signature) && a.body.kind() == b.body.kind()
+				&& (a.body.kind() == FunBodyAst::Kind::CppSource ? a.body.cpp_source() == b.body.cpp_source() : same(a.body.expression(), b.body.expression()));
+		}
+
+	public:
+		template <typename Declaration>
+		bool same(const List<Declaration>& a, const List<Declaration>& b) {
+			if (a.size() != b.size()) return false;
+			typename List<Declaration>::const_iterator bi = b.begin();
+			for (const Declaration& ai : a) {
+				a_source = ai.source;
+				b_source = (*bi).source;
+				if (!same_declaration(ai, *bi)) return false;
+				++bi;
+			}
+			return true;
+		}
+		static bool same(const List<ParseDiagnostic>& a, const List<ParseDiagnostic>& b) {
+			if (a.size() != b.size()) return false;
+			List<ParseDiagnostic>::const_iterator bi = b.begin();
+			for (const ParseDiagnostic& ai : a) {
+				if (!same_position(ai.range, (*bi).range)) return false;
+				++bi;
+			}
+			return true;
+		}
+		// Both ASTs have the same imports, which 'reparse_file' never moves.
+		bool same(const FileAst& a, const FileAst& b) {
+			a_source = { a.source.begin(), 0 };
+			b_source = { b.source.begin(), 0 };
+			if (!same(a.comment, b.comment) || a.imports.size() != b.imports.size())
+				return false;
+			for (uint i = 0; i != a.imports.size(); ++i)
+				if (!same_position(a.imports[i].range, b.imports[i].range) || a.imports[i].n_parents != b.imports[i].n_parents || !(a.imports[i].path == b.imports[i].path))
+					return false;
+			return same(a.includes, b.includes) && same(a.specs, b.specs) && same(a.structs, b.structs) && same(a.funs, b.funs);
+		}
+	};
+
+	// Replaces the first 'old_text' in the current source, checking that reparsing gives the same as parsing from scratch.
+	template <uint N, uint M>
+	ReparseResult assert_reparse(const FileAst& previous, const char (&old_text)[N], const char (&new_text)[M], PathCache& paths, Arena& arena) {
+		StringSlice old_slice { old_text, old_text + N - 1 };
+		const char* found = previous.source.begin();
+		while (!(StringSlice { found, found + old_slice.size() } == old_slice)) {
+			assert(found != previous.source.end());
+			++found;
+		}
+		ushort begin = to_ushort(uint(found - previous.source.begin()));
+		TextEdit edit { { begin, to_ushort(begin + old_slice.size()) }, M == 1 ? StringSlice {} : StringSlice { new_text, new_text + M - 1 } };
+		ReparseResult res = reparse_file(previous, apply_edit(previous.source, edit, arena), edit, paths, arena);
+
+		FileAst from_scratch { previous.path, res.ast->source };
+		List<ParseDiagnostic> diagnostics = parse_file_recovering(from_scratch, paths, arena);
+		assert(SameAst::same(res.diagnostics, diagnostics));
+		assert(SameAst {}.same(*res.ast, from_scratch));
+		return res;
+	}
+
+	void unit_test_reparse() {
+		PathCache paths;
+		TempArena arena;
+		FileAst first { paths.from_part_slice("test"), StringSlice { PARSE_SOURCE, PARSE_SOURCE + sizeof(PARSE_SOURCE) } };
+		parse_file(first, paths, arena);
+
+		// Only the edited function is parsed again.
+		ReparseResult res = assert_reparse(first, "1.5", "2.5", paths, arena);
+		assert(res.n_reparsed == 75); // From "f Void" to the end
+		// The others weren't copied.
+		assert((*res.ast->structs.begin()).name.begin() == (*first.structs.begin()).name.begin());
+		res = assert_reparse(res.ast, "$Eq", "c no Bool\n\treturn false;\n\n$Eq", paths, arena); // New declaration
+		res = assert_reparse(res.ast, "\tsecond ?T\n", "", paths, arena); // Earlier in the file, so later ranges shift
+		res = assert_reparse(res.ast, "Module comment.", "Module", paths, arena); // In the file's comment
+		res = assert_reparse(res.ast, "import", "| More.\nimport", paths, arena); // At the start of the file's first line after its comment
+		res = assert_reparse(res.ast, "\nc Bool copy", "| Bool.\nc Bool copy", paths, arena); // A comment joining the next declaration
+		res = assert_reparse(res.ast, "\t// after", "\tx;\n\t// after", paths, arena); // At the start of a line
+		res = assert_reparse(res.ast, "\n$Eq", "$Eq", paths, arena); // Removes the blank line between declarations
+		res = assert_reparse(res.ast, "private\n", "", paths, arena); // Makes everything after public
+		res = assert_reparse(res.ast, "\treturn false;", "\treturn false; ", paths, arena); // A diagnostic
+		assert(res.diagnostics.size() == 1);
+	}
+
+	// Checks each chunk against the text that should have been written, a repeating "0123456789".
+	struct CheckingSink : WriterSink {
+		ulong n_written = 0;
+		uint max_chunk_size = 0;
+		void write(const StringSlice& chunk) override {
+			for (char c : chunk) {
+				assert(c == char('0' + n_written % 10));
+				++n_written;
+			}
+			max_chunk_size = chunk.size() > max_chunk_size ? chunk.size() : max_chunk_size;
+		}
+	};
+
+	void unit_test_writer() {
+		TempArena arena;
+		Writer w { arena };
+		for (uint i = 0; i != 10000; ++i)
+			w << char('0' + i % 10);
+		w << StringSlice { "abc" } << 123u;
+		StringSlice s = w.finish();
+		assert(s.size() == 10006 && *(s.end() - 6) == 'a' && *(s.end() - 1) == '3');
+
+		// Streaming, the buffer is reused instead of growing, so the arena holds the same amount however much is written.
+		CheckingSink sink;
+		TempArena stream_arena;
+		Writer streaming { stream_arena, sink };
+		const StringSlice digits = "0123456789";
+		ulong held = 0;
+		for (uint i = 0; i != 100000; ++i) {
+			streaming << digits;
+			if (i == 10000)
+				held = stream_arena.n_bytes_held();
+		}
+		assert(stream_arena.n_bytes_held() == held);
+		assert(streaming.finish().is_empty());
+		assert(sink.n_written == 1000000 && sink.max_chunk_size <= Writer::SINK_BUFFER_SIZE);
+	}
+
+	void unit_test_json() {
+		TempArena arena;
+		Json j = parse_json(" {\"a\": [1, -2.5e3, true, null], \"b\": \"x\\n\\u00e9\\ud83d\\ude00\", \"c\": \"\", \"d\": {}} ", arena).get();
+		const Slice<Json>& a = j.get("a").get().array();
+		assert(a.size() == 4 && a[0].number() == StringSlice { "1" } && a[1].number() == StringSlice { "-2.5e3" });
+		assert(a[2].boolean() && a[3].kind() == Json::Kind::Null);
+		assert(j.get_string("b").get() == StringSlice { "x\n\xc3\xa9\xf0\x9f\x98\x80" });
+		assert(j.get_string("c").get().is_empty());
+		assert(j.get("d").get().object().is_empty() && !j.get("e").has() && !j.get_string("a").has());
+
+		assert(!parse_json("", arena).has());
+		assert(!parse_json("[1,]", arena).has());
+		assert(!parse_json("{\"a\" 1}", arena).has());
+		assert(!parse_json("\"\\ud800\"", arena).has()); // Unpaired surrogate
+		assert(!parse_json("01", arena).has());
+		assert(!parse_json("[] []", arena).has());
+
+		// Writing it back gives the same value.
+		Writer w { arena };
+		w << j;
+		Writer::Output out = w.finish();
+		StringBuilder b { arena, out.size() };
+		for (char c : out)
+			b << c;
+		Json again = parse_json(b.finish(), arena).get();
+		assert(again.get_string("b").get() == j.get_string("b").get() && again.get("a").get().array().size() == 4);
+	}
+
+	void unit_test_overlay_document_provider() {
+		EditableDocumentProvider files;
+		OverlayDocumentProvider documents { files };
+		PathCache paths;
+		Path a = paths.from_part_slice("a");
+		TempArena temp;
+		assert(documents.try_get_document(a, NZ_EXTENSION, temp).get() == files.a);
+
+		documents.set(a, NZ_EXTENSION, "edited");
+		StringSlice edited = documents.try_get_document(a, NZ_EXTENSION, temp).get();
+		assert(edited == document("edited"));
+		// Setting the same text again keeps the same document.
+		documents.set(a, NZ_EXTENSION, "edited");
+		assert(documents.try_get_document(a, NZ_EXTENSION, temp).get().begin() == edited.begin());
+		// New text takes the place of the old.
+		documents.set(a, NZ_EXTENSION, "edited again");
+		StringSlice edited_again = documents.try_get_document(a, NZ_EXTENSION, temp).get();
+		assert(edited_again == document("edited again") && edited_again.begin() == edited.begin());
+		// Only for that extension.
+		assert(documents.try_get_document(a, "other", temp).get() == files.a);
+
+		documents.remove(a, NZ_EXTENSION);
+		assert(documents.try_get_document(a, NZ_EXTENSION, temp).get() == files.a);
+	}
+
+	void send_to_server(std::ostream& out, const StringSlice& message) {
+		out << "Content-Length: " << message.size() << "\r\n\r\n";
+		for (char c : message)
+			out << c;
+	}
+
+	// Splits what the server wrote into its messages.
+	List<Json> messages_from_server(const std::string& output, Arena& arena) {
+		const StringSlice header = "Content-Length: ";
+		ListBuilder<Json> res;
+		const char* c = output.data();
+		const char* end = c + output.size();
+		while (c != end) {
+			assert((StringSlice { c, c + header.size() } == header));
+			c += header.size();
+			uint length = 0;
+			for (; *c != '\r'; ++c)
+				length = length * 10 + uint(*c - '0');
+			c += 4; // "\r\n\r\n"
+			res.add(parse_json(copy_string(arena, { c, c + length }), arena).get(), arena);
+			c += length;
+		}
+		return res.finish();
+	}
+
+	const char LSP_MAIN_URI[] = "file:///work/space/main.nz";
+
+	void assert_published(const Json& message, uint n_diagnostics) {
+		assert(message.get_string("method").get() == StringSlice { "textDocument/publishDiagnostics" });
+		const Json& params = message.get("params").get();
+		assert(params.get_string("uri").get() == StringSlice { LSP_MAIN_URI });
+		assert(params.get("diagnostics").get().array().size() == n_diagnostics);
+	}
+
+	void unit_test_language_server() {
+		std::ostringstream client;
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{\"rootUri\":\"file:///work/space/\"}}");
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"method\":\"initialized\",\"params\":{}}");
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"file:///work/space/main.nz\",\"languageId\":\"noze\",\"version\":1,\"text\":\"import .b .a\\n\\nmain Void\\n\\tb = yes\\n\\tassert b\\n\"}}}");
+		// Declares a struct twice.
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"file:///work/space/main.nz\",\"version\":2},\"contentChanges\":[{\"text\":\"import .b .a\\n\\nmain Void\\n\\tb = yes\\n\\tassert b\\n\\nc T copy\\n\\tint\\n\\nc T copy\\n\\tint\\n\"}]}}");
+		// Inserts a struct 'W' before the first 'T', then renames that 'T' (now on line 9) to 'W'.
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"file:///work/space/main.nz\",\"version\":3},\"contentChanges\":["
+			"{\"range\":{\"start\":{\"line\":6,\"character\":0},\"end\":{\"line\":6,\"character\":0}},\"text\":\"c W copy\\n\\tint\\n\\n\"},"
+			"{\"range\":{\"start\":{\"line\":9,\"character\":2},\"end\":{\"line\":9,\"character\":3}},\"text\":\"W\"}]}}");
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didClose\",\"params\":{\"textDocument\":{\"uri\":\"file:///work/space/main.nz\"}}}");
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"textDocument/hover\",\"params\":{}}");
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"shutdown\"}");
+		send_to_server(client, "{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}");
+
+		EditableDocumentProvider files;
+		std::istringstream in { client.str() };
+		std::ostringstream out;
+		assert(run_language_server(in, out, files) == 0);
+
+		TempArena arena;
+		List<Json> messages = messages_from_server(out.str(), arena);
+		assert(messages.size() == 7);
+		List<Json>::const_iterator m = messages.begin();
+		assert((*m).get("id").get().number() == StringSlice { "1" });
+		assert((*m).get("result").get().get("capabilities").has());
+		++m;
+		assert_published(*m, 0);
+		++m;
+		assert_published(*m, 1);
+		const Json& diagnostic = (*m).get("params").get().get("diagnostics").get().array()[0];
+		const Json& start = diagnostic.get("range").get().get("start").get();
+		assert(start.get("line").get().number() == StringSlice { "9" } && start.get("character").get().number() == StringSlice { "0" });
+		// Now the second 'W' is the duplicate. Without the first change, there would be no duplicate. Without the second, it would be the 'T' on line 12.
+		++m;
+		assert_published(*m, 1);
+		const Json& moved = (*m).get("params").get().get("diagnostics").get().array()[0];
+		const Json& moved_start = moved.get("range").get().get("start").get();
+		assert(moved_start.get("line").get().number() == StringSlice { "9" } && moved_start.get("character").get().number() == StringSlice { "0" });
+		// Closing clears its diagnostics.
+		++m;
+		assert_published(*m, 0);
+		++m;
+		assert((*m).get("id").get().number() == StringSlice { "2" } && (*m).get("error").has());
+		++m;
+		assert((*m).get("id").get().number() == StringSlice { "3" } && (*m).get("result").get().kind() == Json::Kind::Null);
+	}
+
+	bool is_aligned(const void* ptr, uint alignment) {
+		return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+	}
+
+	void unit_test_arena() {
+		Arena arena;
+
+		// Much more than fits in the first chunk.
+		MaxSizeVector<64, Ref<ulong>> longs;
+		for (uint i = 0; i != 64; ++i) {
+			arena.allocate(1 + i % 7, 1); // Misalign the next allocation
+			Slice<ulong> arr = uninitialized_array<ulong>(arena, 100);
+			assert(is_aligned(arr.begin(), alignof(ulong)));
+			for (ulong& l : arr)
+				l = i;
+			longs.push(&arr[99]);
+		}
+		for (uint i = 0; i != 64; ++i)
+			assert(*longs[i] == i);
+
+		// A large allocation gets its own chunk and does not disturb the current one.
+		Arena arena2;
+		char* before = static_cast<char*>(arena2.allocate(1, 1));
+		char* large = static_cast<char*>(arena2.allocate(Arena::max_small_allocation * 4, 16));
+		assert(is_aligned(large, 16));
+		large[Arena::max_small_allocation * 4 - 1] = 'x';
+		char* after = static_cast<char*>(arena2.allocate(1, 1));
+		assert(after == before + 1);
+
+		// StringBuilder gives back what it doesn't use.
+		StringBuilder b { arena, 100 };
+		b << StringSlice { "abc" };
+		ArenaString s = b.finish();
+		assert(s == StringSlice { "abc" });
+		char* next = static_cast<char*>(arena.allocate(1, 1));
+		assert(next == s.end());
+	}
+
+	void unit_test_arena_scope() {
+		Arena arena;
+		char* kept = static_cast<char*>(arena.allocate(1, 1));
+		char* first_in_scope;
+		{
+			ArenaScope scope { arena };
+			first_in_scope = static_cast<char*>(arena.allocate(1, 1));
+			assert(first_in_scope == kept + 1);
+			// Spill into new chunks, including a large one.
+			for (uint i = 0; i != 100; ++i)
+				arena.allocate(1000, 8);
+			arena.allocate(Arena::max_small_allocation * 2, 8);
+		}
+		// Everything in the scope was freed, so we're back where we started.
+		assert(static_cast<char*>(arena.allocate(1, 1)) == first_in_scope);
+
+		// Released chunks are reused instead of allocating new ones.
+		Arena::Mark m = arena.mark();
+		char* in_new_chunk = static_cast<char*>(arena.allocate(Arena::max_small_allocation, 1));
+		arena.release(m);
+		assert(static_cast<char*>(arena.allocate(Arena::max_small_allocation, 1)) == in_new_chunk);
+	}
+
+	void use_temp_arena() {
+		TempArena temp;
+		for (uint i = 0; i != 100; ++i)
+			temp.allocate(1000, 8);
+	}
+
+	void unit_test_temp_arena() {
+		use_temp_arena();
+		TempArena::PoolStats before = TempArena::pool_stats();
+		// Same allocations again should be served entirely from the pool.
+		use_temp_arena();
+		TempArena::PoolStats after = TempArena::pool_stats();
+		assert(after.misses == before.misses);
+		assert(after.hits > before.hits);
+	}
 }
 
 void unit_tests() {
+	unit_test_arena();
+	unit_test_arena_scope();
+	unit_test_temp_arena();
 	unit_test_map();
+	unit_test_map_growth();
+	unit_test_identifier_cache();
+	unit_test_compile_session();
+	unit_test_check_with_interfaces();
+	unit_test_write_diagnostics();
+	unit_test_emit_threads();
+	unit_test_emit_struct_order();
+	unit_test_file_document_provider();
+	unit_test_map_empty_file();
+	unit_test_exe_cache();
+	unit_test_emit_shards();
+	unit_test_scan();
+	unit_test_line_and_column_getter();
+	unit_test_tokenize();
+	unit_test_parse_recovering();
+	unit_test_reparse();
+	unit_test_writer();
+	unit_test_json();
+	unit_test_overlay_document_provider();
+	unit_test_language_server();
 }
@@ -1,5 +1,7 @@
 #include "./PathCache.h"
 
+#include <mutex> // std::lock_guard, std::mutex
+
 #include "../util/store/Map.h"
 #include "../util/store/Set.h"
 #include "./PathImpl.h"
@@ -34,11 +36,12 @@ namespace {
 }
 
 struct PathCache::Impl {
+	std::mutex mutex; // Files may be parsed in parallel.
 	Arena arena;
 	Set<Path::Impl, Path::Impl::hash> paths;
 	Slices slices;
 
-	Impl() : arena{}, paths{32, arena}, slices{32, arena} {}
+	Impl() : mutex{}, arena{}, paths{arena}, slices{arena} {}
 };
 
 PathCache::PathCache() : impl(unique_ptr<PathCache::Impl> { new PathCache::Impl() }) {}
@@ -61,6 +64,7 @@ Path PathCache::resolve(Path parent, const StringSlice& child) {
 	return resolve(Option { parent }, child);
 }
 Path PathCache::resolve(Option<Path> parent, const StringSlice& child) {
+	std::lock_guard<std::mutex> lock { impl->mutex };
 	return Path { &impl->paths.get_in_set_or_insert(Path::Impl { parent, get_name(impl->slices, impl->arena, child) }) };
 }
 
@@ -3,7 +3,7 @@
 #include "./unique_ptr.h"
 #include "./Path.h"
 
-// Memoizes construction of paths.
+// Memoizes construction of paths. Safe to use from multiple threads.
 class PathCache {
 	struct Impl;
 	unique_ptr<Impl> impl;
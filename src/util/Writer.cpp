@@ -1,15 +1,47 @@
 #include "Writer.h"
 
+WriterSink::~WriterSink() {}
+
+Writer::Output Writer::finish() {
+	if (sink.has()) {
+		if (cur != begin)
+			sink.get()->write({ begin, cur });
+		cur = begin;
+	}
+	return cur == begin ? StringSlice {} : StringSlice { begin, cur };
+}
+
+void Writer::grow(uint n_bytes) {
+	uint capacity = to_unsigned(end - begin);
+	if (sink.has() && cur != begin) {
+		sink.get()->write({ begin, cur });
+		cur = begin;
+		if (n_bytes <= capacity)
+			return;
+	}
+
+	uint size = to_unsigned(cur - begin);
+	uint new_capacity = capacity == 0 ? (sink.has() ? SINK_BUFFER_SIZE : 256) : capacity * 2;
+	while (new_capacity - size < n_bytes)
+		new_capacity *= 2;
+	// Usually nothing else was allocated since, so there's no need to copy.
+	if (begin != nullptr && arena.try_extend(end, new_capacity - capacity)) {
+		end = begin + new_capacity;
+		return;
+	}
+	char* new_begin = static_cast<char*>(arena.allocate(new_capacity, 1));
+	if (size != 0)
+		std::memcpy(new_begin, begin, size);
+	begin = new_begin;
+	cur = new_begin + size;
+	end = new_begin + new_capacity;
+}
+
 Writer& Writer::operator<<(uint u) {
 	//TODO: duplicate code in ArenaString.cpp
-	if (u < 10) {
-		*this << char('0' + char(u));
-	} else if (u < 100) {
-		*this << char('0' + char(u / 10));
-		*this << char('0' + char(u % 10));
-	} else
-		todo();
-	return *this;
+	if (u >= 10)
+		*this << u / 10;
+	return *this << char('0' + char(u % 10));
 }
 Writer& Writer::operator<<(ushort u) {
 	return *this << uint(u);
@@ -1,39 +1,75 @@
 #pragma once
 
-#include "./store/BlockedList.h"
+#include <cstring> // std::memcpy, std::strlen
+
+#include "./store/Arena.h"
 #include "./store/StringSlice.h"
 #include "./Option.h"
+#include "./Ref.h"
+
+// Where a streaming Writer sends its output.
+/*abstract*/ class WriterSink {
+public:
+	// 'chunk' is only valid during the call.
+	virtual void write(const StringSlice& chunk) = 0;
+	// https://stackoverflow.com/a/29217604
+	// If we make this '= 0' there is a compiler warning.
+	virtual ~WriterSink();
+};
 
+// Writes to a single buffer in an arena, which doubles in size when it fills up.
+// With a sink, the buffer is instead passed to the sink and reused whenever it fills up,
+// so memory use stays the same however much is written.
 class Writer {
 public:
-	using Output = BlockedList<1024, char>;
+	// Points into the arena the Writer was given.
+	using Output = StringSlice;
 
 private:
-	Output out;
 	Arena& arena;
+	Option<Ref<WriterSink>> sink;
+	char* begin;
+	char* cur;
+	char* end;
 	uint _indent;
 
+	// Makes room for at least 'n_bytes' more.
+	void grow(uint n_bytes);
+
 public:
-	Writer(Arena& _arena) : out{}, arena{_arena}, _indent{0} {}
+	// How much a streaming Writer buffers before passing it to its sink.
+	static const uint SINK_BUFFER_SIZE = 1 << 16;
+
+	Writer(Arena& _arena) : arena{_arena}, sink{}, begin{nullptr}, cur{nullptr}, end{nullptr}, _indent{0} {}
+	Writer(Arena& _arena, WriterSink& _sink) : arena{_arena}, sink{Ref<WriterSink> { &_sink }}, begin{nullptr}, cur{nullptr}, end{nullptr}, _indent{0} {}
 	Writer(const Writer& other) = delete;
 	void operator=(const Writer& other) = delete;
 
-	Output finish() { return out; }
+	// With a sink, passes everything left to it and returns an empty slice.
+	Output finish();
+
+	inline void write(const char* chars, uint n_bytes) {
+		if (n_bytes > to_unsigned(end - cur))
+			grow(n_bytes);
+		// 'chars' may be null when 'n_bytes' is 0, and memcpy doesn't allow that.
+		if (n_bytes != 0)
+			std::memcpy(cur, chars, n_bytes);
+		cur += n_bytes;
+	}
 
 	inline Writer& operator<<(char c) {
-		out.push(c, arena);
+		if (cur == end)
+			grow(1);
+		*cur = c;
+		++cur;
 		return *this;
 	}
 	inline Writer& operator<<(const char* s) {
-		while (*s != '\0') {
-			out.push(*s, arena);
-			++s;
-		}
+		write(s, uint(std::strlen(s)));
 		return *this;
 	}
 	inline Writer& operator<<(const StringSlice& s) {
-		for (char c : s)
-			out.push(c, arena);
+		write(s.begin(), s.size());
 		return *this;
 	}
 	Writer& operator<<(uint u);
@@ -2,8 +2,12 @@
 
 // TODO: c++17 #include <filesystem> and rewrite everything...
 #include <dirent.h> // readdir_r
-#include <fstream> // std::ifstream, std::ofstream, std::remove
+#include <fcntl.h> // open
+#include <fstream> // std::ifstream, std::remove, std::rename
 #include <cstring> // strlen
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat, mkdir
+#include <unistd.h> // close, link, read, sysconf, unlink, write
 #include "./store/ArenaString.h"
 
 namespace {
@@ -29,34 +33,75 @@ namespace {
 		return std::ifstream { c_path.slice().begin() };
 	}
 
-	std::ofstream get_ofstream(const FileLocator& loc) {
-		PathString path = get_cstring(loc);
-		return std::ofstream { path.slice().begin() };
+	// Always leaves room for a '\0'.
+	ulong mapped_size(uint file_size) {
+		ulong page_size = to_unsigned(sysconf(_SC_PAGESIZE));
+		return (file_size / page_size + 1) * page_size;
 	}
 }
 
 DirectoryIteratee::~DirectoryIteratee() {}
 
 Option<StringSlice> try_read_file(const FileLocator& loc, Arena& out, bool null_terminated) {
-	std::ifstream i = get_ifstream(loc);
-	if (!i) return {};
-
-	i.seekg(0, std::ios::end);
-	long signed_size = i.tellg();
-	uint size = to_unsigned(signed_size);
+	PathString path = get_cstring(loc);
+	int fd = open(path.slice().begin(), O_RDONLY);
+	if (fd == -1) return {};
+
+	struct stat st;
+	assert(fstat(fd, &st) == 0);
+	uint size = to_unsigned(st.st_size);
+	// StringSlice can't hold a non-null empty range.
+	if (size == 0 && !null_terminated) {
+		close(fd);
+		return Option { StringSlice {} };
+	}
 	ArenaString res = allocate_slice(out, size + null_terminated);
-	i.seekg(0);
-	i.read(res.begin(), signed_size);
-	assert(i.gcount() == signed_size);
+	// Usually one call reads everything.
+	for (uint n_read = 0; n_read != size; ) {
+		long n = read(fd, res.begin() + n_read, size - n_read);
+		if (n <= 0) todo(); // Failed, or the file got shorter since 'fstat'
+		n_read += uint(n);
+	}
+	close(fd);
 	if (null_terminated) res[size] = '\0';
 	return Option { res.slice() };
 }
 
+Option<MappedFile> try_map_file(const FileLocator& loc, bool null_terminated) {
+	PathString path = get_cstring(loc);
+	int fd = open(path.slice().begin(), O_RDONLY);
+	if (fd == -1) return {};
+
+	struct stat st;
+	assert(fstat(fd, &st) == 0);
+	uint size = to_unsigned(st.st_size);
+	// StringSlice can't hold a non-null empty range, so there is nothing to map.
+	if (size == 0 && !null_terminated) {
+		close(fd);
+		return Option { MappedFile { {}, 0 } };
+	}
+	// Reserve zeroed memory with room for a '\0' after the file, then map the file over its start.
+	// Past the end of the file, the last page of the file mapping is zeroed too.
+	ulong n_mapped = mapped_size(size);
+	char* begin = static_cast<char*>(mmap(nullptr, n_mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	assert(begin != MAP_FAILED);
+	if (size != 0)
+		assert(mmap(begin, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == begin);
+	close(fd); // The mapping stays valid.
+	return Option { MappedFile { { begin, begin + size + null_terminated }, n_mapped } };
+}
+
+void unmap_file(const MappedFile& file) {
+	if (!file.contents.is_empty())
+		munmap(const_cast<char*>(file.contents.begin()), file.mapped_size);
+}
+
 void list_directory(const StringSlice& loc, DirectoryIteratee& iteratee) {
 	PathString dir_path = PathString::make([&](MaxSizeStringWriter& w) { w << loc << '\0'; });
 	Ref<DIR> dir = opendir(dir_path.slice().begin());
 
 	while (true) {
+		errno = 0; // readdir only sets this on failure
 		dirent* ent = readdir(dir.ptr());
 		if (ent == nullptr) {
 			assert(errno == 0);
@@ -75,11 +120,27 @@ void list_directory(const StringSlice& loc, DirectoryIteratee& iteratee) {
 }
 
 void write_file(const FileLocator& loc, const Writer::Output& contents) {
-	std::ofstream out = get_ofstream(loc);
-	assert(out);
-	for (char c : contents)
-		out << c;
-	out.close();
+	FileSink sink { loc };
+	sink.write(contents);
+}
+
+FileSink::~FileSink() {
+	if (fd != -1)
+		close(fd);
+}
+
+void FileSink::write(const StringSlice& chunk) {
+	if (fd == -1) {
+		PathString path = get_cstring(loc);
+		fd = open(path.slice().begin(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		assert(fd != -1);
+	}
+	// Usually one call writes everything.
+	for (const char* ptr = chunk.begin(); ptr != chunk.end(); ) {
+		long n = ::write(fd, ptr, to_unsigned(chunk.end() - ptr));
+		assert(n > 0);
+		ptr += n;
+	}
 }
 
 void delete_file(const FileLocator& loc) {
@@ -87,6 +148,43 @@ void delete_file(const FileLocator& loc) {
 	std::remove(path.slice().begin());
 }
 
+void rename_file(const FileLocator& from, const FileLocator& to) {
+	PathString from_path = get_cstring(from);
+	PathString to_path = get_cstring(to);
+	assert(std::rename(from_path.slice().begin(), to_path.slice().begin()) == 0);
+}
+
+void link_file(const FileLocator& from, const FileLocator& to) {
+	PathString from_path = get_cstring(from);
+	PathString to_path = get_cstring(to);
+	unlink(to_path.slice().begin());
+	if (link(from_path.slice().begin(), to_path.slice().begin()) == 0 || errno == EEXIST)
+		return;
+	assert(errno == EXDEV);
+
+	int in = open(from_path.slice().begin(), O_RDONLY);
+	assert(in != -1);
+	struct stat st;
+	assert(fstat(in, &st) == 0);
+	int out = open(to_path.slice().begin(), O_WRONLY | O_CREAT | O_TRUNC, st.st_mode);
+	assert(out != -1);
+	char buffer[4096];
+	while (true) {
+		long n = read(in, buffer, sizeof(buffer));
+		assert(n >= 0);
+		if (n == 0) break;
+		assert(write(out, buffer, to_unsigned(n)) == n);
+	}
+	close(in);
+	close(out);
+}
+
 bool file_exists(const FileLocator& loc) {
 	return bool(get_ifstream(loc));
 }
+
+void make_directory(const StringSlice& path) {
+	PathString c_path = PathString::make([&](MaxSizeStringWriter& w) { w << path << '\0'; });
+	if (mkdir(c_path.slice().begin(), 0755) != 0)
+		assert(errno == EEXIST);
+}
@@ -33,7 +33,42 @@ public:
 
 void list_directory(const StringSlice& loc, DirectoryIteratee& iteratee);
 
+// Copies the file into 'out' with a single 'read'. If 'null_terminated', the contents are followed by a '\0'.
 Option<StringSlice> try_read_file(const FileLocator& loc, Arena& out, bool null_terminated);
+
+struct MappedFile {
+	StringSlice contents;
+	ulong mapped_size; // For 'unmap_file'
+};
+
+// Maps the file into memory read-only instead of copying it. Pass the result to 'unmap_file' when done with it.
+// If 'null_terminated', the contents are followed by a '\0' as with 'try_read_file'.
+// The mapping is a live view of the file: writing to the file changes the contents, and truncating it makes reads past the new end crash.
+// So only map files that are never written in place, only replaced with 'rename_file'. Not files an editor may save.
+Option<MappedFile> try_map_file(const FileLocator& loc, bool null_terminated);
+void unmap_file(const MappedFile& file);
 void write_file(const FileLocator& loc, const Writer::Output& contents);
+// Writes a file a chunk at a time, so its contents never need to be in memory at once.
+// The file is created (or truncated) on the first call to 'write', and closed when this is destroyed.
+class FileSink final : public WriterSink {
+	const FileLocator loc;
+	int fd;
+
+public:
+	explicit FileSink(const FileLocator& _loc) : loc{_loc}, fd{-1} {}
+	FileSink(const FileSink& other) = delete;
+	void operator=(const FileSink& other) = delete;
+	~FileSink() override;
+
+	// False if 'write' was never called, in which case there is no file.
+	inline bool any_written() const { return fd != -1; }
+	void write(const StringSlice& chunk) override;
+};
 void delete_file(const FileLocator& loc);
+// Replaces 'to' if it exists. Anyone who mapped the old file keeps seeing the old contents.
+void rename_file(const FileLocator& from, const FileLocator& to);
+// Makes 'to' another name for 'from', replacing 'to'. Copies instead if they're on different file systems.
+void link_file(const FileLocator& from, const FileLocator& to);
 bool file_exists(const FileLocator& loc);
+// Does nothing if it already exists.
+void make_directory(const StringSlice& path);
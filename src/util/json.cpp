@@ -0,0 +1,305 @@
+#include "./json.h"
+
+#include "./store/ArenaArrayBuilders.h"
+#include "./store/ArenaString.h"
+#include "./store/ListBuilder.h"
+
+namespace {
+	struct InvalidJson {};
+
+	// Deep enough for any message, but keeps a hostile one from overflowing the stack.
+	const uint MAX_DEPTH = 64;
+
+	template <typename T>
+	Slice<T> to_slice(const List<T>& list, Arena& arena) {
+		typename List<T>::const_iterator iter = list.begin();
+		return fill_array<T>()(arena, list.size(), [&](uint i __attribute__((unused))) {
+			T value = *iter;
+			++iter;
+			return value;
+		});
+	}
+
+	bool is_digit(char c) {
+		return '0' <= c && c <= '9';
+	}
+
+	uint hex_digit(char c) {
+		if (is_digit(c)) return uint(c - '0');
+		if ('a' <= c && c <= 'f') return uint(c - 'a' + 10);
+		if ('A' <= c && c <= 'F') return uint(c - 'A' + 10);
+		throw InvalidJson {};
+	}
+
+	void write_utf8(StringBuilder& out, uint code_point) {
+		if (code_point < 0x80)
+			out << char(code_point);
+		else if (code_point < 0x800)
+			out << char(0xc0 | (code_point >> 6)) << char(0x80 | (code_point & 0x3f));
+		else if (code_point < 0x10000)
+			out << char(0xe0 | (code_point >> 12)) << char(0x80 | ((code_point >> 6) & 0x3f)) << char(0x80 | (code_point & 0x3f));
+		else
+			out << char(0xf0 | (code_point >> 18)) << char(0x80 | ((code_point >> 12) & 0x3f))
+				<< char(0x80 | ((code_point >> 6) & 0x3f)) << char(0x80 | (code_point & 0x3f));
+	}
+
+	// Throws InvalidJson instead of returning None, since any failure fails the whole parse.
+	class JsonParser {
+		const char* ptr;
+		const char* const end;
+		Arena& arena;
+		uint depth;
+
+		inline char peek() const {
+			return ptr == end ? '\0' : *ptr;
+		}
+
+		inline bool try_take(char c) {
+			if (peek() == c) {
+				++ptr;
+				return true;
+			}
+			return false;
+		}
+
+		inline void take(char c) {
+			if (!try_take(c)) throw InvalidJson {};
+		}
+
+		void take_word(const char* word) {
+			for (; *word != '\0'; ++word)
+				take(*word);
+		}
+
+		void skip_whitespace() {
+			while (ptr != end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r'))
+				++ptr;
+		}
+
+		uint take_hex4() {
+			uint u = 0;
+			for (uint i = 0; i != 4; ++i) {
+				if (ptr == end) throw InvalidJson {};
+				u = u * 16 + hex_digit(*ptr);
+				++ptr;
+			}
+			return u;
+		}
+
+		void take_escape(StringBuilder& out) {
+			char c = peek();
+			++ptr;
+			switch (c) {
+				case '"': case '\\': case '/': out << c; break;
+				case 'b': out << '\b'; break;
+				case 'f': out << '\f'; break;
+				case 'n': out << '\n'; break;
+				case 'r': out << '\r'; break;
+				case 't': out << '\t'; break;
+				case 'u': {
+					uint u = take_hex4();
+					if (0xdc00 <= u && u < 0xe000) throw InvalidJson {}; // Low surrogate with no high surrogate
+					if (0xd800 <= u && u < 0xdc00) {
+						take('\\');
+						take('u');
+						uint low = take_hex4();
+						if (!(0xdc00 <= low && low < 0xe000)) throw InvalidJson {};
+						u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+					}
+					write_utf8(out, u);
+					break;
+				}
+				default:
+					throw InvalidJson {};
+			}
+		}
+
+		// After the opening '"'.
+		StringSlice take_string() {
+			const char* begin = ptr;
+			bool has_escapes = false;
+			while (true) {
+				if (ptr == end || uint8_t(*ptr) < 0x20) throw InvalidJson {};
+				if (*ptr == '"') break;
+				if (*ptr == '\\') {
+					has_escapes = true;
+					++ptr;
+					if (ptr == end) throw InvalidJson {};
+				}
+				++ptr;
+			}
+			const char* string_end = ptr;
+			++ptr;
+			if (!has_escapes)
+				return begin == string_end ? StringSlice {} : StringSlice { begin, string_end };
+
+			// Decoding never makes a string longer.
+			StringBuilder out { arena, to_unsigned(string_end - begin) };
+			for (ptr = begin; ptr != string_end; ) {
+				if (*ptr == '\\') {
+					++ptr;
+					take_escape(out);
+				} else {
+					out << *ptr;
+					++ptr;
+				}
+			}
+			++ptr;
+			return out.is_empty() ? StringSlice {} : out.finish().slice();
+		}
+
+		void take_digits() {
+			if (!is_digit(peek())) throw InvalidJson {};
+			while (is_digit(peek())) ++ptr;
+		}
+
+		StringSlice take_number() {
+			const char* begin = ptr;
+			try_take('-');
+			if (!try_take('0'))
+				take_digits();
+			if (try_take('.'))
+				take_digits();
+			if (try_take('e') || try_take('E')) {
+				if (!try_take('+')) try_take('-');
+				take_digits();
+			}
+			return { begin, ptr };
+		}
+
+		Json take_array() {
+			ListBuilder<Json> elements;
+			skip_whitespace();
+			if (!try_take(']')) {
+				do {
+					elements.add(take_value(), arena);
+				} while (try_take(','));
+				take(']');
+			}
+			return Json::array(to_slice(elements.finish(), arena));
+		}
+
+		Json take_object() {
+			ListBuilder<JsonMember> members;
+			skip_whitespace();
+			if (!try_take('}')) {
+				do {
+					skip_whitespace();
+					take('"');
+					StringSlice key = take_string();
+					skip_whitespace();
+					take(':');
+					members.add({ key, take_value() }, arena);
+				} while (try_take(','));
+				take('}');
+			}
+			return Json::object(to_slice(members.finish(), arena));
+		}
+
+		// Skips whitespace on both sides.
+		Json take_value() {
+			if (depth == MAX_DEPTH) throw InvalidJson {};
+			++depth;
+			skip_whitespace();
+			Json res = Json::null();
+			char c = peek();
+			if (c == '\0') throw InvalidJson {};
+			++ptr;
+			switch (c) {
+				case '{': res = take_object(); break;
+				case '[': res = take_array(); break;
+				case '"': res = Json::string(take_string()); break;
+				case 't': take_word("rue"); res = Json::boolean(true); break;
+				case 'f': take_word("alse"); res = Json::boolean(false); break;
+				case 'n': take_word("ull"); break;
+				default:
+					--ptr;
+					res = Json::number(take_number());
+			}
+			skip_whitespace();
+			--depth;
+			return res;
+		}
+
+	public:
+		JsonParser(const StringSlice& text, Arena& _arena) : ptr{text.begin()}, end{text.end()}, arena{_arena}, depth{0} {}
+
+		Json parse() {
+			Json res = take_value();
+			if (ptr != end) throw InvalidJson {};
+			return res;
+		}
+	};
+}
+
+Option<const Json&> Json::get(const StringSlice& key) const {
+	if (_kind == Kind::Object)
+		for (const JsonMember& m : _data.object)
+			if (m.key == key)
+				return Option<const Json&> { m.value };
+	return {};
+}
+
+Option<StringSlice> Json::get_string(const StringSlice& key) const {
+	Option<const Json&> value = get(key);
+	return value.has() && value.get().kind() == Kind::String ? Option { value.get().string() } : Option<StringSlice> {};
+}
+
+Option<Json> parse_json(const StringSlice& text, Arena& arena) {
+	try {
+		return Option { JsonParser { text, arena }.parse() };
+	} catch (InvalidJson) {
+		return {};
+	}
+}
+
+void write_json_string_char(Writer& out, char c) {
+	switch (c) {
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\r': out << "\\r"; break;
+		case '\t': out << "\\t"; break;
+		default:
+			if (uint8_t(c) < 0x20) {
+				const char* hex = "0123456789abcdef";
+				out << "\\u00" << hex[uint8_t(c) >> 4] << hex[uint8_t(c) & 0xf];
+			} else
+				out << c;
+	}
+}
+
+Writer& operator<<(Writer& out, const Json& value) {
+	switch (value.kind()) {
+		case Json::Kind::Null:
+			return out << "null";
+		case Json::Kind::Bool:
+			return out << (value.boolean() ? "true" : "false");
+		case Json::Kind::Number:
+			return out << value.number();
+		case Json::Kind::String:
+			write_json_string(out, value.string());
+			return out;
+		case Json::Kind::Array: {
+			out << '[';
+			bool first = true;
+			for (const Json& element : value.array()) {
+				if (!first) out << ',';
+				first = false;
+				out << element;
+			}
+			return out << ']';
+		}
+		case Json::Kind::Object: {
+			out << '{';
+			bool first = true;
+			for (const JsonMember& member : value.object()) {
+				if (!first) out << ',';
+				first = false;
+				write_json_string(out, member.key);
+				out << ':' << member.value;
+			}
+			return out << '}';
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "./store/Arena.h"
+#include "./store/Slice.h"
+#include "./store/StringSlice.h"
+#include "./Option.h"
+#include "./Writer.h"
+
+struct JsonMember;
+
+// Just enough JSON for the language server protocol.
+class Json {
+public:
+	enum class Kind { Null, Bool, Number, String, Array, Object };
+
+private:
+	union Data {
+		bool boolean;
+		StringSlice number; // Left as text, since it's only ever echoed back.
+		StringSlice string; // With escapes decoded.
+		Slice<Json> array;
+		Slice<JsonMember> object;
+		Data() {}
+	};
+	Kind _kind;
+	Data _data;
+
+	inline explicit Json(Kind kind) : _kind{kind} {}
+
+public:
+	inline static Json null() { return Json { Kind::Null }; }
+	inline static Json boolean(bool b) {
+		Json j { Kind::Bool };
+		j._data.boolean = b;
+		return j;
+	}
+	inline static Json number(StringSlice s) {
+		Json j { Kind::Number };
+		j._data.number = s;
+		return j;
+	}
+	inline static Json string(StringSlice s) {
+		Json j { Kind::String };
+		j._data.string = s;
+		return j;
+	}
+	inline static Json array(Slice<Json> elements) {
+		Json j { Kind::Array };
+		j._data.array = elements;
+		return j;
+	}
+	inline static Json object(Slice<JsonMember> members) {
+		Json j { Kind::Object };
+		j._data.object = members;
+		return j;
+	}
+
+	inline Kind kind() const { return _kind; }
+	inline bool boolean() const { assert(_kind == Kind::Bool); return _data.boolean; }
+	inline const StringSlice& number() const { assert(_kind == Kind::Number); return _data.number; }
+	inline const StringSlice& string() const { assert(_kind == Kind::String); return _data.string; }
+	inline const Slice<Json>& array() const { assert(_kind == Kind::Array); return _data.array; }
+	inline const Slice<JsonMember>& object() const { assert(_kind == Kind::Object); return _data.object; }
+
+	// None unless this is an object with a member named 'key'.
+	Option<const Json&> get(const StringSlice& key) const;
+	// None unless this is an object whose member 'key' is a string.
+	Option<StringSlice> get_string(const StringSlice& key) const;
+};
+
+struct JsonMember {
+	StringSlice key;
+	Json value;
+};
+
+// Returns None if 'text' isn't valid JSON.
+// Strings with escapes are decoded into 'arena'; other strings and numbers point into 'text'.
+Option<Json> parse_json(const StringSlice& text, Arena& arena);
+
+void write_json_string_char(Writer& out, char c);
+// Writes 'chars' as a JSON string, quotes included.
+template <typename /*iterable of char*/ Chars>
+void write_json_string(Writer& out, const Chars& chars) {
+	out << '"';
+	for (char c : chars)
+		write_json_string_char(out, c);
+	out << '"';
+}
+
+Writer& operator<<(Writer& out, const Json& value);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <exception> // std::exception_ptr
+#include <thread> // std::thread
+
+#include "./store/Arena.h"
+#include "./assert.h"
+#include "./int.h"
+
+const uint MAX_THREADS = 16;
+
+// Calls 'cb(thread_index)' on 'n_threads' threads and waits for all of them.
+// The calling thread is thread 0, so with 1 thread no threads are started.
+// If any call throws, the exception from the lowest thread index is rethrown here once every thread is done.
+template <typename /*uint => void*/ Cb>
+void run_on_threads(uint n_threads, Cb cb) {
+	assert(1 <= n_threads && n_threads <= MAX_THREADS);
+	std::exception_ptr errors[MAX_THREADS];
+	std::thread threads[MAX_THREADS];
+	for (uint i = 1; i != n_threads; ++i)
+		threads[i] = std::thread { [&cb, &errors, i]() {
+			try {
+				cb(i);
+			} catch (...) {
+				errors[i] = std::current_exception();
+			}
+			// This thread's pooled chunks would otherwise leak.
+			TempArena::free_pool();
+		} };
+
+	try {
+		cb(0);
+	} catch (...) {
+		errors[0] = std::current_exception();
+	}
+
+	for (uint i = 1; i != n_threads; ++i)
+		threads[i].join();
+	for (uint i = 0; i != n_threads; ++i)
+		if (errors[i])
+			std::rethrow_exception(errors[i]);
+}
@@ -1,22 +1,190 @@
 #include "./Arena.h"
 
+#include <initializer_list> // std::initializer_list
+#include <new> // ::operator new
 #include "./assert.h"
 
-Arena::Arena() {
-	uint size = 10000;
-	alloc_begin = ::operator new(size);
-	alloc_end = static_cast<char*>(alloc_begin) + size;
-	alloc_next = alloc_begin;
+namespace {
+	const uint LOG2_FIRST_CHUNK_SIZE = 12;
+	const uint LOG2_MAX_CHUNK_SIZE = 20;
+	const uint FIRST_CHUNK_SIZE = 1 << LOG2_FIRST_CHUNK_SIZE;
+	const uint MAX_CHUNK_SIZE = 1 << LOG2_MAX_CHUNK_SIZE;
+	// Chunks are powers of two, so each size has its own free list in the pool.
+	const uint N_CHUNK_SIZES = LOG2_MAX_CHUNK_SIZE - LOG2_FIRST_CHUNK_SIZE + 1;
+	// Beyond this, chunks returned to the pool are freed instead.
+	const uint MAX_POOLED_CHUNKS_PER_SIZE = 8;
+
+	// Room needed for the header plus an allocation that may need to be aligned.
+	template <typename Chunk>
+	uint chunk_size_for(uint n_bytes, uint alignment) {
+		return uint(sizeof(Chunk)) + alignment - 1 + n_bytes;
+	}
+
+	uint round_up_to_power_of_two(uint u) {
+		uint res = 1;
+		while (res < u)
+			res *= 2;
+		return res;
+	}
+
+	uint size_index(uint size) {
+		uint index = floor_log2(size) - LOG2_FIRST_CHUNK_SIZE;
+		assert(size == FIRST_CHUNK_SIZE << index && index < N_CHUNK_SIZES);
+		return index;
+	}
+}
+
+struct Arena::ChunkPool {
+	Chunk* free[N_CHUNK_SIZES];
+	uint n_free[N_CHUNK_SIZES];
+	TempArena::PoolStats stats;
+
+	Chunk* take(uint size) {
+		uint index = size_index(size);
+		Chunk* c = free[index];
+		if (c == nullptr) {
+			++stats.misses;
+			c = static_cast<Chunk*>(::operator new(size));
+			c->size = size;
+		} else {
+			++stats.hits;
+			free[index] = c->prev;
+			--n_free[index];
+		}
+		return c;
+	}
+
+	void free_all() {
+		for (uint i = 0; i != N_CHUNK_SIZES; ++i) {
+			while (free[i] != nullptr) {
+				Chunk* prev = free[i]->prev;
+				::operator delete(free[i]);
+				free[i] = prev;
+			}
+			n_free[i] = 0;
+		}
+	}
+
+	void give_back(Chunk* c) {
+		uint index = size_index(c->size);
+		if (n_free[index] == MAX_POOLED_CHUNKS_PER_SIZE)
+			::operator delete(c);
+		else {
+			c->prev = free[index];
+			free[index] = c;
+			++n_free[index];
+		}
+	}
+};
+
+Arena::ChunkPool& Arena::this_thread_pool() {
+	// Plain data, so this is zero-initialized and needs no destructor. See TempArena::free_pool.
+	static thread_local ChunkPool pool;
+	return pool;
 }
 
+Arena::Arena() : Arena{/*borrows_from_pool*/ false} {}
+
+Arena::Arena(bool _borrows_from_pool)
+	: chunks{nullptr}, large_chunks{nullptr}, spare_chunks{nullptr}, alloc_next{nullptr}, alloc_end{nullptr},
+	next_chunk_size{FIRST_CHUNK_SIZE}, borrows_from_pool{_borrows_from_pool} {}
+
 Arena::~Arena() {
-	::operator delete(alloc_begin);
+	free_chunks(chunks);
+	free_chunks(spare_chunks);
+	while (large_chunks != nullptr) {
+		Chunk* prev = large_chunks->prev;
+		::operator delete(large_chunks);
+		large_chunks = prev;
+	}
+}
+
+Arena::Chunk* Arena::new_chunk(uint size) {
+	if (borrows_from_pool)
+		return this_thread_pool().take(size);
+	Chunk* c = static_cast<Chunk*>(::operator new(size));
+	c->size = size;
+	return c;
+}
+
+void Arena::free_chunks(Chunk* c) {
+	while (c != nullptr) {
+		Chunk* prev = c->prev;
+		if (borrows_from_pool)
+			this_thread_pool().give_back(c);
+		else
+			::operator delete(c);
+		c = prev;
+	}
+}
+
+void Arena::release(const Mark& m) {
+	while (large_chunks != m.large_chunks) {
+		assert(large_chunks != nullptr); // Otherwise the mark was already released
+		Chunk* c = large_chunks;
+		large_chunks = c->prev;
+		::operator delete(c);
+	}
+	while (chunks != m.chunks) {
+		assert(chunks != nullptr);
+		Chunk* c = chunks;
+		chunks = c->prev;
+		c->prev = spare_chunks;
+		spare_chunks = c;
+	}
+	alloc_next = m.alloc_next;
+	alloc_end = chunks == nullptr ? nullptr : reinterpret_cast<char*>(chunks) + chunks->size;
 }
 
-void* Arena::allocate(uint n_bytes) {
-	assert(n_bytes != 0);
-	void* res = alloc_next;
-	alloc_next = static_cast<char*>(alloc_next) + n_bytes;
+ulong Arena::n_bytes_held() const {
+	ulong n = 0;
+	for (const Chunk* list : { chunks, large_chunks, spare_chunks })
+		for (const Chunk* c = list; c != nullptr; c = c->prev)
+			n += c->size;
+	return n;
+}
+
+void* Arena::allocate_slow(uint n_bytes, uint alignment) {
+	if (n_bytes > max_small_allocation)
+		return allocate_large(n_bytes, alignment);
+
+	uint needed = chunk_size_for<Chunk>(n_bytes, alignment);
+	Chunk* c;
+	if (spare_chunks != nullptr && spare_chunks->size >= needed) {
+		c = spare_chunks;
+		spare_chunks = c->prev;
+	} else {
+		// Chunk sizes are kept to powers of two so they can be pooled.
+		c = new_chunk(next_chunk_size < needed ? round_up_to_power_of_two(needed) : next_chunk_size);
+		if (next_chunk_size < MAX_CHUNK_SIZE)
+			next_chunk_size *= 2;
+	}
+
+	c->prev = chunks;
+	chunks = c;
+	alloc_next = reinterpret_cast<char*>(c + 1);
+	alloc_end = reinterpret_cast<char*>(c) + c->size;
+
+	char* res = align_up(alloc_next, alignment);
+	alloc_next = res + n_bytes;
 	assert(alloc_next <= alloc_end);
 	return res;
 }
+
+// Large allocations go in their own chunk, so we don't abandon the rest of the current chunk.
+void* Arena::allocate_large(uint n_bytes, uint alignment) {
+	uint size = chunk_size_for<Chunk>(n_bytes, alignment);
+	Chunk* c = static_cast<Chunk*>(::operator new(size));
+	c->prev = large_chunks;
+	c->size = size;
+	large_chunks = c;
+	return align_up(reinterpret_cast<char*>(c + 1), alignment);
+}
+
+TempArena::PoolStats TempArena::pool_stats() {
+	return this_thread_pool().stats;
+}
+
+void TempArena::free_pool() {
+	this_thread_pool().free_all();
+}
@@ -1,24 +1,94 @@
 #pragma once
 
+#include <cstdint> // uintptr_t
 #include "../Ref.h"
 
+// Hands out memory by bumping a pointer through a chunk; everything is freed at once when the arena is destroyed.
+// When a chunk fills up we start a new, bigger one, so there is no limit on how much an arena can hold.
 class Arena {
 	friend class StringBuilder; // TODO
-	void* alloc_begin;
-	void* alloc_next;
-	void* alloc_end;
+
+	// Header at the start of every chunk. Chunks form a singly-linked list from newest to oldest.
+	struct Chunk {
+		Chunk* prev;
+		uint size; // Includes this header.
+	};
+
+	// Per-thread free lists of chunks, used by TempArena.
+	struct ChunkPool;
+
+	Chunk* chunks; // The chunk we are currently bumping through is at the head.
+	Chunk* large_chunks; // Each holds a single allocation that was too big to share a chunk.
+	Chunk* spare_chunks; // Chunks emptied by 'release', to be reused before allocating new ones.
+	char* alloc_next;
+	char* alloc_end;
+	uint next_chunk_size;
+	const bool borrows_from_pool;
+
+	inline static char* align_up(char* ptr, uint alignment) {
+		assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+		uintptr_t mask = alignment - 1;
+		return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(ptr) + mask) & ~mask);
+	}
+
+	void* allocate_slow(uint n_bytes, uint alignment);
+	void* allocate_large(uint n_bytes, uint alignment);
+	Chunk* new_chunk(uint size);
+	void free_chunks(Chunk* c);
+
+protected:
+	static ChunkPool& this_thread_pool();
+	explicit Arena(bool _borrows_from_pool);
 
 public:
+	// Records how much of the arena is in use. See ArenaScope.
+	class Mark {
+		friend class Arena;
+		Chunk* chunks;
+		Chunk* large_chunks;
+		char* alloc_next;
+		Mark(Chunk* _chunks, Chunk* _large_chunks, char* _alloc_next) : chunks{_chunks}, large_chunks{_large_chunks}, alloc_next{_alloc_next} {}
+	};
+
+	// Allocations bigger than this bypass the current chunk and get a chunk to themselves.
+	static const uint max_small_allocation = 1 << 13;
+
 	Arena();
 	Arena(const Arena& other) = delete;
 	void operator=(const Arena& other) = delete;
 	~Arena();
 
-	void* allocate(uint n_bytes);
+	inline void* allocate(uint n_bytes, uint alignment) {
+		assert(n_bytes != 0);
+		char* res = align_up(alloc_next, alignment);
+		if (res <= alloc_end && n_bytes <= ulong(alloc_end - res)) {
+			alloc_next = res + n_bytes;
+			return res;
+		}
+		return allocate_slow(n_bytes, alignment);
+	}
+
+	// If 'end' is the end of the most recent allocation and there's room after it, extends that allocation by 'n_bytes'.
+	// Lets a buffer at the end of the arena grow without being copied.
+	inline bool try_extend(const void* end, uint n_bytes) {
+		if (end != alloc_next || n_bytes > ulong(alloc_end - alloc_next))
+			return false;
+		alloc_next += n_bytes;
+		return true;
+	}
+
+	inline Mark mark() const {
+		return { chunks, large_chunks, alloc_next };
+	}
+	// Frees everything allocated since the mark was taken. Marks must be released in the reverse order they were taken.
+	void release(const Mark& m);
+
+	// Total size of the chunks this arena holds, whether used or not.
+	ulong n_bytes_held() const;
 
 	template <typename T>
 	Ref<T> allocate_uninitialized() {
-		return static_cast<T*>(allocate(sizeof(T)));
+		return static_cast<T*>(allocate(sizeof(T), alignof(T)));
 	}
 
 	template <typename T>
@@ -28,3 +98,35 @@ public:
 		return ptr;
 	}
 };
+
+// An arena for temporary data that is freed at the end of a scope.
+// Instead of allocating chunks from the system, borrows them from a pool owned by the current thread, and returns them when done.
+class TempArena : public Arena {
+public:
+	struct PoolStats {
+		ulong hits; // Chunks reused from the pool
+		ulong misses; // Chunks that had to be allocated from the system
+	};
+
+	inline TempArena() : Arena{/*borrows_from_pool*/ true} {}
+
+	// Stats for the current thread's pool. In a steady state, 'misses' should stop increasing.
+	static PoolStats pool_stats();
+	// Frees the chunks held by the current thread's pool. Call this before a thread exits.
+	static void free_pool();
+};
+
+// Everything allocated in the arena while this is alive is freed when it goes out of scope.
+// Useful for speculative work that will usually be thrown away.
+class ArenaScope {
+	Arena& arena;
+	const Arena::Mark mark;
+
+public:
+	inline explicit ArenaScope(Arena& _arena) : arena{_arena}, mark{_arena.mark()} {}
+	ArenaScope(const ArenaScope& other) = delete;
+	void operator=(const ArenaScope& other) = delete;
+	inline ~ArenaScope() {
+		arena.release(mark);
+	}
+};
@@ -19,7 +19,7 @@ inline Slice<T> single_element_slice(Arena& arena, T elem) {
 
 template <typename T>
 inline Slice<T> uninitialized_array(Arena& arena, uint size) {
-	return Slice<T> { static_cast<T*>(arena.allocate(sizeof(T) * size)), size };
+	return Slice<T> { static_cast<T*>(arena.allocate(sizeof(T) * size, alignof(T))), size };
 }
 
 template <typename T>
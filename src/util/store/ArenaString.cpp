@@ -2,14 +2,9 @@
 
 StringBuilder& StringBuilder::operator<<(uint u) {
 	//TODO: duplicate code in Writer.cpp
-	if (u < 10) {
-		*this << char('0' + char(u));
-	} else if (u < 100) {
-		*this << char('0' + char(u / 10));
-		*this << char('0' + char(u % 10));
-	} else
-		todo();
-	return *this;
+	if (u >= 10)
+		*this << u / 10;
+	return *this << char('0' + char(u % 10));
 }
 
 StringBuilder& StringBuilder::operator<<(StringSlice s) {
@@ -19,14 +14,18 @@ StringBuilder& StringBuilder::operator<<(StringSlice s) {
 }
 
 ArenaString StringBuilder::finish() {
-	assert(arena.alloc_next == slice._end); // no intervening allocations
-	arena.alloc_next = ptr; // Only used up this much space, don't waste the rest
+	// Only used up this much space, don't waste the rest.
+	// (A large allocation has a chunk to itself, so there is nothing to give back.)
+	if (slice._end == arena.alloc_next)
+		arena.alloc_next = ptr;
+	else
+		assert(to_unsigned(slice._end - slice._begin) > Arena::max_small_allocation); // no intervening allocations
 	return { slice._begin, ptr };
 }
 
 ArenaString copy_string(Arena& arena, const StringSlice& slice) {
 	uint size = slice.size();
-	char* const begin = static_cast<char*>(arena.allocate(size));
+	char* const begin = static_cast<char*>(arena.allocate(size, 1));
 	char* end = begin;
 	for (char c : slice) {
 		*end = c;
@@ -33,7 +33,7 @@ inline bool operator==(const ArenaString& a, const ArenaString& b) { return a.sl
 inline bool operator==(const ArenaString& a, const StringSlice& b) { return a.slice() == b; }
 
 inline ArenaString allocate_slice(Arena& arena, uint size) {
-	char* begin = static_cast<char*>(arena.allocate(size));
+	char* begin = static_cast<char*>(arena.allocate(size, 1));
 	return { begin, begin + size };
 }
 
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint> // uint8_t
+#ifdef __SSE2__
+#include <emmintrin.h> // _mm_*
+#endif
 #include "../Option.h"
 #include "./Arena.h"
 #include "./ArenaArrayBuilders.h"
@@ -11,96 +15,158 @@ struct InsertResult {
 	KeyValuePair<K, V>& pair;
 };
 
+namespace map_group {
+	// Control bytes are probed a group at a time. Each control byte is EMPTY, or holds 7 bits of the hash of the key in that slot.
+	const uint WIDTH = 16;
+	const uint8_t EMPTY = 0x80;
+
+	// Bit i is set if ctrl[i] == b. 'ctrl' must be aligned to WIDTH.
+	inline uint match(const uint8_t* ctrl, uint8_t b) {
+#ifdef __SSE2__
+		__m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl));
+		return uint(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(char(b)))));
+#else
+		uint res = 0;
+		for (uint i = 0; i != WIDTH; ++i)
+			if (ctrl[i] == b)
+				res |= 1u << i;
+		return res;
+#endif
+	}
+
+	inline uint lowest_bit_index(uint bits) {
+		return uint(__builtin_ctz(bits));
+	}
+}
+
+// Open-addressing hash table (https://abseil.io/about/design/swisstables) that grows as needed.
+// Pairs are allocated separately in the arena and never move, so references to them stay valid when the table grows.
 template <typename K, typename V, typename Hash>
 class Map {
-	struct Entry {
-		KeyValuePair<K, V> pair;
-		Option<Ref<Entry>> next_in_chain;
+	using Pair = KeyValuePair<K, V>;
+
+	template <typename, typename, typename> friend struct build_map;
+	Arena* arena; // null for Map::empty()
+	uint8_t* ctrl; // One control byte per slot.
+	Pair** slots;
+	uint n_groups; // 0 or a power of 2
+	uint _size;
+
+	Map() : arena{nullptr}, ctrl{nullptr}, slots{nullptr}, n_groups{0}, _size{0} {}
+
+	inline uint capacity() const {
+		return n_groups * map_group::WIDTH;
+	}
+
+	// Keep at most 7/8 of slots full, so a probe usually stops at the first group.
+	inline static uint max_size(uint n_groups) {
+		return n_groups * map_group::WIDTH / 8 * 7;
+	}
+
+	struct Hashed {
+		uint group;
+		uint8_t h2;
 	};
-	static uint array_elements_size(uint arr_size) {
-		return arr_size * 3 / 4;
+	inline static Hashed hash_key(const K& key, uint n_groups) {
+		// Keys like Ref have poor low bits, so mix before masking.
+		hash_t h = Hash{}(key) * 0x9e3779b97f4a7c15ul;
+		return { uint(h ^ (h >> 32)) & (n_groups - 1), uint8_t(h >> 57) };
 	}
-	static uint index(const K& key, uint arr_size) {
-		// Only use the first 3/4 of the array -- rest is for conflicts. https://en.wikipedia.org/wiki/Coalesced_hashing
-		hash_t hash = Hash{}(key);
-		return hash % array_elements_size(arr_size);
+
+	Option<Ref<Pair>> find(const K& key) const {
+		if (_size == 0)
+			return {};
+		Hashed hashed = hash_key(key, n_groups);
+		uint group = hashed.group;
+		for (uint n_probes = 1; ; ++n_probes) {
+			const uint8_t* group_ctrl = ctrl + group * map_group::WIDTH;
+			for (uint bits = map_group::match(group_ctrl, hashed.h2); bits != 0; bits &= bits - 1) {
+				Pair* pair = slots[group * map_group::WIDTH + map_group::lowest_bit_index(bits)];
+				if (pair->key == key)
+					return Option<Ref<Pair>> { pair };
+			}
+			if (map_group::match(group_ctrl, map_group::EMPTY) != 0)
+				return {};
+			// Triangular probing visits every group when n_groups is a power of 2.
+			group = (group + n_probes) & (n_groups - 1);
+		}
 	}
 
-	template <typename, typename, typename> friend struct build_map;
-	Slice<Option<Entry>> arr;
-	Option<Entry>* leftmost_conflict_slot;
-	Option<Entry>* next_conflict_slot;
+	// Caller must ensure the key is not already in the table and that there is room.
+	void insert_new(Pair* pair) {
+		Hashed hashed = hash_key(pair->key, n_groups);
+		uint group = hashed.group;
+		for (uint n_probes = 1; ; ++n_probes) {
+			uint empties = map_group::match(ctrl + group * map_group::WIDTH, map_group::EMPTY);
+			if (empties != 0) {
+				uint i = group * map_group::WIDTH + map_group::lowest_bit_index(empties);
+				ctrl[i] = hashed.h2;
+				slots[i] = pair;
+				return;
+			}
+			group = (group + n_probes) & (n_groups - 1);
+		}
+	}
 
-	Map() : arr{}, leftmost_conflict_slot{nullptr}, next_conflict_slot{nullptr} {}
+	// The old table is abandoned in the arena. Since the size doubles, that wastes at most as much as the current table.
+	void resize(uint new_n_groups) {
+		uint8_t* old_ctrl = ctrl;
+		Pair** old_slots = slots;
+		uint old_capacity = capacity();
+
+		n_groups = new_n_groups;
+		ctrl = static_cast<uint8_t*>(arena->allocate(capacity(), map_group::WIDTH));
+		for (uint i = 0; i != capacity(); ++i)
+			ctrl[i] = map_group::EMPTY;
+		slots = static_cast<Pair**>(arena->allocate(capacity() * uint(sizeof(Pair*)), alignof(Pair*)));
+
+		for (uint i = 0; i != old_capacity; ++i)
+			if (old_ctrl[i] != map_group::EMPTY)
+				insert_new(old_slots[i]);
+	}
+
+	void reserve(uint size) {
+		uint new_n_groups = n_groups == 0 ? 1 : n_groups;
+		while (max_size(new_n_groups) < size)
+			new_n_groups *= 2;
+		if (new_n_groups != n_groups)
+			resize(new_n_groups);
+	}
 
 public:
-	Map(uint capacity, Arena& arena)
-		: arr{fill_array<Option<Entry>>{}(arena, capacity, [](uint i __attribute__((unused))) { return Option<Entry> {}; })},
-		leftmost_conflict_slot{arr.begin() + array_elements_size(capacity)},
-		next_conflict_slot{arr.begin() + capacity - 1}
-		{}
+	explicit Map(Arena& _arena) : arena{&_arena}, ctrl{nullptr}, slots{nullptr}, n_groups{0}, _size{0} {}
 
 	inline static Map empty() { return {}; }
 
+	inline uint size() const {
+		return _size;
+	}
+
 	inline bool has(const K& key) const {
-		return get(key).has();
+		return find(key).has();
 	}
 
 	Option<const KeyValuePair<K, V>&> get_pair(const K& key) const {
-		assert(!arr.is_empty());
-		const Option<Entry>& op_entry = arr[index(key, arr.size())];
-		if (!op_entry.has())
-			return Option<const KeyValuePair<K, V>&> {};
-		Ref<const Entry> entry = &op_entry.get();
-		while (true) {
-			if (entry->pair.key == key)
-				return Option<const KeyValuePair<K, V>&> { entry->pair };
-			if (!entry->next_in_chain.has())
-				return Option<const KeyValuePair<K, V>&> {};
-			entry = entry->next_in_chain.get();
-		}
+		Option<Ref<Pair>> found = find(key);
+		return found.has() ? Option<const KeyValuePair<K, V>&> { *found.get() } : Option<const KeyValuePair<K, V>&> {};
 	}
 	Option<KeyValuePair<K, V>&> get_pair(const K& key) {
-		assert(!arr.is_empty());
-		Option<Entry>& op_entry = arr[index(key, arr.size())];
-		if (!op_entry.has())
-			return Option<KeyValuePair<K, V>&> {};
-		Ref<Entry> entry = &op_entry.get();
-		while (true) {
-			if (entry->pair.key == key)
-				return Option<KeyValuePair<K, V>&> { entry->pair };
-			if (!entry->next_in_chain.has())
-				return Option<KeyValuePair<K, V>&> {};
-			entry = entry->next_in_chain.get();
-		}
+		Option<Ref<Pair>> found = find(key);
+		return found.has() ? Option<KeyValuePair<K, V>&> { *found.get() } : Option<KeyValuePair<K, V>&> {};
 	}
 
-	// Note that conflicts come from right, so last_conflict is the leftmost conflict slot.
 	InsertResult<K, V> try_insert(K key, V value) {
-		Option<Entry>& op_entry = arr[index(key, arr.size())];
-		if (!op_entry.has()) {
-			op_entry = Entry { KeyValuePair<K, V> { key, value }, {} };
-			return { true, op_entry.get().pair };
-		}
-
-		Ref<Entry> entry = &op_entry.get();
-		while (true) {
-			if (entry->pair.key == key) {
-				return { false, entry->pair };
-			}
-
-			if (!entry->next_in_chain.has()) {
-				if (next_conflict_slot < leftmost_conflict_slot) todo();
-				*next_conflict_slot = Entry { KeyValuePair<K, V> { key, value }, {} };
-				KeyValuePair<K, V>& res = next_conflict_slot->get().pair;
-				entry->next_in_chain = Ref<Entry> { &next_conflict_slot->get() };
-				--next_conflict_slot;
-				return { true, res };
-			}
-
-			// Else, continue
-			entry = entry->next_in_chain.get();
-		}
+		Option<Ref<Pair>> found = find(key);
+		if (found.has())
+			return { false, *found.get() };
+
+		assert(arena != nullptr); // Map::empty() can't be inserted into
+		if (_size == max_size(n_groups))
+			reserve(_size + 1);
+		Ref<Pair> pair = arena->put<Pair>(Pair { key, value });
+		insert_new(pair.ptr());
+		++_size;
+		return { true, *pair };
 	}
 
 	inline KeyValuePair<K, V>& must_insert(const K& key, V value) {
@@ -132,9 +198,9 @@ public:
 
 	template <typename /*const K&, const V& => void*/ Cb>
 	void each(Cb cb) const {
-		for (const Option<Entry>& op_e : arr) {
-			if (op_e.has()) {
-				const KeyValuePair<K, V>& pair = op_e.get().pair;
+		for (uint i = 0; i != capacity(); ++i) {
+			if (ctrl[i] != map_group::EMPTY) {
+				const KeyValuePair<K, V>& pair = *slots[i];
 				cb(pair.key, pair.value);
 			}
 		}
@@ -143,17 +209,14 @@ public:
 
 template <typename K, typename V, typename Hash>
 class build_map {
-	using M = Map<K, V, Hash>;
-	using Entry = typename M::Entry;
-
-
 public:
 	template <typename Input, typename /*const Input& => K*/ CbGetKey, typename /*const Input& => V*/ CbGetValue, typename /*(const V&, const Input&) => void*/ CbConflict>
 	Map<K, V, Hash> operator()(Arena& arena, const Slice<Input>& inputs, CbGetKey get_key, CbGetValue get_value, CbConflict on_conflict) {
 		if (inputs.is_empty())
 			return Map<K, V, Hash>::empty();
 
-		Map<K, V, Hash> res { inputs.size() * 2, arena };
+		Map<K, V, Hash> res { arena };
+		res.reserve(inputs.size());
 
 		for (const Input& input : inputs) {
 			InsertResult<K, V> insert_result = res.try_insert(get_key(input), get_value(input));
@@ -8,7 +8,7 @@ class Set {
 	Map<T, Dummy, Hash> map;
 
 public:
-	Set(uint initial_capacity, Arena& arena) : map{initial_capacity, arena} {}
+	explicit Set(Arena& arena) : map{arena} {}
 
 	bool has(const T& value) const {
 		return map.has(value);
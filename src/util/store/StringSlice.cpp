@@ -3,7 +3,6 @@
 StringSlice::StringSlice(const char* begin, const char* end) : _begin{begin}, _end{end} {
 	assert(end > begin);
 	assert(begin != nullptr && end != nullptr);
-	assert(size() < 1000); // Indicates memory was corrupted, since identifiers shouldn't get this big.
 }
 
 bool operator==(const StringSlice& a, const StringSlice& b) {
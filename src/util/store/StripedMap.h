@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mutex> // std::unique_lock
+#include <shared_mutex> // std::shared_lock, std::shared_mutex
+
+#include "./Arena.h"
+#include "./ArenaArrayBuilders.h" // Pair
+#include "./Map.h"
+
+// A Map for several threads at once, split into stripes by hash, each with its own lock and arena.
+// Looking up a key only takes its stripe's lock shared, so readers never wait for each other; inserting takes it exclusively.
+template <typename K, typename V, typename Hash>
+class StripedMap {
+	static const uint N_STRIPES = 16;
+
+	struct Stripe {
+		std::shared_mutex mutex;
+		TempArena arena; // For the entries in this stripe
+		Map<K, V, Hash> map;
+
+		inline Stripe() : mutex{}, arena{}, map{arena} {}
+	};
+	Stripe stripes[N_STRIPES];
+
+	inline Stripe& stripe(const K& key) {
+		// Mixed differently from Map's hash, so the keys in one stripe still spread out over its table.
+		return stripes[(Hash{}(key) * 0xc2b2ae3d27d4eb4ful) >> 60];
+	}
+
+public:
+	inline StripedMap() : stripes{} {}
+	StripedMap(const StripedMap& other) = delete;
+
+	Option<V> get(const K& key) {
+		Stripe& s = stripe(key);
+		std::shared_lock<std::shared_mutex> lock { s.mutex };
+		Option<V&> found = s.map.get(key);
+		return found.has() ? Option<V> { found.get() } : Option<V> {};
+	}
+
+	// If 'key' is missing, 'make' allocates the entry in the stripe's arena and returns the key to store (equal to 'key') and the value.
+	// The stripe is locked while it runs, so only one thread adds an entry for 'key'; it must not use this map.
+	template <typename /*Arena& => Pair<K, V>*/ Make>
+	InsertResult<K, V> get_or_insert(const K& key, Make make) {
+		Stripe& s = stripe(key);
+		std::unique_lock<std::shared_mutex> lock { s.mutex };
+		Option<KeyValuePair<K, V>&> found = s.map.get_pair(key);
+		if (found.has())
+			return { false, found.get() };
+		Pair<K, V> made = make(s.arena);
+		return { true, s.map.must_insert(made.first, made.second) };
+	}
+
+	// Only call this once no thread is using the map.
+	template <typename /*const K&, const V& => void*/ Cb>
+	void each(Cb cb) const {
+		for (const Stripe& s : stripes)
+			s.map.each(cb);
+	}
+};
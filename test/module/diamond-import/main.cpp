@@ -0,0 +1,21 @@
+#include <assert.h>
+
+struct Void {
+	
+};
+
+typedef bool Bool;
+
+void yes(Bool* _ret);
+void _main(Void* _ret);
+
+void yes(Bool* _ret) {*_ret = true;
+}
+
+void _main(Void* _ret) {
+	Bool b;
+	yes(&b);
+	assert(b);
+}
+
+int main() { Void v; _main(&v); }